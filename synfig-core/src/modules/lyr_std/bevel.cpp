@@ -46,6 +46,11 @@
 #include <synfig/segment.h>
 #include <synfig/cairo_renddesc.h>
 
+#include <synfig/rendering/common/task/taskblur.h>
+#include <synfig/rendering/software/function/strips.h>
+#include <synfig/rendering/software/task/tasksw.h>
+
+#include <algorithm>
 #include <cstring>
 #include <ETL/misc>
 
@@ -77,6 +82,197 @@ SYNFIG_LAYER_SET_CVS_ID(Layer_Bevel,"$Id$");
 
 /* -- F U N C T I O N S ----------------------------------------------------- */
 
+namespace {
+
+//! Draws the bevel by the difference of the blurred alpha (or luma)
+//! of the sub-task at the pairs of opposite offsets
+class TaskBevel: public rendering::Task
+{
+public:
+	typedef etl::handle<TaskBevel> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	Vector offset;
+	Vector offset45;
+	Color color1;
+	Color color2;
+	bool use_luma;
+	bool solid;
+
+	TaskBevel(): use_luma(), solid() { }
+
+	const Task::Handle& sub_task() const { return Task::sub_task(0); }
+	Task::Handle& sub_task() { return Task::sub_task(0); }
+
+	virtual int get_pass_subtask_index() const
+		{ return sub_task() ? PASSTO_THIS_TASK : PASSTO_NO_TASK; }
+
+	//! Returns offsets of the samples in pixels, the sign of each offset gives the pair
+	void get_pixel_offsets(Vector *offsets) const
+	{
+		const Vector ppu = get_pixels_per_unit();
+		offsets[0] = offset.multiply_coords(ppu);
+		offsets[1] = offset45.multiply_coords(ppu);
+		// the second diagonal is rotated in pixel space, as in the legacy renderer
+		offsets[2] = Vector(offset45[1]*ppu[1], -offset45[0]*ppu[0]);
+	}
+
+	virtual Rect calc_bounds() const
+	{
+		if (!sub_task())
+			return Rect::zero();
+		// solid bevel is half-colored even where the context is transparent
+		if (solid)
+			return Rect::infinite();
+		Rect bounds = sub_task()->get_bounds();
+		if (!bounds.is_valid())
+			return Rect::zero();
+		return bounds.expand(std::max(offset.mag(), offset45.mag()));
+	}
+
+	virtual void set_coords_sub_tasks()
+	{
+		if (!sub_task())
+			{ trunc_to_zero(); return; }
+		if (!is_valid_coords())
+			{ sub_task()->set_coords_zero(); return; }
+
+		Vector offsets[3];
+		get_pixel_offsets(offsets);
+
+		// add the extra pixels for the samples and for the interpolation
+		VectorInt extra_size;
+		for(int i = 0; i < 3; ++i)
+			for(int j = 0; j < 2; ++j)
+				extra_size[j] = std::max(extra_size[j], (int)approximate_ceil(std::fabs(offsets[i][j])) + 1);
+
+		Vector upp = get_units_per_pixel();
+		Rect sub_source_rect = source_rect;
+		sub_source_rect.expand_x(extra_size[0]*upp[0]);
+		sub_source_rect.expand_y(extra_size[1]*upp[1]);
+
+		sub_task()->set_coords(sub_source_rect, target_rect.get_size() + extra_size*2);
+	}
+};
+
+
+class TaskBevelSW: public TaskBevel, public rendering::TaskSW
+{
+public:
+	typedef etl::handle<TaskBevelSW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+private:
+	struct Params
+	{
+		synfig::Surface *dst_surface;
+		const synfig::Surface *src_surface;
+		VectorInt src_offset;  //!< pixel of the source under the pixel (0, 0) of the result
+		Vector offsets[3];
+		Color color1;
+		Color color2;
+		bool use_luma;
+		bool solid;
+
+		Params(): dst_surface(), src_surface(), use_luma(), solid() { }
+
+		Real sample(Real x, Real y) const
+		{
+			// keep coordinates in the range of int,
+			// sampler returns transparent color outside of the surface anyway
+			const Color c = synfig::Surface::sampler_cook::linear_sample( src_surface,
+				synfig::clamp(x, Real(-2), Real(src_surface->get_w() + 2)),
+				synfig::clamp(y, Real(-2), Real(src_surface->get_h() + 2)) );
+			// colors are premultiplied here, so luma is already multiplied by alpha
+			return use_luma ? c.get_y() : c.get_a();
+		}
+	};
+
+	static void process_rect(const Params *pp, RectInt rect)
+	{
+		const Params &p = *pp;
+		const Vector &o = p.offsets[0];
+		const Vector &a = p.offsets[1];
+		const Vector &b = p.offsets[2];
+
+		for(int y = rect.miny; y < rect.maxy; ++y)
+		{
+			Color *dst = &(*p.dst_surface)[y][rect.minx];
+			const Real v = y + p.src_offset[1];
+			for(int x = rect.minx; x < rect.maxx; ++x, ++dst)
+			{
+				const Real u = x + p.src_offset[0];
+
+				Real alpha = p.sample(u - o[0], v - o[1]) - p.sample(u + o[0], v + o[1]);
+				alpha += 0.5*( p.sample(u - a[0], v - a[1]) + p.sample(u - b[0], v - b[1])
+							 - p.sample(u + a[0], v + a[1]) - p.sample(u + b[0], v + b[1]) );
+
+				Color shade;
+				if (p.solid)
+				{
+					alpha = alpha/4.0 + 0.5;
+					shade = Color::blend(p.color1, p.color2, alpha, Color::BLEND_STRAIGHT);
+				}
+				else
+				{
+					alpha /= 2.0;
+					if (alpha > 0)
+						shade = p.color1, shade.set_a(shade.get_a()*alpha);
+					else
+						shade = p.color2, shade.set_a(shade.get_a()*-alpha);
+				}
+				*dst = shade;
+			}
+		}
+	}
+
+public:
+	virtual bool run(RunParams&) const
+	{
+		if (!is_valid() || !sub_task() || !sub_task()->is_valid())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+		LockRead lsrc(sub_task());
+		if (!lsrc)
+			return false;
+
+		Params p;
+		p.dst_surface = &ldst->get_surface();
+		p.src_surface = &lsrc->get_surface();
+
+		const RectInt rect = RectInt(0, 0, p.dst_surface->get_w(), p.dst_surface->get_h()) & target_rect;
+		if (!rect.is_valid())
+			return true;
+
+		const Vector ppu = get_pixels_per_unit();
+		const Vector shift = (source_rect.get_min() - sub_task()->source_rect.get_min()).multiply_coords(ppu);
+		p.src_offset = VectorInt((int)round(shift[0]), (int)round(shift[1]))
+			         + sub_task()->target_rect.get_min() - target_rect.get_min();
+
+		get_pixel_offsets(p.offsets);
+		p.color1 = color1;
+		p.color2 = color2;
+		p.use_luma = use_luma;
+		p.solid = solid;
+
+		rendering::software::run_strips(&TaskBevelSW::process_rect, &p, rect);
+
+		return true;
+	}
+};
+
+rendering::Task::Token TaskBevel::token(
+	DescAbstract<TaskBevel>("Bevel") );
+rendering::Task::Token TaskBevelSW::token(
+	DescReal<TaskBevelSW, TaskBevel>("BevelSW") );
+
+} // end of anonimous namespace
+
 inline void clamp(Vector &v)
 {
 	if(v[0]<0.0)v[0]=0.0;
@@ -721,5 +917,27 @@ Layer_Bevel::get_full_bounding_rect(Context context)const
 }
 
 rendering::Task::Handle
-Layer_Bevel::build_rendering_task_vfunc(Context context) const
-	{ return Layer::build_rendering_task_vfunc(context); }
+Layer_Bevel::build_composite_fork_task_vfunc(ContextParams /* context_params */, rendering::Task::Handle sub_task)const
+{
+	Real softness=param_softness.get(Real());
+	rendering::Blur::Type type=(rendering::Blur::Type)param_type.get(int());
+
+	if (!sub_task)
+		return sub_task;
+
+	rendering::TaskBlur::Handle task_blur(new rendering::TaskBlur());
+	task_blur->blur.size = Vector(softness, softness);
+	task_blur->blur.type = type;
+	task_blur->sub_task() = sub_task;
+
+	TaskBevel::Handle task_bevel(new TaskBevel());
+	task_bevel->offset = offset;
+	task_bevel->offset45 = offset45;
+	task_bevel->color1 = param_color1.get(Color());
+	task_bevel->color2 = param_color2.get(Color());
+	task_bevel->use_luma = param_use_luma.get(bool());
+	task_bevel->solid = param_solid.get(bool());
+	task_bevel->sub_task() = task_blur;
+
+	return task_bevel;
+}
@@ -44,6 +44,7 @@
 #include <synfig/valuenode.h>
 #include <ETL/calculus>
 #include <synfig/cairo_renddesc.h>
+#include <synfig/rendering/common/task/taskwarp.h>
 
 #endif
 
@@ -191,174 +192,197 @@ CurveWarp::CurveWarp():
 	SET_STATIC_DEFAULTS();
 }
 
-inline Point
-CurveWarp::transform(const Point &point_, Real *dist, Real *along, int quality)const
+class lyr_std::CurveWarp_Mapping: public rendering::TaskWarp::Mapping
 {
-	std::vector<BLinePoint> bline(param_bline.get_list_of(BLinePoint()));
-	Point start_point=param_start_point.get(Point());
-	Point end_point=param_end_point.get(Point());
-	Point origin=param_origin.get(Point());
-	bool fast=param_fast.get(bool());
-	Real perp_width=param_perp_width.get(Real());
-
-	Vector tangent;
-	Vector diff;
-	Point p1;
-	Real thickness;
-	bool edge_case = false;
-	float len(0);
-	bool extreme;
-	float t;
-
-	if(bline.size()==0)
-		return Point();
-	else if(bline.size()==1)
-	{
-		tangent=bline.front().get_tangent1();
-		p1=bline.front().get_vertex();
-		thickness=bline.front().get_width();
-		t = 0.5;
-		extreme = false;
-	}
-	else
+public:
+	std::vector<BLinePoint> bline;
+	Point start_point;
+	Point end_point;
+	Point origin;
+	bool fast;
+	Real perp_width;
+	Vector perp;
+	Real curve_length;
+
+	explicit CurveWarp_Mapping(const CurveWarp &layer):
+		bline(layer.param_bline.get_list_of(BLinePoint())),
+		start_point(layer.param_start_point.get(Point())),
+		end_point(layer.param_end_point.get(Point())),
+		origin(layer.param_origin.get(Point())),
+		fast(layer.param_fast.get(bool())),
+		perp_width(layer.param_perp_width.get(Real())),
+		perp(layer.perp_),
+		curve_length(layer.curve_length_)
+	{ }
+
+	Point transform(const Point &point_, Real *dist, Real *along, int quality) const
 	{
-		Point point(point_-origin);
-
-		std::vector<BLinePoint>::const_iterator iter,next;
+		Vector tangent;
+		Vector diff;
+		Point p1;
+		Real thickness;
+		bool edge_case = false;
+		float len(0);
+		bool extreme;
+		float t;
+
+		if(bline.size()==0)
+			return Point();
+		else if(bline.size()==1)
+		{
+			tangent=bline.front().get_tangent1();
+			p1=bline.front().get_vertex();
+			thickness=bline.front().get_width();
+			t = 0.5;
+			extreme = false;
+		}
+		else
+		{
+			Point point(point_-origin);
 
-		// Figure out the BLinePoint we will be using,
-		next=find_closest_to_bline(fast,bline,point,t,len,extreme);
+			std::vector<BLinePoint>::const_iterator iter,next;
 
-		iter=next++;
-		if(next==bline.end()) next=bline.begin();
+			// Figure out the BLinePoint we will be using,
+			next=find_closest_to_bline(fast,bline,point,t,len,extreme);
 
-		// Setup the curve
-		etl::hermite<Vector> curve(iter->get_vertex(), next->get_vertex(), iter->get_tangent2(), next->get_tangent1());
+			iter=next++;
+			if(next==bline.end()) next=bline.begin();
 
-		// Setup the derivative function
-		etl::derivative<etl::hermite<Vector> > deriv(curve);
+			// Setup the curve
+			etl::hermite<Vector> curve(iter->get_vertex(), next->get_vertex(), iter->get_tangent2(), next->get_tangent1());
 
-		int search_iterations(7);
+			// Setup the derivative function
+			etl::derivative<etl::hermite<Vector> > deriv(curve);
 
-		if(quality<=6)search_iterations=7;
-		else if(quality<=7)search_iterations=6;
-		else if(quality<=8)search_iterations=5;
-		else search_iterations=4;
+			int search_iterations(7);
 
-		// Figure out the closest point on the curve
-		if (fast) t = curve.find_closest(fast, point,search_iterations);
+			if(quality<=6)search_iterations=7;
+			else if(quality<=7)search_iterations=6;
+			else if(quality<=8)search_iterations=5;
+			else search_iterations=4;
 
-		// Calculate our values
-		p1=curve(t);			 // the closest point on the curve
-		tangent=deriv(t);		 // the tangent at that point
+			// Figure out the closest point on the curve
+			if (fast) t = curve.find_closest(fast, point,search_iterations);
 
-		// if the point we're nearest to is at either end of the
-		// bline, our distance from the curve is the distance from the
-		// point on the curve.  we need to know which side of the
-		// curve we're on, so find the average of the two tangents at
-		// this point
-		if (t<0.00001 || t>0.99999)
-		{
-			bool zero_tangent = (tangent[0] == 0 && tangent[1] == 0);
+			// Calculate our values
+			p1=curve(t);			 // the closest point on the curve
+			tangent=deriv(t);		 // the tangent at that point
 
-			if (t<0.5)
+			// if the point we're nearest to is at either end of the
+			// bline, our distance from the curve is the distance from the
+			// point on the curve.  we need to know which side of the
+			// curve we're on, so find the average of the two tangents at
+			// this point
+			if (t<0.00001 || t>0.99999)
 			{
-				if (iter->get_split_tangent_angle() || iter->get_split_tangent_radius() || zero_tangent)
-				{
-					// fake the current tangent if we need to
-					if (zero_tangent) tangent = curve(FAKE_TANGENT_STEP) - curve(0);
+				bool zero_tangent = (tangent[0] == 0 && tangent[1] == 0);
 
-					// calculate the other tangent
-					Vector other_tangent(iter->get_tangent1());
-					if (other_tangent[0] == 0 && other_tangent[1] == 0)
+				if (t<0.5)
+				{
+					if (iter->get_split_tangent_angle() || iter->get_split_tangent_radius() || zero_tangent)
 					{
-						// find the previous blinepoint
-						std::vector<BLinePoint>::const_iterator prev;
-						if (iter != bline.begin()) (prev = iter)--;
-						else prev = iter;
-
-						etl::hermite<Vector> other_curve(prev->get_vertex(), iter->get_vertex(), prev->get_tangent2(), iter->get_tangent1());
-						other_tangent = other_curve(1) - other_curve(1-FAKE_TANGENT_STEP);
+						// fake the current tangent if we need to
+						if (zero_tangent) tangent = curve(FAKE_TANGENT_STEP) - curve(0);
+
+						// calculate the other tangent
+						Vector other_tangent(iter->get_tangent1());
+						if (other_tangent[0] == 0 && other_tangent[1] == 0)
+						{
+							// find the previous blinepoint
+							std::vector<BLinePoint>::const_iterator prev;
+							if (iter != bline.begin()) (prev = iter)--;
+							else prev = iter;
+
+							etl::hermite<Vector> other_curve(prev->get_vertex(), iter->get_vertex(), prev->get_tangent2(), iter->get_tangent1());
+							other_tangent = other_curve(1) - other_curve(1-FAKE_TANGENT_STEP);
+						}
+
+						// normalise and sum the two tangents
+						tangent=(other_tangent.norm()+tangent.norm());
+						edge_case=true;
 					}
-
-					// normalise and sum the two tangents
-					tangent=(other_tangent.norm()+tangent.norm());
-					edge_case=true;
 				}
-			}
-			else
-			{
-				if (next->get_split_tangent_angle() || next->get_split_tangent_radius() || zero_tangent)
+				else
 				{
-					// fake the current tangent if we need to
-					if (zero_tangent) tangent = curve(1) - curve(1-FAKE_TANGENT_STEP);
-
-					// calculate the other tangent
-					Vector other_tangent(next->get_tangent2());
-					if (other_tangent[0] == 0 && other_tangent[1] == 0)
+					if (next->get_split_tangent_angle() || next->get_split_tangent_radius() || zero_tangent)
 					{
-						// find the next blinepoint
-						std::vector<BLinePoint>::const_iterator next2(next);
-						if (++next2 == bline.end())
-							next2 = next;
-
-						etl::hermite<Vector> other_curve(next->get_vertex(), next2->get_vertex(), next->get_tangent2(), next2->get_tangent1());
-						other_tangent = other_curve(FAKE_TANGENT_STEP) - other_curve(0);
+						// fake the current tangent if we need to
+						if (zero_tangent) tangent = curve(1) - curve(1-FAKE_TANGENT_STEP);
+
+						// calculate the other tangent
+						Vector other_tangent(next->get_tangent2());
+						if (other_tangent[0] == 0 && other_tangent[1] == 0)
+						{
+							// find the next blinepoint
+							std::vector<BLinePoint>::const_iterator next2(next);
+							if (++next2 == bline.end())
+								next2 = next;
+
+							etl::hermite<Vector> other_curve(next->get_vertex(), next2->get_vertex(), next->get_tangent2(), next2->get_tangent1());
+							other_tangent = other_curve(FAKE_TANGENT_STEP) - other_curve(0);
+						}
+
+						// normalise and sum the two tangents
+						tangent=(other_tangent.norm()+tangent.norm());
+						edge_case=true;
 					}
-
-					// normalise and sum the two tangents
-					tangent=(other_tangent.norm()+tangent.norm());
-					edge_case=true;
 				}
 			}
-		}
-		tangent = tangent.norm();
-
-		// the width of the bline at the closest point on the curve
-		thickness=(next->get_width()-iter->get_width())*t+iter->get_width();
-	}
+			tangent = tangent.norm();
 
-	if (thickness < TOO_THIN && thickness > -TOO_THIN)
-	{
-		if (thickness > 0) thickness = TOO_THIN;
-		else thickness = -TOO_THIN;
-	}
+			// the width of the bline at the closest point on the curve
+			thickness=(next->get_width()-iter->get_width())*t+iter->get_width();
+		}
 
-	if (extreme)
-	{
-		Vector tangent;
+		if (thickness < TOO_THIN && thickness > -TOO_THIN)
+		{
+			if (thickness > 0) thickness = TOO_THIN;
+			else thickness = -TOO_THIN;
+		}
 
-		if (t < 0.5)
+		if (extreme)
 		{
-			std::vector<BLinePoint>::const_iterator iter(bline.begin());
-			tangent = iter->get_tangent1().norm();
-			len = 0;
+			Vector tangent;
+
+			if (t < 0.5)
+			{
+				std::vector<BLinePoint>::const_iterator iter(bline.begin());
+				tangent = iter->get_tangent1().norm();
+				len = 0;
+			}
+			else
+			{
+				std::vector<BLinePoint>::const_iterator iter(--bline.end());
+				tangent = iter->get_tangent2().norm();
+				len = curve_length;
+			}
+			len += (point_-origin - p1)*tangent;
+			diff = tangent.perp();
 		}
-		else
+		else if (edge_case)
 		{
-			std::vector<BLinePoint>::const_iterator iter(--bline.end());
-			tangent = iter->get_tangent2().norm();
-			len = curve_length_;
+			diff=(p1-(point_-origin));
+			if(diff*tangent.perp()<0) diff=-diff;
+			diff=diff.norm();
 		}
-		len += (point_-origin - p1)*tangent;
-		diff = tangent.perp();
-	}
-	else if (edge_case)
-	{
-		diff=(p1-(point_-origin));
-		if(diff*tangent.perp()<0) diff=-diff;
-		diff=diff.norm();
+		else
+			diff=tangent.perp();
+
+		// diff is a unit vector perpendicular to the bline
+		const Real unscaled_distance((point_-origin - p1)*diff);
+		if (dist) *dist = unscaled_distance;
+		if (along) *along = len;
+		return ((start_point + (end_point - start_point) * len / curve_length) +
+				perp * unscaled_distance/(thickness*perp_width));
 	}
-	else
-		diff=tangent.perp();
-
-	// diff is a unit vector perpendicular to the bline
-	const Real unscaled_distance((point_-origin - p1)*diff);
-	if (dist) *dist = unscaled_distance;
-	if (along) *along = len;
-	return ((start_point + (end_point - start_point) * len / curve_length_) +
-			perp_ * unscaled_distance/(thickness*perp_width));
-}
+
+	virtual bool map(Point &point, int quality) const
+		{ point = transform(point, NULL, NULL, quality); return true; }
+};
+
+Point
+CurveWarp::transform(const Point &point_, Real *dist, Real *along, int quality)const
+	{ return CurveWarp_Mapping(*this).transform(point_, dist, along, quality); }
 
 Layer::Handle
 CurveWarp::hit_check(Context context, const Point &point)const
@@ -454,6 +478,15 @@ CurveWarp::get_sub_renddesc_vfunc(const RendDesc &renddesc) const
 	return desc;
 }
 
+rendering::Task::Handle
+CurveWarp::build_rendering_task_vfunc(Context context)const
+{
+	rendering::TaskWarp::Handle task_warp(new rendering::TaskWarp());
+	task_warp->mapping = new CurveWarp_Mapping(*this);
+	task_warp->sub_task() = context.build_rendering_task();
+	return task_warp;
+}
+
 bool
 CurveWarp::accelerated_render(Context context,Surface *surface,int quality, const RendDesc &renddesc, ProgressCallback *cb)const
 {
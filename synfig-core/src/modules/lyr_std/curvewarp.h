@@ -49,9 +49,12 @@ namespace modules
 namespace lyr_std
 {
 
+class CurveWarp_Mapping;
+
 class CurveWarp : public Layer
 {
 	SYNFIG_LAYER_MODULE_EXT
+	friend class CurveWarp_Mapping;
 
 private:
 	//!Parameter: (Point) origin of the warp
@@ -87,6 +90,7 @@ public:
 
 protected:
 	virtual RendDesc get_sub_renddesc_vfunc(const RendDesc &renddesc) const;
+	virtual rendering::Task::Handle build_rendering_task_vfunc(Context context)const;
 };
 
 }; // END of namespace lyr_std
@@ -0,0 +1,266 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file fractal.cpp
+**	\brief Implementation of the rendering task of the escape-time fractal layers
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "fractal.h"
+
+#include <synfig/general.h>
+#include <synfig/localization.h>
+
+#include <synfig/rendering/primitive/transformation.h>
+#include <synfig/rendering/software/function/strips.h>
+#include <synfig/rendering/software/task/tasksw.h>
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+using namespace modules;
+using namespace lyr_std;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+namespace {
+
+class TaskFractalSW: public TaskFractal, public rendering::TaskSW
+{
+public:
+	typedef etl::handle<TaskFractalSW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+private:
+	struct Params
+	{
+		synfig::Surface *dst_surface;
+		const Formula *formula;
+		ContextSampler context;
+		Point origin;      //!< units of the pixel (0, 0) of the result
+		Vector upp;        //!< units per pixel of the result
+		int edge_samples;
+
+		Params(): dst_surface(), formula(), edge_samples(1) { }
+
+		Point get_point(Real x, Real y) const
+			{ return Point(origin[0] + upp[0]*x, origin[1] + upp[1]*y); }
+	};
+
+	static bool is_edge(const Color &a, const Color &b)
+	{
+		const ColorReal threshold = 1.0/64.0;
+		return std::fabs(a.get_r() - b.get_r()) > threshold
+			|| std::fabs(a.get_g() - b.get_g()) > threshold
+			|| std::fabs(a.get_b() - b.get_b()) > threshold
+			|| std::fabs(a.get_a() - b.get_a()) > threshold;
+	}
+
+	//! Iterates points by batches of LANES, the tail of the last batch is padded by the last point
+	static void shade_points(const Params &p, const Point *points, Color *colors, int count)
+	{
+		Real x[LANES], y[LANES];
+		Escape escape[LANES];
+		for(int i = 0; i < count; i += LANES) {
+			const int n = std::min((int)LANES, count - i);
+			for(int l = 0; l < LANES; ++l) {
+				const Point &point = points[i + std::min(l, n - 1)];
+				x[l] = point[0];
+				y[l] = point[1];
+			}
+			p.formula->iterate(x, y, escape);
+			for(int l = 0; l < n; ++l)
+				colors[i + l] = p.formula->shade(points[i + l], escape[l], p.context);
+		}
+	}
+
+	static void process_rect(const Params *pp, RectInt rect)
+	{
+		const Params &p = *pp;
+
+		// to find the edges the pixels around the rect are required too
+		const int border = p.edge_samples > 1 ? 1 : 0;
+		const RectInt r = RectInt(rect).expand(border);
+		const int w = r.get_width();
+		const int h = r.get_height();
+		const int samples = p.edge_samples*p.edge_samples;
+
+		std::vector<Point> points(std::max(w, samples));
+		std::vector<Color> colors(w*h);
+		for(int j = 0; j < h; ++j) {
+			for(int i = 0; i < w; ++i)
+				points[i] = p.get_point(r.minx + i, r.miny + j);
+			shade_points(p, &points.front(), &colors[j*w], w);
+		}
+
+		if (!border) {
+			for(int j = 0; j < h; ++j)
+				std::copy(&colors[j*w], &colors[j*w] + w, &(*p.dst_surface)[r.miny + j][r.minx]);
+			return;
+		}
+
+		// compare premultiplied colors, so fully transparent pixels are equal
+		std::vector<Color> premult(w*h);
+		for(int i = 0; i < w*h; ++i)
+			premult[i] = colors[i].premult_alpha();
+
+		std::vector<Color> sub_colors(samples);
+		const Real k = 1.0/p.edge_samples;
+		for(int j = 1; j < h - 1; ++j) {
+			Color *dst = &(*p.dst_surface)[r.miny + j][rect.minx];
+			for(int i = 1; i < w - 1; ++i, ++dst) {
+				const int index = j*w + i;
+				const Color &c = premult[index];
+				if ( !is_edge(c, premult[index - 1])
+				  && !is_edge(c, premult[index + 1])
+				  && !is_edge(c, premult[index - w])
+				  && !is_edge(c, premult[index + w]) )
+					{ *dst = colors[index]; continue; }
+
+				const Real x = r.minx + i - 0.5 + 0.5*k;
+				const Real y = r.miny + j - 0.5 + 0.5*k;
+				for(int sy = 0; sy < p.edge_samples; ++sy)
+					for(int sx = 0; sx < p.edge_samples; ++sx)
+						points[sy*p.edge_samples + sx] = p.get_point(x + sx*k, y + sy*k);
+				shade_points(p, &points.front(), &sub_colors.front(), samples);
+
+				Color sum = Color::alpha();
+				for(int s = 0; s < samples; ++s)
+					sum += sub_colors[s].premult_alpha();
+				*dst = (sum*ColorReal(1.0/samples)).demult_alpha();
+			}
+		}
+	}
+
+public:
+	virtual bool run(RunParams&) const
+	{
+		const int max_edge_samples = 16;
+
+		if (!is_valid() || !formula)
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+
+		Params p;
+		p.dst_surface = &ldst->get_surface();
+
+		const RectInt rect = RectInt(0, 0, p.dst_surface->get_w(), p.dst_surface->get_h()) & target_rect;
+		if (!rect.is_valid())
+			return true;
+
+		const bool use_context = formula->uses_context() && sub_task() && sub_task()->is_valid();
+		LockRead lsrc(use_context ? sub_task() : Task::Handle());
+		if (use_context) {
+			if (!lsrc)
+				return false;
+			p.context.surface = &lsrc->get_surface();
+			p.context.ppu = sub_task()->get_pixels_per_unit();
+			p.context.offset = Vector(
+				sub_task()->target_rect.minx - sub_task()->source_rect.minx*p.context.ppu[0] - 0.5,
+				sub_task()->target_rect.miny - sub_task()->source_rect.miny*p.context.ppu[1] - 0.5 );
+		}
+
+		p.formula = formula.get();
+		p.edge_samples = std::max(1, std::min(max_edge_samples, edge_samples));
+		p.upp = get_units_per_pixel();
+		p.origin = Point(
+			source_rect.minx + p.upp[0]*(0.5 - target_rect.minx),
+			source_rect.miny + p.upp[1]*(0.5 - target_rect.miny) );
+
+		// cost of the rows is very uneven (inside of the set is most expensive)
+		rendering::software::run_strips(&TaskFractalSW::process_rect, &p, rect, rendering::software::STRIPS_EXPENSIVE);
+
+		return true;
+	}
+};
+
+} // end of anonimous namespace
+
+/* === M E T H O D S ======================================================= */
+
+rendering::Task::Token TaskFractal::token(
+	DescAbstract<TaskFractal>("Fractal") );
+rendering::Task::Token TaskFractalSW::token(
+	DescReal<TaskFractalSW, TaskFractal>("FractalSW") );
+
+
+Color
+TaskFractal::ContextSampler::get_color(const Point &point) const
+{
+	if (!surface || point.is_nan_or_inf())
+		return Color::alpha();
+
+	// keep coordinates in the range of int,
+	// sampler returns transparent color outside of the surface anyway
+	const Point p = point.multiply_coords(ppu) + offset;
+	return synfig::Surface::sampler_cook::linear_sample( surface,
+		clamp(p[0], Real(-2), Real(surface->get_w() + 2)),
+		clamp(p[1], Real(-2), Real(surface->get_h() + 2)) ).demult_alpha();
+}
+
+void
+TaskFractal::set_coords_sub_tasks()
+{
+	if (!sub_task())
+		return;
+	if (!formula || !formula->uses_context() || !is_valid_coords())
+		{ sub_task()->set_coords_zero(); return; }
+
+	Rect rect = formula->get_distortion_bounds(source_rect);
+	if (!rect.is_valid()) {
+		// context is read only at the centers of the pixels, so keep the same grid
+		sub_task()->set_coords(source_rect, target_rect.get_size());
+		return;
+	}
+
+	// add the extra pixels for the interpolation
+	const Vector ppu = get_pixels_per_unit();
+	rect |= source_rect;
+	rect.expand_x(2.0/std::fabs(ppu[0]));
+	rect.expand_y(2.0/std::fabs(ppu[1]));
+	rect &= sub_task()->get_bounds();
+
+	rendering::Transformation::DiscreteBounds discrete_bounds =
+		rendering::Transformation::make_discrete_bounds( rendering::Transformation::Bounds(rect, ppu) );
+	if (discrete_bounds.is_valid())
+		sub_task()->set_coords(discrete_bounds.rect, discrete_bounds.size);
+	else
+		sub_task()->set_coords_zero();
+}
+
+/* === E N T R Y P O I N T ================================================= */
@@ -0,0 +1,127 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file fractal.h
+**	\brief Header file for the rendering task of the escape-time fractal layers
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_LYR_STD_FRACTAL_H
+#define __SYNFIG_LYR_STD_FRACTAL_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <synfig/color.h>
+#include <synfig/rect.h>
+#include <synfig/surface.h>
+
+#include <synfig/rendering/task.h>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig
+{
+namespace modules
+{
+namespace lyr_std
+{
+
+//! Renders escape-time fractals (Julia, Mandelbrot).
+//! Points are iterated by the Formula in batches of LANES points,
+//! then colorized one by one. Optional sub-task is the context
+//! of the layer, it's rendered once into the area of the points
+//! which formula may ask for.
+class TaskFractal: public rendering::Task, public rendering::TaskInterfaceSplit
+{
+public:
+	typedef etl::handle<TaskFractal> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	enum { LANES = 4 };
+
+	//! State of the point after the iterations
+	struct Escape
+	{
+		bool escaped;
+		int iteration;  //!< iteration of the escape
+		Real zr, zi;    //!< last value of z
+		ColorReal mag;  //!< last squared magnitude of z
+
+		Escape(): escaped(), iteration(), zr(), zi(), mag() { }
+	};
+
+	//! Access to the rendered context, behaves as Context::get_color()
+	class ContextSampler
+	{
+	public:
+		const synfig::Surface *surface;
+		Vector ppu;     //!< pixels per unit of the surface
+		Vector offset;  //!< pixel of the surface at zero point (integer coordinates are centers of pixels)
+
+		ContextSampler(): surface() { }
+		Color get_color(const Point &point) const;
+	};
+
+	//! Fractal itself, all methods should be thread-safe
+	class Formula: public etl::shared_object
+	{
+	public:
+		typedef etl::handle<Formula> Handle;
+
+		virtual ~Formula() { }
+
+		//! Iterates LANES points given by coordinates \a x and \a y at once
+		virtual void iterate(const Real *x, const Real *y, Escape *escape) const = 0;
+
+		//! Returns color of the point \a pos by results of the iterations
+		virtual Color shade(const Point &pos, const Escape &escape, const ContextSampler &context) const = 0;
+
+		//! Returns true if shade() reads the context
+		virtual bool uses_context() const = 0;
+
+		//! Returns bounds of the distorted context points required to shade() the points of \a rect,
+		//! invalid rect means that context is read only at the shaded points
+		virtual Rect get_distortion_bounds(const Rect& /* rect */) const
+			{ return Rect(); }
+	};
+
+	Formula::Handle formula;
+	//! Number of subsamples by each axis for the pixels at the edges, 1 means no supersampling
+	int edge_samples;
+
+	TaskFractal(): edge_samples(1) { }
+
+	const Task::Handle& sub_task() const { return Task::sub_task(0); }
+	Task::Handle& sub_task() { return Task::sub_task(0); }
+
+	virtual Rect calc_bounds() const
+		{ return formula ? Rect::infinite() : Rect::zero(); }
+	virtual void set_coords_sub_tasks();
+};
+
+}; // END of namespace lyr_std
+}; // END of namespace modules
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
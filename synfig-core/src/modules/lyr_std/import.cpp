@@ -49,6 +49,7 @@
 #include <synfig/canvas.h>
 #include <synfig/canvasfilenaming.h>
 #include <synfig/filesystem.h>
+#include <synfig/imageprefetcher.h>
 
 #include <synfig/rendering/software/surfacesw.h>
 
@@ -102,8 +103,11 @@ Import::set_param(const String & param, const ValueBase &value)
 
 	IMPORT_VALUE_PLUS_BEGIN(param_filename)
 	{
+		std::lock_guard<std::mutex> lock(deferred_mutex);
+
 		if(!get_canvas() || !get_canvas()->get_file_system())
 		{
+			deferred_filename.clear();
 			importer.reset();
 			cimporter.reset();
 			rendering_surface.reset();
@@ -128,6 +132,7 @@ Import::set_param(const String & param, const ValueBase &value)
 		String full_filename = CanvasFileNaming::make_full_filename(get_canvas()->get_file_name(), fixed_filename);
 		if (full_filename.empty())
 		{
+			deferred_filename.clear();
 			importer.reset();
 			cimporter.reset();
 			rendering_surface.reset();
@@ -139,40 +144,28 @@ Import::set_param(const String & param, const ValueBase &value)
 
 		// If we are already loaded, don't reload
 		// here we need something to force reload if file is changed
-		if(this->independent_filename==independent_filename && importer)
+		if(this->independent_filename==independent_filename && (importer || !deferred_filename.empty()))
 		{
 			param_filename.set(filename);
 			return true;
 		}
 
 		this->independent_filename = independent_filename;
+		deferred_filename.clear();
 
-		handle<Importer> newimporter;
-		newimporter = Importer::open(get_canvas()->get_file_system()->get_identifier(full_filename));
-
-		if (!newimporter)
+		if (Canvas::get_lazy_loading())
 		{
-			String local_filename = CanvasFileNaming::make_local_filename(get_canvas()->get_file_name(), full_filename);
-			newimporter = Importer::open(get_canvas()->get_file_system()->get_identifier(local_filename));
-			if(!newimporter)
-			{
-				error(strprintf("Unable to create an importer object with file \"%s\"", independent_filename.c_str()));
-				importer.reset();
-				cimporter.reset();
-				param_filename.set(filename);
-				rendering_surface.reset();
-				return true;
-			}
+			// file will be opened by load_resources_vfunc()
+			// when it will be required for rendering first time
+			importer.reset();
+			cimporter.reset();
+			rendering_surface.reset();
+			deferred_filename = full_filename;
+			param_filename.set(filename);
+			return true;
 		}
 
-		Time time_offset = param_time_offset.get(Time());
-		Time time = (get_time_mark() == Time::end()) ? time_offset : get_time_mark() + time_offset;
-		if (!newimporter->is_animated())
-			time = Time(0);
-
-		rendering_surface = new rendering::SurfaceResource(
-			newimporter->get_frame(get_canvas()->rend_desc(), time) );
-		importer=newimporter;
+		open_file(full_filename, get_time_mark() == Time::end() ? Time(0) : get_time_mark());
 		param_filename.set(filename);
 
 		return true;
@@ -183,6 +176,36 @@ Import::set_param(const String & param, const ValueBase &value)
 	return Layer_Bitmap::set_param(param,value);
 }
 
+bool
+Import::open_file(const String &full_filename, Time time)
+{
+	handle<Importer> newimporter;
+	newimporter = Importer::open(get_canvas()->get_file_system()->get_identifier(full_filename));
+
+	if (!newimporter)
+	{
+		String local_filename = CanvasFileNaming::make_local_filename(get_canvas()->get_file_name(), full_filename);
+		newimporter = Importer::open(get_canvas()->get_file_system()->get_identifier(local_filename));
+		if(!newimporter)
+		{
+			error(strprintf("Unable to create an importer object with file \"%s\"", independent_filename.c_str()));
+			importer.reset();
+			cimporter.reset();
+			rendering_surface.reset();
+			return false;
+		}
+	}
+
+	time += param_time_offset.get(Time());
+	if (!newimporter->is_animated())
+		time = Time(0);
+
+	rendering_surface = new rendering::SurfaceResource(
+		newimporter->get_frame(get_canvas()->rend_desc(), time) );
+	importer=newimporter;
+	return true;
+}
+
 ValueBase
 Import::get_param(const String & param)const
 {
@@ -226,9 +249,30 @@ Import::set_time_vfunc(IndependentContext context, Time time)const
 void
 Import::load_resources_vfunc(IndependentContext context, Time time)const
 {
-	Time time_offset=param_time_offset.get(Time());
-	if(get_amount() && importer && importer->is_animated())
-		rendering_surface = new rendering::SurfaceResource(
-			importer->get_frame(get_canvas()->rend_desc(), time+time_offset) );
+	bool opened = false;
+	if (get_amount() && get_canvas())
+	{
+		// open file which was deferred by set_param(), the frame for the time is loaded there
+		std::lock_guard<std::mutex> lock(deferred_mutex);
+		if (!deferred_filename.empty())
+		{
+			Import *layer = const_cast<Import*>(this);
+			String full_filename;
+			full_filename.swap(layer->deferred_filename);
+			layer->open_file(full_filename, time);
+			opened = true;
+		}
+	}
+
+	if (!opened)
+	{
+		Time time_offset=param_time_offset.get(Time());
+		if(get_amount() && importer && importer->is_animated())
+		{
+			rendering_surface = new rendering::SurfaceResource(
+				importer->get_frame(get_canvas()->rend_desc(), time+time_offset) );
+			ImagePrefetcher::instance().request(importer, time+time_offset, get_canvas().get());
+		}
+	}
 	context.load_resources(time);
 }
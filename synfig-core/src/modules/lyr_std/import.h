@@ -28,6 +28,8 @@
 
 /* === H E A D E R S ======================================================= */
 
+#include <mutex>
+
 #include <synfig/layers/layer_bitmap.h>
 #include <synfig/color.h>
 #include <synfig/vector.h>
@@ -58,9 +60,18 @@ private:
 	ValueBase param_time_offset;
 
 	String independent_filename;
+	//! Full name of the file which is not opened yet,
+	//! guarded by the deferred_mutex
+	//! \see Canvas::set_lazy_loading()
+	String deferred_filename;
+	//! Protects opening of the deferred file by the render
+	mutable std::mutex deferred_mutex;
 	Importer::Handle importer;
 	CairoImporter::Handle cimporter;
 
+	//! Opens importer for the file and loads the frame at \a time (time offset is added here)
+	bool open_file(const String &full_filename, Time time);
+
 protected:
 	Import();
 
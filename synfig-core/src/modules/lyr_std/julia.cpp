@@ -32,7 +32,10 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+
 #include "julia.h"
+#include "fractal.h"
 
 #include <synfig/localization.h>
 #include <synfig/general.h>
@@ -101,6 +104,172 @@ color_neg_flip(Color &color)
 	}
 }
 
+namespace {
+
+class JuliaFormula: public TaskFractal::Formula
+{
+public:
+	Color icolor;
+	Color ocolor;
+	Angle color_shift;
+	int iterations;
+	Point seed;
+	bool distort_inside;
+	bool shade_inside;
+	bool solid_inside;
+	bool invert_inside;
+	bool color_inside;
+	bool distort_outside;
+	bool shade_outside;
+	bool solid_outside;
+	bool invert_outside;
+	bool color_outside;
+	bool color_cycle;
+	bool smooth_outside;
+	bool broken;
+
+	JuliaFormula():
+		iterations(),
+		distort_inside(), shade_inside(), solid_inside(), invert_inside(), color_inside(),
+		distort_outside(), shade_outside(), solid_outside(), invert_outside(), color_outside(),
+		color_cycle(), smooth_outside(), broken() { }
+
+	virtual void iterate(const Real *x, const Real *y, TaskFractal::Escape *escape) const
+	{
+		const int lanes = TaskFractal::LANES;
+		const Real cr = seed[0], ci = seed[1];
+		const Real k = broken ? 1.0 : 0.0; // "broken" algorithm adds zi to zr
+
+		Real zr[lanes], zi[lanes];
+		ColorReal mag[lanes];
+		bool active[lanes];
+		for(int l = 0; l < lanes; ++l)
+			{ zr[l] = x[l]; zi[l] = y[l]; mag[l] = 0; active[l] = true; }
+
+		int count = lanes;
+		for(int i = 0; i < iterations && count; ++i)
+		{
+			// do the same operations for all lanes, escaped lanes just keep their values
+			for(int l = 0; l < lanes; ++l)
+			{
+				const Real im = zr[l]*zi[l]*2 + ci;
+				const Real r = zr[l]*zr[l] - zi[l]*zi[l] + cr + k*im;
+				const ColorReal m = r*r + im*im;
+				zr[l] = active[l] ? r : zr[l];
+				zi[l] = active[l] ? im : zi[l];
+				mag[l] = active[l] ? m : mag[l];
+			}
+
+			for(int l = 0; l < lanes; ++l)
+				if (active[l] && mag[l] > 4)
+				{
+					active[l] = false;
+					escape[l].iteration = i;
+					--count;
+				}
+		}
+
+		for(int l = 0; l < lanes; ++l)
+		{
+			escape[l].escaped = !active[l];
+			if (active[l]) escape[l].iteration = iterations;
+			escape[l].zr = zr[l];
+			escape[l].zi = zi[l];
+			escape[l].mag = mag[l];
+		}
+	}
+
+	virtual Color shade(const Point &pos, const TaskFractal::Escape &escape, const TaskFractal::ContextSampler &context) const
+	{
+		const Real zr = escape.zr, zi = escape.zi;
+		const ColorReal mag = escape.mag;
+		Color ret;
+
+		if (escape.escaped)
+		{
+			ColorReal depth;
+			if(smooth_outside)
+			{
+				depth= (ColorReal)escape.iteration - log(log(sqrt(mag))) / LOG_OF_2;
+				if(depth<0) depth=0;
+			}
+			else
+				depth=static_cast<ColorReal>(escape.iteration);
+
+			if(solid_outside)
+				ret=ocolor;
+			else
+				if(distort_outside)
+					ret=context.get_color(Point(zr,zi));
+				else
+					ret=context.get_color(pos);
+
+			if(invert_outside)
+				ret=~ret;
+
+			if(color_outside)
+				ret=ret.set_uv(zr,zi).clamped_negative();
+
+			if(color_cycle)
+				ret=ret.rotate_uv(color_shift.operator*(depth)).clamped_negative();
+
+			if(shade_outside)
+			{
+				ColorReal alpha=depth/static_cast<ColorReal>(iterations);
+				ret=(ocolor-ret)*alpha+ret;
+			}
+			return ret;
+		}
+
+		if(solid_inside)
+			ret=icolor;
+		else
+			if(distort_inside)
+				ret=context.get_color(Point(zr,zi));
+			else
+				ret=context.get_color(pos);
+
+		if(invert_inside)
+			ret=~ret;
+
+		if(color_inside)
+			ret=ret.set_uv(zr,zi).clamped_negative();
+
+		if(shade_inside)
+			ret=(icolor-ret)*mag+ret;
+
+		return ret;
+	}
+
+	virtual bool uses_context() const
+		{ return !solid_inside || !solid_outside; }
+
+	virtual Rect get_distortion_bounds(const Rect &rect) const
+	{
+		const bool inside = distort_inside && !solid_inside;
+		const bool outside = distort_outside && !solid_outside;
+		if (!inside && !outside)
+			return Rect();
+
+		// points of the rect may escape at the first iteration,
+		// otherwise z stays in the circle of radius 2 until the escape
+		const Real z2 = std::max(rect.minx*rect.minx, rect.maxx*rect.maxx)
+		              + std::max(rect.miny*rect.miny, rect.maxy*rect.maxy);
+		Real radius = iterations > 0 ? 2.0 : sqrt(z2);
+		if (outside)
+		{
+			// so the last iteration gives at most max(4, |z0|^2) + |c|,
+			// for the "broken" set the imaginary part is added to the real one,
+			// what gives not more than three times of it
+			const Real r = std::max(4.0, z2) + sqrt(seed[0]*seed[0] + seed[1]*seed[1]);
+			radius = std::max(radius, broken ? 3.0*r : r);
+		}
+		return Rect(-radius, -radius, radius, radius);
+	}
+};
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 Julia::Julia():
@@ -124,6 +293,7 @@ param_color_shift(ValueBase(Angle::deg(0)))
 	param_color_cycle=ValueBase(false);
 	param_smooth_outside=ValueBase(true);
 	param_broken=ValueBase(false);
+	param_edge_samples=ValueBase(int(1));
 	param_seed=ValueBase(Point(0,0));
 
 	param_bailout=ValueBase(Real(4));
@@ -169,6 +339,18 @@ Julia::set_param(const String & param, const ValueBase &value)
 		return true;
 	}
 	);
+	IMPORT_VALUE_PLUS(param_edge_samples,
+	{
+		int edge_samples=param_edge_samples.get(int());
+		edge_samples=value.get(edge_samples);
+		if(edge_samples<1)
+			edge_samples=1;
+		if(edge_samples>16)
+			edge_samples=16;
+		param_edge_samples.set(edge_samples);
+		return true;
+	}
+	);
 	IMPORT_VALUE_PLUS(param_bailout,
 	{
 		Real bailout=param_bailout.get(Real());
@@ -205,6 +387,7 @@ Julia::get_param(const String & param)const
 	EXPORT_VALUE(param_color_cycle);
 	EXPORT_VALUE(param_smooth_outside);
 	EXPORT_VALUE(param_broken);
+	EXPORT_VALUE(param_edge_samples);
 
 	if(param=="bailout")
 	{
@@ -230,6 +413,37 @@ Julia::get_sub_renddesc_vfunc(const RendDesc &renddesc) const
 	return desc;
 }
 
+rendering::Task::Handle
+Julia::build_rendering_task_vfunc(Context context) const
+{
+	etl::handle<JuliaFormula> formula(new JuliaFormula());
+	formula->icolor = param_icolor.get(Color());
+	formula->ocolor = param_ocolor.get(Color());
+	formula->color_shift = param_color_shift.get(Angle());
+	formula->iterations = param_iterations.get(int());
+	formula->seed = param_seed.get(Point());
+	formula->distort_inside = param_distort_inside.get(bool());
+	formula->shade_inside = param_shade_inside.get(bool());
+	formula->solid_inside = param_solid_inside.get(bool());
+	formula->invert_inside = param_invert_inside.get(bool());
+	formula->color_inside = param_color_inside.get(bool());
+	formula->distort_outside = param_distort_outside.get(bool());
+	formula->shade_outside = param_shade_outside.get(bool());
+	formula->solid_outside = param_solid_outside.get(bool());
+	formula->invert_outside = param_invert_outside.get(bool());
+	formula->color_outside = param_color_outside.get(bool());
+	formula->color_cycle = param_color_cycle.get(bool());
+	formula->smooth_outside = param_smooth_outside.get(bool());
+	formula->broken = param_broken.get(bool());
+
+	TaskFractal::Handle task(new TaskFractal());
+	task->formula = formula;
+	task->edge_samples = param_edge_samples.get(int());
+	if (formula->uses_context())
+		task->sub_task() = context.build_rendering_task();
+	return task;
+}
+
 Color
 Julia::get_color(Context context, const Point &pos)const
 {
@@ -413,6 +627,10 @@ Julia::get_param_vocab()const
 		.set_local_name(_("Break Set"))
 		.set_description(_("Modify equation to achieve interesting results"))
 	);
+	ret.push_back(ParamDesc("edge_samples")
+		.set_local_name(_("Edge Samples"))
+		.set_description(_("Supersample the pixels at the edges by this number of samples per axis"))
+	);
 
 
 	return ret;
@@ -90,6 +90,8 @@ private:
 	ValueBase param_smooth_outside;
 	//!Parameter: (bool)
 	ValueBase param_broken;
+	//!Parameter: (int)
+	ValueBase param_edge_samples;
 	Real lp;
 
 
@@ -104,6 +106,7 @@ public:
 
 protected:
 	virtual RendDesc get_sub_renddesc_vfunc(const RendDesc &renddesc) const;
+	virtual rendering::Task::Handle build_rendering_task_vfunc(Context context) const;
 };
 
 }; // END of namespace lyr_std
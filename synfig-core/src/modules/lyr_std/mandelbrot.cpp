@@ -32,7 +32,10 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+
 #include "mandelbrot.h"
+#include "fractal.h"
 
 #include <synfig/localization.h>
 #include <synfig/general.h>
@@ -101,6 +104,172 @@ color_neg_flip(Color &color)
 	}
 }
 
+namespace {
+
+class MandelbrotFormula: public TaskFractal::Formula
+{
+public:
+	int iterations;
+	Real bailout;
+	Real lp;
+	bool broken;
+
+	bool distort_inside;
+	bool shade_inside;
+	bool solid_inside;
+	bool invert_inside;
+	Gradient gradient_inside;
+	Real gradient_offset_inside;
+	bool gradient_loop_inside;
+
+	bool distort_outside;
+	bool shade_outside;
+	bool solid_outside;
+	bool invert_outside;
+	Gradient gradient_outside;
+	bool smooth_outside;
+	Real gradient_offset_outside;
+	Real gradient_scale_outside;
+
+	MandelbrotFormula():
+		iterations(), bailout(), lp(), broken(),
+		distort_inside(), shade_inside(), solid_inside(), invert_inside(),
+		gradient_offset_inside(), gradient_loop_inside(),
+		distort_outside(), shade_outside(), solid_outside(), invert_outside(),
+		smooth_outside(), gradient_offset_outside(), gradient_scale_outside() { }
+
+	virtual void iterate(const Real *x, const Real *y, TaskFractal::Escape *escape) const
+	{
+		const int lanes = TaskFractal::LANES;
+		const Real k = broken ? 1.0 : 0.0; // "broken" algorithm adds zi to zr
+
+		Real zr[lanes], zi[lanes];
+		ColorReal mag[lanes];
+		bool active[lanes];
+		for(int l = 0; l < lanes; ++l)
+			{ zr[l] = zi[l] = 0; mag[l] = 0; active[l] = true; }
+
+		int count = lanes;
+		for(int i = 0; i < iterations && count; ++i)
+		{
+			// do the same operations for all lanes, escaped lanes just keep their values
+			for(int l = 0; l < lanes; ++l)
+			{
+				const Real r = zr[l]*zr[l] - zi[l]*zi[l] + x[l] + k*zi[l];
+				const Real im = zr[l]*zi[l]*2 + y[l];
+				const ColorReal m = r*r + im*im;
+				zr[l] = active[l] ? r : zr[l];
+				zi[l] = active[l] ? im : zi[l];
+				mag[l] = active[l] ? m : mag[l];
+			}
+
+			for(int l = 0; l < lanes; ++l)
+				if (active[l] && mag[l] > bailout)
+				{
+					active[l] = false;
+					escape[l].iteration = i;
+					--count;
+				}
+		}
+
+		for(int l = 0; l < lanes; ++l)
+		{
+			escape[l].escaped = !active[l];
+			if (active[l]) escape[l].iteration = iterations;
+			escape[l].zr = zr[l];
+			escape[l].zi = zi[l];
+			escape[l].mag = mag[l];
+		}
+	}
+
+	virtual Color shade(const Point &pos, const TaskFractal::Escape &escape, const TaskFractal::ContextSampler &context) const
+	{
+		const Real zr = escape.zr, zi = escape.zi;
+		const ColorReal mag = escape.mag;
+		Color ret;
+
+		if (escape.escaped)
+		{
+			ColorReal depth;
+			if(smooth_outside)
+			{
+				depth= (ColorReal)escape.iteration + LOG_OF_2*lp - log(log(sqrt(mag))) / LOG_OF_2;
+				if(depth<0) depth=0;
+			}
+			else
+				depth=static_cast<ColorReal>(escape.iteration);
+
+			ColorReal amount(depth/static_cast<ColorReal>(iterations));
+			amount=amount*gradient_scale_outside+gradient_offset_outside;
+			amount-=floor(amount);
+
+			if(solid_outside)
+				ret=gradient_outside(amount);
+			else
+			{
+				if(distort_outside)
+					ret=context.get_color(Point(pos[0]+zr,pos[1]+zi));
+				else
+					ret=context.get_color(pos);
+
+				if(invert_outside)
+					ret=~ret;
+
+				if(shade_outside)
+					ret=Color::blend(gradient_outside(amount), ret, 1.0);
+			}
+			return ret;
+		}
+
+		ColorReal amount(abs(mag+gradient_offset_inside));
+		if(gradient_loop_inside)
+			amount-=floor(amount);
+
+		if(solid_inside)
+			ret=gradient_inside(amount);
+		else
+		{
+			if(distort_inside)
+				ret=context.get_color(Point(pos[0]+zr,pos[1]+zi));
+			else
+				ret=context.get_color(pos);
+
+			if(invert_inside)
+				ret=~ret;
+
+			if(shade_inside)
+				ret=Color::blend(gradient_inside(amount), ret, 1.0);
+		}
+		return ret;
+	}
+
+	virtual bool uses_context() const
+		{ return !solid_inside || !solid_outside; }
+
+	virtual Rect get_distortion_bounds(const Rect &rect) const
+	{
+		const bool inside = distort_inside && !solid_inside;
+		const bool outside = distort_outside && !solid_outside;
+		if (!inside && !outside)
+			return Rect();
+
+		// z stays in the bailout radius until the escape, so the last
+		// iteration gives at most r^2 + |c| (and + r for the "broken" set)
+		const Real r = sqrt(bailout);
+		Real radius = r;
+		if (outside)
+		{
+			const Real c = std::max(
+				std::max(fabs(rect.minx), fabs(rect.maxx)),
+				std::max(fabs(rect.miny), fabs(rect.maxy)) );
+			radius = bailout + c + (broken ? r : 0.0);
+		}
+		return Rect(rect).expand(radius);
+	}
+};
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 Mandelbrot::Mandelbrot():
@@ -124,6 +293,7 @@ Mandelbrot::Mandelbrot():
 
 	param_smooth_outside=ValueBase(true);
 	param_broken=ValueBase(false);
+	param_edge_samples=ValueBase(int(1));
 
 	param_bailout=ValueBase(Real(4));
 	lp=log(log(param_bailout.get(Real())));
@@ -168,6 +338,18 @@ Mandelbrot::set_param(const String & param, const ValueBase &value)
 		  return true;
 	  }
 	  );
+	IMPORT_VALUE_PLUS(param_edge_samples,
+	  {
+		  int edge_samples=param_edge_samples.get(int());
+		  edge_samples=value.get(edge_samples);
+		  if(edge_samples<1)
+			  edge_samples=1;
+		  if(edge_samples>16)
+			  edge_samples=16;
+		  param_edge_samples.set(edge_samples);
+		  return true;
+	  }
+	  );
 	IMPORT_VALUE_PLUS(param_bailout,
 	  {
 		  Real bailout=param_bailout.get(Real());
@@ -202,6 +384,7 @@ Mandelbrot::get_param(const String & param)const
 	EXPORT_VALUE(param_shade_outside);
 	EXPORT_VALUE(param_smooth_outside);
 	EXPORT_VALUE(param_broken);
+	EXPORT_VALUE(param_edge_samples);
 
 	EXPORT_VALUE(param_gradient_inside);
 	EXPORT_VALUE(param_gradient_outside);
@@ -235,6 +418,10 @@ Mandelbrot::get_param_vocab()const
 		.set_local_name(_("Break Set"))
 		.set_description(_("Modify equation to achieve interesting results"))
 	);
+	ret.push_back(ParamDesc("edge_samples")
+		.set_local_name(_("Edge Samples"))
+		.set_description(_("Supersample the pixels at the edges by this number of samples per axis"))
+	);
 
 
 	ret.push_back(ParamDesc("distort_inside")
@@ -313,6 +500,40 @@ Mandelbrot::get_sub_renddesc_vfunc(const RendDesc &renddesc) const
 	return desc;
 }
 
+rendering::Task::Handle
+Mandelbrot::build_rendering_task_vfunc(Context context) const
+{
+	etl::handle<MandelbrotFormula> formula(new MandelbrotFormula());
+	formula->iterations = param_iterations.get(int());
+	formula->bailout = param_bailout.get(Real());
+	formula->lp = lp;
+	formula->broken = param_broken.get(bool());
+
+	formula->distort_inside = param_distort_inside.get(bool());
+	formula->shade_inside = param_shade_inside.get(bool());
+	formula->solid_inside = param_solid_inside.get(bool());
+	formula->invert_inside = param_invert_inside.get(bool());
+	formula->gradient_inside = param_gradient_inside.get(Gradient());
+	formula->gradient_offset_inside = param_gradient_offset_inside.get(Real());
+	formula->gradient_loop_inside = param_gradient_loop_inside.get(bool());
+
+	formula->distort_outside = param_distort_outside.get(bool());
+	formula->shade_outside = param_shade_outside.get(bool());
+	formula->solid_outside = param_solid_outside.get(bool());
+	formula->invert_outside = param_invert_outside.get(bool());
+	formula->gradient_outside = param_gradient_outside.get(Gradient());
+	formula->smooth_outside = param_smooth_outside.get(bool());
+	formula->gradient_offset_outside = param_gradient_offset_outside.get(Real());
+	formula->gradient_scale_outside = param_gradient_scale_outside.get(Real());
+
+	TaskFractal::Handle task(new TaskFractal());
+	task->formula = formula;
+	task->edge_samples = param_edge_samples.get(int());
+	if (formula->uses_context())
+		task->sub_task() = context.build_rendering_task();
+	return task;
+}
+
 Color
 Mandelbrot::get_color(Context context, const Point &pos)const
 {
@@ -59,6 +59,8 @@ private:
 	Real lp;
 	//!Parameter: (bool)
 	ValueBase param_broken;
+	//!Parameter: (int)
+	ValueBase param_edge_samples;
 
 	//!Parameter: (bool)
 	ValueBase param_distort_inside;
@@ -101,6 +103,7 @@ public:
 
 protected:
 	virtual RendDesc get_sub_renddesc_vfunc(const RendDesc &renddesc) const;
+	virtual rendering::Task::Handle build_rendering_task_vfunc(Context context) const;
 };
 
 }; // END of namespace lyr_std
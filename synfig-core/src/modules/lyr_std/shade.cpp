@@ -253,7 +253,7 @@ Layer_Shade::build_composite_fork_task_vfunc(ContextParams /* context_params */,
 	task_blur->blur.size = size;
 	task_blur->blur.type = type;
 	if (sub_task)
-		task_blur->sub_task() = sub_task->clone_recursive();
+		task_blur->sub_task() = sub_task;
 
 	ColorMatrix matrix;
 	matrix *= ColorMatrix().set_replace_color(color);
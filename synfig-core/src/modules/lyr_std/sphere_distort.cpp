@@ -49,6 +49,8 @@
 
 #include <synfig/curve_helper.h>
 
+#include <synfig/rendering/common/task/taskwarp.h>
+
 #endif
 
 /* === U S I N G =========================================================== */
@@ -304,6 +306,58 @@ inline Point sphtrans(const Point &p, const Point &center, const Real &radius,
 	return sphtrans(p, center, radius, percent, type, tmp);
 }
 
+namespace {
+
+class SphereDistortMapping: public rendering::TaskWarp::Mapping
+{
+public:
+	Point center;
+	Real radius;
+	Real percent;
+	int type;
+	bool clip;
+
+	SphereDistortMapping(): radius(), percent(), type(), clip() { }
+
+	virtual bool map(Point &point, int /* quality */) const
+	{
+		bool clipped;
+		point = sphtrans(point, center, radius, percent, type, clipped);
+		return !(clip && clipped);
+	}
+
+	// distorted points never leave the distorted area
+	Rect get_area(const Rect &rect) const
+	{
+		const Real r = fabs(radius);
+		switch(type)
+		{
+			case TYPE_DISTH:
+				return Rect(center[0] - r, rect.miny, center[0] + r, rect.maxy);
+			case TYPE_DISTV:
+				return Rect(rect.minx, center[1] - r, rect.maxx, center[1] + r);
+			default:
+				return Rect(center[0] - r, center[1] - r, center[0] + r, center[1] + r);
+		}
+	}
+
+	virtual Rect map_bounds(const Rect &rect, const Vector& /* resolution */, int /* quality */) const
+	{
+		const Rect area = get_area(rect);
+		return rect && area ? rect | area : rect;
+	}
+
+	virtual Rect unmap_bounds(const Rect &bounds) const
+	{
+		const Rect area = get_area(bounds);
+		if (clip)
+			return area;
+		return bounds && area ? bounds | area : bounds;
+	}
+};
+
+} // end of anonimous namespace
+
 Layer::Handle
 Layer_SphereDistort::hit_check(Context context, const Point &pos)const
 {
@@ -350,6 +404,22 @@ Layer_SphereDistort::get_sub_renddesc_vfunc(const RendDesc &renddesc) const
 	return desc;
 }
 
+rendering::Task::Handle
+Layer_SphereDistort::build_rendering_task_vfunc(Context context)const
+{
+	SphereDistortMapping *mapping = new SphereDistortMapping();
+	mapping->center = param_center.get(Vector());
+	mapping->radius = param_radius.get(double());
+	mapping->percent = param_amount.get(double());
+	mapping->type = param_type.get(int());
+	mapping->clip = param_clip.get(bool());
+
+	rendering::TaskWarp::Handle task_warp(new rendering::TaskWarp());
+	task_warp->mapping = mapping;
+	task_warp->sub_task() = context.build_rendering_task();
+	return task_warp;
+}
+
 #if 1
 bool
 Layer_SphereDistort::accelerated_render(Context context,Surface *surface,int quality, const RendDesc &renddesc, ProgressCallback *cb)const
@@ -42,6 +42,7 @@
 #include <synfig/value.h>
 #include <synfig/valuenode.h>
 #include <synfig/transform.h>
+#include <synfig/rendering/common/task/taskwarp.h>
 #include "twirl.h"
 
 #endif
@@ -65,6 +66,71 @@ SYNFIG_LAYER_SET_CVS_ID(Twirl,"$Id$");
 
 /* === P R O C E D U R E S ================================================= */
 
+static Point
+twirl(const Point &pos, const Point &center, Real radius, const Angle &rotations, bool distort_inside, bool distort_outside, bool reverse)
+{
+	Point centered(pos-center);
+	Real mag(centered.mag());
+
+	Angle a;
+
+	if((distort_inside || mag>radius) && (distort_outside || mag<radius))
+		a=rotations*((centered.mag()-radius)/radius);
+	else
+		return pos;
+
+	if(reverse)	a=-a;
+
+	const Real sin(Angle::sin(a).get());
+	const Real cos(Angle::cos(a).get());
+
+	Point twirled;
+	twirled[0]=cos*centered[0]-sin*centered[1];
+	twirled[1]=sin*centered[0]+cos*centered[1];
+
+	return twirled+center;
+}
+
+namespace {
+
+class TwirlMapping: public rendering::TaskWarp::Mapping
+{
+public:
+	Point center;
+	Real radius;
+	Angle rotations;
+	bool distort_inside;
+	bool distort_outside;
+
+	TwirlMapping(): radius(), distort_inside(), distort_outside() { }
+
+	virtual bool map(Point &point, int /* quality */) const
+	{
+		point = twirl(point, center, radius, rotations, distort_inside, distort_outside, false);
+		return true;
+	}
+
+	// points are rotated around the center, so inner points never leave the circle
+	Rect get_circle_bounds(const Rect &rect) const
+	{
+		const Real r = fabs(radius);
+		const Rect circle(center[0] - r, center[1] - r, center[0] + r, center[1] + r);
+		return rect && circle ? rect | circle : rect;
+	}
+
+	virtual Rect map_bounds(const Rect &rect, const Vector &resolution, int quality) const
+	{
+		if (distort_outside)
+			return rendering::TaskWarp::Mapping::map_bounds(rect, resolution, quality);
+		return get_circle_bounds(rect);
+	}
+
+	virtual Rect unmap_bounds(const Rect &bounds) const
+		{ return distort_outside ? Rect::infinite() : get_circle_bounds(bounds); }
+};
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 /* === E N T R Y P O I N T ================================================= */
@@ -152,27 +218,8 @@ Twirl::distort(const Point &pos,bool reverse)const
 	Angle rotations=param_rotations.get(Angle());
 	bool distort_inside=param_distort_inside.get(bool());
 	bool distort_outside=param_distort_outside.get(bool());
-	
-	Point centered(pos-center);
-	Real mag(centered.mag());
-
-	Angle a;
-
-	if((distort_inside || mag>radius) && (distort_outside || mag<radius))
-		a=rotations*((centered.mag()-radius)/radius);
-	else
-		return pos;
-
-	if(reverse)	a=-a;
-
-	const Real sin(Angle::sin(a).get());
-	const Real cos(Angle::cos(a).get());
 
-	Point twirled;
-	twirled[0]=cos*centered[0]-sin*centered[1];
-	twirled[1]=sin*centered[0]+cos*centered[1];
-
-	return twirled+center;
+	return twirl(pos, center, radius, rotations, distort_inside, distort_outside, reverse);
 }
 
 Layer::Handle
@@ -287,5 +334,20 @@ Twirl::get_sub_renddesc_vfunc(const RendDesc &renddesc) const
 }
 
 rendering::Task::Handle
-Twirl::build_rendering_task_vfunc(Context context) const
-	{ return Layer::build_rendering_task_vfunc(context); }
+Twirl::build_composite_fork_task_vfunc(ContextParams /* context_params */, rendering::Task::Handle sub_task)const
+{
+	if (!sub_task)
+		return sub_task;
+
+	TwirlMapping *mapping = new TwirlMapping();
+	mapping->center = param_center.get(Point());
+	mapping->radius = param_radius.get(Real());
+	mapping->rotations = param_rotations.get(Angle());
+	mapping->distort_inside = param_distort_inside.get(bool());
+	mapping->distort_outside = param_distort_outside.get(bool());
+
+	rendering::TaskWarp::Handle task_warp(new rendering::TaskWarp());
+	task_warp->mapping = mapping;
+	task_warp->sub_task() = sub_task;
+	return task_warp;
+}
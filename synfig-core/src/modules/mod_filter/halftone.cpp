@@ -30,8 +30,13 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
+
 #include "halftone.h"
 
+#include <synfig/rendering/software/function/strips.h>
+
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -52,8 +57,36 @@ using namespace etl;
 float
 Halftone::operator()(const Point &point, const float& luma, float supersample)const
 {
-	float halftone(mask(point));
+	return HalftoneScreen(*this)(point, luma, supersample);
+}
+
+float
+Halftone::mask(synfig::Point point)const
+{
+	return HalftoneScreen(*this).mask(point);
+}
+
 
+HalftoneScreen::HalftoneScreen():
+	type(TYPE_SYMMETRIC),
+	size(0.25, 0.25),
+	sin_angle(0.0f),
+	cos_angle(1.0f)
+{ }
+
+HalftoneScreen::HalftoneScreen(const Halftone &halftone):
+	type(halftone.param_type.get(int())),
+	origin(halftone.param_origin.get(Point())),
+	size(halftone.param_size.get(Vector()))
+{
+	Angle angle=halftone.param_angle.get(Angle());
+	sin_angle=Angle::sin(-angle).get();
+	cos_angle=Angle::cos(-angle).get();
+}
+
+float
+HalftoneScreen::threshold(float halftone, float luma, float supersample)
+{
 	if(supersample>=0.5f)
 		supersample=0.4999999999f;
 
@@ -84,26 +117,46 @@ Halftone::operator()(const Point &point, const float& luma, float supersample)co
 }
 
 float
-Halftone::mask(synfig::Point point)const
+HalftoneScreen::operator()(const Point &point, const float& luma, float supersample)const
 {
-	int type=param_type.get(int());
-	Point origin=param_origin.get(Point());
-	Vector size=param_size.get(Vector());
-	Angle angle=param_angle.get(Angle());
-	
-	float radius1;
-	float radius2;
+	return threshold(mask(point), luma, supersample);
+}
+
+void
+HalftoneScreen::operator()(float *amount, const float *luma, const Point &begin, const Vector &step, int count, float supersample)const
+{
+	// rotation is linear, so rotate the first point and the step only
+	const float	a(sin_angle), b(cos_angle);
+	const Point p(begin-origin);
+	const Point rotated_begin(b*p[0]-a*p[1], a*p[0]+b*p[1]);
+	const Vector rotated_step(b*step[0]-a*step[1], a*step[0]+b*step[1]);
+
+	for(int i=0;i<count;i++)
+		amount[i]=threshold(mask_rotated(rotated_begin+rotated_step*i), luma[i], supersample);
+}
 
+float
+HalftoneScreen::mask(synfig::Point point)const
+{
 	point-=origin;
 
 	{
-		const float	a(Angle::sin(-angle).get()),	b(Angle::cos(-angle).get());
+		const float	a(sin_angle),	b(cos_angle);
 		const float	u(point[0]),v(point[1]);
 
 		point[0]=b*u-a*v;
 		point[1]=a*u+b*v;
 	}
 
+	return mask_rotated(point);
+}
+
+float
+HalftoneScreen::mask_rotated(const synfig::Point &point)const
+{
+	float radius1;
+	float radius2;
+
 	if(type==TYPE_STRIPE)
 	{
 		Point pnt(fmod(point[0],size[0]),fmod(point[1],size[1]));
@@ -171,3 +224,63 @@ Halftone::mask(synfig::Point point)const
 	}
 	return 0;
 }
+
+
+rendering::Task::Token TaskHalftone::token(
+	DescAbstract<TaskHalftone>("Halftone") );
+
+struct TaskHalftone::Params
+{
+	const TaskHalftone *task;
+	synfig::Surface *dst;
+	const synfig::Surface *src;
+	VectorInt src_offset; //!< pixel of the source at the pixel (0, 0) of the result
+	Point origin;         //!< units of the pixel (0, 0) of the result
+	Vector upp;           //!< units per pixel of the result
+	float supersample;
+
+	Params(): task(), dst(), src(), supersample() { }
+};
+
+void
+TaskHalftone::process_rect(const Params *p, RectInt rect)
+{
+	for(int y = rect.miny; y < rect.maxy; ++y)
+		p->task->process_row(
+			&(*p->dst)[y][rect.minx],
+			&(*p->src)[y + p->src_offset[1]][rect.minx + p->src_offset[0]],
+			Point(p->origin[0] + p->upp[0]*rect.minx, p->origin[1] + p->upp[1]*y),
+			Vector(p->upp[0], 0.0),
+			rect.get_width(),
+			p->supersample );
+}
+
+void
+TaskHalftone::process(synfig::Surface &dst, const synfig::Surface &src) const
+{
+	if (!sub_task())
+		return;
+
+	// pixels outside of the context are transparent and stay transparent
+	const Vector ppu = get_pixels_per_unit();
+	const Vector offset = (sub_task()->source_rect.get_min() - source_rect.get_min()).multiply_coords(ppu);
+	const VectorInt src_offset = VectorInt((int)round(offset[0]), (int)round(offset[1])) - sub_task()->target_rect.get_min();
+	RectInt rect = sub_task()->target_rect + target_rect.get_min() + src_offset;
+	rect &= target_rect;
+	rect &= RectInt(0, 0, dst.get_w(), dst.get_h());
+	if (!rect.is_valid())
+		return;
+
+	Params p;
+	p.task = this;
+	p.dst = &dst;
+	p.src = &src;
+	p.src_offset = -target_rect.get_min() - src_offset;
+	p.upp = get_units_per_pixel();
+	p.origin = Point(
+		source_rect.minx - p.upp[0]*target_rect.minx,
+		source_rect.miny - p.upp[1]*target_rect.miny );
+	p.supersample = std::fabs(p.upp[0]/size.mag());
+
+	rendering::software::run_strips(&TaskHalftone::process_rect, &p, rect);
+}
@@ -30,8 +30,12 @@
 
 #include <synfig/vector.h>
 #include <synfig/angle.h>
+#include <synfig/color.h>
+#include <synfig/surface.h>
 #include <synfig/value.h>
 
+#include <synfig/rendering/task.h>
+
 /* === M A C R O S ========================================================= */
 
 #define TYPE_SYMMETRIC		0
@@ -64,6 +68,69 @@ public:
 	float operator()(const synfig::Point &point, const float& intensity, float supersample=0)const;
 };
 
+//! Values of the Halftone parameters taken once, so the screen can be evaluated
+//! for many points without access to the parameters. It's safe to use
+//! from several threads
+class HalftoneScreen
+{
+public:
+	int type;
+	synfig::Point origin;
+	synfig::Vector size;
+	float sin_angle; //!< sine of the negative angle
+	float cos_angle; //!< cosine of the negative angle
+
+	HalftoneScreen();
+	explicit HalftoneScreen(const Halftone &halftone);
+
+	float mask(synfig::Point point)const;
+
+	float operator()(const synfig::Point &point, const float& intensity, float supersample=0)const;
+
+	//! Evaluates \a count points of the row started from \a begin with \a step,
+	//! \a intensity and \a amount are arrays of \a count values
+	void operator()(float *amount, const float *intensity, const synfig::Point &begin, const synfig::Vector &step, int count, float supersample=0)const;
+
+private:
+	float mask_rotated(const synfig::Point &point)const;
+	static float threshold(float halftone, float intensity, float supersample);
+};
+
+//! Base of the rendering tasks of the halftone layers. Sub-task is the context,
+//! each pixel of the result is calculated from the pixel of the context and
+//! its position. Rows are processed by strips in several threads
+class TaskHalftone: public synfig::rendering::Task, public synfig::rendering::TaskInterfaceSplit
+{
+public:
+	typedef etl::handle<TaskHalftone> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	//! Size of the cell of the screen, defines width of the antialiased edges
+	synfig::Vector size;
+
+	TaskHalftone(): size(0.25, 0.25) { }
+
+	const Task::Handle& sub_task() const { return Task::sub_task(0); }
+	Task::Handle& sub_task() { return Task::sub_task(0); }
+
+	virtual int get_pass_subtask_index() const
+		{ return sub_task() ? PASSTO_THIS_TASK : PASSTO_NO_TASK; }
+	virtual synfig::Rect calc_bounds() const
+		{ return sub_task() ? sub_task()->get_bounds() : synfig::Rect::zero(); }
+
+	//! Calculates \a count pixels of the row started from the point \a begin with the \a step
+	virtual void process_row(synfig::Color *dst, const synfig::Color *src, const synfig::Point &begin, const synfig::Vector &step, int count, float supersample) const = 0;
+
+protected:
+	//! Fills \a dst from the surface of the sub-task
+	void process(synfig::Surface &dst, const synfig::Surface &src) const;
+
+private:
+	struct Params;
+	static void process_rect(const Params *p, synfig::RectInt rect);
+};
+
 /* === E N D =============================================================== */
 
 #endif
@@ -31,6 +31,8 @@
 #	include <config.h>
 #endif
 
+#include <vector>
+
 #include "halftone2.h"
 #include "halftone.h"
 
@@ -47,6 +49,8 @@
 #include <synfig/valuenode.h>
 #include <synfig/cairo_renddesc.h>
 
+#include <synfig/rendering/software/task/tasksw.h>
+
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -66,6 +70,70 @@ SYNFIG_LAYER_SET_CVS_ID(Halftone2,"$Id$");
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+class TaskHalftone2: public TaskHalftone
+{
+public:
+	typedef etl::handle<TaskHalftone2> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	HalftoneScreen screen;
+	Color color_dark;
+	Color color_light;
+
+	virtual void process_row(Color *dst, const Color *src, const Point &begin, const Vector &step, int count, float supersample) const
+	{
+		std::vector<float> luma(count), amount(count);
+		for(int i = 0; i < count; ++i)
+			luma[i] = src[i].get_y();
+		screen(&amount.front(), &luma.front(), begin, step, count, supersample);
+
+		for(int i = 0; i < count; ++i)
+		{
+			if(amount[i]<=0.0f)
+				dst[i]=color_dark;
+			else if(amount[i]>=1.0f)
+				dst[i]=color_light;
+			else
+				dst[i]=Color::blend(color_light,color_dark,amount[i],Color::BLEND_STRAIGHT);
+			dst[i].set_a(src[i].get_a());
+		}
+	}
+};
+
+class TaskHalftone2SW: public TaskHalftone2, public rendering::TaskSW
+{
+public:
+	typedef etl::handle<TaskHalftone2SW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	virtual bool run(RunParams&) const
+	{
+		if (!is_valid() || !sub_task() || !sub_task()->is_valid())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+		LockRead lsrc(sub_task());
+		if (!lsrc)
+			return false;
+
+		process(ldst->get_surface(), lsrc->get_surface());
+		return true;
+	}
+};
+
+rendering::Task::Token TaskHalftone2::token(
+	DescAbstract<TaskHalftone2, TaskHalftone>("Halftone2") );
+rendering::Task::Token TaskHalftone2SW::token(
+	DescReal<TaskHalftone2SW, TaskHalftone2>("Halftone2SW") );
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 Halftone2::Halftone2():
@@ -357,7 +425,18 @@ Halftone2::accelerated_cairorender(Context context,cairo_t *cr,int quality, cons
 }
 
 rendering::Task::Handle
-Halftone2::build_rendering_task_vfunc(Context context) const
-	{ return Layer::build_rendering_task_vfunc(context); }
+Halftone2::build_composite_fork_task_vfunc(ContextParams /* context_params */, rendering::Task::Handle sub_task)const
+{
+	if (!sub_task)
+		return sub_task;
+
+	TaskHalftone2::Handle task(new TaskHalftone2());
+	task->screen = HalftoneScreen(halftone);
+	task->size = halftone.param_size.get(Vector());
+	task->color_dark = param_color_dark.get(Color());
+	task->color_light = param_color_light.get(Color());
+	task->sub_task() = sub_task;
+	return task;
+}
 
 ///
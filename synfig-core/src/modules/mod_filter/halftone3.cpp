@@ -31,6 +31,8 @@
 #	include <config.h>
 #endif
 
+#include <vector>
+
 #include "halftone3.h"
 #include "halftone.h"
 
@@ -47,6 +49,8 @@
 #include <synfig/valuenode.h>
 #include <synfig/cairo_renddesc.h>
 
+#include <synfig/rendering/software/task/tasksw.h>
+
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -69,6 +73,97 @@ SYNFIG_LAYER_SET_CVS_ID(Halftone3,"$Id$");
 #define HALFSQRT2	(0.7)
 #define SQRT2	(1.414213562f)
 
+namespace {
+
+class TaskHalftone3: public TaskHalftone
+{
+public:
+	typedef etl::handle<TaskHalftone3> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	HalftoneScreen screen[3];
+	Color color[3];
+	float inverse_matrix[3][3];
+	bool subtractive;
+
+	TaskHalftone3(): subtractive(true)
+	{
+		for(int i=0;i<3;i++)
+			for(int j=0;j<3;j++)
+				inverse_matrix[i][j]=(j==i)?1.0f:0.0f;
+	}
+
+	virtual void process_row(Color *dst, const Color *src, const Point &begin, const Vector &step, int count, float supersample) const
+	{
+		std::vector<float> chan[3], amount[3];
+		for(int k = 0; k < 3; ++k)
+			{ chan[k].resize(count); amount[k].resize(count); }
+
+		for(int i = 0; i < count; ++i)
+		{
+			float r = src[i].get_r(), g = src[i].get_g(), b = src[i].get_b();
+			if(subtractive)
+				{ r = 1.0f - r; g = 1.0f - g; b = 1.0f - b; }
+			for(int k = 0; k < 3; ++k)
+				chan[k][i] = inverse_matrix[k][0]*r + inverse_matrix[k][1]*g + inverse_matrix[k][2]*b;
+		}
+
+		for(int k = 0; k < 3; ++k)
+			screen[k](&amount[k].front(), &chan[k].front(), begin, step, count, supersample);
+
+		for(int i = 0; i < count; ++i)
+		{
+			Color halfcolor;
+			if(subtractive)
+			{
+				halfcolor=Color::white();
+				for(int k = 0; k < 3; ++k)
+					halfcolor-=(~color[k])*amount[k][i];
+			}
+			else
+			{
+				halfcolor=Color::black();
+				for(int k = 0; k < 3; ++k)
+					halfcolor+=color[k]*amount[k][i];
+			}
+			halfcolor.set_a(src[i].get_a());
+			dst[i]=halfcolor;
+		}
+	}
+};
+
+class TaskHalftone3SW: public TaskHalftone3, public rendering::TaskSW
+{
+public:
+	typedef etl::handle<TaskHalftone3SW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	virtual bool run(RunParams&) const
+	{
+		if (!is_valid() || !sub_task() || !sub_task()->is_valid())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+		LockRead lsrc(sub_task());
+		if (!lsrc)
+			return false;
+
+		process(ldst->get_surface(), lsrc->get_surface());
+		return true;
+	}
+};
+
+rendering::Task::Token TaskHalftone3::token(
+	DescAbstract<TaskHalftone3, TaskHalftone>("Halftone3") );
+rendering::Task::Token TaskHalftone3SW::token(
+	DescReal<TaskHalftone3SW, TaskHalftone3>("Halftone3SW") );
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 Halftone3::Halftone3():
@@ -535,7 +630,23 @@ Halftone3::accelerated_cairorender(Context context, cairo_t *cr, int quality, co
 }
 
 rendering::Task::Handle
-Halftone3::build_rendering_task_vfunc(Context context) const
-	{ return Layer::build_rendering_task_vfunc(context); }
+Halftone3::build_composite_fork_task_vfunc(ContextParams /* context_params */, rendering::Task::Handle sub_task)const
+{
+	if (!sub_task)
+		return sub_task;
+
+	TaskHalftone3::Handle task(new TaskHalftone3());
+	task->size = tone[0].param_size.get(Vector());
+	task->subtractive = param_subtractive.get(bool());
+	for(int i=0;i<3;i++)
+	{
+		task->screen[i] = HalftoneScreen(tone[i]);
+		task->color[i] = param_color[i].get(Color());
+		for(int j=0;j<3;j++)
+			task->inverse_matrix[i][j] = inverse_matrix[i][j];
+	}
+	task->sub_task() = sub_task;
+	return task;
+}
 
 ////
@@ -31,6 +31,8 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+
 #include "lumakey.h"
 
 #include <synfig/localization.h>
@@ -47,6 +49,10 @@
 #include <synfig/segment.h>
 #include <synfig/cairo_renddesc.h>
 
+#include <synfig/rendering/common/task/taskpixelprocessor.h>
+#include <synfig/rendering/software/function/strips.h>
+#include <synfig/rendering/software/task/tasksw.h>
+
 #endif
 
 using namespace synfig;
@@ -66,6 +72,88 @@ SYNFIG_LAYER_SET_CVS_ID(LumaKey,"$Id$");
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+class TaskLumaKey: public rendering::TaskPixelProcessor
+{
+public:
+	typedef etl::handle<TaskLumaKey> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+};
+
+class TaskLumaKeySW: public TaskLumaKey, public rendering::TaskSW
+{
+public:
+	typedef etl::handle<TaskLumaKeySW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+private:
+	struct Params
+	{
+		synfig::Surface *dst;
+		const synfig::Surface *src;
+		VectorInt shift; //!< offset from the destination pixel to the source pixel
+
+		Params(): dst(), src() { }
+	};
+
+	static void process_rect(const Params *p, RectInt rect)
+	{
+		const int w = rect.get_width();
+		for(int y = rect.miny; y < rect.maxy; ++y)
+		{
+			Color *dst = &(*p->dst)[y][rect.minx];
+			const Color *src = &(*p->src)[y + p->shift[1]][rect.minx + p->shift[0]];
+			for(Color *dst_end = dst + w; dst != dst_end; ++dst, ++src)
+			{
+				Color tmp(*src);
+				tmp.set_a(tmp.get_y()*tmp.get_a());
+				tmp.set_y(1);
+				*dst = tmp;
+			}
+		}
+	}
+
+public:
+	virtual bool run(RunParams&) const
+	{
+		if (!is_valid() || !sub_task() || !sub_task()->is_valid())
+			return true;
+
+		RectInt rd = target_rect;
+		VectorInt offset = get_offset();
+		RectInt rs = sub_task()->target_rect + rd.get_min() + offset;
+		etl::set_intersect(rs, rs, rd);
+		if (!rs.is_valid())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+		LockRead lsrc(sub_task());
+		if (!lsrc)
+			return false;
+
+		Params p;
+		p.dst = &ldst->get_surface();
+		p.src = &lsrc->get_surface();
+		p.shift = -rd.get_min() - offset;
+
+		rendering::software::run_strips(&TaskLumaKeySW::process_rect, &p, rs);
+
+		return true;
+	}
+};
+
+rendering::Task::Token TaskLumaKey::token(
+	DescAbstract<TaskLumaKey, rendering::TaskPixelProcessor>("LumaKey") );
+rendering::Task::Token TaskLumaKeySW::token(
+	DescReal<TaskLumaKeySW, TaskLumaKey>("LumaKeySW") );
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 LumaKey::LumaKey():
@@ -247,5 +335,12 @@ LumaKey::get_bounding_rect(Context context)const
 }
 
 rendering::Task::Handle
-LumaKey::build_rendering_task_vfunc(Context context) const
-	{ return Layer::build_rendering_task_vfunc(context); }
+LumaKey::build_composite_fork_task_vfunc(ContextParams /* context_params */, rendering::Task::Handle sub_task)const
+{
+	if (!sub_task)
+		return sub_task;
+
+	TaskLumaKey::Handle task(new TaskLumaKey());
+	task->sub_task() = sub_task;
+	return task;
+}
@@ -32,6 +32,10 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include <synfig/localization.h>
 #include <synfig/general.h>
 
@@ -47,6 +51,12 @@
 #include <synfig/transform.h>
 #include <ETL/misc>
 #include <synfig/cairo_renddesc.h>
+#include <synfig/threadpool.h>
+
+#include <synfig/rendering/primitive/transformation.h>
+#include <synfig/rendering/common/optimizer/optimizersplit.h>
+#include <synfig/rendering/software/function/strips.h>
+#include <synfig/rendering/software/task/tasksw.h>
 
 #endif
 
@@ -63,6 +73,431 @@ SYNFIG_LAYER_SET_CVS_ID(RadialBlur,"$Id$");
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+//! Averages colors along the segments from each point towards the origin.
+//! Length of the segment is proportional to the distance from the origin,
+//! so the source is sampled along the rays from the origin,
+//! and the average of the each segment is taken from the running sums of its ray.
+//! When size is above 1 the segments cross the origin and continue along the opposite rays.
+class TaskRadialBlur: public rendering::Task, public rendering::TaskInterfaceSplit
+{
+public:
+	typedef etl::handle<TaskRadialBlur> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	Point origin;
+	Real size;     //!< part of the distance to the origin, segments cross the origin for values above 1
+	bool fade_out;
+
+	TaskRadialBlur(): size(0.2), fade_out(false) { }
+
+	const Task::Handle& sub_task() const { return Task::sub_task(0); }
+	Task::Handle& sub_task() { return Task::sub_task(0); }
+
+	virtual int get_pass_subtask_index() const
+		{ return sub_task() ? PASSTO_THIS_TASK : PASSTO_NO_TASK; }
+
+	//! Returns rect scaled by \a k relative to the origin
+	Rect scale_rect(const Rect &rect, Real k) const
+	{
+		return Rect(
+			origin + (rect.get_min() - origin)*k,
+			origin + (rect.get_max() - origin)*k );
+	}
+
+	virtual Rect calc_bounds() const
+	{
+		if (!sub_task())
+			return Rect::zero();
+		Rect bounds = sub_task()->get_bounds();
+		if (!bounds.is_valid() || bounds.is_full_infinite())
+			return bounds;
+		if (approximate_greater_or_equal_lp(size, Real(1.0)))
+			return Rect::infinite();
+		return bounds | scale_rect(bounds, 1.0/(1.0 - size));
+	}
+
+	virtual void set_coords_sub_tasks()
+	{
+		if (!sub_task())
+			return;
+		if (!is_valid_coords())
+			{ sub_task()->set_coords_zero(); return; }
+
+		// segments of all pixels lie between the target rect and its copy scaled towards the origin,
+		// add the extra pixels for the interpolation
+		const Vector ppu = get_pixels_per_unit();
+		Rect rect = source_rect | scale_rect(source_rect, 1.0 - size);
+		rect.expand_x(2.0/std::fabs(ppu[0]));
+		rect.expand_y(2.0/std::fabs(ppu[1]));
+		rect &= sub_task()->get_bounds();
+
+		rendering::Transformation::DiscreteBounds discrete_bounds =
+			rendering::Transformation::make_discrete_bounds( rendering::Transformation::Bounds(rect, ppu) );
+		if (discrete_bounds.is_valid())
+			sub_task()->set_coords(discrete_bounds.rect, discrete_bounds.size);
+		else
+			sub_task()->set_coords_zero();
+	}
+};
+
+class TaskRadialBlurSW: public TaskRadialBlur, public rendering::TaskSW
+{
+public:
+	typedef etl::handle<TaskRadialBlurSW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+private:
+	//! All coordinates are in pixels of the result, integer values are centers of the pixels
+	struct Params
+	{
+		synfig::Surface *dst;
+		const synfig::Surface *src;
+		RectInt rect;       //!< pixels to fill
+		Point origin;       //!< origin of the blur
+		Vector src_scale;   //!< pixel of the source is point*src_scale + src_offset
+		Vector src_offset;
+		Real k;             //!< (1 - size), far end of the segment is origin + (point - origin)*k,
+		                    //!< negative when the segment crosses the origin
+		bool fade_out;
+
+		Vector ref;         //!< direction of the ray angles are counted from
+		Real angle0;        //!< angle of the first ray relative to the ref
+		Real angle_step;
+		int rays;
+
+		std::vector<float> ray_index;  //!< fractional index of the ray for each pixel of the rect
+		std::vector<int> ray_begin;    //!< pixels of the ray i are pixels[ray_begin[i]] ... pixels[ray_begin[i+1]-1]
+		std::vector<int> pixels;       //!< pixels ordered by rays, as offsets in the rect
+
+		Params(): dst(), src(), k(), fade_out(), angle0(), angle_step(), rays() { }
+
+		Color sample(const Point &point) const
+		{
+			// keep coordinates in the range of int,
+			// sampler returns transparent color outside of the surface anyway
+			const Point p = point.multiply_coords(src_scale) + src_offset;
+			return synfig::Surface::sampler_cook::linear_sample( src,
+				clamp(p[0], Real(-2), Real(src->get_w() + 2)),
+				clamp(p[1], Real(-2), Real(src->get_h() + 2)) );
+		}
+
+		Real get_ray_index(const Point &point) const
+		{
+			const Vector v = point - origin;
+			const Real angle = atan2(ref[0]*v[1] - ref[1]*v[0], ref*v);
+			return (angle - angle0)/angle_step;
+		}
+
+		Vector get_ray_direction(int ray) const
+		{
+			const Real angle = angle0 + ray*angle_step;
+			const Real c = cos(angle), s = sin(angle);
+			return Vector(ref[0]*c - ref[1]*s, ref[0]*s + ref[1]*c);
+		}
+	};
+
+	//! Running sums of the premultiplied colors along the ray, one sample per pixel
+	class Ray
+	{
+	public:
+		int first;                  //!< first sample starts at this distance from the origin
+		std::vector<Real> sums;     //!< 4 channels for each of the samples + 1
+		std::vector<Real> moments;  //!< same, but weighted by the distance, for the fade out
+
+		Ray(): first() { }
+
+		void build(const Params &p, const Vector &dir, int first, int count)
+		{
+			this->first = first;
+			sums.resize(4*(count + 1));
+			std::fill(sums.begin(), sums.begin() + 4, Real(0.0));
+			if (p.fade_out) {
+				moments.resize(sums.size());
+				std::fill(moments.begin(), moments.begin() + 4, Real(0.0));
+			}
+
+			for(int i = 0; i < count; ++i) {
+				const Real r = first + i + 0.5;
+				const Color c = p.sample(p.origin + dir*r);
+				const Real *s = &sums[4*i];
+				Real *ns = &sums[4*i + 4];
+				ns[0] = s[0] + c.get_r();
+				ns[1] = s[1] + c.get_g();
+				ns[2] = s[2] + c.get_b();
+				ns[3] = s[3] + c.get_a();
+				if (p.fade_out) {
+					const Real *m = &moments[4*i];
+					Real *nm = &moments[4*i + 4];
+					nm[0] = m[0] + c.get_r()*r;
+					nm[1] = m[1] + c.get_g()*r;
+					nm[2] = m[2] + c.get_b()*r;
+					nm[3] = m[3] + c.get_a()*r;
+				}
+			}
+		}
+
+		//! Integral from the first sample to the \a x samples from it
+		static void get(Real *dst, const std::vector<Real> &values, Real x)
+		{
+			const int count = (int)values.size()/4 - 1;
+			const int i = clamp((int)floor(x), 0, count - 1);
+			const Real f = clamp(x - i, Real(0.0), Real(1.0));
+			const Real *v = &values[4*i];
+			for(int j = 0; j < 4; ++j)
+				dst[j] = v[j] + (v[j + 4] - v[j])*f;
+		}
+
+		//! Premultiplied average color of the segment from the distance \a r to the distance \a a
+		void average(Real *dst, bool fade_out, Real r, Real a) const
+		{
+			Real sr[4], sa[4];
+			get(sr, sums, r - first);
+			get(sa, sums, a - first);
+			if (!fade_out) {
+				const Real k = 1.0/(r - a);
+				for(int j = 0; j < 4; ++j)
+					dst[j] = (sr[j] - sa[j])*k;
+				return;
+			}
+
+			// weight of the sample at the distance x is (x - a),
+			// it's equal to one at the point itself and to zero at the far end of the segment
+			Real mr[4], ma[4];
+			get(mr, moments, r - first);
+			get(ma, moments, a - first);
+			const Real k = 2.0/((r - a)*(r - a));
+			for(int j = 0; j < 4; ++j)
+				dst[j] = (mr[j] - ma[j] - a*(sr[j] - sa[j]))*k;
+		}
+
+		//! Same as average(), but the segment goes from the distance \a r through the origin
+		//! to the distance \a -a along the \a opposite ray, \a a is negative.
+		//! Both of the rays should start at the origin (first is zero).
+		void average_crossing(Real *dst, bool fade_out, const Ray &opposite, Real r, Real a) const
+		{
+			Real sr[4], sa[4];
+			get(sr, sums, r);
+			get(sa, opposite.sums, -a);
+			if (!fade_out) {
+				const Real k = 1.0/(r - a);
+				for(int j = 0; j < 4; ++j)
+					dst[j] = (sr[j] + sa[j])*k;
+				return;
+			}
+
+			// at the opposite ray the sample at the distance x has the weight (-a - x)
+			Real mr[4], ma[4];
+			get(mr, moments, r);
+			get(ma, opposite.moments, -a);
+			const Real k = 2.0/((r - a)*(r - a));
+			for(int j = 0; j < 4; ++j)
+				dst[j] = (mr[j] - a*sr[j] - a*sa[j] - ma[j])*k;
+		}
+	};
+
+	static void process_ray_indices(Params *p, RectInt rect)
+	{
+		const int w = p->rect.get_width();
+		for(int y = rect.miny; y < rect.maxy; ++y) {
+			float *index = &p->ray_index[(y - p->rect.miny)*w + rect.minx - p->rect.minx];
+			for(int x = rect.minx; x < rect.maxx; ++x, ++index)
+				*index = (float)clamp(p->get_ray_index(Point(x, y)), Real(0.0), Real(p->rays));
+		}
+	}
+
+	static void process_rays(const Params *p, int ray_from, int ray_to)
+	{
+		const Real precision = 1e-6;
+
+		const int w = p->rect.get_width();
+		const int *begin = &p->pixels.front() + p->ray_begin[ray_from];
+		const int *end = &p->pixels.front() + p->ray_begin[ray_to];
+		if (begin == end)
+			return;
+
+		// range of the distances required for the pixels of these rays
+		Real min_r = INFINITY, max_r = 0.0;
+		for(const int *i = begin; i != end; ++i) {
+			const Real r = (Point(p->rect.minx + *i%w, p->rect.miny + *i/w) - p->origin).mag();
+			min_r = std::min(min_r, std::min(r, r*p->k));
+			max_r = std::max(max_r, std::max(r, r*p->k));
+		}
+		const int first = std::max(0, (int)floor(min_r) - 1);
+		const int count = (int)ceil(max_r) + 2 - first;
+
+		// segments crossing the origin continue along the opposite rays
+		const bool crossing = p->k < 0.0;
+		const int opposite_count = crossing ? (int)ceil(-p->k*max_r) + 2 : 0;
+
+		// pixels of the ray are interpolated between this ray and the next one
+		Ray buffers[2], opposite_buffers[2];
+		Ray *ray0 = &buffers[0], *ray1 = &buffers[1];
+		Ray *opposite0 = &opposite_buffers[0], *opposite1 = &opposite_buffers[1];
+		int ray0_index = -1, ray1_index = -1;
+		for(int ray = ray_from; ray < ray_to; ++ray) {
+			if (p->ray_begin[ray] == p->ray_begin[ray + 1])
+				continue;
+			if (ray1_index == ray)
+				{ std::swap(ray0, ray1); std::swap(opposite0, opposite1); std::swap(ray0_index, ray1_index); }
+			if (ray0_index != ray) {
+				ray0->build(*p, p->get_ray_direction(ray), first, count);
+				if (crossing) opposite0->build(*p, -p->get_ray_direction(ray), 0, opposite_count);
+				ray0_index = ray;
+			}
+			ray1->build(*p, p->get_ray_direction(ray + 1), first, count);
+			if (crossing) opposite1->build(*p, -p->get_ray_direction(ray + 1), 0, opposite_count);
+			ray1_index = ray + 1;
+
+			for(const int *i = &p->pixels.front() + p->ray_begin[ray], *e = &p->pixels.front() + p->ray_begin[ray + 1]; i != e; ++i) {
+				const int x = p->rect.minx + *i%w;
+				const int y = p->rect.miny + *i/w;
+				const Real r = (Point(x, y) - p->origin).mag();
+				const Real a = r*p->k;
+
+				Color &dst = (*p->dst)[y][x];
+				if (std::fabs(r - a) < precision)
+					{ dst = p->sample(Point(x, y)).demult_alpha(); continue; }
+
+				const Real f = clamp(Real(p->ray_index[*i]) - ray, Real(0.0), Real(1.0));
+				Real c0[4], c1[4];
+				if (a < 0.0) {
+					ray0->average_crossing(c0, p->fade_out, *opposite0, r, a);
+					ray1->average_crossing(c1, p->fade_out, *opposite1, r, a);
+				} else {
+					ray0->average(c0, p->fade_out, r, a);
+					ray1->average(c1, p->fade_out, r, a);
+				}
+				dst = Color(
+					c0[0] + (c1[0] - c0[0])*f,
+					c0[1] + (c1[1] - c0[1])*f,
+					c0[2] + (c1[2] - c0[2])*f,
+					c0[3] + (c1[3] - c0[3])*f ).demult_alpha();
+			}
+		}
+	}
+
+public:
+	virtual bool run(RunParams&) const
+	{
+		const Real precision = 1e-8;
+
+		if (!is_valid() || !sub_task() || !sub_task()->is_valid())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+		LockRead lsrc(sub_task());
+		if (!lsrc)
+			return false;
+
+		Params p;
+		p.dst = &ldst->get_surface();
+		p.src = &lsrc->get_surface();
+		p.rect = RectInt(0, 0, p.dst->get_w(), p.dst->get_h()) & target_rect;
+		if (!p.rect.is_valid())
+			return true;
+
+		const Vector upp = get_units_per_pixel();
+		const Point units_origin(
+			source_rect.minx - upp[0]*target_rect.minx,
+			source_rect.miny - upp[1]*target_rect.miny );
+		const Vector src_ppu = sub_task()->get_pixels_per_unit();
+		const Vector src_units_offset(
+			sub_task()->target_rect.minx - sub_task()->source_rect.minx*src_ppu[0] - 0.5,
+			sub_task()->target_rect.miny - sub_task()->source_rect.miny*src_ppu[1] - 0.5 );
+		// centers of the pixels are at the integer coordinates
+		const Point pixels_origin = units_origin + upp*0.5;
+		p.origin = Point(
+			(origin[0] - pixels_origin[0])/upp[0],
+			(origin[1] - pixels_origin[1])/upp[1] );
+		p.src_scale = upp.multiply_coords(src_ppu);
+		p.src_offset = pixels_origin.multiply_coords(src_ppu) + src_units_offset;
+		p.k = 1.0 - size;
+		p.fade_out = fade_out;
+
+		// angles of the rays, the step is one pixel at the farthest corner
+		const Rect box(p.rect.minx - 0.5, p.rect.miny - 0.5, p.rect.maxx - 0.5, p.rect.maxy - 0.5);
+		const Point corners[] = {
+			box.get_min(), Point(box.maxx, box.miny), box.get_max(), Point(box.minx, box.maxy) };
+		Real max_r = 0.0;
+		for(int i = 0; i < 4; ++i)
+			max_r = std::max(max_r, (corners[i] - p.origin).mag());
+		if (max_r < precision)
+			return true;
+
+		Rect inner_box = box;
+		inner_box.expand(1.0);
+		if (inner_box.is_inside(p.origin)) {
+			p.ref = Vector(1.0, 0.0);
+			p.rays = std::max(8, (int)ceil(2.0*PI*max_r));
+			p.angle_step = 2.0*PI/p.rays;
+			p.angle0 = -PI;
+		} else {
+			p.ref = (Point(0.5*(box.minx + box.maxx), 0.5*(box.miny + box.maxy)) - p.origin).norm();
+			p.angle_step = 1.0/max_r;
+			Real min_angle = INFINITY, max_angle = -INFINITY;
+			for(int i = 0; i < 4; ++i) {
+				const Vector v = corners[i] - p.origin;
+				const Real angle = atan2(p.ref[0]*v[1] - p.ref[1]*v[0], p.ref*v);
+				min_angle = std::min(min_angle, angle);
+				max_angle = std::max(max_angle, angle);
+			}
+			p.angle0 = min_angle - p.angle_step;
+			p.rays = (int)ceil((max_angle - min_angle)/p.angle_step) + 3;
+		}
+
+		const int width = p.rect.get_width();
+		const int height = p.rect.get_height();
+		const int threads = ThreadPool::instance().get_max_threads();
+		const bool multithreaded = width*height >= rendering::OptimizerSplit::min_area && threads > 1;
+
+		// find the rays for the pixels
+		p.ray_index.resize(width*height);
+		rendering::software::run_strips(&TaskRadialBlurSW::process_ray_indices, &p, p.rect);
+
+		// sort pixels by rays
+		p.ray_begin.assign(p.rays + 1, 0);
+		for(std::vector<float>::const_iterator i = p.ray_index.begin(); i != p.ray_index.end(); ++i)
+			++p.ray_begin[std::min((int)*i, p.rays - 1) + 1];
+		for(int i = 0; i < p.rays; ++i)
+			p.ray_begin[i + 1] += p.ray_begin[i];
+		p.pixels.resize(width*height);
+		{
+			std::vector<int> pos(p.ray_begin.begin(), p.ray_begin.end() - 1);
+			for(int i = 0; i < (int)p.ray_index.size(); ++i)
+				p.pixels[pos[std::min((int)p.ray_index[i], p.rays - 1)]++] = i;
+		}
+
+		// neighbour rays have the similar lengths, so the groups of rays are processed together,
+		// make more groups than threads to balance the load
+		const int groups = multithreaded ? std::min(p.rays, 4*threads) : 1;
+		if (groups < 2) {
+			process_rays(&p, 0, p.rays);
+			return true;
+		}
+
+		ThreadPool::Group group;
+		for(int i = 0; i < groups; ++i)
+			group.enqueue( sigc::bind( sigc::ptr_fun(&TaskRadialBlurSW::process_rays),
+				&p, p.rays*i/groups, p.rays*(i + 1)/groups ));
+		group.run();
+
+		return true;
+	}
+};
+
+rendering::Task::Token TaskRadialBlur::token(
+	DescAbstract<TaskRadialBlur>("RadialBlur") );
+rendering::Task::Token TaskRadialBlurSW::token(
+	DescReal<TaskRadialBlurSW, TaskRadialBlur>("RadialBlurSW") );
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 /* === E N T R Y P O I N T ================================================= */
@@ -540,5 +975,16 @@ RadialBlur::accelerated_cairorender(Context context, cairo_t *cr, int quality, c
 }
 
 rendering::Task::Handle
-RadialBlur::build_rendering_task_vfunc(Context context) const
-	{ return Layer::build_rendering_task_vfunc(context); }
+RadialBlur::build_composite_fork_task_vfunc(ContextParams /* context_params */, rendering::Task::Handle sub_task)const
+{
+	Real size = param_size.get(Real());
+	if (!sub_task || approximate_zero_lp(size))
+		return sub_task;
+
+	TaskRadialBlur::Handle task(new TaskRadialBlur());
+	task->origin = param_origin.get(Vector());
+	task->size = size;
+	task->fade_out = param_fade_out.get(bool());
+	task->sub_task() = sub_task;
+	return task;
+}
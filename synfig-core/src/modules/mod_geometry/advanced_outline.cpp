@@ -670,6 +670,24 @@ Advanced_Outline::sync_vfunc()
 	catch (...) { synfig::error("Advanced Outline::sync(): Exception thrown"); throw; }
 }
 
+bool
+Advanced_Outline::get_shape_key(ShapeKey &key) const
+{
+	key.add(param_start_tip.get(int()));
+	key.add(param_end_tip.get(int()));
+	key.add(param_cusp_type.get(int()));
+	key.add(param_width.get(Real()));
+	key.add(param_expand.get(Real()));
+	key.add(param_smoothness.get(Real()));
+	key.add(param_homogeneous.get(bool()));
+	key.add(param_dash_enabled.get(bool()));
+	key.add(param_dash_offset.get(Real()));
+	key.add(get_outline_grow_mark());
+	return key.add(param_bline)
+	    && key.add(param_wplist)
+	    && key.add(param_dilist);
+}
+
 bool
 Advanced_Outline::set_shape_param(const String & param, const ValueBase &value)
 {
@@ -89,6 +89,7 @@ private:
 	
 protected:
 	virtual void sync_vfunc();
+	virtual bool get_shape_key(ShapeKey &key) const;
 };
 
 /* === E N D =============================================================== */
@@ -211,6 +211,19 @@ Outline::sync_vfunc()
 	} catch (...) { synfig::error("Outline::sync(): Exception thrown"); throw; }
 }
 
+bool
+Outline::get_shape_key(ShapeKey &key) const
+{
+	key.add(param_width.get(Real()));
+	key.add(param_expand.get(Real()));
+	key.add(param_sharp_cusps.get(bool()));
+	key.add(param_homogeneous_width.get(bool()));
+	key.add(param_round_tip[0].get(bool()));
+	key.add(param_round_tip[1].get(bool()));
+	key.add(get_outline_grow_mark());
+	return key.add(param_bline);
+}
+
 bool
 Outline::set_shape_param(const String & param, const ValueBase &value)
 {
@@ -75,6 +75,7 @@ public:
 
 protected:
 	virtual void sync_vfunc();
+	virtual bool get_shape_key(ShapeKey &key) const;
 };
 
 /* === E N D =============================================================== */
@@ -170,6 +170,10 @@ Region::sync_vfunc()
 	close();
 }
 
+bool
+Region::get_shape_key(ShapeKey &key) const
+	{ return key.add(param_bline); }
+
 bool
 Region::set_shape_param(const String & param, const ValueBase &value)
 {
@@ -40,6 +40,9 @@
 #include <ETL/stringf>
 #include "trgt_gif.h"
 #include <cstdio>
+#include <algorithm>
+#include <sigc++/bind.h>
+#include <synfig/threadpool.h>
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -60,16 +63,10 @@ SYNFIG_TARGET_SET_CVS_ID(gif,"$Id$");
 
 /* === M E T H O D S ======================================================= */
 
-gif::gif(const char *filename_, const synfig::TargetParam & /* params */):
-	bs(),
+gif::gif(const char *filename_, const synfig::TargetParam &params):
 	filename(filename_),
 	file( (filename=="-")?stdout:g_fopen(filename_,POPEN_BINARY_WRITE_TYPE) ),
-	codesize(),
 	rootsize(),
-	nextcode(),
-	table(NULL),
-	next(NULL),
-	node(NULL),
 	imagecount(0),
 	cur_scanline(),
 	lossy(true),
@@ -78,11 +75,13 @@ gif::gif(const char *filename_, const synfig::TargetParam & /* params */):
 	color_bits(8),
 	iframe_density(30),
 	loop_count(0x7fff),
-	local_palette(true)
+	local_palette(true),
+	encoder_queue(params.encoder_jobs)
 { }
 
 gif::~gif()
 {
+	write_ready_frames(true);
 	if(file)
 		fputc(';',file.get());	// Image terminator
 }
@@ -119,10 +118,8 @@ gif::init(synfig::ProgressCallback * /* cb */)
 
 	rootsize=color_bits;	// Size of pixel bits
 
-	curr_frame.set_wh(w,h);
 	prev_frame.set_wh(w,h);
 	curr_surface.set_wh(w,h);
-	curr_frame.clear();
 	prev_frame.clear();
 	curr_surface.clear();
 
@@ -206,25 +203,83 @@ gif::start_frame(synfig::ProgressCallback *callback)
 }
 
 void
-gif::end_frame()
+gif::quantize_rows(Frame *frame, const PaletteIndex *index, int begin, int end)
 {
-	int w = desc.get_w(), h = desc.get_h();
-	unsigned int value;
-	int delaytime = round_to_int(100.0/desc.get_frame_rate());
+	const int w=frame->surface.get_w();
+	for(int y=begin;y<end;y++)
+	{
+		const Color *src=frame->surface[y];
+		unsigned char *dst=frame->indices[y];
+		for(int x=0;x<w;x++)
+			dst[x]=std::max(0,index->find_closest(src[x].clamped()));
+	}
+}
 
-	bool build_off_previous(multi_image);
+void
+gif::dither(Frame &frame, const PaletteIndex &index)
+{
+	const int w=frame.surface.get_w(), h=frame.surface.get_h();
 
-	Palette prev_palette(curr_palette);
+	// Floyd-Steinberg error diffusion, errors of the current and
+	// the next rows are kept in the separate buffers with
+	// one pixel of padding at the both sides
+	const int pitch=4*(w+2);
+	std::vector<float> errors(2*pitch, 0.f);
+	float *curr=&errors[4];
+	float *next=&errors[pitch+4];
+
+	for(int y=0;y<h;y++)
+	{
+		std::fill(next-4, next-4+pitch, 0.f);
+		const Color *src=frame.surface[y];
+		unsigned char *dst=frame.indices[y];
+		for(int x=0;x<w;x++)
+		{
+			float *e=curr+4*x;
+			float *n=next+4*x;
+			const Color color=Color(
+				src[x].get_r()+e[0],
+				src[x].get_g()+e[1],
+				src[x].get_b()+e[2],
+				src[x].get_a()+e[3] ).clamped();
+			const int item=std::max(0,index.find_closest(color));
+			dst[x]=item;
+
+			const Color &c=frame.palette[item].color;
+			const float error[4]={
+				color.get_r()-c.get_r(),
+				color.get_g()-c.get_g(),
+				color.get_b()-c.get_b(),
+				color.get_a()-c.get_a() };
+			for(int k=0;k<4;k++)
+			{
+				e[4+k]+=error[k]*(7.f/16.f);
+				n[k-4]+=error[k]*(3.f/16.f);
+				n[k]  +=error[k]*(5.f/16.f);
+				n[k+4]+=error[k]*(1.f/16.f);
+			}
+		}
+		std::swap(curr,next);
+	}
+}
+
+void
+gif::quantize_frame(FrameHandle frame)
+{
+	const int min_rows=16;
+
+	Frame &f=*frame;
+	const int w=f.surface.get_w(), h=f.surface.get_h();
 
 	// Fill in the background color
-	if(get_alpha_mode()==TARGET_ALPHA_MODE_KEEP)
+	if(f.fill_background)
 	{
-		Surface::alpha_pen pen(curr_surface.begin(),1.0,Color::BLEND_BEHIND);
-		pen.set_value(get_canvas()->rend_desc().get_bg_color());
-		for(int y=0;y<curr_surface.get_h();y++,pen.inc_y())
+		Surface::alpha_pen pen(f.surface.begin(),1.0,Color::BLEND_BEHIND);
+		pen.set_value(f.bg_color);
+		for(int y=0;y<h;y++,pen.inc_y())
 		{
 			int x;
-			for(x=0;x<curr_surface.get_w();x++,pen.inc_x())
+			for(x=0;x<w;x++,pen.inc_x())
 			{
 				if(pen.get_value().get_a()>0.1)
 					pen.put_value();
@@ -235,12 +290,87 @@ gif::end_frame()
 		}
 	}
 
-	if(local_palette)
+	if(f.palette_size)
+	{
+		f.palette=Palette(f.surface, f.palette_size, Gamma());
+		synfig::info("curr_palette.size()=%d",f.palette.size());
+	}
+
+	const PaletteIndex index(f.palette, Gamma());
+	f.indices.set_wh(w,h);
+
+	if(f.dithering)
+	{
+		// error goes forward through the whole frame
+		dither(f,index);
+	}
+	else
 	{
-		curr_palette = Palette(curr_surface, 256/(1<<(8-rootsize)) - build_off_previous - 1, Gamma());
-		synfig::info("curr_palette.size()=%d",curr_palette.size());
+		const int strips=std::min(ThreadPool::instance().get_max_threads(), h/min_rows);
+		if(strips<2)
+		{
+			quantize_rows(&f,&index,0,h);
+		}
+		else
+		{
+			ThreadPool::Group group;
+			for(int i=0;i<strips;i++)
+				group.enqueue(sigc::bind(sigc::ptr_fun(&gif::quantize_rows), &f, &index, h*i/strips, h*(i+1)/strips));
+			group.run();
+		}
 	}
 
+	f.ready=true;
+}
+
+void
+gif::write_ready_frames(bool wait)
+{
+	if(wait)
+		encoder_queue.wait();
+	while(!frames.empty() && frames.front()->ready)
+	{
+		write_frame(*frames.front());
+		frames.pop_front();
+	}
+}
+
+void
+gif::end_frame()
+{
+	int w = desc.get_w(), h = desc.get_h();
+
+	FrameHandle frame(new Frame());
+	frame->surface.swap(curr_surface);
+	curr_surface.set_wh(w,h);
+
+	frame->fill_background=get_alpha_mode()==TARGET_ALPHA_MODE_KEEP;
+	frame->bg_color=get_canvas()->rend_desc().get_bg_color();
+	frame->dithering=dithering;
+	if(local_palette)
+		frame->palette_size=256/(1<<(8-rootsize)) - multi_image - 1;
+	else
+		frame->palette=curr_palette;
+
+	// colors of the frames are reduced in parallel,
+	// but they are compressed in order of the frames
+	frames.push_back(frame);
+	encoder_queue.enqueue(sigc::bind(sigc::ptr_fun(&gif::quantize_frame), frame));
+	write_ready_frames(false);
+}
+
+void
+gif::write_frame(Frame &frame)
+{
+	int w = desc.get_w(), h = desc.get_h();
+	unsigned int value;
+	int delaytime = round_to_int(100.0/desc.get_frame_rate());
+
+	bool build_off_previous(multi_image);
+
+	Palette prev_palette(curr_palette);
+	curr_palette=frame.palette;
+
 	int transparent_index = curr_palette.find_closest(Color(1,0,1,0), Gamma()) - curr_palette.begin();
 	bool has_transparency = curr_palette[transparent_index].color.get_a()<=0.00001;
 
@@ -301,48 +431,18 @@ gif::end_frame()
 		curr_palette=out;
 	}
 
-	bs=bitstream(file);
-
 	// Prepare ourselves for LZW compression
-	codesize=rootsize+1;
-	nextcode=(1<<rootsize)+2;
-	table=lzwcode::NewTable((1<<rootsize));
-	node=table;
-
-	// Output the rootsize
-	fputc(rootsize,file.get());	// rootsize;
+	lzw.start(file,rootsize);
 
-	// Push a table reset into the bitstream
-	bs.push_value(1<<rootsize,codesize);
-
-	for(int cur_scanline=0;cur_scanline<desc.get_h();cur_scanline++)
+	for(int cur_scanline=0;cur_scanline<h;cur_scanline++)
 	{
-		//color_to_pixelformat(curr_frame[cur_scanline], curr_surface[cur_scanline], PF_GRAY, &gamma(), desc.get_w());
+		const unsigned char *indices=frame.indices[cur_scanline];
+		unsigned char *prev=prev_frame[cur_scanline];
 
 		// Now we compress it!
 		for(int i=0; i < w; ++i)
 		{
-			Color color(curr_surface[cur_scanline][i].clamped());
-			Palette::iterator iter(curr_palette.find_closest(color, Gamma()));
-
-			if(dithering)
-			{
-				Color error(color-iter->color);
-				//error*=0.25;
-				if(curr_surface.get_h()>cur_scanline+1)
-				{
-					curr_surface[cur_scanline+1][i-1]  += error * ((float)3/(float)16);
-					curr_surface[cur_scanline+1][i]    += error * ((float)5/(float)16);
-					if(curr_surface.get_w()>i+1)
-						curr_surface[cur_scanline+1][i+1]  += error * ((float)1/(float)16);
-				}
-				if(curr_surface.get_w()>i+1)
-					curr_surface[cur_scanline][i+1]    += error * ((float)7/(float)16);
-			}
-
-			curr_frame[cur_scanline][i]=iter-curr_palette.begin();
-
-			value=curr_frame[cur_scanline][i];
+			value=indices[i];
 			if(build_off_previous)
 				value++;
 			if(value>(unsigned)(1<<rootsize)-1)
@@ -358,77 +458,34 @@ gif::end_frame()
 
 					// Lossy
 					if(
-						abs( ( iter->color-prev_palette[prev_frame[cur_scanline][i]-1].color ).get_y() ) > (1.0/16.0) ||
-//						abs((int)value-(int)prev_frame[cur_scanline][i])>2||
-//						(value<=2 && value!=prev_frame[cur_scanline][i]) ||
+						!prev[i] || prev[i]>prev_palette.size() ||
+						abs( ( curr_palette[indices[i]].color-prev_palette[prev[i]-1].color ).get_y() ) > (1.0/16.0) ||
 						(imagecount%iframe_density)==0 || imagecount==desc.get_frame_end()-1 ) // lossy version
-						prev_frame[cur_scanline][i]=value;
+						prev[i]=value;
 					else
 					{
-						prev_frame[cur_scanline][i]=value;
+						prev[i]=value;
 						value=0;
 					}
 				}
 				else
 				{
 					// lossless version
-					if(value!=prev_frame[cur_scanline][i])
-						prev_frame[cur_scanline][i]=value;
+					if(value!=prev[i])
+						prev[i]=value;
 					else
 						value=0;
 				}
 			}
 			else
-			prev_frame[cur_scanline][i]=value;
+			prev[i]=value;
 
-			next=node->FindCode(value);
-			if(next)
-				node=next;
-			else
-			{
-				node->AddNode(nextcode, value);
-				bs.push_value(node->code, codesize);
-				node = table->FindCode(value);
-
-				// Check to see if we need to increase the codesize
-				if (nextcode == ( 1 << codesize))
-					codesize += 1;
-
-				nextcode += 1;
-
-				// check to see if we have filled up the table
-				if (nextcode == 4096)
-				{
-					// output the clear code: make sure to use the current
-					// codesize
-					bs.push_value((unsigned) 1 << rootsize, codesize);
-
-					delete table;
-					table = lzwcode::NewTable((1<<rootsize));
-					codesize = rootsize + 1;
-					nextcode = (1 << rootsize) + 2;
-
-					// since we have a new table, need the correct prefix
-					node = table->FindCode(value);
-				}
-			}
+			lzw.put(value);
 		}
 	}
 
-
-
-
-
-	// Push the last code onto the bitstream
-	bs.push_value(node->code,codesize);
-
-	// Push a end-of-stream code onto the bitstream
-	bs.push_value((1<<rootsize)+1,codesize);
-
 	// Make sure everything is dumped out
-	bs.dump();
-
-	delete table;
+	lzw.finish();
 
 	fputc(0,file.get());		// Block terminator
 
@@ -36,6 +36,12 @@
 #include <synfig/surface.h>
 #include <synfig/palette.h>
 #include <synfig/targetparam.h>
+#include <synfig/encoderqueue.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
 
 /* === M A C R O S ========================================================= */
 
@@ -46,7 +52,7 @@
 class gif : public synfig::Target_Scanline
 {
 	SYNFIG_TARGET_MODULE_EXT
-private:
+public:
 	// Class for abstracting the
 	// output of the codes
 	struct bitstream
@@ -97,83 +103,188 @@ private:
 		}
 
 		// Pushes a symbol of the given size
-		// onto the bitstream.
+		// onto the bitstream, by as many
+		// bits at once as the pool can take.
 		void push_value(int value, int size)
 		{
-			int i;
-			for(i=0;i<size;i++)
-				push_bit((value>>(i))&1);
+			while(size>0)
+			{
+				int bits=8-curr_bit;
+				if(bits>size)
+					bits=size;
+				pool|=(value&((1<<bits)-1))<<curr_bit;
+				curr_bit+=bits;
+				value>>=bits;
+				size-=bits;
+				if(curr_bit==8)
+					empty();
+			}
 		}
 	};
 
-	// Class for dealing with the LZW codes
-	struct lzwcode
+	// Class for dealing with the LZW codes.
+	// Strings are kept in the open addressing hash
+	// table by the code of their prefix and the last
+	// value, the table is allocated once, so reset
+	// of the dictionary costs almost nothing.
+	struct lzwtable
 	{
-		int value; // the data element or character
-		int code; // lzwcode
-		struct lzwcode* kids; // children of this node
-		struct lzwcode* next; // siblings of this node
+		enum { SIZE = 8192 }; // power of two, larger than the max count of codes (4096)
 
-		lzwcode():value(0),code(0),kids(0),next(0) { }
+		std::vector<int> keys;
+		std::vector<int> codes;
 
-		lzwcode *FindCode(int value)
+		lzwtable():keys(SIZE,-1),codes(SIZE,0) { }
+
+		static int key(int prefix, int value)
+			{ return (prefix<<8)|value; }
+		static int hash(int key)
+			{ return (key*2654435761u)>>19 & (SIZE-1); }
+
+		void reset()
+			{ std::fill(keys.begin(),keys.end(),-1); }
+
+		// Returns the code of the string or -1
+		int find(int prefix, int value)const
 		{
-			lzwcode *node=this;
+			const int k=key(prefix,value);
+			for(int i=hash(k);keys[i]>=0;i=(i+1)&(SIZE-1))
+				if(keys[i]==k)
+					return codes[i];
+			return -1;
+		}
 
-			// check the children (kids) of the node for the value
-			for (node = node->kids; node != 0; node = node->next)
-				if (node->value == value)
-					return(node);
-			return(0);
+		void add(int prefix, int value, int code)
+		{
+			const int k=key(prefix,value);
+			int i=hash(k);
+			while(keys[i]>=0)
+				i=(i+1)&(SIZE-1);
+			keys[i]=k;
+			codes[i]=code;
 		}
+	};
 
-		void AddNode(unsigned short code, unsigned short value)
+	// LZW compressor of the image data.
+	// Codes are pushed onto the bitstream
+	// as the values come.
+	struct lzwencoder
+	{
+		bitstream bs;
+		lzwtable table;
+		int
+			rootsize,	// Size of pixel bits
+			codesize,	// Current code size
+			nextcode,	// Next code to use
+			code;		// Code of the current string, -1 means empty string
+
+		lzwencoder():rootsize(),codesize(),nextcode(),code(-1) { }
+
+		// Outputs the rootsize and the
+		// table reset, to start the image
+		void start(synfig::SmartFILE file, int size)
 		{
-			lzwcode *n = new lzwcode;
-
-			// add a new child to node; the child will have code and value
-			n->value = value;
-			n->code = code;
-			n->kids = 0;
-			n->next = this->kids;
-			this->kids = n;
+			bs=bitstream(file);
+			rootsize=size;
+			codesize=rootsize+1;
+			nextcode=(1<<rootsize)+2;
+			table.reset();
+			code=-1;
+
+			// Output the rootsize
+			fputc(rootsize,file.get());
+
+			// Push a table reset into the bitstream
+			bs.push_value(1<<rootsize,codesize);
 		}
 
-		static lzwcode * NewTable(int values)
+		void put(int value)
 		{
-			int i;
-			lzwcode * table = new lzwcode;
+			if(code<0)
+			{
+				code=value;
+				return;
+			}
+
+			int next=table.find(code, value);
+			if(next>=0)
+			{
+				code=next;
+				return;
+			}
 
-			table->kids = 0;
-			for (i = 0; i < values; i++)
-				table->AddNode( i, i);
+			table.add(code, value, nextcode);
+			bs.push_value(code, codesize);
+			code=value;
 
-			return(table);
+			// Check to see if we need to increase the codesize
+			if (nextcode == ( 1 << codesize))
+				codesize += 1;
+
+			nextcode += 1;
+
+			// check to see if we have filled up the table
+			if (nextcode == 4096)
+			{
+				// output the clear code: make sure to use the current
+				// codesize
+				bs.push_value((unsigned) 1 << rootsize, codesize);
+
+				table.reset();
+				codesize = rootsize + 1;
+				nextcode = (1 << rootsize) + 2;
+			}
 		}
 
-		// Destructor just deletes any
-		// children and siblings.
-		~lzwcode()
+		// Outputs the current string and the end
+		// code, everything is dumped out
+		void finish()
 		{
-			if(kids)
-				delete kids;
-			if(next)
-				delete next;
+			// Push the last code onto the bitstream
+			bs.push_value(std::max(code,0),codesize);
+
+			// Push a end-of-stream code onto the bitstream
+			bs.push_value((1<<rootsize)+1,codesize);
+
+			bs.dump();
 		}
 	};
 
 private:
-	bitstream bs;
+	// Rendered frame. Its colors are reduced
+	// to the palette in background, frames are
+	// independent at this stage. Then they are
+	// compressed in order by write_frame().
+	struct Frame
+	{
+		synfig::Surface surface;
+		etl::surface<unsigned char> indices;
+		synfig::Palette palette;
+		int palette_size; // size of the local palette to build, zero means that palette is given
+		bool dithering;
+		bool fill_background;
+		synfig::Color bg_color;
+		std::atomic<bool> ready;
+
+		Frame():palette_size(),dithering(),fill_background(),ready(false) { }
+	};
+
+	typedef std::shared_ptr<Frame> FrameHandle;
+
+	static void quantize_frame(FrameHandle frame);
+	static void quantize_rows(Frame *frame, const synfig::PaletteIndex *index, int begin, int end);
+	static void dither(Frame &frame, const synfig::PaletteIndex &index);
+
+	void write_frame(Frame &frame);
+	void write_ready_frames(bool wait);
+
+private:
 	synfig::String filename;
 	synfig::SmartFILE file;
-	int
-		codesize,	// Current code size
-		rootsize,	// Size of pixel bits (will be recalculated)
-		nextcode;	// Next code to use
-	lzwcode *table,*next,*node;
+	int rootsize;	// Size of pixel bits (will be recalculated)
+	lzwencoder lzw;
 
 	synfig::Surface curr_surface;
-	etl::surface<unsigned char> curr_frame;
 	etl::surface<unsigned char> prev_frame;
 
 	int imagecount;
@@ -191,6 +302,9 @@ private:
 
 	synfig::Palette curr_palette;
 
+	std::deque<FrameHandle> frames;
+	synfig::EncoderQueue encoder_queue;
+
 	void output_curr_palette();
 
 public:
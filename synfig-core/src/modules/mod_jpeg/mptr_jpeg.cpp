@@ -115,9 +115,12 @@ jpeg_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddes
 	jpeg_decompress_struct cinfo;
 	struct my_error_mgr jerr;
 
-	/* Open the file pointer */
-	FileSystem::ReadStream::Handle stream = identifier.get_read_stream();
-	if (!stream)
+	/* Use the file placed in memory if possible, or open the file pointer */
+	FileSystem::MappedFile::Handle mapped_file = identifier.get_mapped_file();
+	FileSystem::ReadStream::Handle stream;
+	if (!mapped_file)
+		stream = identifier.get_read_stream();
+	if (!mapped_file && !stream)
 	{
 		throw String("Error on jpeg importer, unable to physically open "+identifier.filename);
 		return false;
@@ -142,12 +145,20 @@ jpeg_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddes
 
 	/* Step 2: specify data source (eg, from memory thru a String) */
 
-	std::ostringstream tmp;
-	tmp << stream->rdbuf();
-	String streamString = tmp.str();
-	stream.reset();
+	String streamString;
+	if (mapped_file)
+	{
+		jpeg_mem_src(&cinfo, (unsigned char*)mapped_file->data(), mapped_file->size());
+	}
+	else
+	{
+		std::ostringstream tmp;
+		tmp << stream->rdbuf();
+		streamString = tmp.str();
+		stream.reset();
 
-	jpeg_mem_src(&cinfo, (unsigned char*)streamString.c_str(), streamString.size());
+		jpeg_mem_src(&cinfo, (unsigned char*)streamString.c_str(), streamString.size());
+	}
 
 	/* Step 3: read file parameters with jpeg_read_header() */
 
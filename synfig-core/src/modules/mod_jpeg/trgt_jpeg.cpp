@@ -35,6 +35,7 @@
 #include <glib/gstdio.h>
 #include "trgt_jpeg.h"
 #include <ETL/stringf>
+#include <sigc++/bind.h>
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -53,34 +54,82 @@ SYNFIG_TARGET_SET_CVS_ID(jpeg_trgt,"$Id$");
 
 /* === M E T H O D S ======================================================= */
 
+void
+jpeg_trgt::write_frame(Frame &frame)
+{
+	struct jpeg_compress_struct cinfo = jpeg_compress_struct();
+	struct jpeg_error_mgr jerr = jpeg_error_mgr();
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, frame.file);
+
+	cinfo.image_width = frame.w; 	/* image width and height, in pixels */
+	cinfo.image_height = frame.h;
+	cinfo.input_components = 3;		/* # of color components per pixel */
+	cinfo.in_color_space = JCS_RGB; 	/* colorspace of input image */
+	/* Now use the library's routine to set default compression parameters.
+	* (You must set at least cinfo.in_color_space before calling this,
+	* since the defaults depend on the source color space.)
+	*/
+	jpeg_set_defaults(&cinfo);
+	/* Now you can set any non-default parameters you wish to.
+	* Here we just illustrate the use of quality (quantization table) scaling:
+	*/
+	jpeg_set_quality(&cinfo, frame.quality, TRUE /* limit to baseline-JPEG values */);
+
+	/* Step 4: Start compressor */
+
+	/* TRUE ensures that we will write a complete interchange-JPEG file.
+	* Pass TRUE unless you are very sure of what you're doing.
+	*/
+	jpeg_start_compress(&cinfo, TRUE);
+
+	const int pitch = 3*frame.w;
+	while((int)cinfo.next_scanline < frame.h)
+	{
+		JSAMPROW row_pointer = &frame.pixels[cinfo.next_scanline*pitch];
+		jpeg_write_scanlines(&cinfo, &row_pointer, 1);
+	}
+
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+
+	if(frame.file!=stdout)
+		fclose(frame.file);
+	else
+		fflush(frame.file);
+	frame.file=nullptr;
+}
+
+void
+jpeg_trgt::write_frame_async(FrameHandle frame)
+	{ write_frame(*frame); }
+
 jpeg_trgt::jpeg_trgt(const char *Filename, const synfig::TargetParam &params):
-	file(nullptr),
 	quality(95),
-	cinfo(),
-	jerr(),
 	multi_image(),
-	ready(false),
 	imagecount(),
+	scanline(),
 	filename(Filename),
-	buffer(nullptr),
 	color_buffer(nullptr),
-	sequence_separator(params.sequence_separator)
+	sequence_separator(params.sequence_separator),
+	encoder_queue(params.encoder_jobs)
 {
 	set_alpha_mode(TARGET_ALPHA_MODE_FILL);
+
+	PixelDither dither;
+	if (pixel_dither_from_name(params.dither, dither))
+		set_dither(dither);
 }
 
 jpeg_trgt::~jpeg_trgt()
 {
-	if(ready)
-	{
-		jpeg_finish_compress(&cinfo);
-		jpeg_destroy_compress(&cinfo);
-		ready=false;
-	}
-	if(file)
-		fclose(file);
-	file=nullptr;
-	delete [] buffer;
+	// the frame which was not finished
+	if(frame && frame->file && frame->file!=stdout)
+		fclose(frame->file);
+	frame.reset();
+	encoder_queue.wait();
 	delete [] color_buffer;
 }
 
@@ -101,8 +150,11 @@ jpeg_trgt::start_frame(synfig::ProgressCallback *callback)
 {
 	int w=desc.get_w(),h=desc.get_h();
 
-	if(file && file!=stdout)
-		fclose(file);
+	if(frame && frame->file && frame->file!=stdout)
+		fclose(frame->file);
+	frame.reset();
+
+	FILE *file=nullptr;
 	if(filename=="-")
 	{
 		if(callback)callback->task(strprintf("(stdout) %d",imagecount).c_str());
@@ -126,74 +178,59 @@ jpeg_trgt::start_frame(synfig::ProgressCallback *callback)
 	if(!file)
 		return false;
 
-	delete [] buffer;
-	buffer=new unsigned char[3*w];
-
 	delete [] color_buffer;
 	color_buffer=new Color[w];
 
-
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_compress(&cinfo);
-	jpeg_stdio_dest(&cinfo, file);
-
-	cinfo.image_width = w; 	/* image width and height, in pixels */
-	cinfo.image_height = h;
-	cinfo.input_components = 3;		/* # of color components per pixel */
-	cinfo.in_color_space = JCS_RGB; 	/* colorspace of input image */
-	/* Now use the library's routine to set default compression parameters.
-	* (You must set at least cinfo.in_color_space before calling this,
-	* since the defaults depend on the source color space.)
-	*/
-	jpeg_set_defaults(&cinfo);
-	/* Now you can set any non-default parameters you wish to.
-	* Here we just illustrate the use of quality (quantization table) scaling:
-	*/
-	jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-
-	/* Step 4: Start compressor */
-
-	/* TRUE ensures that we will write a complete interchange-JPEG file.
-	* Pass TRUE unless you are very sure of what you're doing.
-	*/
-	jpeg_start_compress(&cinfo, TRUE);
-
-	ready=true;
+	frame=FrameHandle(new Frame());
+	frame->file=file;
+	frame->w=w;
+	frame->h=h;
+	frame->quality=quality;
+	frame->pixels.resize((size_t)3*w*h);
 	return true;
 }
 
 void
 jpeg_trgt::end_frame()
 {
-	if(ready)
+	if(frame && frame->file)
 	{
-		jpeg_finish_compress(&cinfo);
-		jpeg_destroy_compress(&cinfo);
-		ready=false;
+		// files of the sequence are independent, so compress them in background
+		// while the next frames are rendering
+		if(multi_image && frame->file!=stdout)
+			encoder_queue.enqueue(sigc::bind(sigc::ptr_fun(&jpeg_trgt::write_frame_async), frame));
+		else
+			write_frame(*frame);
 	}
-
-	if(file && file!=stdout)
-		fclose(file);
-	file=nullptr;
+	frame.reset();
 	imagecount++;
 }
 
 Color *
-jpeg_trgt::start_scanline(int /*scanline*/)
+jpeg_trgt::start_scanline(int y)
 {
+	scanline=y;
 	return color_buffer;
 }
 
 bool
 jpeg_trgt::end_scanline()
 {
-	if(!file || !ready)
+	if(!frame || !frame->file || scanline<0 || scanline>=frame->h)
 		return false;
 
-	color_to_pixelformat(buffer, color_buffer, PF_RGB, nullptr, desc.get_w());
+	color_to_pixelformat(&frame->pixels[(size_t)scanline*3*frame->w], color_buffer, PF_RGB, nullptr, frame->w, 1, 0, 0, get_dither(), 0, scanline);
+
+	return true;
+}
+
+bool
+jpeg_trgt::put_rows(const Surface &surface, int y)
+{
+	if(!frame || !frame->file || y<0 || y+surface.get_h()>frame->h || surface.get_w()!=frame->w)
+		return false;
 
-	JSAMPROW *row_pointer(&buffer);
-	jpeg_write_scanlines(&cinfo, row_pointer, 1);
+	convert_rows(&frame->pixels[(size_t)y*3*frame->w], 3*frame->w, surface, PF_RGB, nullptr, y);
 
 	return true;
 }
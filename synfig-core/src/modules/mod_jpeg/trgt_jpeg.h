@@ -32,7 +32,10 @@
 #include <synfig/target_scanline.h>
 #include <synfig/string.h>
 #include <synfig/targetparam.h>
+#include <synfig/encoderqueue.h>
 #include <cstdio>
+#include <memory>
+#include <vector>
 
 extern "C" {
 	#include <jpeglib.h>
@@ -48,18 +51,32 @@ class jpeg_trgt : public synfig::Target_Scanline
 {
 	SYNFIG_TARGET_MODULE_EXT
 private:
-	FILE *file;
-	int /*w,h,*/quality;
-	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr jerr;
+	//! Whole frame converted to the 8-bit RGB rows, it's compressed after the rendering
+	struct Frame
+	{
+		FILE *file;
+		int w, h;
+		int quality;
+		std::vector<unsigned char> pixels;
 
+		Frame(): file(nullptr), w(), h(), quality() { }
+	};
 
-	bool multi_image,ready;
+	typedef std::shared_ptr<Frame> FrameHandle;
+
+	//! Compresses the frame and closes its file, may be called from any thread
+	static void write_frame(Frame &frame);
+	static void write_frame_async(FrameHandle frame);
+
+	int quality;
+	bool multi_image;
 	int imagecount;
+	int scanline;
 	synfig::String filename;
-	unsigned char *buffer;
 	synfig::Color *color_buffer;
 	synfig::String sequence_separator;
+	FrameHandle frame;
+	synfig::EncoderQueue encoder_queue;
 public:
 	jpeg_trgt(const char *filename, const synfig::TargetParam& /* params */);
 	virtual ~jpeg_trgt();
@@ -70,6 +87,9 @@ public:
 
 	virtual synfig::Color * start_scanline(int scanline);
 	virtual bool end_scanline();
+
+	virtual bool can_put_rows() const { return true; }
+	virtual bool put_rows(const synfig::Surface &surface, int y);
 };
 
 /* === E N D =============================================================== */
@@ -65,9 +65,16 @@ extern "C"
 #ifndef DISABLE_MODULE
 #	include <cstring>
 #	include <algorithm>
+#	include <condition_variable>
 #	include <functional>
+#	include <map>
+#	include <mutex>
+#	include <thread>
+#	include <vector>
+#	include <sigc++/bind.h>
 #	include <synfig/general.h>
 #	include <synfig/localization.h>
+#	include <synfig/encoderqueue.h>
 #	include "trgt_av.h"
 #endif
 
@@ -95,9 +102,23 @@ SYNFIG_TARGET_SET_CVS_ID(Target_LibAVCodec,"$Id$");
 
 static bool av_registered = false;
 
+//! Frames go through the pipeline:
+//! render thread fills the RGB buffer of the frame and enqueues it to the converter queue,
+//! colour conversion runs in the ThreadPool (several frames at once, each with its own SwsContext),
+//! then the encoder thread takes the converted frames in order of their timestamps.
+//! Count of the frames in the pipeline is limited, so start_frame() blocks when the encoder falls behind.
 class Target_LibAVCodec::Internal
 {
 private:
+	struct Frame
+	{
+		std::vector<unsigned char> rgb;
+		AVFrame *video_frame;
+		int64_t pts;
+
+		Frame(): video_frame(), pts() { }
+	};
+
 	AVFormatContext *context;
 	AVPacket *packet;
 	bool file_opened;
@@ -106,9 +127,23 @@ private:
 	const AVCodec *video_codec;
 	AVStream *video_stream;
 	AVCodecContext *video_context;
-	AVFrame *video_frame;
-	AVFrame *video_frame_rgb;
-	SwsContext *video_swscale_context;
+	int rgb_pitch;
+
+	// fields below are guarded by the mutex
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<Frame*> free_frames;
+	std::map<int64_t, Frame*> converted_frames;
+	std::vector<SwsContext*> free_swscale_contexts;
+	int max_frames;
+	int frames;              //!< count of the frames from start_frame() until they are encoded
+	bool finishing;
+	bool failed;
+
+	Frame *frame;            //!< frame which is rendered now
+	int64_t next_pts;
+	EncoderQueue converter_queue;
+	std::thread encoder_thread;
 
 	bool add_video_stream(enum AVCodecID codec_id, const RendDesc &desc) {
 		// find the video encoder
@@ -147,6 +182,11 @@ private:
 		video_context->time_base    = (AVRational){ 1, fps };
 		video_stream->time_base     = video_context->time_base;
 
+		// let the codec choose the count of threads and use both frame and slice threading,
+		// the encoder works in its own thread, so the latency of the frame threading is not a problem
+		video_context->thread_count = 0;
+		video_context->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
 		// some formats want stream headers to be separate.
 		if (context->oformat->flags & AVFMT_GLOBALHEADER)
 			video_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
@@ -164,45 +204,18 @@ private:
 			return false;
         }
 
-		// allocate frame
-		video_frame = av_frame_alloc();
-		assert(video_frame);
-		video_frame->format = video_context->pix_fmt;
-		video_frame->width  = video_context->width;
-		video_frame->height = video_context->height;
-		video_frame->pts    = 0;
-		if (av_frame_get_buffer(video_frame, 32) < 0) {
-			synfig::error("Target_LibAVCodec: could not allocate the video frame data");
-			close();
-			return false;
-		}
-
-		// if the output format is not RGB24, then a temporary picture is needed too.
-		if (video_frame->format != AV_PIX_FMT_RGB24) {
-			video_frame_rgb = av_frame_alloc();
-			assert(video_frame_rgb);
-			video_frame_rgb->format = AV_PIX_FMT_RGB24;
-			video_frame_rgb->width  = video_frame->width;
-			video_frame_rgb->height = video_frame->height;
-			if (av_frame_get_buffer(video_frame_rgb, 32) < 0) {
-				synfig::error("Target_LibAVCodec: could not allocate the temporary video frame data");
-				close();
-				return false;
-			}
+		rgb_pitch = 3*video_context->width;
 
-			video_swscale_context = sws_getContext(
-				video_frame_rgb->width,
-				video_frame_rgb->height,
-				(AVPixelFormat)video_frame_rgb->format,
-				video_frame->width,
-				video_frame->height,
-				(AVPixelFormat)video_frame->format,
-				SWS_BICUBIC, NULL, NULL, NULL );
-			if (!video_swscale_context) {
+		// if the output format is not RGB24, then the conversion is needed,
+		// create the first conversion context now to check the formats
+		if (video_context->pix_fmt != AV_PIX_FMT_RGB24) {
+			SwsContext *swscale_context = create_swscale_context();
+			if (!swscale_context) {
 				synfig::error("Target_LibAVCodec: cannot initialize the conversion context");
 				close();
 				return false;
 			}
+			free_swscale_contexts.push_back(swscale_context);
 		}
 
 		// copy the stream parameters to the muxer
@@ -215,8 +228,179 @@ private:
 		return true;
 	}
 
+	SwsContext* create_swscale_context() const {
+		return sws_getContext(
+			video_context->width,
+			video_context->height,
+			AV_PIX_FMT_RGB24,
+			video_context->width,
+			video_context->height,
+			video_context->pix_fmt,
+			SWS_BICUBIC, NULL, NULL, NULL );
+	}
+
+	//! Stops the pipeline after the error, the \a f frame is released if given
+	void set_failed(Frame *f = NULL) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (f)
+			free_frames.push_back(f);
+		failed = true;
+		cond.notify_all();
+	}
+
+	//! Runs in the ThreadPool
+	void convert_frame(Frame *f) {
+		f->video_frame = av_frame_alloc();
+		assert(f->video_frame);
+		f->video_frame->format = video_context->pix_fmt;
+		f->video_frame->width  = video_context->width;
+		f->video_frame->height = video_context->height;
+		f->video_frame->pts    = f->pts;
+		if (av_frame_get_buffer(f->video_frame, 32) < 0) {
+			synfig::error("Target_LibAVCodec: could not allocate the video frame data");
+			av_frame_free(&f->video_frame);
+			set_failed(f);
+			return;
+		}
+
+		const uint8_t *rgb_data[4] = { &f->rgb.front(), NULL, NULL, NULL };
+		const int rgb_linesize[4] = { rgb_pitch, 0, 0, 0 };
+
+		if (video_context->pix_fmt == AV_PIX_FMT_RGB24) {
+			for(int y = 0; y < video_context->height; ++y)
+				memcpy(
+					f->video_frame->data[0] + y*f->video_frame->linesize[0],
+					rgb_data[0] + y*rgb_pitch,
+					rgb_pitch );
+		} else {
+			SwsContext *swscale_context = NULL;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!free_swscale_contexts.empty()) {
+					swscale_context = free_swscale_contexts.back();
+					free_swscale_contexts.pop_back();
+				}
+			}
+			if (!swscale_context)
+				swscale_context = create_swscale_context();
+			if (!swscale_context) {
+				synfig::error("Target_LibAVCodec: cannot initialize the conversion context");
+				av_frame_free(&f->video_frame);
+				set_failed(f);
+				return;
+			}
+
+			sws_scale(
+				swscale_context,
+				rgb_data,
+				rgb_linesize,
+				0,
+				video_context->height,
+				f->video_frame->data,
+				f->video_frame->linesize );
+
+			std::lock_guard<std::mutex> lock(mutex);
+			free_swscale_contexts.push_back(swscale_context);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		converted_frames[f->pts] = f;
+		cond.notify_all();
+	}
+
+	bool write_packets() {
+		while(true) {
+			int res = avcodec_receive_packet(video_context, packet);
+			if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+				break;
+			if (res) {
+				synfig::error("Target_LibAVCodec: error during encoding");
+				return false;
+			}
+
+			av_packet_rescale_ts(packet, video_context->time_base, video_stream->time_base);
+			packet->stream_index = video_stream->index;
+
+			res = av_interleaved_write_frame(context, packet);
+			av_packet_unref(packet);
+			if (res < 0) {
+				synfig::error("Target_LibAVCodec: error while writing video frame");
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//! Runs in the own thread, encodes the converted frames in order
+	void encode_frames() {
+		int64_t pts = 0;
+		while(true) {
+			Frame *f = NULL;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while(!failed && !(finishing && !frames) && converted_frames.count(pts) == 0)
+					cond.wait(lock);
+				if (failed)
+					return;
+				if (converted_frames.count(pts) == 0)
+					break; // all frames are encoded
+				f = converted_frames[pts];
+				converted_frames.erase(pts);
+			}
+
+			bool success = avcodec_send_frame(video_context, f->video_frame) >= 0;
+			if (!success)
+				synfig::error("Target_LibAVCodec: error sending a frame for encoding");
+			av_frame_free(&f->video_frame);
+			success = success && write_packets();
+			++pts;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			free_frames.push_back(f);
+			--frames;
+			if (!success)
+				failed = true;
+			cond.notify_all();
+			if (failed)
+				return;
+		}
+
+		// flush the delayed frames
+		if (avcodec_send_frame(video_context, NULL) < 0 || !write_packets())
+			set_failed();
+	}
+
+	//! Waits until all frames are encoded and stops the encoder thread,
+	//! returns false if some of them was failed
+	bool stop_pipeline() {
+		if (!encoder_thread.joinable())
+			return true;
+		converter_queue.wait();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// frame which was started but not finished
+			if (frame) {
+				free_frames.push_back(frame);
+				frame = NULL;
+				--frames;
+			}
+			finishing = true;
+			cond.notify_all();
+		}
+		encoder_thread.join();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for(std::map<int64_t, Frame*>::iterator i = converted_frames.begin(); i != converted_frames.end(); ++i) {
+			av_frame_free(&i->second->video_frame);
+			free_frames.push_back(i->second);
+		}
+		converted_frames.clear();
+		frames = 0;
+		return !failed;
+	}
+
 public:
-	Internal():
+	explicit Internal(int max_jobs):
 		context(),
 		packet(),
 		file_opened(),
@@ -224,11 +408,24 @@ public:
 		video_codec(),
 		video_stream(),
 		video_context(),
-		video_frame(),
-		video_frame_rgb(),
-		video_swscale_context()
-	{ }
-	~Internal() { close(); }
+		rgb_pitch(),
+		max_frames(),
+		frames(),
+		finishing(),
+		failed(),
+		frame(),
+		next_pts(),
+		converter_queue(max_jobs)
+	{
+		// converted frames waiting for the encoder are counted too
+		max_frames = 2*converter_queue.get_max_jobs();
+	}
+
+	~Internal() {
+		close();
+		for(std::vector<Frame*>::iterator i = free_frames.begin(); i != free_frames.end(); ++i)
+			delete *i;
+	}
 
 	bool open(const String &filename, const RendDesc &desc) {
 		close();
@@ -299,103 +496,81 @@ public:
 			close();
             return false;
 		}
+		headers_sent = true;
+
+		// start the encoder
+		next_pts = 0;
+		finishing = false;
+		failed = false;
+		encoder_thread = std::thread(&Internal::encode_frames, this);
 
 		return true;
 	}
 
-	bool encode_frame(const Surface &surface, bool last_frame) {
-		assert(context);
-		if (!context) return false;
-
-		// convert frame
+	int get_rgb_pitch() const
+		{ return rgb_pitch; }
 
-		AVFrame *frame_rgb = video_swscale_context ? video_frame_rgb : video_frame;
-		int w = std::min(frame_rgb->width, surface.get_w());
-		int h = std::max(frame_rgb->height, surface.get_h());
-		if (w != surface.get_w() || h != surface.get_h())
-			synfig::warning(
-				"Target_LibAVCodec: frame size (%d, %d) does not match to initial RendDesc (%d, %d)",
-				surface.get_w(), surface.get_h(), w, h );
+	//! Returns the row of the RGB buffer of the current frame
+	unsigned char* get_rgb_row(int y)
+		{ return frame ? &frame->rgb[(size_t)y*rgb_pitch] : NULL; }
 
-		if (av_frame_make_writable(frame_rgb) < 0) {
-	    	synfig::error("Target_LibAVCodec: could not make frame data writable");
-			close();
+	//! Takes the free RGB buffer for the next frame,
+	//! waits when too many frames are in the pipeline
+	bool start_frame() {
+		if (!context || !encoder_thread.joinable())
 			return false;
-		}
-
-		color_to_pixelformat(
-			(unsigned char *)frame_rgb->data[0],
-			surface[0],
-			PF_RGB,
-			0,
-			w,
-			h,
-			frame_rgb->linesize[0],
-			surface.get_pitch() );
-
-		if (video_swscale_context)
-			sws_scale(
-				video_swscale_context,
-				(const uint8_t * const *)video_frame_rgb->data,
-				video_frame_rgb->linesize,
-				0,
-				video_frame->height,
-				video_frame->data,
-				video_frame->linesize );
+		if (frame)
+			return true;
 
-		// encode frame
-
-		if (avcodec_send_frame(video_context, video_frame) < 0) {
-			synfig::error("Target_LibAVCodec: error sending a frame for encoding");
-			close();
+		std::unique_lock<std::mutex> lock(mutex);
+		while(!failed && frames >= max_frames)
+			ThreadPool::instance().wait(cond, lock);
+		if (failed)
 			return false;
-		}
-		while(true) {
-			int res = avcodec_receive_packet(video_context, packet);
-			if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
-				break;
-			if (res) {
-				synfig::error("Target_LibAVCodec: error during encoding");
-				close();
-				return false;
-			}
 
-			av_packet_rescale_ts(packet, video_context->time_base, video_stream->time_base);
-			packet->stream_index = video_stream->index;
+		++frames;
+		if (free_frames.empty()) {
+			frame = new Frame();
+			frame->rgb.resize((size_t)rgb_pitch*video_context->height);
+		} else {
+			frame = free_frames.back();
+			free_frames.pop_back();
+		}
+		return true;
+	}
 
-			res = av_interleaved_write_frame(context, packet);
-			av_packet_unref(packet);
-			if (res < 0) {
-				synfig::error("Target_LibAVCodec: error while writing video frame");
-				close();
-				return false;
-			}
-	    }
+	//! Passes the rendered frame to the conversion and returns immediately
+	bool end_frame(bool last_frame) {
+		if (!frame)
+			return false;
 
-	    // increment frame counter
+		frame->pts = next_pts++;
+		converter_queue.enqueue( sigc::bind( sigc::mem_fun(this, &Internal::convert_frame), frame ));
+		frame = NULL;
 
 		if (last_frame)
-			close();
-		else
-			++video_frame->pts;
+			return close();
 
-		return true;
+		std::lock_guard<std::mutex> lock(mutex);
+		return !failed;
 	}
 
-	void close() {
+	bool close() {
+		bool success = stop_pipeline();
+
 		if (headers_sent) {
-			if (av_write_trailer(context) < 0)
+			if (av_write_trailer(context) < 0) {
 				synfig::error("Target_LibAVCodec: could not write format trailer");
+				success = false;
+			}
 			headers_sent = false;
 		}
 
 		if (video_context) avcodec_free_context(&video_context);
-		if (video_swscale_context) {
-			sws_freeContext(video_swscale_context);
-			video_swscale_context = NULL;
-		}
-		if (video_frame) av_frame_free(&video_frame);
-		if (video_frame_rgb) av_frame_free(&video_frame_rgb);
+		for(std::vector<SwsContext*>::iterator i = free_swscale_contexts.begin(); i != free_swscale_contexts.end(); ++i)
+			sws_freeContext(*i);
+		free_swscale_contexts.clear();
+		if (packet) av_packet_free(&packet);
 		video_stream = NULL;
 		video_codec = NULL;
 
@@ -408,6 +583,8 @@ public:
 			avformat_free_context(context);
 			context = NULL;
 		}
+
+		return success;
 	}
 };
 
@@ -415,11 +592,16 @@ public:
 
 Target_LibAVCodec::Target_LibAVCodec(
 	const char *filename,
-	const synfig::TargetParam &/*params*/
+	const synfig::TargetParam &params
 ):
-	internal(new Internal()),
-	filename(filename)
-{ }
+	internal(new Internal(params.encoder_jobs)),
+	filename(filename),
+	scanline()
+{
+	PixelDither dither;
+	if (pixel_dither_from_name(params.dither, dither))
+		set_dither(dither);
+}
 
 Target_LibAVCodec::~Target_LibAVCodec()
 	{ delete internal; }
@@ -462,23 +644,47 @@ Target_LibAVCodec::set_rend_desc(RendDesc *given_desc)
 
 void
 Target_LibAVCodec::end_frame()
-	{ internal->encode_frame(surface, curr_frame_ > desc.get_frame_end()); }
+{
+	if (!internal->end_frame(curr_frame_ > desc.get_frame_end()))
+		synfig::error("Target_LibAVCodec: unable to encode the frame");
+}
 
 bool
 Target_LibAVCodec::start_frame(synfig::ProgressCallback */*callback*/)
-	{ return true; }
+	{ return internal->start_frame(); }
 
 Color*
 Target_LibAVCodec::start_scanline(int scanline)
-	{ return surface[scanline]; }
+{
+	this->scanline = scanline;
+	return &color_buffer.front();
+}
 
 bool
 Target_LibAVCodec::end_scanline()
-	{ return true; }
+{
+	unsigned char *row = internal->get_rgb_row(scanline);
+	if (!row || scanline < 0 || scanline >= desc.get_h())
+		return false;
+	color_to_pixelformat(row, &color_buffer.front(), PF_RGB, NULL, desc.get_w(), 1, 0, 0, get_dither(), 0, scanline);
+	return true;
+}
+
+bool
+Target_LibAVCodec::put_rows(const Surface &surface, int y)
+{
+	unsigned char *row = internal->get_rgb_row(0);
+	if (!row || y < 0 || y + surface.get_h() > desc.get_h() || surface.get_w() != desc.get_w())
+		return false;
+
+	const int pitch = internal->get_rgb_pitch();
+	convert_rows(row + (size_t)y*pitch, pitch, surface, PF_RGB, NULL, y);
+	return true;
+}
 
 bool Target_LibAVCodec::init(synfig::ProgressCallback */*cb*/)
 {
-	surface.set_wh(desc.get_w(), desc.get_h());
+	color_buffer.resize(desc.get_w());
 	if (!internal->open(filename, desc)) {
 		synfig::warning("Target_LibAVCodec: unable to initialize encoders");
 		return false;
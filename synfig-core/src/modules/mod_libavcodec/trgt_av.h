@@ -31,6 +31,7 @@
 #include <synfig/string.h>
 #include <synfig/targetparam.h>
 #include <cstdio>
+#include <vector>
 #include "synfig/surface.h"
 
 /* === M A C R O S ========================================================= */
@@ -47,7 +48,8 @@ private:
 	Internal *internal;
 
 	synfig::String filename;
-	synfig::Surface	surface;
+	std::vector<synfig::Color> color_buffer;
+	int scanline;
 
 public:
 	Target_LibAVCodec(
@@ -62,6 +64,9 @@ public:
 	virtual void end_frame();
 	virtual synfig::Color * start_scanline(int scanline);
 	virtual bool end_scanline();
+
+	virtual bool can_put_rows() const { return true; }
+	virtual bool put_rows(const synfig::Surface &surface, int y);
 };
 
 /* === E N D =============================================================== */
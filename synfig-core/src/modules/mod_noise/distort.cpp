@@ -44,6 +44,7 @@
 #include <synfig/surface.h>
 #include <synfig/value.h>
 #include <synfig/valuenode.h>
+#include <synfig/rendering/common/task/taskwarp.h>
 #include <time.h>
 
 #endif
@@ -65,6 +66,95 @@ SYNFIG_LAYER_SET_CVS_ID(NoiseDistort,"$Id$");
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+class NoiseDistortMapping: public rendering::TaskWarp::Mapping
+{
+public:
+	Vector displacement;
+	Vector size;
+	RandomNoise random;
+	int smooth;
+	int detail;
+	Real speed;
+	bool turbulent;
+	Time time_mark;
+
+	NoiseDistortMapping(
+		const Vector &displacement,
+		const Vector &size,
+		int seed,
+		int smooth,
+		int detail,
+		Real speed,
+		bool turbulent,
+		const Time &time_mark
+	):
+		displacement(displacement),
+		size(size),
+		smooth(smooth),
+		detail(detail),
+		speed(speed),
+		turbulent(turbulent),
+		time_mark(time_mark)
+	{
+		random.set_seed(seed);
+	}
+
+	Point distort(const Point &point) const
+	{
+		float x(point[0]/size[0]*(1<<detail));
+		float y(point[1]/size[1]*(1<<detail));
+
+		int i;
+		Time time = speed*time_mark;
+		int smooth_type((!speed && smooth == (int)(RandomNoise::SMOOTH_SPLINE)) ? (int)(RandomNoise::SMOOTH_FAST_SPLINE) : smooth);
+
+		Vector vect(0,0);
+		for(i=0;i<detail;i++)
+		{
+			vect[0]=random(RandomNoise::SmoothType(smooth_type),0+(detail-i)*5,x,y,time)+vect[0]*0.5;
+			vect[1]=random(RandomNoise::SmoothType(smooth_type),1+(detail-i)*5,x,y,time)+vect[1]*0.5;
+
+			if (vect[0] < -1) vect[0] = -1;
+			if (vect[0] >  1) vect[0] =  1;
+
+			if (vect[1] < -1) vect[1] = -1;
+			if (vect[1] >  1) vect[1] =  1;
+
+			if(turbulent)
+			{
+				vect[0]=abs(vect[0]);
+				vect[1]=abs(vect[1]);
+			}
+
+			x/=2.0f;
+			y/=2.0f;
+		}
+
+		if(!turbulent)
+		{
+			vect[0]=vect[0]/2.0f+0.5f;
+			vect[1]=vect[1]/2.0f+0.5f;
+		}
+		vect[0]=(vect[0]-0.5f)*displacement[0];
+		vect[1]=(vect[1]-0.5f)*displacement[1];
+
+		return point+vect;
+	}
+
+	virtual bool map(Point &point, int /* quality */) const
+		{ point = distort(point); return true; }
+
+	// points are moved by half of displacement at most
+	virtual Rect map_bounds(const Rect &rect, const Vector& /* resolution */, int /* quality */) const
+		{ return Rect(rect).expand_x(fabs(displacement[0])*0.5).expand_y(fabs(displacement[1])*0.5); }
+	virtual Rect unmap_bounds(const Rect &bounds) const
+		{ return Rect(bounds).expand_x(fabs(displacement[0])*0.5).expand_y(fabs(displacement[1])*0.5); }
+};
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 NoiseDistort::NoiseDistort():
@@ -84,54 +174,15 @@ NoiseDistort::NoiseDistort():
 inline Point
 NoiseDistort::point_func(const Point &point)const
 {
-	Vector displacement=param_displacement.get(Vector());
-	Vector size=param_size.get(Vector());
-	RandomNoise random;
-	random.set_seed(param_random.get(int()));
-	int smooth_=param_smooth.get(int());
-	int detail=param_detail.get(int());
-	Real speed=param_speed.get(Real());
-	bool turbulent=param_turbulent.get(bool());
-	
-	float x(point[0]/size[0]*(1<<detail));
-	float y(point[1]/size[1]*(1<<detail));
-	
-	int i;
-	Time time = speed*get_time_mark();
-	int temp_smooth(smooth_);
-	int smooth((!speed && temp_smooth == (int)(RandomNoise::SMOOTH_SPLINE)) ? (int)(RandomNoise::SMOOTH_FAST_SPLINE) : temp_smooth);
-	
-	Vector vect(0,0);
-	for(i=0;i<detail;i++)
-	{
-		vect[0]=random(RandomNoise::SmoothType(smooth),0+(detail-i)*5,x,y,time)+vect[0]*0.5;
-		vect[1]=random(RandomNoise::SmoothType(smooth),1+(detail-i)*5,x,y,time)+vect[1]*0.5;
-		
-		if (vect[0] < -1) vect[0] = -1;
-		if (vect[0] >  1) vect[0] =  1;
-		
-		if (vect[1] < -1) vect[1] = -1;
-		if (vect[1] >  1) vect[1] =  1;
-		
-		if(turbulent)
-		{
-			vect[0]=abs(vect[0]);
-			vect[1]=abs(vect[1]);
-		}
-		
-		x/=2.0f;
-		y/=2.0f;
-	}
-	
-	if(!turbulent)
-	{
-		vect[0]=vect[0]/2.0f+0.5f;
-		vect[1]=vect[1]/2.0f+0.5f;
-	}
-	vect[0]=(vect[0]-0.5f)*displacement[0];
-	vect[1]=(vect[1]-0.5f)*displacement[1];
-	
-	return point+vect;
+	return NoiseDistortMapping(
+		param_displacement.get(Vector()),
+		param_size.get(Vector()),
+		param_random.get(int()),
+		param_smooth.get(int()),
+		param_detail.get(int()),
+		param_speed.get(Real()),
+		param_turbulent.get(bool()),
+		get_time_mark() ).distort(point);
 }
 
 inline Color
@@ -362,5 +413,21 @@ NoiseDistort::accelerated_render(Context context,Surface *surface,int quality, c
 */
 
 rendering::Task::Handle
-NoiseDistort::build_rendering_task_vfunc(Context context) const
-	{ return Layer::build_rendering_task_vfunc(context); }
+NoiseDistort::build_composite_fork_task_vfunc(ContextParams /* context_params */, rendering::Task::Handle sub_task)const
+{
+	if (!sub_task)
+		return sub_task;
+
+	rendering::TaskWarp::Handle task_warp(new rendering::TaskWarp());
+	task_warp->mapping = new NoiseDistortMapping(
+		param_displacement.get(Vector()),
+		param_size.get(Vector()),
+		param_random.get(int()),
+		param_smooth.get(int()),
+		param_detail.get(int()),
+		param_speed.get(Real()),
+		param_turbulent.get(bool()),
+		get_time_mark() );
+	task_warp->sub_task() = sub_task;
+	return task_warp;
+}
@@ -84,7 +84,7 @@ public:
 
 protected:
 	virtual synfig::RendDesc get_sub_renddesc_vfunc(const synfig::RendDesc &renddesc) const;
-	virtual synfig::rendering::Task::Handle build_rendering_task_vfunc(synfig::Context context) const;
+	virtual synfig::rendering::Task::Handle build_composite_fork_task_vfunc(synfig::ContextParams context_params, synfig::rendering::Task::Handle sub_task)const;
 }; // EOF of class NoiseDistort
 
 /* === E N D =============================================================== */
@@ -37,6 +37,8 @@
 #include <cstdio>
 #include <algorithm>
 #include <functional>
+#include <sigc++/bind.h>
+#include <synfig/general.h>
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -58,7 +60,24 @@ SYNFIG_TARGET_SET_CVS_ID(exr_trgt,"$Id$");
 bool
 exr_trgt::ready()
 {
-	return (bool)exr_file;
+	return frame && frame->exr_file;
+}
+
+void
+exr_trgt::write_frame(FrameHandle frame)
+{
+	try
+	{
+		frame->exr_file->setFrameBuffer(frame->out_surface[0],1,frame->out_surface.get_w());
+		frame->exr_file->writePixels(frame->out_surface.get_h());
+	}
+	catch(const std::exception &e)
+	{
+		synfig::error("exr_trgt: %s", e.what());
+	}
+
+	delete frame->exr_file;
+	frame->exr_file=NULL;
 }
 
 exr_trgt::exr_trgt(const char *Filename, const synfig::TargetParam &params):
@@ -66,9 +85,8 @@ exr_trgt::exr_trgt(const char *Filename, const synfig::TargetParam &params):
 	imagecount(0),
 	scanline(),
 	filename(Filename),
-	exr_file(NULL),
-	buffer(NULL),
-	buffer_color(NULL)
+	buffer_color(NULL),
+	encoder_queue(params.encoder_jobs)
 {
 	// OpenEXR uses linear gamma
 	sequence_separator = params.sequence_separator;
@@ -76,8 +94,8 @@ exr_trgt::exr_trgt(const char *Filename, const synfig::TargetParam &params):
 
 exr_trgt::~exr_trgt()
 {
-	if(exr_file) delete exr_file;
-	if(buffer) delete [] buffer;
+	frame.reset();
+	encoder_queue.wait();
 	if(buffer_color) delete [] buffer_color;
 }
 
@@ -101,8 +119,7 @@ exr_trgt::start_frame(synfig::ProgressCallback *cb)
 
 	String frame_name;
 
-	if(exr_file)
-		delete exr_file;
+	frame.reset();
 	if(multi_image)
 	{
 		frame_name = (filename_sans_extension(filename) +
@@ -116,12 +133,11 @@ exr_trgt::start_frame(synfig::ProgressCallback *cb)
 		frame_name=filename;
 		if(cb)cb->task(filename);
 	}
-	exr_file=new Imf::RgbaOutputFile(frame_name.c_str(),w,h,Imf::WRITE_RGBA,desc.get_pixel_aspect());
+	frame=FrameHandle(new Frame());
+	frame->exr_file=new Imf::RgbaOutputFile(frame_name.c_str(),w,h,Imf::WRITE_RGBA,desc.get_pixel_aspect());
 	if(buffer_color) delete [] buffer_color;
 	buffer_color=new Color[w];
-	//if(buffer) delete [] buffer;
-	//buffer=new Imf::Rgba[w];
-	out_surface.set_wh(w,h);
+	frame->out_surface.set_wh(w,h);
 
 	return true;
 }
@@ -129,15 +145,17 @@ exr_trgt::start_frame(synfig::ProgressCallback *cb)
 void
 exr_trgt::end_frame()
 {
-	if(exr_file)
+	if(ready())
 	{
-		exr_file->setFrameBuffer(out_surface[0],1,desc.get_w());
-		exr_file->writePixels(desc.get_h());
-
-		delete exr_file;
+		// files of the sequence are independent, so compress them in background
+		// while the next frames are rendering
+		if(multi_image)
+			encoder_queue.enqueue(sigc::bind(sigc::ptr_fun(&exr_trgt::write_frame), frame));
+		else
+			write_frame(frame);
 	}
 
-	exr_file=0;
+	frame.reset();
 
 	imagecount++;
 }
@@ -158,8 +176,7 @@ exr_trgt::end_scanline()
 	int i;
 	for(i=0;i<desc.get_w();i++)
 	{
-//		Imf::Rgba &rgba=buffer[i];
-		Imf::Rgba &rgba=out_surface[scanline][i];
+		Imf::Rgba &rgba=frame->out_surface[scanline][i];
 		Color &color=buffer_color[i];
 		rgba.r=color.get_r();
 		rgba.g=color.get_g();
@@ -167,8 +184,5 @@ exr_trgt::end_scanline()
 		rgba.a=color.get_a();
 	}
 
-    //exr_file->setFrameBuffer(buffer,1,desc.get_w());
-	//exr_file->writePixels(1);
-
 	return true;
 }
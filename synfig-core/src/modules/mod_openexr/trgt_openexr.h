@@ -33,7 +33,9 @@
 #include <synfig/string.h>
 #include <synfig/surface.h>
 #include <synfig/targetparam.h>
+#include <synfig/encoderqueue.h>
 #include <cstdio>
+#include <memory>
 #include <OpenEXR/ImfArray.h>
 #include <OpenEXR/ImfRgbaFile.h>
 #include <exception>
@@ -48,16 +50,30 @@ class exr_trgt : public synfig::Target_Scanline
 {
 public:
 private:
+	//! Rendered frame, it's written to the file after the rendering
+	struct Frame
+	{
+		Imf::RgbaOutputFile *exr_file;
+		etl::surface<Imf::Rgba> out_surface;
+
+		Frame(): exr_file(NULL) { }
+		~Frame() { delete exr_file; }
+	};
+
+	typedef std::shared_ptr<Frame> FrameHandle;
+
+	//! Writes the pixels and closes the file, may be called from any thread
+	static void write_frame(FrameHandle frame);
+
 	bool multi_image;
 	int imagecount,scanline;
 	synfig::String filename;
-	Imf::RgbaOutputFile *exr_file;
-	Imf::Rgba *buffer;
-	etl::surface<Imf::Rgba> out_surface;
 	synfig::Color *buffer_color;
+	FrameHandle frame;
 
 	bool ready();
 	synfig::String sequence_separator;
+	synfig::EncoderQueue encoder_queue;
 public:
 	exr_trgt(const char *filename, const synfig::TargetParam& /* params */);
 	virtual ~exr_trgt();
@@ -45,14 +45,24 @@
 #include <synfig/value.h>
 #include <synfig/valuenode.h>
 
+#include <synfig/threadpool.h>
+
 #include <ETL/calculus>
 #include <ETL/bezier>
 #include <ETL/hermite>
+#include <algorithm>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <time.h>
 
 #include <synfig/valuenodes/valuenode_bline.h>
 
+#include <synfig/rendering/software/function/strips.h>
+#include <synfig/rendering/software/task/tasksw.h>
+
 #endif
 
 using namespace etl;
@@ -66,6 +76,8 @@ using namespace etl;
 #define EPSILON				(0.000000001)
 #define CUSP_TANGENT_ADJUST	(0.025)
 
+#define DEFAULT_PLANT_CACHE_SIZE_MB 64
+
 /* === G L O B A L S ======================================================= */
 
 SYNFIG_LAYER_INIT(Plant);
@@ -77,6 +89,309 @@ SYNFIG_LAYER_SET_CVS_ID(Plant,"$Id$");
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+//! Parameters of the growth shared by all branches
+struct Growth
+{
+	int splits;
+	Real step;
+	Vector gravity;
+	Real drag;
+	Gradient gradient;
+	Angle split_angle;
+	Real random_factor;
+	Random random;
+
+	Growth(): splits(), step(), drag(), random_factor() { }
+};
+
+//! Branch sprouted from the stem, grows independently from other branches
+struct BranchJob
+{
+	const Growth *growth;
+	int n;
+	float stunt_growth;
+	Point position;
+	Vector velocity;
+	size_t stem_particles; //!< count of the stem particles drawn before this branch
+
+	std::vector<Plant::Particle> particles;
+	Rect bounds;
+
+	BranchJob(): growth(), n(), stunt_growth(), stem_particles(), bounds(Rect::zero()) { }
+};
+
+void
+branch(const Growth &g, std::vector<Plant::Particle> &particles, Rect &bounds, int n, int depth, float t, float stunt_growth, Point position, Vector vel)
+{
+	float next_split((1.0-t)/(g.splits-depth)+t/*+random_factor*random(40+depth,t*splits,0,0)/splits*/);
+	for(;t<next_split;t+=g.step)
+	{
+		vel[0]+=g.gravity[0]*g.step;
+		vel[1]+=g.gravity[1]*g.step;
+		vel*=(1.0-(g.drag)*g.step);
+		position[0]+=vel[0]*g.step;
+		position[1]+=vel[1]*g.step;
+
+		particles.push_back(Plant::Particle(position, g.gradient(t)));
+		bounds.expand(position);
+	}
+
+	if(t>=1.0-stunt_growth)return;
+
+	synfig::Real sin_v=synfig::Angle::cos(g.split_angle).get();
+	synfig::Real cos_v=synfig::Angle::sin(g.split_angle).get();
+
+	synfig::Vector velocity1(vel[0]*sin_v - vel[1]*cos_v + g.random_factor*g.random(Random::SMOOTH_COSINE, 30+n+depth, t*g.splits, 0.0f, 0.0f),
+							 vel[0]*cos_v + vel[1]*sin_v + g.random_factor*g.random(Random::SMOOTH_COSINE, 32+n+depth, t*g.splits, 0.0f, 0.0f));
+	synfig::Vector velocity2(vel[0]*sin_v + vel[1]*cos_v + g.random_factor*g.random(Random::SMOOTH_COSINE, 31+n+depth, t*g.splits, 0.0f, 0.0f),
+							-vel[0]*cos_v + vel[1]*sin_v + g.random_factor*g.random(Random::SMOOTH_COSINE, 33+n+depth, t*g.splits, 0.0f, 0.0f));
+
+	branch(g, particles, bounds, n, depth+1, t, stunt_growth, position, velocity1);
+	branch(g, particles, bounds, n, depth+1, t, stunt_growth, position, velocity2);
+}
+
+void
+run_branch_job(BranchJob *job)
+	{ branch(*job->growth, job->particles, job->bounds, job->n, 0, 0, job->stunt_growth, job->position, job->velocity); }
+
+//! Raw bytes of the parameters, used as the key of the cache
+class KeyWriter
+{
+private:
+	String data;
+
+public:
+	template<typename T>
+	void add(const T &x)
+		{ data.append((const char*)&x, sizeof(x)); }
+	const String& get_data() const
+		{ return data; }
+};
+
+//! Simulated plants shared between all plant layers and frames,
+//! the least recently used plants are dropped when the total size
+//! exceeds the budget (SYNFIG_PLANT_CACHE_SIZE environment variable, in megabytes)
+class PlantCache
+{
+private:
+	struct Entry
+	{
+		String key;
+		Plant::ParticleData::Handle data;
+		size_t bytes;
+		Entry(): bytes() { }
+	};
+
+	typedef std::list<Entry> List;
+	typedef std::unordered_map<String, List::iterator> Map;
+
+	std::mutex mutex;
+	List entries; //!< most recently used entries are at the front
+	Map map;
+	size_t bytes;
+	size_t budget;
+
+	PlantCache():
+		bytes(),
+		budget((size_t)DEFAULT_PLANT_CACHE_SIZE_MB << 20)
+	{
+		if (const char *s = getenv("SYNFIG_PLANT_CACHE_SIZE"))
+			budget = (size_t)std::max(0, atoi(s)) << 20;
+	}
+
+public:
+	static PlantCache& instance()
+	{
+		static PlantCache cache;
+		return cache;
+	}
+
+	Plant::ParticleData::Handle get(const String &key)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Map::iterator i = map.find(key);
+		if (i == map.end())
+			return Plant::ParticleData::Handle();
+		entries.splice(entries.begin(), entries, i->second);
+		return i->second->data;
+	}
+
+	void put(const String &key, const Plant::ParticleData::Handle &data)
+	{
+		Entry entry;
+		entry.key = key;
+		entry.data = data;
+		entry.bytes = 2*key.size() + sizeof(*data)
+		            + data->particles.capacity()*sizeof(Plant::Particle);
+		if (entry.bytes > budget)
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (map.count(key))
+			return;
+		entries.push_front(entry);
+		map[key] = entries.begin();
+		bytes += entry.bytes;
+
+		while(bytes > budget) {
+			bytes -= entries.back().bytes;
+			map.erase(entries.back().key);
+			entries.pop_back();
+		}
+	}
+};
+
+
+class TaskPlant: public rendering::Task
+{
+public:
+	typedef etl::handle<TaskPlant> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	Plant::ParticleData::Handle data;
+	Point origin;
+	Real size;
+	bool reverse;
+	bool size_as_alpha;
+
+	TaskPlant(): size(), reverse(), size_as_alpha() { }
+
+	virtual int get_pass_subtask_index() const
+		{ return data && !data->particles.empty() ? PASSTO_THIS_TASK : PASSTO_NO_TASK; }
+
+	virtual Rect calc_bounds() const
+	{
+		if (!data || data->particles.empty())
+			return Rect::zero();
+		Rect bounds = data->bounds;
+		bounds += origin;
+		bounds.expand(std::fabs(size));
+		return bounds;
+	}
+};
+
+
+//! Draws all particles at once: the boxes of the particles are calculated
+//! in one pass, then the target is split into strips, and each thread
+//! splats the boxes crossing its strip in the original order
+class TaskPlantSW: public TaskPlant, public rendering::TaskSW
+{
+public:
+	typedef etl::handle<TaskPlantSW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+private:
+	struct Box
+	{
+		float x1, y1, x2, y2;
+		Color color;
+	};
+
+	struct Params
+	{
+		synfig::Surface *surface;
+		const std::vector<Box> *boxes;
+		Params(): surface(), boxes() { }
+	};
+
+	static void draw_box(synfig::Surface &surface, const RectInt &rect, const Box &box)
+	{
+		const int x0 = std::max(rect.minx, (int)std::floor(box.x1));
+		const int x1 = std::min(rect.maxx, (int)std::ceil(box.x2));
+		const int y0 = std::max(rect.miny, (int)std::floor(box.y1));
+		const int y1 = std::min(rect.maxy, (int)std::ceil(box.y2));
+		for(int y = y0; y < y1; ++y)
+		{
+			// amount of the pixel covered by the box
+			const ColorReal ky = std::min(float(y + 1), box.y2) - std::max(float(y), box.y1);
+			Color *c = &surface[y][x0];
+			for(int x = x0; x < x1; ++x, ++c)
+			{
+				const ColorReal kx = std::min(float(x + 1), box.x2) - std::max(float(x), box.x1);
+				*c = Color::blend(box.color, *c, kx*ky, Color::BLEND_COMPOSITE);
+			}
+		}
+	}
+
+	static void process_rect(const Params *p, RectInt rect)
+	{
+		for(std::vector<Box>::const_iterator i = p->boxes->begin(); i != p->boxes->end(); ++i)
+			if (i->y2 > rect.miny && i->y1 < rect.maxy)
+				draw_box(*p->surface, rect, *i);
+	}
+
+public:
+	virtual bool run(RunParams&) const
+	{
+		if (!is_valid() || !data || data->particles.empty())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+
+		Params p;
+		p.surface = &ldst->get_surface();
+
+		const RectInt rect = RectInt(0, 0, p.surface->get_w(), p.surface->get_h()) & target_rect;
+		if (!rect.is_valid())
+			return true;
+
+		const Vector ppu = get_pixels_per_unit();
+		const Vector offset(
+			target_rect.minx - (source_rect.minx - origin[0])*ppu[0],
+			target_rect.miny - (source_rect.miny - origin[1])*ppu[1] );
+		const Real radius = size*std::sqrt(std::fabs(ppu[0]*ppu[1]));
+
+		// calculate the boxes in pixels, skip the boxes out of the target
+		const std::vector<Plant::Particle> &particles = data->particles;
+		std::vector<Box> boxes;
+		boxes.reserve(particles.size());
+		for(size_t i = 0; i < particles.size(); ++i)
+		{
+			const Plant::Particle &particle = particles[reverse ? particles.size() - i - 1 : i];
+
+			Box box;
+			box.color = particle.color;
+			float scaled_radius(radius);
+			if (size_as_alpha)
+			{
+				scaled_radius *= box.color.get_a();
+				box.color.set_a(1);
+			}
+
+			const Point center = particle.point.multiply_coords(ppu) + offset;
+			box.x1 = center[0] - scaled_radius*0.5;
+			box.x2 = center[0] + scaled_radius*0.5;
+			box.y1 = center[1] - scaled_radius*0.5;
+			box.y2 = center[1] + scaled_radius*0.5;
+			if ( box.x1 < box.x2 && box.y1 < box.y2
+			  && box.x2 > rect.minx && box.x1 < rect.maxx
+			  && box.y2 > rect.miny && box.y1 < rect.maxy )
+				boxes.push_back(box);
+		}
+		p.boxes = &boxes;
+
+		if (boxes.size() < 1024)
+			process_rect(&p, rect);
+		else
+			rendering::software::run_strips(&TaskPlantSW::process_rect, &p, rect);
+
+		return true;
+	}
+};
+
+rendering::Task::Token TaskPlant::token(
+	DescAbstract<TaskPlant>("Plant") );
+rendering::Task::Token TaskPlantSW::token(
+	DescReal<TaskPlantSW, TaskPlant>("PlantSW") );
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 
@@ -128,49 +443,6 @@ Plant::Plant():
 	SET_STATIC_DEFAULTS();
 }
 
-void
-Plant::branch(int n,int depth,float t, float stunt_growth, synfig::Point position,synfig::Vector vel)const
-{
-	int splits=param_splits.get(int());
-	Real step=param_step.get(Real());
-	Vector gravity=param_gravity.get(Vector());
-	Real drag=param_drag.get(Real());
-	Gradient gradient=param_gradient.get(Gradient());
-	Angle split_angle=param_split_angle.get(Angle());
-	Real random_factor=param_random_factor.get(Real());
-	Random random;
-	random.set_seed(param_random.get(int()));
-	
-	float next_split((1.0-t)/(splits-depth)+t/*+random_factor*random(40+depth,t*splits,0,0)/splits*/);
-	for(;t<next_split;t+=step)
-	{
-		vel[0]+=gravity[0]*step;
-		vel[1]+=gravity[1]*step;
-		vel*=(1.0-(drag)*step);
-		position[0]+=vel[0]*step;
-		position[1]+=vel[1]*step;
-
-		particle_list.push_back(Particle(position, gradient(t)));
-		if (particle_list.size() % 1000000 == 0)
-			synfig::info("constructed %d million particles...", particle_list.size()/1000000);
-
-		bounding_rect.expand(position);
-	}
-
-	if(t>=1.0-stunt_growth)return;
-
-	synfig::Real sin_v=synfig::Angle::cos(split_angle).get();
-	synfig::Real cos_v=synfig::Angle::sin(split_angle).get();
-
-	synfig::Vector velocity1(vel[0]*sin_v - vel[1]*cos_v + random_factor*random(Random::SMOOTH_COSINE, 30+n+depth, t*splits, 0.0f, 0.0f),
-							 vel[0]*cos_v + vel[1]*sin_v + random_factor*random(Random::SMOOTH_COSINE, 32+n+depth, t*splits, 0.0f, 0.0f));
-	synfig::Vector velocity2(vel[0]*sin_v + vel[1]*cos_v + random_factor*random(Random::SMOOTH_COSINE, 31+n+depth, t*splits, 0.0f, 0.0f),
-							-vel[0]*cos_v + vel[1]*sin_v + random_factor*random(Random::SMOOTH_COSINE, 33+n+depth, t*splits, 0.0f, 0.0f));
-
-	Plant::branch(n,depth+1,t,stunt_growth,position,velocity1);
-	Plant::branch(n,depth+1,t,stunt_growth,position,velocity2);
-}
-
 void
 Plant::calc_bounding_rect()const
 {
@@ -208,12 +480,47 @@ Plant::calc_bounding_rect()const
 	bounding_rect.expand_y(size);
 }
 
+String
+Plant::get_cache_key()const
+{
+	const std::vector<BLinePoint> bline(param_bline.get_list_of(BLinePoint()));
+	const Gradient gradient(param_gradient.get(Gradient()));
+
+	KeyWriter key;
+	key.add(bline_loop);
+	key.add(bline.size());
+	for(std::vector<BLinePoint>::const_iterator i = bline.begin(); i != bline.end(); ++i)
+	{
+		key.add(i->get_vertex());
+		key.add(i->get_tangent1());
+		key.add(i->get_tangent2());
+		key.add(i->get_width());
+	}
+	key.add(gradient.size());
+	for(Gradient::const_iterator i = gradient.begin(); i != gradient.end(); ++i)
+	{
+		key.add(i->pos);
+		key.add(i->color);
+	}
+	key.add(param_random.get(int()));
+	key.add(Angle::rad(param_split_angle.get(Angle())).get());
+	key.add(param_gravity.get(Vector()));
+	key.add(param_velocity.get(Real()));
+	key.add(param_perp_velocity.get(Real()));
+	key.add(param_step.get(Real()));
+	key.add(param_splits.get(int()));
+	key.add(param_sprouts.get(int()));
+	key.add(param_random_factor.get(Real()));
+	key.add(param_drag.get(Real()));
+	key.add(param_use_width.get(bool()));
+	return key.get_data();
+}
+
 void
 Plant::sync()const
 {
 	std::vector<BLinePoint> bline(param_bline.get_list_of(BLinePoint()));
 	Real step_=param_step.get(Real());
-	Gradient gradient=param_gradient.get(Gradient());
 	Real random_factor=param_random_factor.get(Real());
 	Random random;
 	random.set_seed(param_random.get(int()));
@@ -225,9 +532,21 @@ Plant::sync()const
 	
 	std::lock_guard<std::mutex> lock(mutex);
 	if (!needs_sync_) return;
+
+	// the same plant may be used by several layers or by several frames
+	const String key = get_cache_key();
+	if (ParticleData::Handle data = PlantCache::instance().get(key))
+	{
+		particle_data = data;
+		bounding_rect = data->bounds;
+		needs_sync_=false;
+		return;
+	}
+
 	time_t start_time; time(&start_time);
-	particle_list.clear();
 
+	ParticleData::Handle data(new ParticleData());
+	particle_data = data;
 	bounding_rect=Rect::zero();
 
 	// Bline must have at least 2 points in it
@@ -237,6 +556,20 @@ Plant::sync()const
 		return;
 	}
 
+	Growth growth;
+	growth.splits=splits;
+	growth.step=step_;
+	growth.gravity=param_gravity.get(Vector());
+	growth.drag=param_drag.get(Real());
+	growth.gradient=param_gradient.get(Gradient());
+	growth.split_angle=param_split_angle.get(Angle());
+	growth.random_factor=random_factor;
+	growth.random=random;
+
+	// particles of the stem, branches are grown later
+	std::vector<Particle> stem;
+	std::list<BranchJob> jobs;
+
 	std::vector<synfig::BLinePoint>::const_iterator iter,next;
 
 	etl::hermite<Vector> curve;
@@ -271,9 +604,7 @@ Plant::sync()const
 		{
 			Point point(curve(f));
 
-			particle_list.push_back(Particle(point, gradient(0)));
-			if (particle_list.size() % 1000000 == 0)
-				synfig::info("constructed %d million particles...", particle_list.size()/1000000);
+			stem.push_back(Particle(point, growth.gradient(0)));
 
 			bounding_rect.expand(point);
 
@@ -298,17 +629,61 @@ Plant::sync()const
 				}
 
 				branch_count++;
-				branch(i, 0, 0,		 // time
-					   stunt_growth, // stunt growth
-					   point, branch_velocity);
+
+				jobs.push_back(BranchJob());
+				BranchJob &job = jobs.back();
+				job.growth = &growth;
+				job.n = i;
+				job.stunt_growth = stunt_growth;
+				job.position = point;
+				job.velocity = branch_velocity;
+				job.stem_particles = stem.size();
 			}
 		}
 	}
 
+	// branches don't depend on each other, so grow them in several threads
+	if (jobs.size() > 1)
+	{
+		ThreadPool::Group group;
+		for(std::list<BranchJob>::iterator i = jobs.begin(); i != jobs.end(); ++i)
+			group.enqueue( sigc::bind(sigc::ptr_fun(&run_branch_job), &*i) );
+		group.run();
+	}
+	else
+	if (!jobs.empty())
+	{
+		run_branch_job(&jobs.front());
+	}
+
+	// merge particles in the same order as they was generated sequentially
+	size_t count = stem.size();
+	for(std::list<BranchJob>::const_iterator i = jobs.begin(); i != jobs.end(); ++i)
+		count += i->particles.size();
+	if (count >= 1000000)
+		synfig::info("constructed %d million particles...", count/1000000);
+
+	std::vector<Particle> &particles = data->particles;
+	particles.reserve(count);
+	size_t stem_index = 0;
+	for(std::list<BranchJob>::iterator i = jobs.begin(); i != jobs.end(); ++i)
+	{
+		particles.insert(particles.end(), stem.begin() + stem_index, stem.begin() + i->stem_particles);
+		stem_index = i->stem_particles;
+		particles.insert(particles.end(), i->particles.begin(), i->particles.end());
+		if (!i->particles.empty())
+			bounding_rect |= i->bounds;
+		std::vector<Particle>().swap(i->particles);
+	}
+	particles.insert(particles.end(), stem.begin() + stem_index, stem.end());
+	data->bounds = bounding_rect;
+
+	PlantCache::instance().put(key, data);
+
 	time_t end_time; time(&end_time);
 	if (end_time-start_time > 4)
 		synfig::info("Plant::sync() constructed %d particles in %d seconds\n",
-					 particle_list.size(), int(end_time-start_time));
+					 particles.size(), int(end_time-start_time));
 	needs_sync_=false;
 }
 
@@ -553,6 +928,21 @@ Plant::accelerated_cairorender(Context context, cairo_t *cr, int quality, const
 }
 
 
+rendering::Task::Handle
+Plant::build_composite_task_vfunc(ContextParams /*context_params*/)const
+{
+	if(needs_sync_==true)
+		sync();
+
+	TaskPlant::Handle task(new TaskPlant());
+	task->data = particle_data;
+	task->origin = param_origin.get(Vector());
+	task->size = param_size.get(Real());
+	task->reverse = param_reverse.get(bool());
+	task->size_as_alpha = param_size_as_alpha.get(bool());
+	return task;
+}
+
 void
 Plant::draw_particles(Surface *dest_surface, const RendDesc &renddesc)const
 {
@@ -577,6 +967,10 @@ Plant::draw_particles(Surface *dest_surface, const RendDesc &renddesc)const
 	if (std::isinf(pw) || std::isinf(ph))
 		return;
 	
+	if (!particle_data)
+		return;
+	std::vector<Particle> &particle_list = particle_data->particles;
+
 	if (particle_list.begin() != particle_list.end())
 	{
 		std::vector<Particle>::iterator iter;
@@ -795,6 +1189,10 @@ Plant::draw_particles(cairo_t *cr)const
 	bool reverse=param_reverse.get(bool());
 	bool size_as_alpha=param_size_as_alpha.get(bool());
 
+	if (!particle_data)
+		return;
+	std::vector<Particle> &particle_list = particle_data->particles;
+
 	if (particle_list.begin() != particle_list.end())
 	{
 		std::vector<Particle>::iterator iter;
@@ -51,6 +51,28 @@ using namespace etl;
 class Plant : public Layer_Composite, public Layer_NoDeform
 {
 	SYNFIG_LAYER_MODULE_EXT
+public:
+	struct Particle
+	{
+		Point point;
+		Color color;
+
+		Particle(const Point &point,const Color& color):
+			point(point),color(color) { }
+	};
+
+	//! Result of the growth simulation, shared between the layers
+	//! and the frames with the same parameters
+	struct ParticleData: public etl::shared_object
+	{
+		typedef etl::handle<ParticleData> Handle;
+
+		std::vector<Particle> particles;
+		Rect bounds;
+
+		ParticleData(): bounds(Rect::zero()) { }
+	};
+
 private:
 	//! Parameter: (std::vector<BLinePoint>)
 	ValueBase param_bline;
@@ -89,23 +111,14 @@ private:
 
 	bool bline_loop;
 
-	struct Particle
-	{
-		Point point;
-		Color color;
-
-		Particle(const Point &point,const Color& color):
-			point(point),color(color) { }
-	};
-
-	mutable std::vector<Particle> particle_list;
+	mutable ParticleData::Handle particle_data;
 	mutable Rect	bounding_rect;
 	Real mass;
 
 	mutable bool needs_sync_;
 	mutable std::mutex mutex;
 
-	void branch(int n, int depth,float t, float stunt_growth, Point position,Vector velocity)const;
+	String get_cache_key()const;
 	void sync()const;
 	String version;
 	void draw_particles(Surface *surface, const RendDesc &renddesc)const;
@@ -129,6 +142,9 @@ public:
 	virtual bool accelerated_cairorender(Context context, cairo_t *cr, int quality, const RendDesc &renddesc, ProgressCallback *cb)const;
 	using Layer::get_bounding_rect;
 	virtual Rect get_bounding_rect(Context context)const;
+
+protected:
+	virtual rendering::Task::Handle build_composite_task_vfunc(ContextParams context_params)const;
 };
 
 /* === E N D =============================================================== */
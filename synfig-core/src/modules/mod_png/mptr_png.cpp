@@ -46,6 +46,7 @@
 
 
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
 #include <functional>
 #endif
@@ -106,6 +107,22 @@ png_mptr::read_callback(png_structp png_ptr, png_bytep out_bytes, png_size_t byt
 		memset(out_bytes + s, 0, bytes_count_to_read - s);
 }
 
+void
+png_mptr::read_memory_callback(png_structp png_ptr, png_bytep out_bytes, png_size_t bytes_count_to_read)
+{
+	MemoryReader *reader = (MemoryReader*)png_get_io_ptr(png_ptr);
+	png_size_t s = reader == NULL
+				 ? 0
+				 : std::min((size_t)bytes_count_to_read, reader->size - reader->position);
+	if (s > 0)
+	{
+		memcpy(out_bytes, reader->data + reader->position, s);
+		reader->position += s;
+	}
+	if (s < bytes_count_to_read)
+		memset(out_bytes + s, 0, bytes_count_to_read - s);
+}
+
 png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
 	Importer(identifier)
 {
@@ -118,18 +135,28 @@ png_mptr::~png_mptr()
 bool
 png_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddesc*/, Time, synfig::ProgressCallback */*cb*/)
 {
-	/* Open the file pointer */
-	FileSystem::ReadStream::Handle stream = identifier.get_read_stream();
-    if (!stream)
+	/* Use the file placed in memory if possible, or open the file pointer */
+	FileSystem::MappedFile::Handle mapped_file = identifier.get_mapped_file();
+	FileSystem::ReadStream::Handle stream;
+	if (!mapped_file)
+		stream = identifier.get_read_stream();
+    if (!mapped_file && !stream)
     {
         //! \todo THROW SOMETHING
 		throw strprintf("Unable to physically open %s",identifier.filename.c_str());
 		return false;
     }
+	MemoryReader memory_reader(mapped_file ? mapped_file->data() : NULL, mapped_file ? mapped_file->size() : 0);
 
 	/* Make sure we are dealing with a PNG format file */
 	png_byte header[PNG_CHECK_BYTES];
-	if (!stream->read_variable(header))
+	if (mapped_file && memory_reader.size >= sizeof(header))
+	{
+		memcpy(header, memory_reader.data, sizeof(header));
+		memory_reader.position = sizeof(header);
+	}
+	else
+	if (mapped_file || !stream->read_variable(header))
 	{
         //! \todo THROW SOMETHING
 		throw strprintf("Cannot read header from \"%s\"",identifier.filename.c_str());
@@ -173,7 +200,10 @@ png_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddesc
 		return false;
     }
 
-    png_set_read_fn(png_ptr, stream.get(), read_callback);
+	if (mapped_file)
+		png_set_read_fn(png_ptr, &memory_reader, read_memory_callback);
+	else
+		png_set_read_fn(png_ptr, stream.get(), read_callback);
 	png_set_sig_bytes(png_ptr,PNG_CHECK_BYTES);
 
 	png_read_info(png_ptr, info_ptr);
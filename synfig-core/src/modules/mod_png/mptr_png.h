@@ -44,9 +44,19 @@ class png_mptr : public synfig::Importer
 {
 	SYNFIG_IMPORTER_MODULE_EXT
 private:
+	//! Position of reading in the file placed in memory
+	struct MemoryReader
+	{
+		const char *data;
+		size_t size;
+		size_t position;
+		MemoryReader(const char *data, size_t size): data(data), size(size), position() { }
+	};
+
 	static void png_out_error(png_struct *png_data,const char *msg);
 	static void png_out_warning(png_struct *png_data,const char *msg);
 	static void read_callback(png_structp png_ptr, png_bytep out_bytes, png_size_t bytes_count_to_read);
+	static void read_memory_callback(png_structp png_ptr, png_bytep out_bytes, png_size_t bytes_count_to_read);
 
 public:
 	png_mptr(const synfig::FileSystem::Identifier &identifier);
@@ -44,6 +44,7 @@
 #include <functional>
 #include <ETL/misc>
 #include <string.h>
+#include <sigc++/bind.h>
 
 #endif
 
@@ -66,41 +67,161 @@ SYNFIG_TARGET_SET_CVS_ID(png_trgt,"$Id$");
 void
 png_trgt::png_out_error(png_struct *png_data,const char *msg)
 {
-	png_trgt *me=(png_trgt*)png_get_error_ptr(png_data);
 	synfig::error(strprintf("png_trgt: error: %s",msg));
-	me->ready=false;
+	longjmp(png_jmpbuf(png_data),1);
 }
 
 void
-png_trgt::png_out_warning(png_struct *png_data,const char *msg)
+png_trgt::png_out_warning(png_struct */*png_data*/,const char *msg)
 {
-	png_trgt *me=(png_trgt*)png_get_error_ptr(png_data);
 	synfig::warning(strprintf("png_trgt: warning: %s",msg));
-	me->ready=false;
 }
 
+int
+png_trgt::parse_filters(const String &str)
+{
+	int filters=0;
+	String::size_type begin=0;
+	while(begin<=str.size())
+	{
+		String::size_type end=str.find(',',begin);
+		if(end==String::npos) end=str.size();
+		String name=str.substr(begin,end-begin);
+		begin=end+1;
+		name.erase(0,name.find_first_not_of(" \t"));
+		name.erase(name.find_last_not_of(" \t")+1);
+
+		if(name.empty())         continue;
+		else if(name=="none")    filters|=PNG_FILTER_NONE;
+		else if(name=="sub")     filters|=PNG_FILTER_SUB;
+		else if(name=="up")      filters|=PNG_FILTER_UP;
+		else if(name=="avg")     filters|=PNG_FILTER_AVG;
+		else if(name=="paeth")   filters|=PNG_FILTER_PAETH;
+		else if(name=="all")     filters|=PNG_ALL_FILTERS;
+		else synfig::warning(strprintf("png_trgt: unknown png filter '%s' is ignored",name.c_str()));
+	}
+	return filters ? filters : PNG_FILTER_NONE;
+}
+
+bool
+png_trgt::write_frame(Frame &frame)
+{
+	png_structp png_ptr=png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, png_out_error, png_out_warning);
+	if (!png_ptr)
+	{
+		synfig::error("Unable to setup PNG struct");
+		if(frame.file!=stdout) fclose(frame.file);
+		frame.file=NULL;
+		return false;
+	}
+
+	png_infop info_ptr= png_create_info_struct(png_ptr);
+	if (!info_ptr)
+	{
+		synfig::error("Unable to setup PNG info struct");
+		png_destroy_write_struct(&png_ptr,(png_infopp)NULL);
+		if(frame.file!=stdout) fclose(frame.file);
+		frame.file=NULL;
+		return false;
+	}
+
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		if(frame.file!=stdout) fclose(frame.file);
+		frame.file=NULL;
+		return false;
+	}
+	png_init_io(png_ptr,frame.file);
+	png_set_filter(png_ptr,0,frame.filters);
+	if (frame.compression_level>=0)
+		png_set_compression_level(png_ptr,frame.compression_level);
+
+	if (frame.alpha)
+		png_set_IHDR(png_ptr,info_ptr,frame.w,frame.h,8,PNG_COLOR_TYPE_RGBA,PNG_INTERLACE_NONE,PNG_COMPRESSION_TYPE_DEFAULT,PNG_FILTER_TYPE_DEFAULT);
+	else
+		png_set_IHDR(png_ptr,info_ptr,frame.w,frame.h,8,PNG_COLOR_TYPE_RGB,PNG_INTERLACE_NONE,PNG_COMPRESSION_TYPE_DEFAULT,PNG_FILTER_TYPE_DEFAULT);
+
+	// Write the physical size
+	png_set_pHYs(png_ptr,info_ptr,frame.x_res,frame.y_res,PNG_RESOLUTION_METER);
+	
+	// Explicit set gamma value to 2.2 (it's a default value)
+	png_set_gAMA(png_ptr,info_ptr,1/2.2);
+
+	char title      [] = "Title";
+	char description[] = "Description";
+	char software   [] = "Software";
+	char synfig     [] = "SYNFIG";
+
+	// Output any text info along with the file
+	png_text comments[3];
+	memset(comments, 0, sizeof(comments));
+
+	comments[0].compression = PNG_TEXT_COMPRESSION_NONE;
+	comments[0].key         = title;
+	comments[0].text        = const_cast<char *>(frame.title.c_str());
+	comments[0].text_length = strlen(comments[0].text);
+
+	comments[1].compression = PNG_TEXT_COMPRESSION_NONE;
+	comments[1].key         = description;
+	comments[1].text        = const_cast<char *>(frame.description.c_str());
+	comments[1].text_length = strlen(comments[1].text);
+
+	comments[2].compression = PNG_TEXT_COMPRESSION_NONE;
+	comments[2].key         = software;
+	comments[2].text        = synfig;
+	comments[2].text_length = strlen(comments[2].text);
+
+	png_set_text(png_ptr, info_ptr, comments, sizeof(comments)/sizeof(png_text));
+
+	png_write_info_before_PLTE(png_ptr, info_ptr);
+	png_write_info(png_ptr, info_ptr);
+
+	const int pitch=frame.get_pitch();
+	for(int y=0;y<frame.h;y++)
+		png_write_row(png_ptr,&frame.pixels[y*pitch]);
+
+	png_write_end(png_ptr,info_ptr);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+
+	if(frame.file!=stdout)
+		fclose(frame.file);
+	else
+		fflush(frame.file);
+	frame.file=NULL;
+	return true;
+}
+
+void
+png_trgt::write_frame_async(FrameHandle frame)
+	{ write_frame(*frame); }
+
 
 //Target *png_trgt::New(const char *filename){	return new png_trgt(filename);}
 
 png_trgt::png_trgt(const char *Filename, const synfig::TargetParam &params):
-	file(NULL),
-	png_ptr(NULL),
-	info_ptr(NULL),
 	multi_image(),
-	ready(false),
 	imagecount(),
+	scanline(),
 	filename(Filename),
-	buffer(NULL),
 	color_buffer(NULL),
-	sequence_separator(params.sequence_separator)
-{ }
+	sequence_separator(params.sequence_separator),
+	compression_level(std::min(params.compression_level,9)),
+	filters(parse_filters(params.png_filter)),
+	encoder_queue(params.encoder_jobs)
+{
+	PixelDither dither;
+	if (pixel_dither_from_name(params.dither, dither))
+		set_dither(dither);
+}
 
 png_trgt::~png_trgt()
 {
-	if(file)
-		fclose(file);
-	file=NULL;
-	delete [] buffer;
+	// the frame which was not finished
+	if(frame && frame->file && frame->file!=stdout)
+		fclose(frame->file);
+	frame.reset();
+	encoder_queue.wait();
 	delete [] color_buffer;
 }
 
@@ -120,17 +241,17 @@ png_trgt::set_rend_desc(RendDesc *given_desc)
 void
 png_trgt::end_frame()
 {
-	if(ready && file)
+	if(frame && frame->file)
 	{
-		png_write_end(png_ptr,info_ptr);
-		png_destroy_write_struct(&png_ptr, &info_ptr);
+		// files of the sequence are independent, so compress them in background
+		// while the next frames are rendering
+		if(multi_image && frame->file!=stdout)
+			encoder_queue.enqueue(sigc::bind(sigc::ptr_fun(&png_trgt::write_frame_async), frame));
+		else
+			write_frame(*frame);
 	}
-
-	if(file && file!=stdout)
-		fclose(file);
-	file=NULL;
+	frame.reset();
 	imagecount++;
-	ready=false;
 }
 
 bool
@@ -138,8 +259,11 @@ png_trgt::start_frame(synfig::ProgressCallback *callback)
 {
 	int w=desc.get_w(),h=desc.get_h();
 
-	if(file && file!=stdout)
-		fclose(file);
+	if(frame && frame->file && frame->file!=stdout)
+		fclose(frame->file);
+	frame.reset();
+
+	FILE *file=NULL;
 	if(filename=="-")
 	{
 		if(callback)callback->task(strprintf("(stdout) %d",imagecount).c_str());
@@ -163,100 +287,51 @@ png_trgt::start_frame(synfig::ProgressCallback *callback)
 	if(!file)
 		return false;
 
-	delete [] buffer;
-	buffer=new unsigned char[4*w];
-
 	delete [] color_buffer;
 	color_buffer=new Color[w];
 
-	png_ptr=png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)this,png_out_error, png_out_warning);
-	if (!png_ptr)
-	{
-		synfig::error("Unable to setup PNG struct");
-		fclose(file);
-		return false;
-	}
-
-	info_ptr= png_create_info_struct(png_ptr);
-	if (!info_ptr)
-	{
-		synfig::error("Unable to setup PNG info struct");
-		fclose(file);
-		png_destroy_write_struct(&png_ptr,(png_infopp)NULL);
-		return false;
-	}
-
-	if (setjmp(png_jmpbuf(png_ptr)))
-	{
-		synfig::error("Unable to setup longjump");
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		fclose(file);
-		return false;
-	}
-	png_init_io(png_ptr,file);
-	png_set_filter(png_ptr,0,PNG_FILTER_NONE);
-
-	setjmp(png_jmpbuf(png_ptr));
-	if (get_alpha_mode()==TARGET_ALPHA_MODE_KEEP)
-		png_set_IHDR(png_ptr,info_ptr,w,h,8,PNG_COLOR_TYPE_RGBA,PNG_INTERLACE_NONE,PNG_COMPRESSION_TYPE_DEFAULT,PNG_FILTER_TYPE_DEFAULT);
-	else
-		png_set_IHDR(png_ptr,info_ptr,w,h,8,PNG_COLOR_TYPE_RGB,PNG_INTERLACE_NONE,PNG_COMPRESSION_TYPE_DEFAULT,PNG_FILTER_TYPE_DEFAULT);
-
-	// Write the physical size
-	png_set_pHYs(png_ptr,info_ptr,round_to_int(desc.get_x_res()),round_to_int(desc.get_y_res()),PNG_RESOLUTION_METER);
-	
-	// Explicit set gamma value to 2.2 (it's a default value)
-	png_set_gAMA(png_ptr,info_ptr,1/2.2);
-
-	char title      [] = "Title";
-	char description[] = "Description";
-	char software   [] = "Software";
-	char synfig     [] = "SYNFIG";
-
-	// Output any text info along with the file
-	png_text comments[3];
-	memset(comments, 0, sizeof(comments));
-
-	comments[0].compression = PNG_TEXT_COMPRESSION_NONE;
-	comments[0].key         = title;
-	comments[0].text        = const_cast<char *>(get_canvas()->get_name().c_str());
-	comments[0].text_length = strlen(comments[0].text);
-
-	comments[1].compression = PNG_TEXT_COMPRESSION_NONE;
-	comments[1].key         = description;
-	comments[1].text        = const_cast<char *>(get_canvas()->get_description().c_str());
-	comments[1].text_length = strlen(comments[1].text);
-
-	comments[2].compression = PNG_TEXT_COMPRESSION_NONE;
-	comments[2].key         = software;
-	comments[2].text        = synfig;
-	comments[2].text_length = strlen(comments[2].text);
-
-	png_set_text(png_ptr, info_ptr, comments, sizeof(comments)/sizeof(png_text));
-
-	png_write_info_before_PLTE(png_ptr, info_ptr);
-	png_write_info(png_ptr, info_ptr);
-	ready=true;
+	frame=FrameHandle(new Frame());
+	frame->file=file;
+	frame->w=w;
+	frame->h=h;
+	frame->alpha=get_alpha_mode()==TARGET_ALPHA_MODE_KEEP;
+	frame->x_res=round_to_int(desc.get_x_res());
+	frame->y_res=round_to_int(desc.get_y_res());
+	frame->compression_level=compression_level;
+	frame->filters=filters;
+	frame->title=get_canvas()->get_name();
+	frame->description=get_canvas()->get_description();
+	frame->pixels.resize((size_t)frame->get_pitch()*h);
 	return true;
 }
 
 Color *
-png_trgt::start_scanline(int /*scanline*/)
+png_trgt::start_scanline(int y)
 {
+	scanline=y;
 	return color_buffer;
 }
 
 bool
 png_trgt::end_scanline()
 {
-	if(!file || !ready)
+	if(!frame || !frame->file || scanline<0 || scanline>=frame->h)
 		return false;
 
-	PixelFormat pf = get_alpha_mode()==TARGET_ALPHA_MODE_KEEP ? PF_RGB|PF_A : PF_RGB;
-	color_to_pixelformat(buffer, color_buffer, pf, 0, desc.get_w());
+	PixelFormat pf = frame->alpha ? PF_RGB|PF_A : PF_RGB;
+	color_to_pixelformat(&frame->pixels[(size_t)scanline*frame->get_pitch()], color_buffer, pf, 0, frame->w, 1, 0, 0, get_dither(), 0, scanline);
+
+	return true;
+}
+
+bool
+png_trgt::put_rows(const Surface &surface, int y)
+{
+	if(!frame || !frame->file || y<0 || y+surface.get_h()>frame->h || surface.get_w()!=frame->w)
+		return false;
 
-	setjmp(png_jmpbuf(png_ptr));
-	png_write_row(png_ptr,buffer);
+	PixelFormat pf = frame->alpha ? PF_RGB|PF_A : PF_RGB;
+	convert_rows(&frame->pixels[(size_t)y*frame->get_pitch()], frame->get_pitch(), surface, pf, NULL, y);
 
 	return true;
 }
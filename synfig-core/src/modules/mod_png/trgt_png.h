@@ -33,7 +33,10 @@
 #include <synfig/target_scanline.h>
 #include <synfig/string.h>
 #include <synfig/targetparam.h>
+#include <synfig/encoderqueue.h>
 #include <cstdio>
+#include <memory>
+#include <vector>
 
 /* === M A C R O S ========================================================= */
 
@@ -45,19 +48,42 @@ class png_trgt : public synfig::Target_Scanline
 {
 	SYNFIG_TARGET_MODULE_EXT
 private:
-	FILE *file;
-	//int w,h;
-	png_structp png_ptr;
-	png_infop info_ptr;
+	//! Whole frame converted to the 8-bit rows, it's compressed after the rendering
+	struct Frame
+	{
+		FILE *file;
+		int w, h;
+		bool alpha;
+		int x_res, y_res;
+		int compression_level;
+		int filters;
+		synfig::String title;
+		synfig::String description;
+		std::vector<unsigned char> pixels;
+
+		Frame(): file(NULL), w(), h(), alpha(), x_res(), y_res(), compression_level(-1), filters() { }
+		int get_pitch() const { return (alpha ? 4 : 3)*w; }
+	};
+
+	typedef std::shared_ptr<Frame> FrameHandle;
 
 	static void png_out_error(png_struct *png,const char *msg);
 	static void png_out_warning(png_struct *png,const char *msg);
-	bool multi_image,ready;
+	static int parse_filters(const synfig::String &str);
+	//! Compresses the frame and closes its file, may be called from any thread
+	static bool write_frame(Frame &frame);
+	static void write_frame_async(FrameHandle frame);
+
+	bool multi_image;
 	int imagecount;
+	int scanline;
 	synfig::String filename;
-	unsigned char *buffer;
 	synfig::Color *color_buffer;
 	synfig::String sequence_separator;
+	int compression_level;
+	int filters;
+	FrameHandle frame;
+	synfig::EncoderQueue encoder_queue;
 public:
 	png_trgt(const char *filename, const synfig::TargetParam& /* params */);
 	virtual ~png_trgt();
@@ -68,6 +94,9 @@ public:
 
 	virtual synfig::Color * start_scanline(int scanline);
 	virtual bool end_scanline();
+
+	virtual bool can_put_rows() const { return true; }
+	virtual bool put_rows(const synfig::Surface &surface, int y);
 };
 
 /* === E N D =============================================================== */
@@ -0,0 +1,711 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file trgt_png_atlas.cpp
+**	\brief PNG texture atlas target
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <synfig/localization.h>
+#include <synfig/general.h>
+
+#include <glib/gstdio.h>
+#include "trgt_png_atlas.h"
+#include <zlib.h>
+#include <ETL/stringf>
+#include <ETL/misc>
+#include <synfig/canvas.h>
+#include <synfig/threadpool.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <string.h>
+#include <sigc++/bind.h>
+
+#endif
+
+/* === M A C R O S ========================================================= */
+
+using namespace synfig;
+using namespace std;
+using namespace etl;
+
+/* === G L O B A L S ======================================================= */
+
+SYNFIG_TARGET_INIT(png_trgt_atlas);
+SYNFIG_TARGET_SET_NAME(png_trgt_atlas,"png-atlas");
+SYNFIG_TARGET_SET_EXT(png_trgt_atlas,"png");
+SYNFIG_TARGET_SET_VERSION(png_trgt_atlas,"0.1");
+SYNFIG_TARGET_SET_CVS_ID(png_trgt_atlas,"$Id$");
+
+/* === P R O C E D U R E S ================================================= */
+
+namespace {
+
+typedef std::vector<unsigned char> Buffer;
+
+//! Transparent gap between the sprites, so the filtering of the textures
+//! does not mix the neighbours
+const int sprite_padding = 1;
+
+//! Approximate size of the raw data compressed by the single thread
+const int stripe_bytes = 256*1024;
+
+struct PackRect
+{
+	int x, y, w, h;
+	PackRect(int x = 0, int y = 0, int w = 0, int h = 0): x(x), y(y), w(w), h(h) { }
+
+	bool contains(const PackRect &other) const
+	{
+		return other.x >= x && other.y >= y
+			&& other.x + other.w <= x + w
+			&& other.y + other.h <= y + h;
+	}
+
+	bool intersects(const PackRect &other) const
+	{
+		return other.x < x + w && other.x + other.w > x
+			&& other.y < y + h && other.y + other.h > y;
+	}
+};
+
+//! MaxRects bin packer with the "best short side fit" rule
+class MaxRectsPacker
+{
+	std::vector<PackRect> free_rects;
+	int used_w, used_h;
+
+	void split(const PackRect &used)
+	{
+		std::vector<PackRect> result;
+		result.reserve(free_rects.size() + 4);
+		for(std::vector<PackRect>::const_iterator i = free_rects.begin(); i != free_rects.end(); ++i)
+		{
+			const PackRect &r = *i;
+			if (!r.intersects(used)) { result.push_back(r); continue; }
+			if (used.x > r.x)
+				result.push_back(PackRect(r.x, r.y, used.x - r.x, r.h));
+			if (used.x + used.w < r.x + r.w)
+				result.push_back(PackRect(used.x + used.w, r.y, r.x + r.w - used.x - used.w, r.h));
+			if (used.y > r.y)
+				result.push_back(PackRect(r.x, r.y, r.w, used.y - r.y));
+			if (used.y + used.h < r.y + r.h)
+				result.push_back(PackRect(r.x, used.y + used.h, r.w, r.y + r.h - used.y - used.h));
+		}
+		free_rects.swap(result);
+	}
+
+	//! Removes the free rects which are inside of the other ones
+	void prune()
+	{
+		const int count = (int)free_rects.size();
+		std::vector<bool> removed(count, false);
+		for(int i = 0; i < count; ++i)
+			for(int j = 0; j < count && !removed[i]; ++j)
+				if (i != j && !removed[j] && free_rects[j].contains(free_rects[i]))
+					removed[i] = true;
+
+		int last = 0;
+		for(int i = 0; i < count; ++i)
+			if (!removed[i])
+				free_rects[last++] = free_rects[i];
+		free_rects.resize(last);
+	}
+
+public:
+	MaxRectsPacker(int w, int h): used_w(), used_h()
+		{ free_rects.push_back(PackRect(0, 0, w, h)); }
+
+	int get_used_w() const { return used_w; }
+	int get_used_h() const { return used_h; }
+
+	bool insert(int w, int h, PackRect &placed)
+	{
+		int best = -1;
+		int best_short = INT_MAX, best_long = INT_MAX;
+		for(int i = 0; i < (int)free_rects.size(); ++i)
+		{
+			const PackRect &r = free_rects[i];
+			if (r.w < w || r.h < h) continue;
+			const int short_side = std::min(r.w - w, r.h - h);
+			const int long_side = std::max(r.w - w, r.h - h);
+			if (short_side < best_short || (short_side == best_short && long_side < best_long))
+				{ best = i; best_short = short_side; best_long = long_side; }
+		}
+		if (best < 0) return false;
+
+		placed = PackRect(free_rects[best].x, free_rects[best].y, w, h);
+		split(placed);
+		prune();
+		used_w = std::max(used_w, placed.x + w);
+		used_h = std::max(used_h, placed.y + h);
+		return true;
+	}
+};
+
+inline int paeth(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+//! Applies the PNG filter to the RGBA8 row, returns the sum of the absolute values of the result
+template<int filter>
+unsigned long filter_row_by(unsigned char *dst, const unsigned char *row, const unsigned char *prev, int bytes)
+{
+	const int bpp = 4;
+	unsigned long sum = 0;
+	dst[0] = (unsigned char)filter;
+	for(int i = 0; i < bytes; ++i)
+	{
+		const int a = i >= bpp ? row[i - bpp] : 0;
+		const int b = prev[i];
+		const int c = i >= bpp ? prev[i - bpp] : 0;
+		const int p = filter == 0 ? 0
+		            : filter == 1 ? a
+		            : filter == 2 ? b
+		            : filter == 3 ? (a + b) >> 1
+		            :               paeth(a, b, c);
+		const unsigned char v = (unsigned char)(row[i] - p);
+		dst[i + 1] = v;
+		sum += v < 128 ? v : 256 - v;
+	}
+	return sum;
+}
+
+//! Chooses the filter of the row by the minimum sum of the absolute differences,
+//! \a candidate is the scratch buffer of the same size as \a filtered
+void filter_row(Buffer &filtered, Buffer &candidate, const unsigned char *row, const unsigned char *prev, int bytes)
+{
+	typedef unsigned long (*FilterFunc)(unsigned char*, const unsigned char*, const unsigned char*, int);
+	static const FilterFunc filters[] = {
+		filter_row_by<0>, filter_row_by<1>, filter_row_by<2>, filter_row_by<3>, filter_row_by<4> };
+
+	unsigned long best = filters[0](&filtered.front(), row, prev, bytes);
+	for(int i = 1; i < 5; ++i)
+	{
+		const unsigned long sum = filters[i](&candidate.front(), row, prev, bytes);
+		if (sum < best) { best = sum; filtered.swap(candidate); }
+	}
+}
+
+//! Horizontal stripe of the image compressed as the part of the single deflate stream
+struct Stripe
+{
+	const unsigned char *pixels;
+	int width;
+	int y0, y1;
+	int level;
+	bool last;
+
+	Buffer data;
+	uLong adler;
+	z_off_t size;
+	bool success;
+
+	Stripe(): pixels(), width(), y0(), y1(), level(), last(), adler(), size(), success() { }
+};
+
+//! Filters and compresses the rows of the stripe to the raw deflate data.
+//! The stripe is primed by the tail of the previous one, so the ratio is close
+//! to the single stream, and it is ended by the sync flush, so the stripes
+//! may be concatenated.
+void compress_stripe(Stripe *stripe)
+{
+	const int bytes = stripe->width*4;
+	const size_t pitch = bytes;
+	const Buffer zero_row(bytes, 0);
+	Buffer filtered(bytes + 1), candidate(bytes + 1);
+
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (deflateInit2(&z, stripe->level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return;
+
+	if (stripe->y0 > 0)
+	{
+		const int window = 1 << MAX_WBITS;
+		const int rows = std::min(stripe->y0, window/(bytes + 1) + 1);
+		Buffer dictionary;
+		dictionary.reserve((size_t)rows*(bytes + 1));
+		for(int y = stripe->y0 - rows; y < stripe->y0; ++y)
+		{
+			filter_row(filtered, candidate, stripe->pixels + y*pitch,
+			           y > 0 ? stripe->pixels + (y - 1)*pitch : &zero_row.front(), bytes);
+			dictionary.insert(dictionary.end(), filtered.begin(), filtered.end());
+		}
+		const size_t size = std::min(dictionary.size(), (size_t)window);
+		deflateSetDictionary(&z, &dictionary[dictionary.size() - size], (uInt)size);
+	}
+
+	stripe->size = (z_off_t)(stripe->y1 - stripe->y0)*(bytes + 1);
+	stripe->data.resize(deflateBound(&z, (uLong)stripe->size) + 64);
+	stripe->adler = adler32(0, NULL, 0);
+	z.next_out = &stripe->data.front();
+	z.avail_out = (uInt)stripe->data.size();
+
+	bool success = true;
+	for(int y = stripe->y0; y < stripe->y1 && success; ++y)
+	{
+		filter_row(filtered, candidate, stripe->pixels + y*pitch,
+		           y > 0 ? stripe->pixels + (y - 1)*pitch : &zero_row.front(), bytes);
+		stripe->adler = adler32(stripe->adler, &filtered.front(), bytes + 1);
+
+		const int flush = y + 1 < stripe->y1 ? Z_NO_FLUSH
+		                : stripe->last       ? Z_FINISH
+		                :                      Z_SYNC_FLUSH;
+		z.next_in = &filtered.front();
+		z.avail_in = bytes + 1;
+		const int result = deflate(&z, flush);
+		success = z.avail_in == 0 && z.avail_out > 0
+		       && (flush == Z_FINISH ? result == Z_STREAM_END : result == Z_OK);
+	}
+
+	stripe->data.resize(z.total_out);
+	stripe->success = success;
+	deflateEnd(&z);
+}
+
+void put_uint32(unsigned char *dst, uLong x)
+{
+	dst[0] = (unsigned char)(x >> 24);
+	dst[1] = (unsigned char)(x >> 16);
+	dst[2] = (unsigned char)(x >> 8);
+	dst[3] = (unsigned char)x;
+}
+
+bool write_chunk(FILE *file, const char *type, const unsigned char *data, size_t size)
+{
+	unsigned char header[8], footer[4];
+	put_uint32(header, (uLong)size);
+	memcpy(header + 4, type, 4);
+
+	uLong crc = crc32(0, NULL, 0);
+	crc = crc32(crc, header + 4, 4);
+	if (size) crc = crc32(crc, data, (uInt)size);
+	put_uint32(footer, crc);
+
+	return fwrite(header, 1, 8, file) == 8
+		&& (!size || fwrite(data, 1, size, file) == size)
+		&& fwrite(footer, 1, 4, file) == 4;
+}
+
+bool write_text_chunk(FILE *file, const char *key, const String &text)
+{
+	Buffer data(key, key + strlen(key) + 1);
+	data.insert(data.end(), text.begin(), text.end());
+	return write_chunk(file, "tEXt", &data.front(), data.size());
+}
+
+} // end of anonymous namespace
+
+/* === M E T H O D S ======================================================= */
+
+png_trgt_atlas::png_trgt_atlas(const char *Filename, const synfig::TargetParam &params):
+	filename(Filename),
+	sequence_separator(params.sequence_separator),
+	compression_level(std::min(params.compression_level,9)),
+	imagecount(),
+	scanline(),
+	written(),
+	frame(),
+	trim_queue(params.encoder_jobs)
+{
+	PixelDither dither;
+	if (pixel_dither_from_name(params.dither, dither))
+		set_dither(dither);
+}
+
+png_trgt_atlas::~png_trgt_atlas()
+{
+	trim_queue.wait();
+
+	// render was stopped before the last frame, write the frames we have
+	if (!written && !sprites.empty())
+		write_atlas();
+
+	delete frame;
+	for(std::vector<Buffer*>::iterator i = free_buffers.begin(); i != free_buffers.end(); ++i)
+		delete *i;
+}
+
+bool
+png_trgt_atlas::set_rend_desc(RendDesc *given_desc)
+{
+	desc=*given_desc;
+	imagecount=desc.get_frame_start();
+	color_buffer.resize(desc.get_w());
+	return true;
+}
+
+bool
+png_trgt_atlas::start_frame(synfig::ProgressCallback *callback)
+{
+	if (filename=="-")
+	{
+		synfig::error(_("png_trgt_atlas: the atlas can not be written to stdout"));
+		return false;
+	}
+
+	if (!frame)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!free_buffers.empty())
+		{
+			frame=free_buffers.back();
+			free_buffers.pop_back();
+		}
+	}
+	if (!frame)
+		frame=new Buffer();
+	frame->resize((size_t)desc.get_w()*desc.get_h()*4);
+
+	if(callback)callback->task(strprintf("%s %d",filename.c_str(),imagecount));
+	return true;
+}
+
+void
+png_trgt_atlas::end_frame()
+{
+	if (!frame)
+		return;
+
+	// trim the frame in background while the next one is rendering
+	trim_queue.enqueue(sigc::bind(sigc::mem_fun(*this, &png_trgt_atlas::trim_frame),
+	                              frame, imagecount, desc.get_w(), desc.get_h()));
+	frame=NULL;
+
+	imagecount++;
+	if (imagecount>desc.get_frame_end())
+		write_atlas();
+}
+
+Color *
+png_trgt_atlas::start_scanline(int y)
+{
+	scanline=y;
+	return &color_buffer.front();
+}
+
+bool
+png_trgt_atlas::end_scanline()
+{
+	const int w=desc.get_w();
+	if (!frame || scanline<0 || scanline>=desc.get_h())
+		return false;
+
+	color_to_pixelformat(&(*frame)[(size_t)scanline*w*4], &color_buffer.front(), PF_RGB|PF_A, 0, w, 1, 0, 0, get_dither(), 0, scanline);
+	return true;
+}
+
+bool
+png_trgt_atlas::put_rows(const Surface &surface, int y)
+{
+	const int w=desc.get_w();
+	if (!frame || y<0 || y+surface.get_h()>desc.get_h() || surface.get_w()!=w)
+		return false;
+
+	convert_rows(&(*frame)[(size_t)y*w*4], w*4, surface, PF_RGB|PF_A, NULL, y);
+	return true;
+}
+
+void
+png_trgt_atlas::trim_frame(Buffer *buffer, int frame_number, int w, int h)
+{
+	const size_t pitch=(size_t)w*4;
+
+	// bounds of the pixels with the non-zero alpha
+	int left=w, right=-1, top=h, bottom=-1;
+	for(int y=0;y<h;y++)
+	{
+		const unsigned char *row=&(*buffer)[y*pitch];
+		int x0=0;
+		while(x0<w && !row[x0*4+3]) x0++;
+		if (x0==w) continue;
+		int x1=w-1;
+		while(!row[x1*4+3]) x1--;
+
+		left=std::min(left,x0);
+		right=std::max(right,x1);
+		if (top>y) top=y;
+		bottom=y;
+	}
+
+	Sprite sprite;
+	sprite.frame=frame_number;
+	if (right<0)
+	{
+		// fully transparent frame is kept as the single transparent pixel
+		sprite.w=sprite.h=1;
+		sprite.pixels.resize(4, 0);
+	}
+	else
+	{
+		sprite.trim_x=left;
+		sprite.trim_y=top;
+		sprite.w=right-left+1;
+		sprite.h=bottom-top+1;
+		sprite.pixels.resize((size_t)sprite.w*sprite.h*4);
+		for(int y=0;y<sprite.h;y++)
+			memcpy(&sprite.pixels[(size_t)y*sprite.w*4], &(*buffer)[(top+y)*pitch+left*4], sprite.w*4);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	sprites.push_back(std::move(sprite));
+	free_buffers.push_back(buffer);
+}
+
+bool
+png_trgt_atlas::pack_sprites(int &width, int &height)
+{
+	const int count=(int)sprites.size();
+	if (!count)
+		return false;
+
+	// bigger sprites first
+	std::vector<int> order(count);
+	for(int i=0;i<count;i++) order[i]=i;
+	std::sort(order.begin(), order.end(), [this](int a, int b) {
+		const Sprite &sa=sprites[a], &sb=sprites[b];
+		const int ma=std::max(sa.w,sa.h), mb=std::max(sb.w,sb.h);
+		return ma!=mb ? ma>mb : sa.w*sa.h>sb.w*sb.h;
+	});
+
+	double area=0;
+	int max_w=0, total_h=0;
+	for(int i=0;i<count;i++)
+	{
+		const int w=sprites[i].w+sprite_padding, h=sprites[i].h+sprite_padding;
+		area+=(double)w*h;
+		max_w=std::max(max_w,w);
+		total_h+=h;
+	}
+
+	// the height is not limited, so try several widths around the square
+	// and take the layout with the smallest area
+	const int min_w=std::max(max_w,(int)std::ceil(std::sqrt(area)));
+	std::vector<PackRect> placed(count), best;
+	double best_area=0;
+	for(int attempt=0;attempt<6;attempt++)
+	{
+		MaxRectsPacker packer(std::max(max_w,(int)(min_w*(1.0+0.2*attempt))), total_h);
+		bool success=true;
+		for(int i=0;i<count && success;i++)
+		{
+			const Sprite &sprite=sprites[order[i]];
+			success=packer.insert(sprite.w+sprite_padding, sprite.h+sprite_padding, placed[order[i]]);
+		}
+		if (!success)
+			continue;
+
+		const int w=packer.get_used_w()-sprite_padding, h=packer.get_used_h()-sprite_padding;
+		if (best.empty() || (double)w*h<best_area)
+		{
+			best=placed;
+			best_area=(double)w*h;
+			width=w;
+			height=h;
+		}
+	}
+
+	if (best.empty())
+	{
+		synfig::error(_("png_trgt_atlas: unable to pack %d frames"), count);
+		return false;
+	}
+
+	for(int i=0;i<count;i++)
+	{
+		sprites[i].x=best[i].x;
+		sprites[i].y=best[i].y;
+	}
+	return true;
+}
+
+bool
+png_trgt_atlas::write_image(int width, int height)
+{
+	const size_t pitch=(size_t)width*4;
+	Buffer pixels(pitch*height, 0);
+	for(std::vector<Sprite>::iterator i=sprites.begin();i!=sprites.end();++i)
+	{
+		for(int y=0;y<i->h;y++)
+			memcpy(&pixels[(i->y+y)*pitch+i->x*4], &i->pixels[(size_t)y*i->w*4], i->w*4);
+		Buffer().swap(i->pixels);
+	}
+
+	// compress the stripes of the rows in parallel
+	const int stripe_rows=std::max(16, stripe_bytes/(int)(pitch+1));
+	std::vector<Stripe> stripes((height+stripe_rows-1)/stripe_rows);
+	ThreadPool::Group group;
+	for(int i=0;i<(int)stripes.size();i++)
+	{
+		Stripe &stripe=stripes[i];
+		stripe.pixels=&pixels.front();
+		stripe.width=width;
+		stripe.y0=i*stripe_rows;
+		stripe.y1=std::min(height,stripe.y0+stripe_rows);
+		stripe.level=compression_level<0 ? Z_DEFAULT_COMPRESSION : compression_level;
+		stripe.last=i+1==(int)stripes.size();
+		group.enqueue(sigc::bind(sigc::ptr_fun(&compress_stripe), &stripe));
+	}
+	group.run();
+
+	uLong adler=adler32(0,NULL,0);
+	for(std::vector<Stripe>::const_iterator i=stripes.begin();i!=stripes.end();++i)
+	{
+		if (!i->success)
+		{
+			synfig::error(_("png_trgt_atlas: unable to compress the image"));
+			return false;
+		}
+		adler=adler32_combine(adler,i->adler,i->size);
+	}
+
+	FILE *file=g_fopen(filename.c_str(),POPEN_BINARY_WRITE_TYPE);
+	if (!file)
+	{
+		synfig::error(_("png_trgt_atlas: unable to open %s for write"), filename.c_str());
+		return false;
+	}
+
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+	unsigned char ihdr[13];
+	put_uint32(ihdr, width);
+	put_uint32(ihdr+4, height);
+	ihdr[8]=8;   // bit depth
+	ihdr[9]=6;   // RGBA
+	ihdr[10]=0;  // deflate
+	ihdr[11]=0;  // adaptive filtering
+	ihdr[12]=0;  // no interlace
+
+	unsigned char phys[9];
+	put_uint32(phys, round_to_int(desc.get_x_res()));
+	put_uint32(phys+4, round_to_int(desc.get_y_res()));
+	phys[8]=1;   // meter
+
+	// zlib header of the stream without the preset dictionary
+	static const unsigned char zlib_header[2] = { 0x78, 0x9c };
+	unsigned char zlib_footer[4];
+	put_uint32(zlib_footer, adler);
+
+	bool success = fwrite(signature, 1, sizeof(signature), file)==sizeof(signature)
+	            && write_chunk(file, "IHDR", ihdr, sizeof(ihdr))
+	            && write_chunk(file, "pHYs", phys, sizeof(phys));
+	if (success && get_canvas())
+		success = write_text_chunk(file, "Title", get_canvas()->get_name())
+		       && write_text_chunk(file, "Description", get_canvas()->get_description());
+	success = success
+	       && write_text_chunk(file, "Software", "SYNFIG")
+	       && write_chunk(file, "IDAT", zlib_header, sizeof(zlib_header));
+	for(std::vector<Stripe>::const_iterator i=stripes.begin();success && i!=stripes.end();++i)
+		success = write_chunk(file, "IDAT", &i->data.front(), i->data.size());
+	success = success
+	       && write_chunk(file, "IDAT", zlib_footer, sizeof(zlib_footer))
+	       && write_chunk(file, "IEND", NULL, 0);
+
+	if (fclose(file)!=0)
+		success=false;
+	if (!success)
+		synfig::error(_("png_trgt_atlas: unable to write %s"), filename.c_str());
+	return success;
+}
+
+bool
+png_trgt_atlas::write_metadata(int width, int height)
+{
+	// frames are described in the "JSON hash" format of TexturePacker,
+	// which is understood by the most of the game engines
+	const String metadata_filename=filename_sans_extension(filename)+".json";
+	const String prefix=basename(filename_sans_extension(filename))+sequence_separator;
+	const int w=desc.get_w(), h=desc.get_h();
+
+	String json="{\n\t\"frames\": {\n";
+	for(std::vector<Sprite>::const_iterator i=sprites.begin();i!=sprites.end();++i)
+	{
+		json+=strprintf(
+			"\t\t\"%s\": {\n"
+			"\t\t\t\"frame\": {\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d},\n"
+			"\t\t\t\"rotated\": false,\n"
+			"\t\t\t\"trimmed\": %s,\n"
+			"\t\t\t\"spriteSourceSize\": {\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d},\n"
+			"\t\t\t\"sourceSize\": {\"w\":%d,\"h\":%d}\n"
+			"\t\t}%s\n",
+			escape_json(prefix+strprintf("%04d",i->frame)).c_str(),
+			i->x, i->y, i->w, i->h,
+			i->w!=w || i->h!=h ? "true" : "false",
+			i->trim_x, i->trim_y, i->w, i->h,
+			w, h,
+			i+1!=sprites.end() ? "," : "");
+	}
+	json+=strprintf(
+		"\t},\n"
+		"\t\"meta\": {\n"
+		"\t\t\"app\": \"synfig\",\n"
+		"\t\t\"image\": \"%s\",\n"
+		"\t\t\"format\": \"RGBA8888\",\n"
+		"\t\t\"size\": {\"w\":%d,\"h\":%d},\n"
+		"\t\t\"scale\": \"1\"\n"
+		"\t}\n"
+		"}\n",
+		escape_json(basename(filename)).c_str(), width, height);
+
+	FILE *file=g_fopen(metadata_filename.c_str(),"wb");
+	if (!file)
+	{
+		synfig::error(_("png_trgt_atlas: unable to open %s for write"), metadata_filename.c_str());
+		return false;
+	}
+	bool success=fwrite(json.c_str(), 1, json.size(), file)==json.size();
+	if (fclose(file)!=0)
+		success=false;
+	if (!success)
+		synfig::error(_("png_trgt_atlas: unable to write %s"), metadata_filename.c_str());
+	return success;
+}
+
+bool
+png_trgt_atlas::write_atlas()
+{
+	trim_queue.wait();
+	written=true;
+
+	if (sprites.empty())
+	{
+		synfig::error(_("png_trgt_atlas: there are no frames to write"));
+		return false;
+	}
+
+	std::sort(sprites.begin(), sprites.end(),
+		[](const Sprite &a, const Sprite &b) { return a.frame<b.frame; });
+
+	int width=0, height=0;
+	return pack_sprites(width, height)
+	    && write_image(width, height)
+	    && write_metadata(width, height);
+}
@@ -0,0 +1,103 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file trgt_png_atlas.h
+**	\brief Target which packs the trimmed frames into the PNG texture atlas
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_TRGT_PNG_ATLAS_H
+#define __SYNFIG_TRGT_PNG_ATLAS_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <synfig/target_scanline.h>
+#include <synfig/string.h>
+#include <synfig/targetparam.h>
+#include <synfig/encoderqueue.h>
+#include <mutex>
+#include <vector>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+//! Sprite sheet with the frames trimmed to their alpha bounds and packed by the MaxRects algorithm.
+//! Frames are converted to RGBA8 and trimmed in background while the next ones are rendering,
+//! so only the opaque parts of them are kept in memory.
+//! The atlas is written to the PNG file with the metadata in the JSON file next to it,
+//! the stripes of the image are compressed in parallel.
+class png_trgt_atlas : public synfig::Target_Scanline
+{
+	SYNFIG_TARGET_MODULE_EXT
+private:
+	typedef std::vector<unsigned char> Buffer;
+
+	//! Trimmed frame
+	struct Sprite
+	{
+		int frame;
+		int trim_x, trim_y;  //!< position of the trimmed rect in the frame
+		int w, h;
+		int x, y;            //!< position in the atlas
+		Buffer pixels;       //!< RGBA8 rows of the trimmed rect
+
+		Sprite(): frame(), trim_x(), trim_y(), w(), h(), x(), y() { }
+	};
+
+	synfig::String filename;
+	synfig::String sequence_separator;
+	int compression_level;
+	int imagecount;
+	int scanline;
+	bool written;
+	std::vector<synfig::Color> color_buffer;
+	Buffer *frame;
+
+	// fields below are guarded by the mutex
+	std::mutex mutex;
+	std::vector<Buffer*> free_buffers;
+	std::vector<Sprite> sprites;
+
+	synfig::EncoderQueue trim_queue;
+
+	void trim_frame(Buffer *buffer, int frame_number, int w, int h);
+	bool pack_sprites(int &width, int &height);
+	bool write_image(int width, int height);
+	bool write_metadata(int width, int height);
+	bool write_atlas();
+
+public:
+	png_trgt_atlas(const char *filename, const synfig::TargetParam &params);
+	virtual ~png_trgt_atlas();
+
+	virtual bool set_rend_desc(synfig::RendDesc *desc);
+	virtual bool start_frame(synfig::ProgressCallback *cb);
+	virtual void end_frame();
+
+	virtual synfig::Color * start_scanline(int scanline);
+	virtual bool end_scanline();
+
+	virtual bool can_put_rows() const { return true; }
+	virtual bool put_rows(const synfig::Surface &surface, int y);
+};
+
+/* === E N D =============================================================== */
+
+#endif
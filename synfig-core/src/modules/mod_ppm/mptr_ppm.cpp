@@ -31,18 +31,18 @@
 #	include <config.h>
 #endif
 
-#include <glib/gstdio.h>
 #include "mptr_ppm.h"
 #include <synfig/importer.h>
 #include <synfig/time.h>
 #include <synfig/surface.h>
 #include <synfig/general.h>
 #include <synfig/localization.h>
-#include <synfig/smartfile.h>
 
+#include <cctype>
 #include <cstdio>
 #include <algorithm>
 #include <functional>
+#include <sstream>
 
 #endif
 
@@ -59,41 +59,66 @@ SYNFIG_IMPORTER_SET_NAME(ppm_mptr,"ppm");
 SYNFIG_IMPORTER_SET_EXT(ppm_mptr,"ppm");
 SYNFIG_IMPORTER_SET_VERSION(ppm_mptr,"0.1");
 SYNFIG_IMPORTER_SET_CVS_ID(ppm_mptr,"$Id$");
-SYNFIG_IMPORTER_SET_SUPPORTS_FILE_SYSTEM_WRAPPER(ppm_mptr, false);
+SYNFIG_IMPORTER_SET_SUPPORTS_FILE_SYSTEM_WRAPPER(ppm_mptr, true);
+
+/* === P R O C E D U R E S ================================================= */
+
+static int
+read_number(const char *&position, const char *end)
+{
+	while(position < end && isspace((unsigned char)*position)) ++position;
+	int number = 0;
+	for(; position < end && isdigit((unsigned char)*position); ++position)
+		number = number*10 + (*position - '0');
+	return number;
+}
 
 /* === M E T H O D S ======================================================= */
 
 bool
 ppm_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddesc*/, Time, synfig::ProgressCallback *cb)
 {
-	SmartFILE file(g_fopen(identifier.filename.c_str(),"rb"));
-	if(!file)
+	// use the file placed in memory if possible, or read it whole
+	FileSystem::MappedFile::Handle mapped_file = identifier.get_mapped_file();
+	String buffer;
+	if (!mapped_file)
 	{
-		if(cb)cb->error("pp_mptr::GetFrame(): "+strprintf(_("Unable to open %s"),identifier.filename.c_str()));
-		return false;
+		FileSystem::ReadStream::Handle stream = identifier.get_read_stream();
+		if(!stream)
+		{
+			if(cb)cb->error("pp_mptr::GetFrame(): "+strprintf(_("Unable to open %s"),identifier.filename.c_str()));
+			return false;
+		}
+		std::ostringstream tmp;
+		tmp << stream->rdbuf();
+		buffer = tmp.str();
 	}
-	int w,h;
-	float divisor;
+	const char *position = mapped_file ? mapped_file->data() : buffer.c_str();
+	const char *end = position + (mapped_file ? mapped_file->size() : buffer.size());
 
-	if(fgetc(file.get())!='P' || fgetc(file.get())!='6')
+	if(end - position < 3 || position[0]!='P' || position[1]!='6')
 	{
 		if(cb)cb->error("pp_mptr::GetFrame(): "+strprintf(_("%s was not in PPM format"),identifier.filename.c_str()));
 		return false;
 	}
+	position += 3;
 
-	fgetc(file.get());
-	fscanf(file.get(),"%d %d\n",&w,&h);
-	fscanf(file.get(),"%f",&divisor);
-	fgetc(file.get());
+	int w = read_number(position, end);
+	int h = read_number(position, end);
+	read_number(position, end); // divisor
+	if (position < end) ++position;
+
+	if(w <= 0 || h <= 0 || (end - position)/3/w < h)
+	{
+		if(cb)cb->error("pp_mptr::GetFrame(): "+strprintf(_("%s was not in PPM format"),identifier.filename.c_str()));
+		return false;
+	}
 
 	surface.set_wh(w, h);
+	const unsigned char *data = (const unsigned char*)position;
 	const ColorReal k = 1/255.0;
 	for(int y = 0; y < surface.get_h(); ++y)
-		for(int x = 0; x < surface.get_w(); ++x) {
-			ColorReal r = ((unsigned char)fgetc(file.get()))*k;
-			ColorReal g = ((unsigned char)fgetc(file.get()))*k;
-			ColorReal b = ((unsigned char)fgetc(file.get()))*k;
-			surface[y][x] = Color(r, g, b);
-		}
+		for(int x = 0; x < surface.get_w(); ++x, data += 3)
+			surface[y][x] = Color(data[0]*k, data[1]*k, data[2]*k);
 	return true;
 }
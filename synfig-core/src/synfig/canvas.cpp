@@ -83,6 +83,8 @@ int _CanvasCounter::counter(0);
 
 /* === G L O B A L S ======================================================= */
 
+static bool lazy_loading__ = false;
+
 /* === P R O C E D U R E S ================================================= */
 
 /* === M E T H O D S ======================================================= */
@@ -416,6 +418,18 @@ Canvas::get_outline_grow()const
 	return outline_grow;
 }
 
+void
+Canvas::set_lazy_loading(bool x)
+{
+	lazy_loading__ = x;
+}
+
+bool
+Canvas::get_lazy_loading()
+{
+	return lazy_loading__;
+}
+
 void
 Canvas::set_time(Time t)const
 {
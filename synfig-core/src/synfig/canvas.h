@@ -670,6 +670,15 @@ public:
 	Real get_outline_grow()const;
 	void set_outline_grow(Real x);
 
+	//! Enables or disables on-demand loading of external resources.
+	//! When enabled, external canvases (like "file.sif#") referenced by
+	//! group layers and files of import layers are not opened while
+	//! the document is parsed, but the first time they are needed to
+	//! render an active layer.
+	static void set_lazy_loading(bool x);
+	//! Returns true if on-demand loading of external resources is enabled
+	static bool get_lazy_loading();
+
 #if 0
 	void show_canvas_ancestry(String file, int line, String note)const;
 	void show_canvas_ancestry()const;
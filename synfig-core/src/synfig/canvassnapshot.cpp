@@ -0,0 +1,1160 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file canvassnapshot.cpp
+**	\brief Binary snapshot of the canvas document
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include <glib.h>
+#include <glibmm.h>
+
+#include <ETL/stringf>
+
+#include "canvassnapshot.h"
+
+#include "general.h"
+#include <synfig/localization.h>
+
+#include "gradient.h"
+#include "keyframe.h"
+#include "layer.h"
+#include "segment.h"
+#include "transformation.h"
+#include "valuenode_registry.h"
+
+#include "layers/layer_mime.h"
+#include "layers/layer_pastecanvas.h"
+
+#include "valuenodes/valuenode_animated.h"
+#include "valuenodes/valuenode_bline.h"
+#include "valuenodes/valuenode_bone.h"
+#include "valuenodes/valuenode_const.h"
+#include "valuenodes/valuenode_dilist.h"
+#include "valuenodes/valuenode_dynamiclist.h"
+#include "valuenodes/valuenode_staticlist.h"
+#include "valuenodes/valuenode_wplist.h"
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define BYTE_ORDER_MARK 0x01020304u
+
+/* === G L O B A L S ======================================================= */
+
+const char CanvasSnapshot::magic[8] = { 'S', 'Y', 'N', 'F', 'I', 'G', 'S', 'S' };
+const String CanvasSnapshot::snapshot_extension(".snapshot");
+
+static bool enabled__ = false;
+
+/* === P R O C E D U R E S ================================================= */
+
+namespace {
+
+enum NodeKind
+{
+	NODE_CONST,
+	NODE_ANIMATED,
+	NODE_STATIC_LIST,
+	NODE_DYNAMIC_LIST,
+	NODE_LINKABLE
+};
+
+enum ParamKind
+{
+	PARAM_VALUE,
+	PARAM_NODE,
+	PARAM_CANVAS
+};
+
+//! Index of the value node which means 'no value node'
+const std::uint32_t no_node = 0xffffffff;
+
+//! Limit of nesting of lists and inline canvases, protects reader from the broken files
+const int max_depth = 256;
+
+bool
+get_real_filename(const FileSystem::Identifier &identifier, String &real_filename)
+{
+	if (!identifier.file_system || identifier.filename.empty())
+		return false;
+
+	String uri = identifier.file_system->get_real_uri(identifier.filename);
+	if (uri.empty())
+		return false;
+
+	try { real_filename = Glib::filename_from_uri(uri); }
+	catch(...) { return false; }
+	return true;
+}
+
+//! Reads size and SHA-256 hash of the whole file,
+//! hashing is still much cheaper than parsing of the document
+bool
+get_source_info(const String &real_filename, std::uint64_t &size, String &hash)
+{
+	GError *error = NULL;
+	GMappedFile *file = g_mapped_file_new(real_filename.c_str(), FALSE, &error);
+	if (!file)
+	{
+		if (error) g_error_free(error);
+		return false;
+	}
+
+	size = (std::uint64_t)g_mapped_file_get_length(file);
+	gchar *checksum = g_compute_checksum_for_data(
+		G_CHECKSUM_SHA256,
+		(const guchar*)g_mapped_file_get_contents(file),
+		g_mapped_file_get_length(file) );
+	hash = checksum ? checksum : "";
+	g_free(checksum);
+	g_mapped_file_unref(file);
+	return hash.size() == sizeof(CanvasSnapshot::Header().source_hash);
+}
+
+bool
+check_header(const CanvasSnapshot::Header &header, std::uint64_t source_size, const String &source_hash, std::uint64_t data_size)
+{
+	return !memcmp(header.magic, CanvasSnapshot::magic, sizeof(header.magic))
+		&& header.version == CanvasSnapshot::FORMAT_VERSION
+		&& header.byte_order == BYTE_ORDER_MARK
+		&& header.source_size == source_size
+		&& source_hash.size() == sizeof(header.source_hash)
+		&& !memcmp(header.source_hash, source_hash.c_str(), sizeof(header.source_hash))
+		&& header.data_size == data_size;
+}
+
+//! Serializes the canvas.
+//! Value nodes are written before the layers, each of them once,
+//! and the children before their parents, so reader always
+//! refers to the nodes which are already created.
+class Writer
+{
+public:
+	std::vector<Type*> types;
+	std::map<Type*, std::uint32_t> type_ids;
+	std::map<const ValueNode*, std::uint32_t> node_ids;
+	String nodes;
+	GUID root_guid;
+
+	template<typename T>
+	static void put(String &out, const T &x)
+		{ out.append((const char*)&x, sizeof(x)); }
+
+	static void put_bool(String &out, bool x)
+		{ put(out, (std::uint8_t)x); }
+	static void put_int(String &out, int x)
+		{ put(out, (std::int32_t)x); }
+	static void put_count(String &out, size_t x)
+		{ put(out, (std::uint32_t)x); }
+	static void put_real(String &out, Real x)
+		{ put(out, (double)x); }
+	static void put_vector(String &out, const Vector &x)
+		{ put_real(out, x[0]); put_real(out, x[1]); }
+
+	static void put_color(String &out, const Color &x)
+	{
+		put(out, (ColorReal)x.get_r());
+		put(out, (ColorReal)x.get_g());
+		put(out, (ColorReal)x.get_b());
+		put(out, (ColorReal)x.get_a());
+	}
+
+	static void put_string(String &out, const String &x)
+		{ put_count(out, x.size()); out += x; }
+	static void put_guid(String &out, const GUID &x)
+		{ put_string(out, x.get_string()); }
+
+	void put_type(String &out, Type &type)
+	{
+		std::map<Type*, std::uint32_t>::const_iterator i = type_ids.find(&type);
+		if (i != type_ids.end())
+			{ put(out, i->second); return; }
+		std::uint32_t id = (std::uint32_t)types.size();
+		types.push_back(&type);
+		type_ids[&type] = id;
+		put(out, id);
+	}
+
+	void put_value(String &out, const ValueBase &value)
+	{
+		Type &type = value.get_type();
+		put_type(out, type);
+		put_bool(out, value.get_static());
+		put_int(out, value.get_interpolation());
+
+		if (type == type_bool)
+			put_bool(out, value.get(bool()));
+		else
+		if (type == type_integer)
+			put_int(out, value.get(int()));
+		else
+		if (type == type_real)
+			put_real(out, value.get(Real()));
+		else
+		if (type == type_time)
+			put_real(out, (Real)value.get(Time()));
+		else
+		if (type == type_angle)
+			put_real(out, Angle::rad(value.get(Angle())).get());
+		else
+		if (type == type_vector)
+			put_vector(out, value.get(Vector()));
+		else
+		if (type == type_color)
+			put_color(out, value.get(Color()));
+		else
+		if (type == type_string)
+			put_string(out, value.get(String()));
+		else
+		if (type == type_gradient)
+		{
+			const Gradient &gradient = value.get(Gradient());
+			put_count(out, gradient.size());
+			for(Gradient::const_iterator i = gradient.begin(); i != gradient.end(); ++i)
+				{ put_real(out, i->pos); put_color(out, i->color); }
+		}
+		else
+		if (type == type_transformation)
+		{
+			const Transformation &transformation = value.get(Transformation());
+			put_vector(out, transformation.offset);
+			put_real(out, Angle::rad(transformation.angle).get());
+			put_real(out, Angle::rad(transformation.skew_angle).get());
+			put_vector(out, transformation.scale);
+		}
+		else
+		if (type == type_segment)
+		{
+			const Segment &segment = value.get(Segment());
+			put_vector(out, segment.p1);
+			put_vector(out, segment.t1);
+			put_vector(out, segment.p2);
+			put_vector(out, segment.t2);
+		}
+		else
+		if (type == type_list)
+		{
+			const ValueBase::List &list = value.get_list();
+			put_count(out, list.size());
+			for(ValueBase::List::const_iterator i = list.begin(); i != list.end(); ++i)
+				put_value(out, *i);
+		}
+		else
+			throw std::runtime_error(etl::strprintf("values of type '%s' are not supported", type.description.name.c_str()));
+	}
+
+	std::uint32_t add_node(const ValueNode::ConstHandle &node)
+	{
+		if (!node)
+			throw std::runtime_error("empty value node");
+
+		std::map<const ValueNode*, std::uint32_t>::const_iterator found = node_ids.find(node.get());
+		if (found != node_ids.end())
+			return found->second;
+
+		String record;
+		if ( ValueNode_Bone::ConstHandle::cast_dynamic(node)
+		  || PlaceholderValueNode::ConstHandle::cast_dynamic(node) )
+			throw std::runtime_error(etl::strprintf("value nodes '%s' are not supported", node->get_name().c_str()));
+		else
+		if (ValueNode_Animated::ConstHandle animated = ValueNode_Animated::ConstHandle::cast_dynamic(node))
+		{
+			if (animated->get_type() == type_canvas)
+				throw std::runtime_error("animated canvases are not supported");
+
+			const ValueNode_Animated::WaypointList &list = animated->waypoint_list();
+			std::vector<std::uint32_t> ids;
+			for(ValueNode_Animated::WaypointList::const_iterator i = list.begin(); i != list.end(); ++i)
+				ids.push_back(add_node(i->get_value_node()));
+
+			put(record, (std::uint8_t)NODE_ANIMATED);
+			put_type(record, animated->get_type());
+			put_int(record, animated->get_interpolation());
+			put_count(record, list.size());
+			for(ValueNode_Animated::WaypointList::const_iterator i = list.begin(); i != list.end(); ++i)
+			{
+				put_real(record, (Real)i->get_time());
+				put(record, ids[i - list.begin()]);
+				put_int(record, i->get_before());
+				put_int(record, i->get_after());
+				put_real(record, i->get_tension());
+				put_real(record, i->get_continuity());
+				put_real(record, i->get_bias());
+				put_real(record, i->get_temporal_tension());
+			}
+		}
+		else
+		if (ValueNode_StaticList::ConstHandle list = ValueNode_StaticList::ConstHandle::cast_dynamic(node))
+		{
+			std::vector<std::uint32_t> ids;
+			for(std::vector<ValueNode::RHandle>::const_iterator i = list->list.begin(); i != list->list.end(); ++i)
+				ids.push_back(add_node(*i));
+
+			put(record, (std::uint8_t)NODE_STATIC_LIST);
+			put_type(record, list->get_contained_type());
+			put_count(record, ids.size());
+			for(std::vector<std::uint32_t>::const_iterator i = ids.begin(); i != ids.end(); ++i)
+				put(record, *i);
+		}
+		else
+		if (ValueNode_DynamicList::ConstHandle list = ValueNode_DynamicList::ConstHandle::cast_dynamic(node))
+		{
+			const String name = list->get_name();
+			if (name != "dynamic_list" && name != "bline" && name != "wplist" && name != "dilist")
+				throw std::runtime_error(etl::strprintf("value nodes '%s' are not supported", name.c_str()));
+
+			std::vector<std::uint32_t> ids;
+			for(std::vector<ValueNode_DynamicList::ListEntry>::const_iterator i = list->list.begin(); i != list->list.end(); ++i)
+				ids.push_back(add_node(i->value_node));
+
+			put(record, (std::uint8_t)NODE_DYNAMIC_LIST);
+			put_string(record, name);
+			put_type(record, list->get_contained_type());
+			put_bool(record, list->get_loop());
+			put_count(record, ids.size());
+			for(std::vector<ValueNode_DynamicList::ListEntry>::const_iterator i = list->list.begin(); i != list->list.end(); ++i)
+			{
+				put(record, ids[i - list->list.begin()]);
+				put_count(record, i->timing_info.size());
+				for(ValueNode_DynamicList::ListEntry::ActivepointList::const_iterator j = i->timing_info.begin(); j != i->timing_info.end(); ++j)
+				{
+					put_real(record, (Real)j->get_time());
+					put_bool(record, j->get_state());
+					put_int(record, j->get_priority());
+				}
+			}
+		}
+		else
+		if (ValueNode_Const::ConstHandle value_node = ValueNode_Const::ConstHandle::cast_dynamic(node))
+		{
+			put(record, (std::uint8_t)NODE_CONST);
+			put_value(record, value_node->get_value());
+		}
+		else
+		if (LinkableValueNode::ConstHandle linkable = LinkableValueNode::ConstHandle::cast_dynamic(node))
+		{
+			const String name = linkable->get_name();
+			if (!ValueNodeRegistry::book().count(name))
+				throw std::runtime_error(etl::strprintf("value nodes '%s' are not supported", name.c_str()));
+
+			// as in the document, only the critical and the exported links are stored
+			ParamVocab vocab(linkable->get_children_vocab());
+			ParamVocab::const_iterator param = vocab.begin();
+			std::vector<std::uint32_t> ids(linkable->link_count(), no_node);
+			for(int i = 0; i < linkable->link_count(); ++i)
+			{
+				ValueNode::ConstHandle link = linkable->get_link(i).constant();
+				if (!link)
+					throw std::runtime_error("bad link");
+				bool critical = param != vocab.end() && param->get_critical();
+				if (param != vocab.end())
+					++param;
+				if (link->is_exported() || critical)
+					ids[i] = add_node(link);
+			}
+
+			put(record, (std::uint8_t)NODE_LINKABLE);
+			put_string(record, name);
+			put_type(record, linkable->get_type());
+			put_count(record, ids.size());
+			for(std::vector<std::uint32_t>::const_iterator i = ids.begin(); i != ids.end(); ++i)
+				put(record, *i);
+		}
+		else
+			throw std::runtime_error(etl::strprintf("value nodes '%s' are not supported", node->get_name().c_str()));
+
+		// as in the document GUID is relative to the root canvas
+		put_guid(record, node->get_guid() ^ root_guid);
+
+		std::uint32_t id = (std::uint32_t)node_ids.size();
+		node_ids[node.get()] = id;
+		nodes += record;
+		return id;
+	}
+
+	static void put_canvas_properties(String &out, const Canvas &canvas)
+	{
+		const RendDesc &desc = canvas.rend_desc();
+		put_string(out, canvas.get_version());
+		put_int(out, desc.get_w());
+		put_int(out, desc.get_h());
+		put_real(out, desc.get_x_res());
+		put_real(out, desc.get_y_res());
+		put(out, (ColorReal)desc.get_gamma().get_r());
+		put(out, (ColorReal)desc.get_gamma().get_g());
+		put(out, (ColorReal)desc.get_gamma().get_b());
+		put_real(out, desc.get_frame_rate());
+		put_real(out, (Real)desc.get_time_start());
+		put_real(out, (Real)desc.get_time_end());
+		put_int(out, desc.get_antialias());
+		put_vector(out, desc.get_tl());
+		put_vector(out, desc.get_br());
+		put_color(out, desc.get_bg_color());
+		put_vector(out, desc.get_focus());
+	}
+
+	void put_layer(String &out, const Layer &layer)
+	{
+		if (dynamic_cast<const Layer_Mime*>(&layer))
+			throw std::runtime_error(etl::strprintf("unknown layer '%s' is not supported", layer.get_name().c_str()));
+		if (const Layer_PasteCanvas *paste_canvas = dynamic_cast<const Layer_PasteCanvas*>(&layer))
+			if (!paste_canvas->get_deferred_sub_canvas().empty())
+				throw std::runtime_error("external canvases are not supported");
+
+		put_string(out, layer.get_name());
+		put_bool(out, layer.active());
+		put_bool(out, layer.get_exclude_from_rendering());
+		put_string(out, layer.get_version());
+		put_string(out, layer.get_description());
+		put_string(out, layer.get_group());
+
+		// the same parameters as in the document
+		String params;
+		size_t count = 0;
+		const Layer::Vocab vocab(layer.get_param_vocab());
+		const Layer::DynamicParamList &dynamic_param_list = layer.dynamic_param_list();
+		for(Layer::Vocab::const_iterator i = vocab.begin(); i != vocab.end(); ++i)
+		{
+			Layer::DynamicParamList::const_iterator j = dynamic_param_list.find(i->get_name());
+			if (j != dynamic_param_list.end())
+			{
+				std::uint32_t id = add_node(j->second);
+				put_string(params, i->get_name());
+				put(params, (std::uint8_t)PARAM_NODE);
+				put(params, id);
+				++count;
+				continue;
+			}
+
+			if (!i->get_critical())
+				continue;
+			ValueBase value = layer.get_param(i->get_name());
+			if (!value.is_valid())
+				continue;
+
+			if (value.get_type() == type_canvas)
+			{
+				Canvas::LooseHandle canvas = value.get(Canvas::LooseHandle());
+				if (!canvas)
+					continue;
+				if (!canvas->is_inline())
+					throw std::runtime_error("exported and external canvases are not supported");
+				put_string(params, i->get_name());
+				put(params, (std::uint8_t)PARAM_CANVAS);
+				put_bool(params, value.get_static());
+				put_canvas(params, *canvas);
+				++count;
+				continue;
+			}
+
+			put_string(params, i->get_name());
+			put(params, (std::uint8_t)PARAM_VALUE);
+			put_value(params, value);
+			++count;
+		}
+
+		put_count(out, count);
+		out += params;
+	}
+
+	void put_layers(String &out, const Canvas &canvas)
+	{
+		put_count(out, canvas.size());
+		for(Canvas::const_iterator i = canvas.begin(); i != canvas.end(); ++i)
+			put_layer(out, **i);
+	}
+
+	void put_canvas(String &out, const Canvas &canvas)
+	{
+		put_canvas_properties(out, canvas);
+		put_layers(out, canvas);
+	}
+
+	void put_root(String &out, const Canvas::ConstHandle &canvas)
+	{
+		if (!canvas->children().empty())
+			throw std::runtime_error("exported canvases are not supported");
+		if (!ValueNode_Bone::get_bone_map(canvas).empty())
+			throw std::runtime_error("bones are not supported");
+
+		root_guid = canvas->get_guid();
+
+		String properties;
+		put_canvas_properties(properties, *canvas);
+		put_guid(properties, root_guid);
+		put_string(properties, canvas->get_name());
+		put_string(properties, canvas->get_description());
+		put_string(properties, canvas->get_author());
+
+		const std::list<String> meta_keys = canvas->get_meta_data_keys();
+		put_count(properties, meta_keys.size());
+		for(std::list<String>::const_iterator i = meta_keys.begin(); i != meta_keys.end(); ++i)
+			{ put_string(properties, *i); put_string(properties, canvas->get_meta_data(*i)); }
+
+		const KeyframeList &keyframes = canvas->keyframe_list();
+		put_count(properties, keyframes.size());
+		for(KeyframeList::const_iterator i = keyframes.begin(); i != keyframes.end(); ++i)
+		{
+			put_real(properties, (Real)i->get_time());
+			put_string(properties, i->get_description());
+			put_bool(properties, i->active());
+		}
+
+		String exported;
+		const ValueNodeList &value_node_list = canvas->value_node_list();
+		put_count(exported, value_node_list.size());
+		for(ValueNodeList::const_iterator i = value_node_list.begin(); i != value_node_list.end(); ++i)
+		{
+			std::uint32_t id = add_node(*i);
+			put(exported, id);
+			put_string(exported, (*i)->get_id());
+		}
+
+		String layers;
+		put_layers(layers, *canvas);
+
+		// types are used by all of the other sections
+		put_count(out, types.size());
+		for(std::vector<Type*>::const_iterator i = types.begin(); i != types.end(); ++i)
+			put_string(out, (*i)->description.name);
+		out += properties;
+		put_count(out, node_ids.size());
+		out += nodes;
+		out += exported;
+		out += layers;
+	}
+};
+
+//! Creates the canvas from the data written by Writer
+class Reader
+{
+public:
+	const char *position;
+	const char *end;
+
+	Canvas::Handle root;
+	std::vector<Type*> types;
+	std::vector<ValueNode::Handle> nodes;
+
+	Reader(const char *begin, size_t size):
+		position(begin), end(begin + size) { }
+
+	void take(void *x, size_t size)
+	{
+		if ((size_t)(end - position) < size)
+			throw std::runtime_error("unexpected end of data");
+		memcpy(x, position, size);
+		position += size;
+	}
+
+	template<typename T>
+	T get()
+		{ T x; take(&x, sizeof(x)); return x; }
+
+	bool get_bool()
+		{ return get<std::uint8_t>() != 0; }
+	int get_int()
+		{ return get<std::int32_t>(); }
+	size_t get_count()
+		{ return get<std::uint32_t>(); }
+	Real get_real()
+		{ return get<double>(); }
+
+	Vector get_vector()
+	{
+		Real x = get_real();
+		Real y = get_real();
+		return Vector(x, y);
+	}
+
+	Color get_color()
+	{
+		ColorReal r = get<ColorReal>();
+		ColorReal g = get<ColorReal>();
+		ColorReal b = get<ColorReal>();
+		ColorReal a = get<ColorReal>();
+		return Color(r, g, b, a);
+	}
+
+	String get_string()
+	{
+		size_t size = get_count();
+		if ((size_t)(end - position) < size)
+			throw std::runtime_error("unexpected end of data");
+		String x(position, size);
+		position += size;
+		return x;
+	}
+
+	GUID get_guid()
+		{ return GUID(get_string()); }
+
+	Interpolation get_interpolation()
+	{
+		int x = get_int();
+		if (x < INTERPOLATION_TCB || x > INTERPOLATION_CLAMPED)
+			throw std::runtime_error("bad interpolation");
+		return (Interpolation)x;
+	}
+
+	Type& get_type()
+	{
+		size_t id = get_count();
+		if (id >= types.size())
+			throw std::runtime_error("bad type index");
+		return *types[id];
+	}
+
+	ValueNode::Handle get_node()
+	{
+		size_t id = get_count();
+		if (id >= nodes.size())
+			throw std::runtime_error("bad value node index");
+		return nodes[id];
+	}
+
+	ValueBase get_value(int depth = 0)
+	{
+		if (depth > max_depth)
+			throw std::runtime_error("too deep nesting of lists");
+
+		Type &type = get_type();
+		bool is_static = get_bool();
+		Interpolation interpolation = get_interpolation();
+
+		ValueBase value;
+		if (type == type_bool)
+			value.set(get_bool());
+		else
+		if (type == type_integer)
+			value.set(get_int());
+		else
+		if (type == type_real)
+			value.set(get_real());
+		else
+		if (type == type_time)
+			value.set(Time(get_real()));
+		else
+		if (type == type_angle)
+			value.set(Angle(Angle::rad(get_real())));
+		else
+		if (type == type_vector)
+			value.set(get_vector());
+		else
+		if (type == type_color)
+			value.set(get_color());
+		else
+		if (type == type_string)
+			value.set(get_string());
+		else
+		if (type == type_gradient)
+		{
+			Gradient gradient;
+			for(size_t count = get_count(); count; --count)
+			{
+				Gradient::CPoint cpoint;
+				cpoint.pos = get_real();
+				cpoint.color = get_color();
+				gradient.push_back(cpoint);
+			}
+			value.set(gradient);
+		}
+		else
+		if (type == type_transformation)
+		{
+			Transformation transformation;
+			transformation.offset = get_vector();
+			transformation.angle = Angle::rad(get_real());
+			transformation.skew_angle = Angle::rad(get_real());
+			transformation.scale = get_vector();
+			value.set(transformation);
+		}
+		else
+		if (type == type_segment)
+		{
+			Segment segment;
+			segment.p1 = get_vector();
+			segment.t1 = get_vector();
+			segment.p2 = get_vector();
+			segment.t2 = get_vector();
+			value.set(segment);
+		}
+		else
+		if (type == type_list)
+		{
+			ValueBase::List list;
+			for(size_t count = get_count(); count; --count)
+				list.push_back(get_value(depth + 1));
+			value = ValueBase(list);
+		}
+		else
+			throw std::runtime_error(etl::strprintf("values of type '%s' are not supported", type.description.name.c_str()));
+
+		value.set_static(is_static);
+		value.set_interpolation(interpolation);
+		return value;
+	}
+
+	void read_node()
+	{
+		ValueNode::Handle node;
+		switch(get<std::uint8_t>())
+		{
+		case NODE_CONST:
+			node = ValueNode_Const::create(get_value());
+			break;
+		case NODE_ANIMATED:
+		{
+			ValueNode_Animated::Handle animated = ValueNode_Animated::create(get_type());
+			if (!animated)
+				throw std::runtime_error("unable to create animated value node");
+			animated->set_root_canvas(root);
+			animated->set_interpolation(get_interpolation());
+			for(size_t count = get_count(); count; --count)
+			{
+				Time time(get_real());
+				ValueNode::Handle value_node = get_node();
+				Interpolation before = get_interpolation();
+				Interpolation after = get_interpolation();
+				Real tension = get_real();
+				Real continuity = get_real();
+				Real bias = get_real();
+				Real temporal_tension = get_real();
+
+				ValueNode_Animated::WaypointList::iterator waypoint = animated->new_waypoint(time, value_node);
+				waypoint->set_before(before);
+				waypoint->set_after(after);
+				waypoint->set_tension(tension);
+				waypoint->set_continuity(continuity);
+				waypoint->set_bias(bias);
+				waypoint->set_temporal_tension(temporal_tension);
+			}
+			animated->changed();
+			node = animated;
+			break;
+		}
+		case NODE_STATIC_LIST:
+		{
+			ValueNode_StaticList::Handle list = ValueNode_StaticList::create_on_canvas(get_type());
+			if (!list)
+				throw std::runtime_error("unable to create static list");
+			list->set_root_canvas(root);
+			for(size_t count = get_count(); count; --count)
+				list->add(get_node());
+			node = list;
+			break;
+		}
+		case NODE_DYNAMIC_LIST:
+		{
+			String name = get_string();
+			Type &type = get_type();
+			bool loop = get_bool();
+
+			ValueNode_DynamicList::Handle list;
+			if (name == "bline")
+				list = ValueNode_BLine::create(type_list, root);
+			else
+			if (name == "wplist")
+				list = ValueNode_WPList::create();
+			else
+			if (name == "dilist")
+				list = ValueNode_DIList::create();
+			else
+			if (name == "dynamic_list")
+				list = ValueNode_DynamicList::create_on_canvas(type);
+			if (!list)
+				throw std::runtime_error("unable to create dynamic list");
+			list->set_loop(loop);
+			list->set_root_canvas(root);
+
+			for(size_t count = get_count(); count; --count)
+			{
+				ValueNode_DynamicList::ListEntry entry;
+				entry.value_node = get_node();
+				entry.timing_info.clear();
+				for(size_t points = get_count(); points; --points)
+				{
+					Time time(get_real());
+					bool state = get_bool();
+					int priority = get_int();
+					entry.timing_info.push_back(Activepoint(time, state, priority));
+				}
+				list->add(entry);
+				list->set_link(list->link_count()-1, entry.value_node);
+			}
+			node = list;
+			break;
+		}
+		case NODE_LINKABLE:
+		{
+			String name = get_string();
+			Type &type = get_type();
+			if (!ValueNodeRegistry::book().count(name))
+				throw std::runtime_error(etl::strprintf("unknown value node '%s'", name.c_str()));
+
+			LinkableValueNode::Handle linkable = ValueNodeRegistry::create(name, type);
+			if (!linkable || linkable->get_type() != type)
+				throw std::runtime_error(etl::strprintf("unable to create value node '%s'", name.c_str()));
+			if (get_count() != (size_t)linkable->link_count())
+				throw std::runtime_error(etl::strprintf("bad links count of value node '%s'", name.c_str()));
+
+			for(int i = 0; i < linkable->link_count(); ++i)
+			{
+				std::uint32_t id = get<std::uint32_t>();
+				if (id == no_node)
+					continue;
+				if (id >= nodes.size() || !linkable->set_link(i, nodes[id]))
+					throw std::runtime_error(etl::strprintf("bad link %d of value node '%s'", i, name.c_str()));
+			}
+			node = linkable;
+			break;
+		}
+		default:
+			throw std::runtime_error("bad value node kind");
+		}
+
+		node->set_guid(get_guid() ^ root->get_guid());
+		node->set_root_canvas(root);
+		nodes.push_back(node);
+	}
+
+	void read_canvas_properties(Canvas &canvas)
+	{
+		canvas.set_version(get_string());
+
+		RendDesc &desc = canvas.rend_desc();
+		desc.clear_flags();
+		desc.set_w(get_int());
+		desc.set_h(get_int());
+		desc.set_x_res(get_real());
+		desc.set_y_res(get_real());
+		ColorReal gamma_r = get<ColorReal>();
+		ColorReal gamma_g = get<ColorReal>();
+		ColorReal gamma_b = get<ColorReal>();
+		desc.set_gamma(Gamma(gamma_r, gamma_g, gamma_b));
+		desc.set_frame_rate(get_real());
+		desc.set_time_start(Time(get_real()));
+		desc.set_time_end(Time(get_real()));
+		desc.set_antialias(get_int());
+		desc.set_tl(get_vector());
+		desc.set_br(get_vector());
+		desc.set_bg_color(get_color());
+		desc.set_focus(get_vector());
+		desc.set_flags(RendDesc::PX_ASPECT|RendDesc::IM_SPAN);
+
+		if (desc.get_w() < 1 || desc.get_h() < 1)
+			throw std::runtime_error("bad canvas size");
+	}
+
+	//! Builds the layer in the same way as CanvasParser::parse_layer()
+	Layer::Handle read_layer(const Canvas::Handle &canvas, int depth)
+	{
+		String name = get_string();
+		Layer::Handle layer = Layer::create(name);
+		if (!layer)
+			throw std::runtime_error(etl::strprintf("unable to create layer '%s'", name.c_str()));
+		layer->set_canvas(canvas);
+
+		bool active = get_bool();
+		bool exclude_from_rendering = get_bool();
+		String version = get_string();
+		String description = get_string();
+		String group = get_string();
+
+		if (!group.empty())
+			layer->add_to_group(group);
+		if (version != layer->get_version())
+			layer->set_version(version);
+		if (!description.empty())
+			layer->set_description(description);
+		layer->set_active(active);
+		layer->set_exclude_from_rendering(exclude_from_rendering);
+
+		for(size_t count = get_count(); count; --count)
+		{
+			String param = get_string();
+			switch(get<std::uint8_t>())
+			{
+			case PARAM_VALUE:
+				if (!layer->set_param(param, get_value()))
+					synfig::warning("CanvasSnapshot: Layer '%s' rejected value for parameter '%s'", name.c_str(), param.c_str());
+				break;
+			case PARAM_NODE:
+				layer->connect_dynamic_param(param, get_node());
+				break;
+			case PARAM_CANVAS:
+			{
+				bool is_static = get_bool();
+				Canvas::Handle inline_canvas = Canvas::create_inline(canvas);
+				read_canvas(inline_canvas, depth + 1);
+				ValueBase value;
+				value.set(inline_canvas);
+				value.set_static(is_static);
+				if (!layer->set_param(param, value))
+					synfig::warning("CanvasSnapshot: Layer '%s' rejected canvas for parameter '%s'", name.c_str(), param.c_str());
+				break;
+			}
+			default:
+				throw std::runtime_error("bad parameter kind");
+			}
+		}
+
+		layer->reset_version();
+		return layer;
+	}
+
+	void read_layers(const Canvas::Handle &canvas, int depth)
+	{
+		for(size_t count = get_count(); count; --count)
+			canvas->push_back(read_layer(canvas, depth));
+	}
+
+	void read_canvas(const Canvas::Handle &canvas, int depth)
+	{
+		if (depth > max_depth)
+			throw std::runtime_error("too deep nesting of canvases");
+		read_canvas_properties(*canvas);
+		read_layers(canvas, depth);
+	}
+
+	Canvas::Handle read_root(const FileSystem::Identifier &identifier, const String &as)
+	{
+		for(size_t count = get_count(); count; --count)
+		{
+			String name = get_string();
+			Type &type = ValueBase::ident_type(name);
+			if (type == type_nil)
+				throw std::runtime_error(etl::strprintf("unknown type '%s'", name.c_str()));
+			types.push_back(&type);
+		}
+
+		root = Canvas::create();
+		root->set_identifier(identifier);
+		root->set_file_name(as);
+
+		read_canvas_properties(*root);
+		// the same canvas may be loaded already, then it keeps the new GUID, as in CanvasParser
+		GUID guid = get_guid();
+		if (!guid_cast<Canvas>(guid))
+			root->set_guid(guid);
+		root->set_name(get_string());
+		root->set_description(get_string());
+		root->set_author(get_string());
+
+		for(size_t count = get_count(); count; --count)
+		{
+			String key = get_string();
+			String data = get_string();
+			root->set_meta_data(key, data);
+		}
+
+		for(size_t count = get_count(); count; --count)
+		{
+			Time time(get_real());
+			Keyframe keyframe(time);
+			keyframe.set_description(get_string());
+			keyframe.set_active(get_bool());
+			root->keyframe_list().add(keyframe);
+		}
+		root->keyframe_list().sync();
+
+		for(size_t count = get_count(); count; --count)
+			read_node();
+
+		for(size_t count = get_count(); count; --count)
+		{
+			ValueNode::Handle value_node = get_node();
+			root->add_value_node(value_node, get_string());
+		}
+
+		read_layers(root, 0);
+
+		if (position != end)
+			throw std::runtime_error("unexpected data after the end of canvas");
+		return root;
+	}
+};
+
+} // END of anonymous namespace
+
+/* === M E T H O D S ======================================================= */
+
+void
+CanvasSnapshot::set_enabled(bool x)
+{
+	enabled__ = x;
+}
+
+bool
+CanvasSnapshot::get_enabled()
+{
+	return enabled__;
+}
+
+String
+CanvasSnapshot::get_snapshot_filename(const FileSystem::Identifier &identifier)
+{
+	String real_filename;
+	if (!get_real_filename(identifier, real_filename))
+		return String();
+	return real_filename + snapshot_extension;
+}
+
+bool
+CanvasSnapshot::is_actual(const FileSystem::Identifier &identifier)
+{
+	String real_filename;
+	std::uint64_t size;
+	String hash;
+	if ( !get_real_filename(identifier, real_filename)
+	  || !get_source_info(real_filename, size, hash) )
+		return false;
+
+	GError *error = NULL;
+	GMappedFile *file = g_mapped_file_new((real_filename + snapshot_extension).c_str(), FALSE, &error);
+	if (!file)
+	{
+		if (error) g_error_free(error);
+		return false;
+	}
+
+	bool actual = false;
+	Header header;
+	if (g_mapped_file_get_length(file) >= sizeof(header))
+	{
+		memcpy(&header, g_mapped_file_get_contents(file), sizeof(header));
+		actual = check_header(header, size, hash, g_mapped_file_get_length(file) - sizeof(header));
+	}
+	g_mapped_file_unref(file);
+	return actual;
+}
+
+bool
+CanvasSnapshot::write(const FileSystem::Identifier &identifier, Canvas::ConstHandle canvas)
+{
+	String real_filename;
+	std::uint64_t size;
+	String hash;
+	if ( !canvas
+	  || !get_real_filename(identifier, real_filename)
+	  || !get_source_info(real_filename, size, hash) )
+		return false;
+
+	String data;
+	try
+	{
+		Writer writer;
+		writer.put_root(data, canvas);
+	}
+	catch(std::exception &x)
+	{
+		synfig::info("CanvasSnapshot: Snapshot of '%s' is not written: %s", real_filename.c_str(), x.what());
+		return false;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, magic, sizeof(header.magic));
+	header.version = FORMAT_VERSION;
+	header.byte_order = BYTE_ORDER_MARK;
+	header.source_size = size;
+	memcpy(header.source_hash, hash.c_str(), sizeof(header.source_hash));
+	header.data_size = data.size();
+
+	String buffer((const char*)&header, sizeof(header));
+	buffer += data;
+
+	String snapshot_filename = real_filename + snapshot_extension;
+	GError *error = NULL;
+	if (!g_file_set_contents(snapshot_filename.c_str(), buffer.data(), buffer.size(), &error))
+	{
+		synfig::error("CanvasSnapshot: Unable to write file '%s': %s",
+			snapshot_filename.c_str(), error ? error->message : "");
+		if (error) g_error_free(error);
+		return false;
+	}
+	return true;
+}
+
+Canvas::Handle
+CanvasSnapshot::read(const FileSystem::Identifier &identifier, const String &as)
+{
+	String real_filename;
+	std::uint64_t size;
+	String hash;
+	if (!get_real_filename(identifier, real_filename))
+		return Canvas::Handle();
+
+	String snapshot_filename = real_filename + snapshot_extension;
+	GError *error = NULL;
+	GMappedFile *file = g_mapped_file_new(snapshot_filename.c_str(), FALSE, &error);
+	if (!file)
+	{
+		if (error) g_error_free(error);
+		return Canvas::Handle();
+	}
+
+	Canvas::Handle canvas;
+	Header header;
+	const char *contents = g_mapped_file_get_contents(file);
+	size_t length = g_mapped_file_get_length(file);
+	if (length >= sizeof(header))
+		memcpy(&header, contents, sizeof(header));
+	if ( length >= sizeof(header)
+	  && get_source_info(real_filename, size, hash)
+	  && check_header(header, size, hash, length - sizeof(header)) )
+	{
+		try
+		{
+			Reader reader(contents + sizeof(header), length - sizeof(header));
+			canvas = reader.read_root(identifier, as);
+		}
+		catch(std::exception &x)
+		{
+			synfig::warning("CanvasSnapshot: File '%s' is broken, ignored: %s", snapshot_filename.c_str(), x.what());
+			canvas.reset();
+		}
+		catch(...)
+		{
+			synfig::warning("CanvasSnapshot: Unable to read file '%s'", snapshot_filename.c_str());
+			canvas.reset();
+		}
+	}
+
+	g_mapped_file_unref(file);
+	return canvas;
+}
+
+/* === E N T R Y P O I N T ================================================= */
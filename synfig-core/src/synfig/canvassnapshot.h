@@ -0,0 +1,108 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file canvassnapshot.h
+**	\brief Binary snapshot of the canvas document
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_CANVASSNAPSHOT_H
+#define __SYNFIG_CANVASSNAPSHOT_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <cstdint>
+
+#include "canvas.h"
+#include "filesystem.h"
+#include "string.h"
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+
+/*!	\class CanvasSnapshot
+**	\brief Compact binary form of the loaded canvas.
+*
+* Snapshot is stored next to the source file (with the "snapshot_extension"
+* appended to the file name) and contains the canvas as it is built
+* by CanvasParser: layers with their parameters, value nodes (shared ones
+* are stored once and referred by index), exported values, keyframes
+* and metadata. Loading of the snapshot creates the objects directly,
+* without XML parsing and without conversion of values from text.
+*
+* Only the self-contained canvases are supported: canvases with bones,
+* exported child canvases or references to external files are not written,
+* and they are always loaded from the source file.
+*
+* GUIDs of the canvas and of the value nodes are stored too (the ones of
+* the value nodes relative to the canvas, as in the document), so linked
+* value nodes keep the same identity as after the XML parsing.
+*
+* Snapshot remembers size and SHA-256 hash of the source file
+* and it is ignored when the source file was changed.
+*/
+class CanvasSnapshot
+{
+public:
+	enum { FORMAT_VERSION = 3 };
+
+	static const char magic[8];
+	static const String snapshot_extension;
+
+	//! Fixed size header at the beginning of the file
+	struct Header
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byte_order;
+		std::uint64_t source_size;
+		char source_hash[64];
+		std::uint64_t data_size;
+	};
+
+	//! Enables or disables loading of the snapshots by open_canvas(),
+	//! it is disabled by default (see --cache-binary option of the synfig tool)
+	static void set_enabled(bool x);
+	//! Returns true if loading of the snapshots by open_canvas() is enabled
+	static bool get_enabled();
+
+	//! Returns the name of the snapshot file for the \a identifier of the source file,
+	//! or an empty string if the source is not a regular file
+	static String get_snapshot_filename(const FileSystem::Identifier &identifier);
+
+	//! Returns true if the snapshot of \a identifier exists and it is up to date
+	static bool is_actual(const FileSystem::Identifier &identifier);
+
+	//! Writes the \a canvas loaded from \a identifier into the snapshot file.
+	//! \return false if the canvas contains unsupported data or on the write error
+	static bool write(const FileSystem::Identifier &identifier, Canvas::ConstHandle canvas);
+
+	//! Creates the canvas from the snapshot of \a identifier, \a as is the file name of the new canvas.
+	//! \return null if snapshot not found, if it is out of date or broken
+	static Canvas::Handle read(const FileSystem::Identifier &identifier, const String &as);
+}; // END of class CanvasSnapshot
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
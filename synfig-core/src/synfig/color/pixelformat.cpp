@@ -24,93 +24,333 @@
 */
 /* ========================================================================= */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
 #include "pixelformat.h"
 
 using namespace synfig;
 
 namespace {
+	//! Gamma curves of the three channels tabulated in the range [0, 1],
+	//! values between the nodes are interpolated linearly.
+	//! The curve is too steep near zero for the interpolation,
+	//! so the values below 1/256 are calculated directly.
+	class GammaTable {
+	public:
+		enum { SIZE = 4096 };
+
+	private:
+		Gamma gamma;
+		bool exact;
+		std::vector<ColorReal> values;
+
+	public:
+		GammaTable(): exact(true) { }
+
+		void set(const Gamma &x) {
+			if (!values.empty() && gamma == x)
+				return;
+			gamma = x;
+
+			// only the positive gammas keep the range [0, 1],
+			// other ones are calculated directly as before
+			exact = !(gamma.get_r() > 0 && gamma.get_g() > 0 && gamma.get_b() > 0);
+
+			values.resize(3*(SIZE + 1));
+			for(int c = 0; c < 3; ++c)
+				for(int i = 0; i <= SIZE; ++i)
+					values[c*(SIZE + 1) + i] = Gamma::calculate(ColorReal(i)/ColorReal(SIZE), gamma.get(c));
+		}
+
+		//! Returns the clamped value of the gamma curve
+		ColorReal apply(int channel, ColorReal x) const {
+			if (!exact) {
+				if (x >= ColorReal(1))
+					return ColorReal(1);
+				if (x >= ColorReal(1.0/256.0)) {
+					const ColorReal f = x*ColorReal(SIZE);
+					const int i = (int)f;
+					const ColorReal *v = &values[channel*(SIZE + 1) + i];
+					return v[0] + (v[1] - v[0])*(f - ColorReal(i));
+				}
+				// negative values and NaN
+				if (!(x > ColorReal(0)))
+					return ColorReal(0);
+			}
+			const ColorReal y = gamma.apply(channel, x);
+			return y > ColorReal(0) ? (y < ColorReal(1) ? y : ColorReal(1)) : ColorReal(0);
+		}
+	};
+
+
+	//! Tables are cached per thread, usually all of the conversions use the same gamma
+	const GammaTable*
+	get_gamma_table(const Gamma *gamma)
+	{
+		if (!gamma) return NULL;
+		static thread_local GammaTable table;
+		table.set(*gamma);
+		return &table;
+	}
+
+
+	//! Thresholds of the dithering in the range (0, 1), the pattern is repeated over the image
+	class DitherPattern {
+	public:
+		enum { SIZE = 32, MASK = SIZE - 1 };
+
+	private:
+		ColorReal thresholds[SIZE*SIZE];
+
+		void set_ranks(const std::vector<int> &ranks) {
+			for(int i = 0; i < SIZE*SIZE; ++i)
+				thresholds[i] = (ColorReal(ranks[i]) + ColorReal(0.5))/ColorReal(SIZE*SIZE);
+		}
+
+		//! Bayer matrix, each pair of bits of the coordinates
+		//! gives the next level of the 2x2 pattern {0, 2; 3, 1}
+		void build_ordered() {
+			std::vector<int> ranks(SIZE*SIZE);
+			for(int y = 0; y < SIZE; ++y) {
+				for(int x = 0; x < SIZE; ++x) {
+					int rank = 0;
+					for(int bit = 1; bit < SIZE; bit <<= 1) {
+						const int bx = x & bit ? 1 : 0;
+						const int by = y & bit ? 1 : 0;
+						rank = (rank << 2) | (2*(bx ^ by) + by);
+					}
+					ranks[y*SIZE + x] = rank;
+				}
+			}
+			set_ranks(ranks);
+		}
+
+		//! Void-and-cluster method by Robert Ulichney
+		void build_blue_noise() {
+			const int count = SIZE*SIZE;
+			const double sigma = 1.5;
+
+			// toroidal gaussian kernel
+			std::vector<double> kernel(count);
+			for(int y = 0; y < SIZE; ++y) {
+				for(int x = 0; x < SIZE; ++x) {
+					const int dx = std::min(x, SIZE - x);
+					const int dy = std::min(y, SIZE - y);
+					kernel[y*SIZE + x] = std::exp(-double(dx*dx + dy*dy)/(2*sigma*sigma));
+				}
+			}
+
+			std::vector<bool> pattern(count);
+			std::vector<double> energy(count);
+			const auto toggle = [&](int index, bool value) {
+				pattern[index] = value;
+				const int px = index%SIZE, py = index/SIZE;
+				const double sign = value ? 1 : -1;
+				for(int y = 0; y < SIZE; ++y)
+					for(int x = 0; x < SIZE; ++x)
+						energy[y*SIZE + x] += sign*kernel[((y - py) & MASK)*SIZE + ((x - px) & MASK)];
+			};
+			// tightest cluster among the points or largest void among the empty pixels
+			const auto find = [&](bool cluster) {
+				int found = -1;
+				for(int i = 0; i < count; ++i)
+					if ( pattern[i] == cluster
+					  && (found < 0 || (cluster ? energy[i] > energy[found] : energy[i] < energy[found])) )
+						found = i;
+				return found;
+			};
+
+			// initial random points, the generator is fixed to get the same pattern everywhere
+			const int initial = count/10;
+			unsigned int seed = 12345;
+			for(int placed = 0; placed < initial; ) {
+				seed = seed*1103515245u + 12345u;
+				const int index = (seed >> 16)%count;
+				if (!pattern[index])
+					toggle(index, true), ++placed;
+			}
+
+			// move the points from the clusters to the voids until it's stable
+			for(int i = 0; i < count; ++i) {
+				const int cluster = find(true);
+				toggle(cluster, false);
+				const int void_ = find(false);
+				toggle(void_, true);
+				if (void_ == cluster)
+					break;
+			}
+
+			std::vector<int> ranks(count);
+			const std::vector<bool> initial_pattern = pattern;
+			const std::vector<double> initial_energy = energy;
+
+			// rank the initial points by removing the tightest clusters
+			for(int rank = initial - 1; rank >= 0; --rank) {
+				const int index = find(true);
+				toggle(index, false);
+				ranks[index] = rank;
+			}
+
+			// rank the rest of the pixels by filling the largest voids
+			pattern = initial_pattern;
+			energy = initial_energy;
+			for(int rank = initial; rank < count; ++rank) {
+				const int index = find(false);
+				toggle(index, true);
+				ranks[index] = rank;
+			}
+
+			set_ranks(ranks);
+		}
+
+	public:
+		explicit DitherPattern(PixelDither dither) {
+			switch(dither) {
+			case PIXEL_DITHER_ORDERED:    build_ordered();    break;
+			case PIXEL_DITHER_BLUE_NOISE: build_blue_noise(); break;
+			default: std::fill(thresholds, thresholds + SIZE*SIZE, ColorReal(0)); break;
+			}
+		}
+
+		const ColorReal* row(int y) const
+			{ return thresholds + (y & MASK)*SIZE; }
+
+		//! Patterns are built once at the first use
+		static const DitherPattern* get(PixelDither dither) {
+			static const DitherPattern none(PIXEL_DITHER_NONE);
+			if (dither == PIXEL_DITHER_ORDERED) {
+				static const DitherPattern ordered(PIXEL_DITHER_ORDERED);
+				return &ordered;
+			}
+			if (dither == PIXEL_DITHER_BLUE_NOISE) {
+				static const DitherPattern blue_noise(PIXEL_DITHER_BLUE_NOISE);
+				return &blue_noise;
+			}
+			return &none;
+		}
+	};
+
+
 	struct Color2PFParams {
 		unsigned char *dst;
 		const Color *src;
 		PixelFormat pf;
-		const Gamma *gamma;
+		const GammaTable *gamma;
+		const DitherPattern *dither;
 		int width;
 		int height;
 		int dst_stride_extra;
 		int src_stride_extra;
+		int offset_x;
+		int offset_y;
 
 		explicit inline Color2PFParams(
 			unsigned char *dst = NULL,
 			const Color *src = NULL,
 			PixelFormat pf = 0,
-			const Gamma *gamma = NULL,
+			const GammaTable *gamma = NULL,
+			const DitherPattern *dither = NULL,
 			int width = 0,
 			int height = 0,
 			int dst_stride_extra = 0,
-			int src_stride_extra = 0
+			int src_stride_extra = 0,
+			int offset_x = 0,
+			int offset_y = 0
 		):
 			dst(dst),
 			src(src),
 			pf(pf),
 			gamma(gamma),
+			dither(dither),
 			width(width),
 			height(height),
 			dst_stride_extra(dst_stride_extra),
-			src_stride_extra(src_stride_extra) { }
+			src_stride_extra(src_stride_extra),
+			offset_x(offset_x),
+			offset_y(offset_y) { }
 	};
 
 
-	static inline unsigned char*
-	color2pf_raw(
-		unsigned char *dst,
-		const Color &src,
-		const Gamma* )
-	{
+	ColorReal clamp(ColorReal c)
+		{ return c > ColorReal(0.0) ? (c < ColorReal(1.0) ? c : ColorReal(1.0)): ColorReal(0.0); }
+
+	//! Same as Color::clamped() for the single channel, but without the branches
+	inline ColorReal clamp_simple(ColorReal c, ColorReal nan_value) {
+		const ColorReal x = std::min(std::max(c, ColorReal(0.0)), ColorReal(1.0));
+		return c == c ? x : nan_value;
+	}
+
+	inline unsigned char to_byte_simple(ColorReal c, ColorReal nan_value)
+		{ return (unsigned char)(clamp_simple(c, nan_value)*ColorReal(255.9)); }
+
+	template<bool with_gamma>
+	inline ColorReal channel(const GammaTable *gamma, int index, ColorReal x)
+		{ return with_gamma ? gamma->apply(index, x) : clamp(x); }
+
+
+	static unsigned char*
+	color2pf_image_raw(Color2PFParams params) {
 		// just copy raw color data
-		*reinterpret_cast<Color*>(dst) = src;
-		return dst + sizeof(src);
+		while(params.height-- > 0) {
+			memcpy(params.dst, params.src, params.width*sizeof(Color));
+			params.dst += params.width*sizeof(Color) + params.dst_stride_extra;
+			params.src += params.width + params.src_stride_extra;
+		}
+		return params.dst;
 	}
 
 
+	//! Premultiplies the channel by \a ai in the same fixed point as color2pf(),
+	//! NaN is clamped to zero as color2pf() does
+	inline unsigned char to_byte_premult_simple(ColorReal c, int ai)
+		{ return (unsigned char)(((int)(clamp(c)*ColorReal(65535.99))*ai) >> 16); }
+
+	//! Conversion without gamma and grayscale.
+	//! The channels are at the fixed offsets and the loop has no branches,
+	//! so the compiler is able to vectorize it.
 	template<
 		bool bgr,
 		bool alpha,
-		bool alpha_start >
-	static inline unsigned char*
-	color2pf_simple(
-		unsigned char *dst,
-		const Color &src,
-		const Gamma* )
+		bool alpha_start,
+		bool alpha_premult >
+	static unsigned char*
+	color2pf_image_simple(Color2PFParams params)
 	{
-		const Color color = src.clamped();
-
-		// put alpha before color channels if need
-		if (alpha && alpha_start)
-			*dst = (unsigned char)(color.get_a()*ColorReal(255.9)), ++dst;
+		const int channels = alpha ? 4 : 3;
+		const int first = alpha && alpha_start ? 1 : 0;
+		const int r = first + (bgr ? 2 : 0);
+		const int g = first + 1;
+		const int b = first + (bgr ? 0 : 2);
+		const int a = alpha_start ? 0 : 3;
 
-		// put color channels
-		if (bgr) {
-			*dst = (unsigned char)(color.get_b()*ColorReal(255.9)), ++dst;
-			*dst = (unsigned char)(color.get_g()*ColorReal(255.9)), ++dst;
-			*dst = (unsigned char)(color.get_r()*ColorReal(255.9)), ++dst;
-		} else {
-			*dst = (unsigned char)(color.get_r()*ColorReal(255.9)), ++dst;
-			*dst = (unsigned char)(color.get_g()*ColorReal(255.9)), ++dst;
-			*dst = (unsigned char)(color.get_b()*ColorReal(255.9)), ++dst;
+		while(params.height-- > 0) {
+			unsigned char *dst = params.dst;
+			const Color *src = params.src;
+			for(int i = 0; i < params.width; ++i, dst += channels) {
+				if (alpha && alpha_premult) {
+					const int ac = (int)(clamp(src[i].get_a())*ColorReal(255.99));
+					dst[r] = to_byte_premult_simple(src[i].get_r(), ac + 1);
+					dst[g] = to_byte_premult_simple(src[i].get_g(), ac + 1);
+					dst[b] = to_byte_premult_simple(src[i].get_b(), ac + 1);
+					dst[a] = (unsigned char)ac;
+				} else {
+					dst[r] = to_byte_simple(src[i].get_r(), ColorReal(0.5));
+					dst[g] = to_byte_simple(src[i].get_g(), ColorReal(0.5));
+					dst[b] = to_byte_simple(src[i].get_b(), ColorReal(0.5));
+					if (alpha)
+						dst[a] = to_byte_simple(src[i].get_a(), ColorReal(1.0));
+				}
+			}
+			params.dst = dst + params.dst_stride_extra;
+			params.src = src + params.width + params.src_stride_extra;
 		}
-
-		// put alpha after color channels if need
-		if (alpha && !alpha_start)
-			*dst = (unsigned char)(color.get_a()*ColorReal(255.9)), ++dst;
-
-		return dst;
+		return params.dst;
 	}
 
 
-	ColorReal clamp(ColorReal c)
-		{ return c > ColorReal(0.0) ? (c < ColorReal(1.0) ? c : ColorReal(1.0)): ColorReal(0.0); }
-
-
 	template<
 		bool with_gamma,
 		bool gray,
@@ -122,17 +362,16 @@ namespace {
 	color2pf(
 		unsigned char *dst,
 		const Color &src,
-		const Gamma *gamma )
+		const GammaTable *gamma,
+		ColorReal )
 	{
-		const Color src_gm = with_gamma ? gamma->apply(src) : src;
-
 		// get color values
 		int ri, gi, bi, ac;
-		ri = (int)(clamp(src_gm.get_r())*ColorReal(65535.99));
-		gi = (int)(clamp(src_gm.get_g())*ColorReal(65535.99));
-		bi = (int)(clamp(src_gm.get_b())*ColorReal(65535.99));
+		ri = (int)(channel<with_gamma>(gamma, 0, src.get_r())*ColorReal(65535.99));
+		gi = (int)(channel<with_gamma>(gamma, 1, src.get_g())*ColorReal(65535.99));
+		bi = (int)(channel<with_gamma>(gamma, 2, src.get_b())*ColorReal(65535.99));
 		if (alpha)
-			ac = (int)(clamp(src_gm.get_a())*ColorReal(255.99));
+			ac = (int)(clamp(src.get_a())*ColorReal(255.99));
 
 		// put alpha before color channels if need
 		if (alpha && alpha_start)
@@ -186,12 +425,67 @@ namespace {
 	}
 
 
-	template<unsigned char* func(unsigned char*, const Color&, const Gamma*)>
+	//! Same as color2pf(), but the color channels are rounded
+	//! by the \a threshold of the dithering pattern instead of the truncation
+	template<
+		bool with_gamma,
+		bool gray,
+		bool bgr,
+		bool alpha,
+		bool alpha_start,
+		bool alpha_premult >
+	static inline unsigned char*
+	color2pf_dither(
+		unsigned char *dst,
+		const Color &src,
+		const GammaTable *gamma,
+		ColorReal threshold )
+	{
+		ColorReal r = channel<with_gamma>(gamma, 0, src.get_r());
+		ColorReal g = channel<with_gamma>(gamma, 1, src.get_g());
+		ColorReal b = channel<with_gamma>(gamma, 2, src.get_b());
+		int ac = 0;
+		if (alpha)
+			ac = (int)(clamp(src.get_a())*ColorReal(255.99));
+
+		// premultiply by the stored alpha, so the color is consistent with it
+		if (alpha && alpha_premult) {
+			const ColorReal k = ColorReal(ac)*ColorReal(1.0/255.0);
+			r *= k, g *= k, b *= k;
+		}
+
+		const ColorReal t = threshold;
+		if (alpha && alpha_start)
+			*dst = ac, ++dst;
+
+		if (gray) {
+			const ColorReal y = r*EncodeYUV[0][0] + g*EncodeYUV[0][1] + b*EncodeYUV[0][2];
+			*dst = (unsigned char)std::min(255, (int)(y*ColorReal(255.0) + t)), ++dst;
+		} else
+		if (bgr) {
+			*dst = (unsigned char)std::min(255, (int)(b*ColorReal(255.0) + t)), ++dst;
+			*dst = (unsigned char)std::min(255, (int)(g*ColorReal(255.0) + t)), ++dst;
+			*dst = (unsigned char)std::min(255, (int)(r*ColorReal(255.0) + t)), ++dst;
+		} else {
+			*dst = (unsigned char)std::min(255, (int)(r*ColorReal(255.0) + t)), ++dst;
+			*dst = (unsigned char)std::min(255, (int)(g*ColorReal(255.0) + t)), ++dst;
+			*dst = (unsigned char)std::min(255, (int)(b*ColorReal(255.0) + t)), ++dst;
+		}
+
+		if (alpha && !alpha_start)
+			*dst = ac, ++dst;
+
+		return dst;
+	}
+
+
+	template<unsigned char* func(unsigned char*, const Color&, const GammaTable*, ColorReal)>
 	static unsigned char*
 	color2pf_image(Color2PFParams params) {
-		while(params.height-- > 0) {
-			for(int i = 0; i < params.width; ++i)
-				params.dst = func(params.dst, *params.src, params.gamma), ++params.src;
+		for(int y = params.offset_y; params.height-- > 0; ++y) {
+			const ColorReal *thresholds = params.dither->row(y);
+			for(int i = 0, x = params.offset_x; i < params.width; ++i, ++x)
+				params.dst = func(params.dst, *params.src, params.gamma, thresholds[x & DitherPattern::MASK]), ++params.src;
 			params.dst += params.dst_stride_extra;
 			params.src += params.src_stride_extra;
 		}
@@ -199,54 +493,76 @@ namespace {
 	}
 
 
-	template<bool with_gamma, bool gray, bool bgr>
+	template<bool with_gamma, bool dither, bool gray, bool bgr>
 	static inline unsigned char*
 	color2pf_image_partauto(const Color2PFParams &params) {
+		#define C2PF(alpha, alpha_start, alpha_premult) \
+			( dither \
+			? color2pf_image< color2pf_dither<with_gamma, gray, bgr, alpha, alpha_start, alpha_premult> >(params) \
+			: color2pf_image< color2pf       <with_gamma, gray, bgr, alpha, alpha_start, alpha_premult> >(params) )
+
 		if (!FLAGS(params.pf, PF_A))
-			return     color2pf_image< color2pf<with_gamma, gray, bgr, false, false, false> >(params);
+			return     C2PF(false, false, false);
 		if (FLAGS(params.pf, PF_A_PREMULT)) {
 			if (FLAGS(params.pf, PF_A_START))
-				return color2pf_image< color2pf<with_gamma, gray, bgr, true,  true,  true>  >(params);
-			return     color2pf_image< color2pf<with_gamma, gray, bgr, true,  false, true>  >(params);
+				return C2PF(true,  true,  true);
+			return     C2PF(true,  false, true);
 		}
 		if (FLAGS(params.pf, PF_A_START))
-			return     color2pf_image< color2pf<with_gamma, gray, bgr, true,  true,  false> >(params);
-		return         color2pf_image< color2pf<with_gamma, gray, bgr, true,  false, false> >(params);
+			return     C2PF(true,  true,  false);
+		return         C2PF(true,  false, false);
+
+		#undef C2PF
+	}
+
+
+	template<bool with_gamma, bool dither>
+	static inline unsigned char*
+	color2pf_image_gammaauto(const Color2PFParams &params) {
+		if (FLAGS(params.pf, PF_GRAY))
+			return color2pf_image_partauto<with_gamma, dither, true,  false>(params);
+		if (FLAGS(params.pf, PF_BGR))
+			return color2pf_image_partauto<with_gamma, dither, false, true >(params);
+		return     color2pf_image_partauto<with_gamma, dither, false, false>(params);
 	}
 
 
 	static inline unsigned char*
 	color2pf_image_auto(const Color2PFParams &params) {
 		if (FLAGS(params.pf, PF_RAW_COLOR))
-			return color2pf_image<color2pf_raw>(params);
+			return color2pf_image_raw(params);
 
 		bool with_gamma    = (bool)params.gamma;
+		bool dither        = (bool)params.dither;
 		bool gray          = FLAGS(params.pf, PF_GRAY);
 		bool bgr           = !gray && FLAGS(params.pf, PF_BGR);
 		bool alpha         = FLAGS(params.pf, PF_A);
 		bool alpha_premult = alpha && FLAGS(params.pf, PF_A_PREMULT);
 
-		if (!gray && !alpha_premult && !with_gamma) {
+		if (!gray && !with_gamma && !dither) {
 			// simple
 			bool alpha_start = alpha && FLAGS(params.pf, PF_A_START);
-			if (bgr) {
-				if (alpha_start) return color2pf_image< color2pf_simple<true,  true,  true>  >(params);
-				if (alpha)       return color2pf_image< color2pf_simple<true,  true,  false> >(params);
-				return                  color2pf_image< color2pf_simple<true,  false, false> >(params);
-			}
-			if (alpha_start) return     color2pf_image< color2pf_simple<false, true,  true>  >(params);
-			if (alpha)       return     color2pf_image< color2pf_simple<false, true,  false> >(params);
-			return                      color2pf_image< color2pf_simple<false, false, false> >(params);
+			#define C2PF(bgr) \
+				( alpha_premult \
+				? ( alpha_start ? color2pf_image_simple<bgr, true,  true,  true > (params) \
+				                : color2pf_image_simple<bgr, true,  false, true > (params) ) \
+				: alpha_start   ? color2pf_image_simple<bgr, true,  true,  false> (params) \
+				: alpha         ? color2pf_image_simple<bgr, true,  false, false> (params) \
+				                : color2pf_image_simple<bgr, false, false, false> (params) )
+			return bgr ? C2PF(true) : C2PF(false);
+			#undef C2PF
 		}
 
-		if (with_gamma) {
-			if (gray) return color2pf_image_partauto<true,  true,  false>(params);
-			if (bgr)  return color2pf_image_partauto<true,  false, true >(params);
-			return           color2pf_image_partauto<true,  false, false>(params);
-		}
-		if (gray) return     color2pf_image_partauto<false, true,  false>(params);
-		if (bgr)  return     color2pf_image_partauto<false, false, true >(params);
-		return               color2pf_image_partauto<false, false, false>(params);
+		// converters without dithering ignore the thresholds, so give them the empty pattern
+		Color2PFParams p = params;
+		if (!dither)
+			p.dither = DitherPattern::get(PIXEL_DITHER_NONE);
+
+		if (with_gamma)
+			return dither ? color2pf_image_gammaauto<true,  true >(p)
+			              : color2pf_image_gammaauto<true,  false>(p);
+		return     dither ? color2pf_image_gammaauto<false, true >(p)
+		                  : color2pf_image_gammaauto<false, false>(p);
 	}
 } // namespace
 
@@ -395,12 +711,45 @@ synfig::color_to_pixelformat(
 	int height,
 	int dst_stride,
 	int src_stride )
+{
+	return color_to_pixelformat(
+		dst, src, pf, gamma, width, height, dst_stride, src_stride, PIXEL_DITHER_NONE );
+}
+
+
+unsigned char*
+synfig::color_to_pixelformat(
+	unsigned char *dst,
+	const Color *src,
+	PixelFormat pf,
+	const Gamma *gamma,
+	int width,
+	int height,
+	int dst_stride,
+	int src_stride,
+	PixelDither dither,
+	int offset_x,
+	int offset_y )
 {
 	assert(src_stride % sizeof(Color) == 0);
 	return color2pf_image_auto(Color2PFParams(
-		dst, src, pf, gamma, width, height,
+		dst, src, pf,
+		get_gamma_table(gamma),
+		dither == PIXEL_DITHER_NONE ? NULL : DitherPattern::get(dither),
+		width, height,
 		dst_stride ? dst_stride - width*pixel_size(pf) : 0,
-		src_stride ? src_stride/sizeof(Color) - width  : 0 ));
+		src_stride ? src_stride/sizeof(Color) - width  : 0,
+		offset_x, offset_y ));
+}
+
+
+bool
+synfig::pixel_dither_from_name(const std::string &name, PixelDither &dither)
+{
+	if (name == "none")       { dither = PIXEL_DITHER_NONE;       return true; }
+	if (name == "ordered")    { dither = PIXEL_DITHER_ORDERED;    return true; }
+	if (name == "blue-noise") { dither = PIXEL_DITHER_BLUE_NOISE; return true; }
+	return false;
 }
 
 
@@ -27,6 +27,8 @@
 #ifndef __SYNFIG_COLOR_PIXELFORMAT_H
 #define __SYNFIG_COLOR_PIXELFORMAT_H
 
+#include <string>
+
 #include "color.h"
 #include "gamma.h"
 
@@ -57,6 +59,18 @@ enum
 
 typedef unsigned int PixelFormat;
 
+//! Rounding of the color channels when they are reduced to 8 bits
+enum PixelDither
+{
+	PIXEL_DITHER_NONE,       //!< Truncate the values
+	PIXEL_DITHER_ORDERED,    //!< Round by the thresholds of the 32x32 Bayer matrix
+	PIXEL_DITHER_BLUE_NOISE  //!< Round by the thresholds of the 32x32 blue noise mask
+};
+
+//! Finds the dithering by its name: none, ordered or blue-noise
+//! Returns false if the name is unknown
+bool pixel_dither_from_name(const std::string &name, PixelDither &dither);
+
 //! Returns the size of bytes of pixel in given PixelFormat
 size_t pixel_size(PixelFormat x);
 
@@ -76,6 +90,23 @@ color_to_pixelformat(
 	int dst_stride = 0,
 	int src_stride = 0 );
 
+//! Same as above, but the color channels are rounded with the \a dither pattern.
+//! offset_x and offset_y - position of the first pixel in the whole image,
+//! so the pattern stays continuous when the image is converted by parts
+unsigned char*
+color_to_pixelformat(
+	unsigned char *dst,
+	const Color *src,
+	PixelFormat pf,
+	const Gamma *gamma,
+	int width,
+	int height,
+	int dst_stride,
+	int src_stride,
+	PixelDither dither,
+	int offset_x = 0,
+	int offset_y = 0 );
+
 //! Converts pixels from PixelFormat to synfig::Color
 //! Returns the pointer to the next src pixel
 //! dst_stride and src_stride - offset to next row in bytes (may be negative)
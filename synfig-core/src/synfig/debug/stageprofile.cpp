@@ -0,0 +1,138 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file stageprofile.cpp
+**	\brief Per-frame timing of the render pipeline stages
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+
+#include <glib.h>
+
+#include "stageprofile.h"
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+using namespace debug;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+std::atomic<bool> StageProfile::enabled(false);
+std::mutex StageProfile::mutex;
+long long StageProfile::current[StageProfile::STAGES_COUNT];
+std::vector<long long> StageProfile::frames[StageProfile::STAGES_COUNT];
+
+long long
+StageProfile::get_time()
+	{ return g_get_monotonic_time(); }
+
+void
+StageProfile::add(Stage stage, long long microseconds)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	current[stage] += microseconds;
+}
+
+void
+StageProfile::frame_finished()
+{
+	if (!is_enabled()) return;
+	std::lock_guard<std::mutex> lock(mutex);
+	for(int i = 0; i < STAGES_COUNT; ++i) {
+		frames[i].push_back(current[i]);
+		current[i] = 0;
+	}
+}
+
+void
+StageProfile::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for(int i = 0; i < STAGES_COUNT; ++i) {
+		frames[i].clear();
+		current[i] = 0;
+	}
+}
+
+const char*
+StageProfile::get_stage_name(Stage stage)
+{
+	switch(stage) {
+	case SET_TIME:       return "set_time";
+	case LOAD_RESOURCES: return "load_resources";
+	case BUILD_TASK:     return "build_rendering_task";
+	case OPTIMIZE:       return "optimize";
+	case RUN:            return "render_queue";
+	case WRITE:          return "target_write";
+	default:             break;
+	}
+	return "";
+}
+
+int
+StageProfile::get_frames_count()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)frames[0].size();
+}
+
+std::vector<double>
+StageProfile::get_frames(Stage stage)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<double> result;
+	result.reserve(frames[stage].size());
+	for(std::vector<long long>::const_iterator i = frames[stage].begin(); i != frames[stage].end(); ++i)
+		result.push_back((double)*i*0.000001);
+	return result;
+}
+
+StageProfile::Statistics
+StageProfile::get_statistics(Stage stage)
+{
+	std::vector<double> values = get_frames(stage);
+	Statistics statistics;
+	if (values.empty())
+		return statistics;
+
+	std::sort(values.begin(), values.end());
+	const int count = (int)values.size();
+	statistics.min = values.front();
+	statistics.median = count % 2 ? values[count/2] : 0.5*(values[count/2 - 1] + values[count/2]);
+	// nearest-rank percentile
+	statistics.p99 = values[std::max(0, (99*count + 99)/100 - 1)];
+	for(std::vector<double>::const_iterator i = values.begin(); i != values.end(); ++i)
+		statistics.total += *i;
+	return statistics;
+}
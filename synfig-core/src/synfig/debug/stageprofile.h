@@ -0,0 +1,115 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file stageprofile.h
+**	\brief Per-frame timing of the render pipeline stages
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_DEBUG_STAGEPROFILE_H
+#define __SYNFIG_DEBUG_STAGEPROFILE_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+namespace debug {
+
+//! Accumulates the time which the targets spend in the stages of the render pipeline
+//! and splits it by frames. Profiling is disabled by default, then the scopes
+//! cost only the check of the flag.
+//! Targets rendering several frames at once (Target_Tile) prepare the next frame
+//! before the previous one is finished, so its preparation is counted in the previous frame.
+class StageProfile {
+public:
+	enum Stage {
+		SET_TIME = 0,    //!< Canvas::set_time()
+		LOAD_RESOURCES,  //!< Canvas::load_resources()
+		BUILD_TASK,      //!< Canvas::build_rendering_task()
+		OPTIMIZE,        //!< Renderer::optimize()
+		RUN,             //!< waiting for the tasks in the RenderQueue
+		WRITE,           //!< passing of the rendered frame to the target
+		STAGES_COUNT
+	};
+
+	//! Time of the stage per frame, in seconds
+	struct Statistics {
+		double min;
+		double median;
+		double p99;
+		double total;
+		Statistics(): min(), median(), p99(), total() { }
+	};
+
+	//! Adds the time of its life to the stage
+	class Scope {
+	private:
+		Stage stage;
+		long long start;
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	public:
+		explicit Scope(Stage stage, bool active = true):
+			stage(stage), start(active && is_enabled() ? get_time() : -1) { }
+		~Scope()
+			{ if (start >= 0) add(stage, get_time() - start); }
+	};
+
+private:
+	static std::atomic<bool> enabled;
+	static std::mutex mutex;
+	static long long current[STAGES_COUNT];
+	static std::vector<long long> frames[STAGES_COUNT];
+
+	//! Monotonic time in microseconds
+	static long long get_time();
+
+public:
+	static bool is_enabled() { return enabled; }
+	static void set_enabled(bool x) { enabled = x; }
+
+	//! Adds \a microseconds to the stage of the current frame
+	static void add(Stage stage, long long microseconds);
+	//! Closes the current frame, the next stages are counted in the next one
+	static void frame_finished();
+	//! Drops the collected frames
+	static void reset();
+
+	static const char* get_stage_name(Stage stage);
+	static int get_frames_count();
+	//! Time of the stage in each of the frames, in seconds
+	static std::vector<double> get_frames(Stage stage);
+	static Statistics get_statistics(Stage stage);
+};
+
+}; // END of namespace debug
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
@@ -0,0 +1,80 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file encoderqueue.cpp
+**	\brief EncoderQueue File
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <sigc++/bind.h>
+
+#include "encoderqueue.h"
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+EncoderQueue::EncoderQueue(int max_jobs):
+	max_jobs(max_jobs > 0 ? max_jobs : ThreadPool::instance().get_max_threads()),
+	jobs(0)
+{ }
+
+EncoderQueue::~EncoderQueue()
+	{ wait(); }
+
+void
+EncoderQueue::process(const Slot &slot) {
+	slot();
+	std::lock_guard<std::mutex> lock(mutex);
+	--jobs;
+	cond.notify_all();
+}
+
+void
+EncoderQueue::enqueue(const Slot &slot) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while(jobs >= max_jobs)
+			ThreadPool::instance().wait(cond, lock);
+		++jobs;
+	}
+	ThreadPool::instance().enqueue( sigc::bind( sigc::mem_fun(this, &EncoderQueue::process), slot ));
+}
+
+void
+EncoderQueue::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while(jobs > 0)
+		ThreadPool::instance().wait(cond, lock);
+}
+
+/* === E N T R Y P O I N T ================================================= */
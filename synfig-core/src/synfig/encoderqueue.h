@@ -0,0 +1,78 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file encoderqueue.h
+**	\brief EncoderQueue Header
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_ENCODERQUEUE_H
+#define __SYNFIG_ENCODERQUEUE_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <mutex>
+#include <condition_variable>
+
+#include "threadpool.h"
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+
+//! Encodes the finished frames of the image sequences in the ThreadPool,
+//! so the rendering of the next frame is not blocked by the compression
+//! of the previous ones. Count of the frames in progress is limited,
+//! enqueue() blocks until one of them is written.
+class EncoderQueue {
+public:
+	typedef ThreadPool::Slot Slot;
+
+private:
+	std::mutex mutex;
+	std::condition_variable cond;
+	int max_jobs;
+	int jobs;
+
+	void process(const Slot &slot);
+
+	EncoderQueue(const EncoderQueue&) = delete;
+	EncoderQueue& operator=(const EncoderQueue&) = delete;
+
+public:
+	//! \param max_jobs limit of the frames in progress, zero or less means count of the threads
+	explicit EncoderQueue(int max_jobs = 0);
+	//! Waits for all of the frames
+	~EncoderQueue();
+
+	int get_max_jobs() const { return max_jobs; }
+
+	//! Runs the \a slot in background, the slot should write the frame and report its errors itself
+	void enqueue(const Slot &slot);
+	//! Waits until all of the enqueued frames are written
+	void wait();
+};
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
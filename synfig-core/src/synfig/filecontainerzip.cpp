@@ -38,6 +38,7 @@
 
 #include <ETL/stringf>
 
+#include "filesystemnative.h"
 #include "zstreambuf.h"
 
 #include "filecontainerzip.h"
@@ -243,6 +244,46 @@ changed_(false)
 
 FileContainerZip::~FileContainerZip() { close(); }
 
+FileContainerZip::FileMap::iterator FileContainerZip::find_file(const String &filename)
+{
+	FileIndex::const_iterator i = files_index_.find(fix_slashes(filename));
+	return i == files_index_.end() ? files_.end() : i->second;
+}
+
+FileContainerZip::FileMap::iterator FileContainerZip::add_file(const FileInfo &info)
+{
+	std::pair<FileMap::iterator, bool> result = files_.insert(FileMap::value_type(info.name, info));
+	if (!result.second)
+		result.first->second = info;
+	files_index_[info.name] = result.first;
+	return result.first;
+}
+
+void FileContainerZip::remove_file(const String &filename)
+{
+	String name = fix_slashes(filename);
+	files_index_.erase(name);
+	files_.erase(name);
+}
+
+void FileContainerZip::rebuild_files_index()
+{
+	files_index_.clear();
+	files_index_.reserve(files_.size());
+	for(FileMap::iterator i = files_.begin(); i != files_.end(); i++)
+		files_index_[i->first] = i;
+}
+
+bool FileContainerZip::map_storage(file_size_t size)
+{
+	// storage file only grows, so the old mapping is valid while it covers requested range
+	if (storage_mapped_ && (file_size_t)storage_mapped_->size() >= size)
+		return true;
+	fflush(storage_file_);
+	storage_mapped_ = FileSystemNative::instance()->map_file(storage_filename_);
+	return storage_mapped_ && (file_size_t)storage_mapped_->size() >= size;
+}
+
 unsigned int FileContainerZip::crc32(unsigned int previous_crc, const void *buffer, size_t size)
 {
 	static const unsigned int table[] = {
@@ -396,7 +437,7 @@ bool FileContainerZip::create(const String &container_filename)
 	if (is_opened()) return false;
 	storage_file_ = g_fopen(fix_slashes(container_filename).c_str(), "w+b");
 	
-	if (is_opened()) changed_ = true;
+	if (is_opened()) { storage_filename_ = container_filename; changed_ = true; }
 	return is_opened();
 }
 
@@ -500,7 +541,9 @@ bool FileContainerZip::open_from_history(const String &container_filename, file_
 	// loaded
 	fseek(f, 0, SEEK_END);
 	storage_file_ = f;
+	storage_filename_ = container_filename;
 	files_.swap( files );
+	rebuild_files_index();
 	prev_storage_size_ = actual_filesize;
 	file_reading_ = false;
 	file_writing_ = false;
@@ -611,7 +654,13 @@ void FileContainerZip::close()
 	// close storage file and clead variables
 	fclose(storage_file_);
 	storage_file_ = NULL;
+	storage_filename_.clear();
+	{
+		std::lock_guard<std::mutex> lock(mapping_mutex_);
+		storage_mapped_.reset();
+	}
 	files_.clear();
+	files_index_.clear();
 	prev_storage_size_ = 0;
 	file_reading_ = false;
 	file_writing_ = false;
@@ -626,7 +675,7 @@ bool FileContainerZip::is_opened()
 bool FileContainerZip::is_file(const String &filename)
 {
 	if (!is_opened()) return false;
-	FileMap::const_iterator i = files_.find(fix_slashes(filename));
+	FileMap::const_iterator i = find_file(filename);
 	return i != files_.end() && !i->second.is_directory;
 }
 
@@ -634,7 +683,7 @@ bool FileContainerZip::is_directory(const String &filename)
 {
 	if (!is_opened()) return false;
 	if (filename.empty()) return true;
-	FileMap::const_iterator i = files_.find(fix_slashes(filename));
+	FileMap::const_iterator i = find_file(filename);
 	return i != files_.end() && i->second.is_directory;
 }
 
@@ -659,7 +708,7 @@ bool FileContainerZip::directory_create(const String &dirname)
 	 || !is_directory(info.name_part_directory)) return false;
 
 	changed_ = true;
-	files_[info.name] = info;
+	add_file(info);
 	return true;
 }
 
@@ -667,8 +716,9 @@ bool FileContainerZip::directory_scan(const String &dirname, FileList &out_files
 {
 	out_files.clear();
 	if (!is_directory(dirname)) return false;
+	String directory = fix_slashes(dirname);
 	for(FileMap::iterator i = files_.begin(); i != files_.end(); i++)
-		if (i->second.name_part_directory == fix_slashes(dirname))
+		if (i->second.name_part_directory == directory)
 			out_files.push_back(i->second.name_part_localname);
 	return true;
 }
@@ -681,7 +731,7 @@ bool FileContainerZip::file_remove(const String &filename)
 		directory_scan(filename, files);
 		if (!files.empty()) return false;
 		changed_ = true;
-		files_.erase(fix_slashes(filename));
+		remove_file(filename);
 	}
 	else
 	if (is_file(filename))
@@ -689,7 +739,7 @@ bool FileContainerZip::file_remove(const String &filename)
 		if (file_is_opened() && file_->first == fix_slashes(filename))
 			return false;
 		changed_ = true;
-		files_.erase(fix_slashes(filename));
+		remove_file(filename);
 	}
 	return true;
 }
@@ -711,7 +761,7 @@ bool FileContainerZip::file_open_read_whole_container()
 bool FileContainerZip::file_open_read(const String &filename)
 {
 	if (!is_opened() || file_is_opened()) return false;
-	file_ = files_.find(fix_slashes(filename));
+	file_ = find_file(filename);
 	if (file_ == files_.end() || file_->second.is_directory)
 		return false;
 
@@ -735,7 +785,7 @@ bool FileContainerZip::file_open_write(const String &filename)
 	if (!is_opened() || file_is_opened()) return false;
 	if (!file_check_name(filename)) return false;
 
-	file_ = files_.find(fix_slashes(filename));
+	file_ = find_file(filename);
 
 	FileInfo new_info;
 	if (file_ == files_.end())
@@ -771,15 +821,13 @@ bool FileContainerZip::file_open_write(const String &filename)
 
 	// update file info
 	info.header_offset = offset;
+	info.data_offset = offset + sizeof(lfh) + info.name.size();
 	info.size = 0;
 	info.compression = 0;
 	info.crc32 = 0;
 	info.time = t;
 	if (file_ == files_.end())
-	{
-		files_[new_info.name] = new_info;
-		file_ = files_.find(fix_slashes(filename));
-	}
+		file_ = add_file(new_info);
 	file_writing_ = true;
 	file_processed_size_ = 0;
 	return true;
@@ -849,4 +897,35 @@ FileSystem::ReadStream::Handle FileContainerZip::get_read_stream(const String &f
 	return stream;
 }
 
+FileSystem::MappedFile::Handle FileContainerZip::get_mapped_file(const String &filename)
+{
+	// mapped files may be requested from several threads
+	std::lock_guard<std::mutex> lock(mapping_mutex_);
+
+	// data of the file opened for write may be not flushed yet
+	if (!is_opened() || file_is_opened_for_write())
+		return MappedFile::Handle();
+
+	FileMap::iterator i = find_file(filename);
+	if (i == files_.end() || i->second.is_directory || i->second.compression != 0)
+		return MappedFile::Handle();
+	FileInfo &info = i->second;
+
+	if (info.data_offset == 0)
+	{
+		// skip local header
+		if (!map_storage(info.header_offset + sizeof(LocalFileHeader)))
+			return MappedFile::Handle();
+		LocalFileHeader lfh;
+		memcpy(&lfh, storage_mapped_->data() + info.header_offset, sizeof(lfh));
+		if (lfh.signature != LocalFileHeader::valid_signature__)
+			return MappedFile::Handle();
+		info.data_offset = info.header_offset + sizeof(lfh) + lfh.filename_length + lfh.extrafield_length;
+	}
+
+	if (!map_storage(info.data_offset + info.size))
+		return MappedFile::Handle();
+	return MappedFile::Handle(new MappedFile(storage_mapped_, (size_t)info.data_offset, (size_t)info.size));
+}
+
 /* === E N T R Y P O I N T ================================================= */
@@ -28,6 +28,8 @@
 /* === H E A D E R S ======================================================= */
 
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <ctime>
 #include "filecontainer.h"
 
@@ -74,6 +76,7 @@ namespace synfig
 			bool directory_saved;
 			file_size_t size;
 			file_size_t header_offset;
+			file_size_t data_offset; //!< offset of the file data, zero if not known yet
 			unsigned int compression;
 			unsigned int crc32;
 			time_t time;
@@ -85,13 +88,18 @@ namespace synfig
 
 			inline FileInfo():
 				is_directory(false), directory_saved(false),
-				size(0), header_offset(0), compression(0), crc32(0), time(0) { }
+				size(0), header_offset(0), data_offset(0), compression(0), crc32(0), time(0) { }
 		};
 
 		typedef std::map< String, FileInfo > FileMap;
+		typedef std::unordered_map< String, FileMap::iterator > FileIndex;
 
 		FILE *storage_file_;
+		String storage_filename_;
 		FileMap files_;
+		FileIndex files_index_;
+		MappedFile::Handle storage_mapped_;
+		std::mutex mapping_mutex_; //!< guards storage_mapped_ and FileInfo::data_offset
 		file_size_t prev_storage_size_;
 		bool file_reading_whole_container_;
 		bool file_reading_;
@@ -105,6 +113,13 @@ namespace synfig
 		static HistoryRecord decode_history(const String &comment);
 		static void read_history(std::list<HistoryRecord> &list, FILE *f, file_size_t size);
 
+		FileMap::iterator find_file(const String &filename);
+		FileMap::iterator add_file(const FileInfo &info);
+		void remove_file(const String &filename);
+		void rebuild_files_index();
+		//! Should be called with locked mapping_mutex_
+		bool map_storage(file_size_t size);
+
 	public:
 		FileContainerZip();
 		virtual ~FileContainerZip();
@@ -140,6 +155,10 @@ namespace synfig
 		virtual size_t file_write(const void *buffer, size_t size);
 
 		virtual FileSystem::ReadStream::Handle get_read_stream(const String &filename);
+
+		//! Returns the data of the stored (uncompressed) file directly
+		//! from the memory mapped container
+		virtual FileSystem::MappedFile::Handle get_mapped_file(const String &filename);
 	};
 
 }
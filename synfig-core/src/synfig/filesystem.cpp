@@ -30,6 +30,7 @@
 #endif
 
 #include <glibmm.h>
+#include <algorithm>
 #include <cstdio>
 
 #include <ETL/stringf>
@@ -97,12 +98,32 @@ FileSystem::WriteStream::overflow(int character)
 	return character != EOF && sizeof(c) == internal_write(&c, sizeof(c)) ? character : EOF;
 }
 
+// MappedFile
+
+FileSystem::MappedFile::MappedFile():
+	data_(), size_() { }
+
+FileSystem::MappedFile::MappedFile(const Handle &parent, size_t offset, size_t size):
+	parent_(parent), data_(), size_()
+{
+	if (parent_ && offset <= parent_->size())
+	{
+		data_ = parent_->data() + offset;
+		size_ = std::min(size, parent_->size() - offset);
+	}
+}
+
+FileSystem::MappedFile::~MappedFile()
+	{ }
+
 // Identifier
 
 FileSystem::ReadStream::Handle FileSystem::Identifier::get_read_stream() const
 	{ return file_system ? file_system->get_read_stream(filename) : ReadStream::Handle(); }
 FileSystem::WriteStream::Handle FileSystem::Identifier::get_write_stream() const
 	{ return file_system ? file_system->get_write_stream(filename) : WriteStream::Handle(); }
+FileSystem::MappedFile::Handle FileSystem::Identifier::get_mapped_file() const
+	{ return file_system ? file_system->get_mapped_file(filename) : MappedFile::Handle(); }
 
 
 // FileSystem
@@ -231,6 +252,9 @@ FileSystem::safe_get_line(std::istream& is, String& t)
 String FileSystem::get_real_uri(const String & /* filename */)
 	{ return String(); }
 
+FileSystem::MappedFile::Handle FileSystem::get_mapped_file(const String & /* filename */)
+	{ return MappedFile::Handle(); }
+
 String FileSystem::get_real_filename(const String &filename) {
 	return Glib::filename_from_uri(get_real_uri(filename));
 }
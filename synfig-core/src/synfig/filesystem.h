@@ -121,6 +121,29 @@ namespace synfig
 				{ return write_whole_block(&v, sizeof(T)); }
 		};
 
+		//! Read-only contents of the whole file placed in memory
+		//! (usually mapped from disk), so it may be used without copying
+		class MappedFile : public etl::shared_object
+		{
+		public:
+			typedef etl::handle<MappedFile> Handle;
+
+		protected:
+			Handle parent_;
+			const char *data_;
+			size_t size_;
+
+			MappedFile();
+		public:
+			//! Creates the view of the part of the \a parent, view holds the parent
+			MappedFile(const Handle &parent, size_t offset, size_t size);
+			virtual ~MappedFile();
+
+			const char* data() const { return data_; }
+			size_t size() const { return size_; }
+			bool empty() const { return size_ == 0; }
+		};
+
 		class Identifier {
 		public:
 			FileSystem::Handle file_system;
@@ -170,6 +193,7 @@ namespace synfig
 
 			ReadStream::Handle get_read_stream() const;
 			WriteStream::Handle get_write_stream() const;
+			MappedFile::Handle get_mapped_file() const;
 		};
 
 		FileSystem();
@@ -187,6 +211,10 @@ namespace synfig
 		virtual WriteStream::Handle get_write_stream(const String &filename) = 0;
 		virtual String get_real_uri(const String &filename);
 
+		//! Returns the contents of the file placed in memory without copying,
+		//! or an empty handle if it's not possible, use get_read_stream() then
+		virtual MappedFile::Handle get_mapped_file(const String &filename);
+
 		inline bool is_exists(const String filename) { return is_file(filename) || is_directory(filename); }
 
 		String get_real_filename(const String &filename);
@@ -228,6 +228,15 @@ String FileSystemGroup::get_real_uri(const String &filename)
 		 : String();
 }
 
+FileSystem::MappedFile::Handle FileSystemGroup::get_mapped_file(const String &filename)
+{
+	FileSystem::Handle file_system;
+	String internal_filename;
+	return find_system(filename, file_system, internal_filename)
+	     ? file_system->get_mapped_file(internal_filename)
+	     : FileSystem::MappedFile::Handle();
+}
+
 /* === E N T R Y P O I N T ================================================= */
 
 
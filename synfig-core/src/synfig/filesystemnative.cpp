@@ -82,6 +82,29 @@ size_t FileSystemNative::WriteStream::internal_write(const void *buffer, size_t
 	{ return fwrite(buffer, 1, size, file_); }
 
 
+// MappedFile
+
+FileSystemNative::MappedFile::MappedFile(GMappedFile *file):
+	file_(file), buffer_()
+{
+	data_ = g_mapped_file_get_contents(file_);
+	size_ = g_mapped_file_get_length(file_);
+}
+
+FileSystemNative::MappedFile::MappedFile(char *buffer, size_t size):
+	file_(), buffer_(buffer)
+{
+	data_ = buffer_;
+	size_ = size;
+}
+
+FileSystemNative::MappedFile::~MappedFile()
+{
+	if (file_) g_mapped_file_unref(file_);
+	g_free(buffer_);
+}
+
+
 // FileSystemNative
 
 FileSystemNative::FileSystemNative() { }
@@ -144,6 +167,23 @@ FileSystem::WriteStream::Handle FileSystemNative::get_write_stream(const String
 	     : FileSystem::WriteStream::Handle(new WriteStream(this, f));
 }
 
+FileSystem::MappedFile::Handle FileSystemNative::get_mapped_file(const String &filename)
+{
+	gchar *contents = NULL;
+	gsize length = 0;
+	if (!g_file_get_contents(fix_slashes(filename).c_str(), &contents, &length, NULL))
+		return FileSystem::MappedFile::Handle();
+	return FileSystem::MappedFile::Handle(new MappedFile(contents, (size_t)length));
+}
+
+FileSystem::MappedFile::Handle FileSystemNative::map_file(const String &filename)
+{
+	GMappedFile *file = g_mapped_file_new(fix_slashes(filename).c_str(), FALSE, NULL);
+	return file == NULL
+	     ? FileSystem::MappedFile::Handle()
+	     : FileSystem::MappedFile::Handle(new MappedFile(file));
+}
+
 String FileSystemNative::get_real_uri(const String &filename)
 {
 	if (filename.empty()) return String();
@@ -33,6 +33,8 @@
 
 /* === T Y P E D E F S ===================================================== */
 
+typedef struct _GMappedFile GMappedFile;
+
 /* === C L A S S E S & S T R U C T S ======================================= */
 
 namespace synfig
@@ -69,6 +71,21 @@ namespace synfig
 			virtual ~WriteStream();
 		};
 
+		//! Contents of the file mapped from disk or read into memory
+		class MappedFile : public FileSystem::MappedFile
+		{
+		public:
+			typedef etl::handle<MappedFile> Handle;
+		protected:
+			friend class FileSystemNative;
+			GMappedFile *file_;
+			char *buffer_;
+			MappedFile(GMappedFile *file);
+			MappedFile(char *buffer, size_t size);
+		public:
+			virtual ~MappedFile();
+		};
+
 	private:
 		static const Handle instance__;
 		FileSystemNative();
@@ -90,6 +107,13 @@ namespace synfig
 		virtual FileSystem::ReadStream::Handle get_read_stream(const String &filename);
 		virtual FileSystem::WriteStream::Handle get_write_stream(const String &filename);
 		virtual String get_real_uri(const String &filename);
+		//! Reads the whole file into memory. Files are not really mapped here,
+		//! because other processes may truncate them, what crashes the mapping process.
+		virtual FileSystem::MappedFile::Handle get_mapped_file(const String &filename);
+		//! Maps the file into memory, the file should not be changed by the other processes
+		//! while the mapping is alive, so it's only for the files owned by synfig
+		//! (like storage of the FileContainerZip)
+		FileSystem::MappedFile::Handle map_file(const String &filename);
 	};
 
 }
@@ -261,6 +261,23 @@ FileSystemTemporary::get_read_stream(const String &filename)
 	return FileSystem::ReadStream::Handle();
 }
 
+FileSystem::MappedFile::Handle
+FileSystemTemporary::get_mapped_file(const String &filename)
+{
+	FileMap::const_iterator i = files.find(fix_slashes(filename));
+	if (i != files.end())
+	{
+		if (!i->second.is_removed && !i->second.is_directory && !i->second.tmp_filename.empty())
+			return file_system->get_mapped_file(i->second.tmp_filename);
+	}
+	else
+	{
+		if (get_sub_file_system())
+			return get_sub_file_system()->get_mapped_file(filename);
+	}
+	return FileSystem::MappedFile::Handle();
+}
+
 FileSystem::WriteStream::Handle
 FileSystemTemporary::get_write_stream(const String &filename)
 {
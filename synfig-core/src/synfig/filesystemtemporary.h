@@ -100,6 +100,7 @@ namespace synfig
 		virtual FileSystem::ReadStream::Handle get_read_stream(const String &filename);
 		virtual FileSystem::WriteStream::Handle get_write_stream(const String &filename);
 		virtual String get_real_uri(const String &filename);
+		virtual FileSystem::MappedFile::Handle get_mapped_file(const String &filename);
 
 		const FileSystem::Handle& get_sub_file_system() const
 			{ return sub_file_system; }
@@ -90,6 +90,9 @@ extern void info(const String &str);
 //! Returns absolute path to the binary
 extern String get_binary_path(const String &fallback_path);
 
+//! Escapes quotes, backslashes and control characters to write the string into JSON
+extern String escape_json(const String &str);
+
 }; // END of namespace synfig
 
 /* === E N D =============================================================== */
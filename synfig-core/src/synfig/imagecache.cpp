@@ -0,0 +1,243 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file imagecache.cpp
+**	\brief Process-wide cache of decoded images
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "imagecache.h"
+
+#include <synfig/rendering/software/surfaceswpacked.h>
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define DEFAULT_BUDGET_MB 512
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+ImageCache::ImageCache():
+	bytes(),
+	budget((size_t)DEFAULT_BUDGET_MB << 20),
+	pack_evicted(true)
+{
+	if (const char *s = getenv("SYNFIG_IMAGE_CACHE_SIZE"))
+		budget = (size_t)std::max(0, atoi(s)) << 20;
+	if (const char *s = getenv("SYNFIG_IMAGE_CACHE_PACK"))
+		pack_evicted = atoi(s) != 0;
+}
+
+ImageCache&
+ImageCache::instance()
+{
+	static ImageCache cache;
+	return cache;
+}
+
+size_t
+ImageCache::get_surface_bytes(const rendering::Surface::Handle &surface)
+{
+	if (!surface)
+		return 0;
+	if (rendering::SurfaceSWPacked::Handle packed = rendering::SurfaceSWPacked::Handle::cast_dynamic(surface))
+		return sizeof(*packed) + packed->get_surface().get_data_size();
+	return sizeof(*surface) + surface->get_pixels_count()*sizeof(Color);
+}
+
+void
+ImageCache::shrink(std::unique_lock<std::mutex> &lock)
+{
+	List::iterator i = entries.end();
+	while(bytes > budget && i != entries.begin())
+	{
+		--i;
+
+		if (pack_evicted && !i->packed)
+		{
+			// try to keep the compressed copy before dropping the entry,
+			// the packing is slow, so other threads may use the cache meanwhile
+			i->packed = true;
+			const Key key = i->key;
+			const rendering::Surface::Handle surface = i->surface;
+			lock.unlock();
+			rendering::Surface::Handle packed = new rendering::SurfaceSWPacked(*surface);
+			size_t packed_bytes = get_surface_bytes(packed);
+			lock.lock();
+
+			// entry may be replaced or dropped while the lock was released
+			Map::iterator j = map.find(key);
+			if (j == map.end() || j->second->surface != surface)
+				{ i = entries.end(); continue; }
+			i = j->second;
+
+			if (packed->is_exists() && packed_bytes < i->bytes)
+			{
+				bytes = bytes - i->bytes + packed_bytes;
+				i->surface = packed;
+				i->bytes = packed_bytes;
+				i->packed = true;
+				++statistics.packed;
+				continue;
+			}
+		}
+
+		bytes -= i->bytes;
+		map.erase(i->key);
+		i = entries.erase(i);
+		++statistics.evicted;
+	}
+}
+
+rendering::Surface::Handle
+ImageCache::get(const Key &key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Map::iterator i = map.find(key);
+	if (i == map.end())
+		{ ++statistics.misses; return rendering::Surface::Handle(); }
+	++statistics.hits;
+	entries.splice(entries.begin(), entries, i->second);
+	return i->second->surface;
+}
+
+bool
+ImageCache::has(const Key &key) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return map.count(key) != 0;
+}
+
+void
+ImageCache::put(const Key &key, const rendering::Surface::Handle &surface)
+{
+	if (!surface || !surface->is_exists())
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	Map::iterator i = map.find(key);
+	if (i != map.end())
+	{
+		bytes -= i->second->bytes;
+		entries.erase(i->second);
+		map.erase(i);
+	}
+
+	Entry entry;
+	entry.key = key;
+	entry.surface = surface;
+	entry.bytes = get_surface_bytes(surface);
+	entry.packed = (bool)rendering::SurfaceSWPacked::Handle::cast_dynamic(surface);
+	entries.push_front(entry);
+	map[key] = entries.begin();
+	bytes += entry.bytes;
+
+	shrink(lock);
+}
+
+void
+ImageCache::forget(const FileSystem::Identifier &identifier)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for(List::iterator i = entries.begin(); i != entries.end();)
+	{
+		if (i->key.identifier == identifier)
+		{
+			bytes -= i->bytes;
+			map.erase(i->key);
+			i = entries.erase(i);
+		}
+		else ++i;
+	}
+}
+
+void
+ImageCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	map.clear();
+	entries.clear();
+	bytes = 0;
+}
+
+void
+ImageCache::set_budget(size_t x)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	budget = x;
+	shrink(lock);
+}
+
+size_t
+ImageCache::get_budget() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return budget;
+}
+
+void
+ImageCache::set_pack_evicted(bool x)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	pack_evicted = x;
+}
+
+bool
+ImageCache::get_pack_evicted() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pack_evicted;
+}
+
+ImageCache::Statistics
+ImageCache::get_statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Statistics s = statistics;
+	s.entries = map.size();
+	s.bytes = bytes;
+	s.budget = budget;
+	return s;
+}
+
+void
+ImageCache::reset_statistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	statistics = Statistics();
+}
+
+/* === E N T R Y P O I N T ================================================= */
@@ -0,0 +1,152 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file imagecache.h
+**	\brief Process-wide cache of decoded images
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_IMAGECACHE_H
+#define __SYNFIG_IMAGECACHE_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "filesystem.h"
+#include "time.h"
+
+#include <synfig/rendering/surface.h>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+
+/*!	\class ImageCache
+**	\brief Keeps decoded frames of imported files shared between all importers.
+*
+*	Entries are addressed by the file identifier, frame time and the requested
+*	size (zero size means the native size of the image). When the total size
+*	of the cached surfaces exceeds the budget, the least recently used entries
+*	are packed into compressed surfaces (if enabled) and then dropped.
+*
+*	Budget may be set by the SYNFIG_IMAGE_CACHE_SIZE environment variable
+*	(in megabytes), packing of evicted entries is controlled by the
+*	SYNFIG_IMAGE_CACHE_PACK variable.
+*/
+class ImageCache
+{
+public:
+	struct Key
+	{
+		FileSystem::Identifier identifier;
+		Time time;
+		int width;
+		int height;
+
+		Key(): width(), height() { }
+		Key(const FileSystem::Identifier &identifier, const Time &time, int width = 0, int height = 0):
+			identifier(identifier), time(time), width(width), height(height) { }
+
+		bool operator< (const Key &other) const
+		{
+			if (identifier < other.identifier) return true;
+			if (other.identifier < identifier) return false;
+			if (time < other.time) return true;
+			if (other.time < time) return false;
+			if (width < other.width) return true;
+			if (other.width < width) return false;
+			return height < other.height;
+		}
+	};
+
+	struct Statistics
+	{
+		long long hits;
+		long long misses;
+		long long packed;
+		long long evicted;
+		size_t entries;
+		size_t bytes;
+		size_t budget;
+
+		Statistics(): hits(), misses(), packed(), evicted(), entries(), bytes(), budget() { }
+	};
+
+private:
+	struct Entry
+	{
+		Key key;
+		rendering::Surface::Handle surface;
+		size_t bytes;
+		bool packed;
+		Entry(): bytes(), packed() { }
+	};
+
+	typedef std::list<Entry> List;
+	typedef std::map<Key, List::iterator> Map;
+
+	mutable std::mutex mutex;
+
+	List entries; //!< most recently used entries are at the front
+	Map map;
+	size_t bytes;
+	size_t budget;
+	bool pack_evicted;
+	Statistics statistics;
+
+	ImageCache();
+
+	static size_t get_surface_bytes(const rendering::Surface::Handle &surface);
+	//! Drops or packs the least recently used entries until the budget is met,
+	//! \a lock should be locked, it is released while the surfaces are packed
+	void shrink(std::unique_lock<std::mutex> &lock);
+
+public:
+	static ImageCache& instance();
+
+	//! Returns cached surface or an empty handle if not found
+	rendering::Surface::Handle get(const Key &key);
+	//! Checks presence of the surface, does not touch statistics and LRU order
+	bool has(const Key &key) const;
+	//! Puts surface into cache, replaces the previous surface with the same key
+	void put(const Key &key, const rendering::Surface::Handle &surface);
+	//! Removes all frames of the file
+	void forget(const FileSystem::Identifier &identifier);
+	void clear();
+
+	void set_budget(size_t x);
+	size_t get_budget() const;
+
+	void set_pack_evicted(bool x);
+	bool get_pack_evicted() const;
+
+	Statistics get_statistics() const;
+	void reset_statistics();
+}; // END of class ImageCache
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
@@ -0,0 +1,233 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file imageprefetcher.cpp
+**	\brief Background loading of frames of animated imported files
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "imageprefetcher.h"
+
+#include "canvas.h"
+#include "filesystem.h"
+#include "general.h"
+#include "imagecache.h"
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define DEFAULT_LOOK_AHEAD 4
+#define DEFAULT_THREADS 2
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+ImagePrefetcher::ImagePrefetcher():
+	running_tasks(),
+	stopped(),
+	renders(),
+	canvas(),
+	frame_duration(),
+	look_ahead(DEFAULT_LOOK_AHEAD),
+	max_threads(DEFAULT_THREADS)
+{
+	if (const char *s = getenv("SYNFIG_PREFETCH_FRAMES"))
+		look_ahead = std::max(0, atoi(s));
+	if (const char *s = getenv("SYNFIG_PREFETCH_THREADS"))
+		max_threads = std::max(1, atoi(s));
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+	// stop threads if render was not finished properly
+	while(renders > 0)
+		end();
+}
+
+ImagePrefetcher&
+ImagePrefetcher::instance()
+{
+	static ImagePrefetcher prefetcher;
+	return prefetcher;
+}
+
+void
+ImagePrefetcher::thread_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true)
+	{
+		while(!stopped && queue.empty())
+			cond.wait(lock);
+		if (stopped)
+			break;
+
+		Task task = queue.front();
+		queue.pop_front();
+		++running_tasks;
+		lock.unlock();
+
+		try
+		{
+			task.importer->load_frame(task.renddesc, task.time);
+		}
+		catch(const String &s)
+		{
+			synfig::warning("ImagePrefetcher: %s", s.c_str());
+		}
+		catch(...)
+		{
+			synfig::warning("ImagePrefetcher: Unable to load frame from \"%s\"", task.importer->identifier.filename.c_str());
+		}
+
+		lock.lock();
+		--running_tasks;
+		// keep the importer alive, so it will not be destroyed in this thread
+		processed.push_back(task);
+		cond_idle.notify_all();
+	}
+}
+
+bool
+ImagePrefetcher::is_scheduled(const Importer::Handle &importer, const Time &time) const
+{
+	for(std::deque<Task>::const_iterator i = queue.begin(); i != queue.end(); ++i)
+		if (i->importer == importer && i->time == time)
+			return true;
+	return false;
+}
+
+void
+ImagePrefetcher::begin(const Canvas *canvas, const Time &time_start, const Time &time_end, Real frame_rate)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (++renders != 1)
+		return;
+
+	this->canvas = canvas;
+	this->time_current = time_start;
+	this->time_end = time_end;
+	frame_duration = frame_rate > 0 ? 1.0/frame_rate : 0.0;
+	if (look_ahead <= 0 || frame_duration <= 0)
+		return;
+
+	stopped = false;
+	for(int i = 0; i < max_threads; ++i)
+		threads.push_back(new std::thread(&ImagePrefetcher::thread_loop, this));
+}
+
+void
+ImagePrefetcher::end()
+{
+	std::vector<std::thread*> threads_to_join;
+	std::deque<Task> cancelled;
+	std::vector<Task> release;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (renders <= 0 || --renders != 0)
+			return;
+
+		cancelled.swap(queue);
+		while(running_tasks > 0)
+			cond_idle.wait(lock);
+		stopped = true;
+		canvas = NULL;
+		threads_to_join.swap(threads);
+		release.swap(processed);
+	}
+	cond.notify_all();
+
+	for(std::vector<std::thread*>::iterator i = threads_to_join.begin(); i != threads_to_join.end(); ++i)
+		{ (*i)->join(); delete *i; }
+}
+
+void
+ImagePrefetcher::set_time(const Time &time)
+{
+	std::vector<Task> release;
+	std::lock_guard<std::mutex> lock(mutex);
+	time_current = time;
+	release.swap(processed);
+}
+
+void
+ImagePrefetcher::request(const Importer::Handle &importer, const Time &time, const Canvas *canvas)
+{
+	if (!importer || !canvas || !importer->is_prefetchable())
+		return;
+
+	// containers (FileContainerZip) have no real file names and can not be read from several threads
+	const FileSystem::Identifier &identifier = importer->identifier;
+	if (!identifier.file_system || identifier.file_system->get_real_uri(identifier.filename).empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (renders != 1 || threads.empty() || canvas != this->canvas)
+			return;
+
+		// frames are loaded with the same frame rate as the layers of the canvas use
+		const RendDesc &renddesc = canvas->rend_desc();
+		const Real fps = renddesc.get_frame_rate();
+		int frames_left = (int)std::floor((Real)(time_end - time_current)/frame_duration + 0.5);
+		int count = std::min(look_ahead, frames_left);
+		for(int i = 1; i <= count; ++i)
+		{
+			Time t = time + Time(frame_duration*i);
+			if (fps > 0) t = t.round(fps);
+			if ( !is_scheduled(importer, t)
+			  && !ImageCache::instance().has(ImageCache::Key(importer->identifier, t)) )
+				queue.push_back(Task(importer, renddesc, t));
+		}
+	}
+	cond.notify_all();
+}
+
+void
+ImagePrefetcher::set_look_ahead(int x)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	look_ahead = std::max(0, x);
+}
+
+int
+ImagePrefetcher::get_look_ahead() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return look_ahead;
+}
+
+/* === E N T R Y P O I N T ================================================= */
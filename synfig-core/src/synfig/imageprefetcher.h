@@ -0,0 +1,142 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file imageprefetcher.h
+**	\brief Background loading of frames of animated imported files
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_IMAGEPREFETCHER_H
+#define __SYNFIG_IMAGEPREFETCHER_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "importer.h"
+#include "real.h"
+#include "renddesc.h"
+#include "time.h"
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+
+class Canvas;
+
+/*!	\class ImagePrefetcher
+**	\brief Loads upcoming frames of animated importers into ImageCache.
+*
+*	While the render of a frame range is active, each request of a frame
+*	from an animated importer schedules loading of the next frames
+*	(up to the look-ahead count, but not beyond the end of the render)
+*	on background threads. So disk and decoder latency overlaps with
+*	the rendering of the current frame.
+*
+*	Only the layers placed directly in the rendered canvas are prefetched,
+*	their time is not retimed by the groups, so the next frames are known.
+*	Files stored in the containers are not prefetched, because the containers
+*	are not thread-safe. Image lists are not prefetched too (see Importer::is_prefetchable()).
+*	Decoding is serialized per importer by Importer::load_frame(), frames are indexed
+*	with the frame rate of the canvas, as the render requests them by Importer::get_frame().
+*
+*	Look-ahead count and number of threads may be set by the
+*	SYNFIG_PREFETCH_FRAMES and SYNFIG_PREFETCH_THREADS environment
+*	variables, zero look-ahead disables the prefetching.
+*/
+class ImagePrefetcher
+{
+public:
+	//! Marks the render of the frame range in the current scope
+	class Render
+	{
+	public:
+		Render(const Canvas *canvas, const Time &time_start, const Time &time_end, Real frame_rate)
+			{ instance().begin(canvas, time_start, time_end, frame_rate); }
+		~Render()
+			{ instance().end(); }
+	};
+
+private:
+	struct Task
+	{
+		Importer::Handle importer;
+		RendDesc renddesc;
+		Time time;
+		Task() { }
+		Task(const Importer::Handle &importer, const RendDesc &renddesc, const Time &time):
+			importer(importer), renddesc(renddesc), time(time) { }
+	};
+
+	mutable std::mutex mutex;
+	std::condition_variable cond;
+	std::condition_variable cond_idle;
+
+	std::vector<std::thread*> threads;
+	std::deque<Task> queue;
+	std::vector<Task> processed; //!< tasks are released in the main thread
+	int running_tasks;
+	bool stopped;
+
+	int renders;
+	const Canvas *canvas;
+	Time time_current;
+	Time time_end;
+	Real frame_duration;
+	int look_ahead;
+	int max_threads;
+
+	ImagePrefetcher();
+	ImagePrefetcher(const ImagePrefetcher&) = delete;
+
+	void thread_loop();
+	bool is_scheduled(const Importer::Handle &importer, const Time &time) const;
+
+public:
+	~ImagePrefetcher();
+
+	static ImagePrefetcher& instance();
+
+	//! Starts prefetching for the render of frames of \a canvas from \a time_start to \a time_end.
+	//! Prefetching is disabled while more than one render is active.
+	void begin(const Canvas *canvas, const Time &time_start, const Time &time_end, Real frame_rate);
+	//! Cancels pending tasks and waits for running ones
+	void end();
+	//! Sets the time of the frame which is rendering now
+	void set_time(const Time &time);
+
+	//! Called when the frame at \a time was requested from \a importer by the layer of \a canvas,
+	//! \a time should differ from the time of the rendered frame by the constant offset only
+	void request(const Importer::Handle &importer, const Time &time, const Canvas *canvas);
+
+	void set_look_ahead(int x);
+	int get_look_ahead() const;
+}; // END of class ImagePrefetcher
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
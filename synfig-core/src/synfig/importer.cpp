@@ -43,6 +43,7 @@
 #include <synfig/localization.h>
 
 #include "canvas.h"
+#include "imagecache.h"
 #include "importer.h"
 #include "string.h"
 #include "surface.h"
@@ -142,6 +143,7 @@ Importer::open(const FileSystem::Identifier &identifier, bool force)
 void Importer::forget(const FileSystem::Identifier &identifier)
 {
 	__open_importers->erase(identifier);
+	ImageCache::instance().forget(identifier);
 }
 
 Importer::Importer(const FileSystem::Identifier &identifier):
@@ -160,23 +162,51 @@ Importer::~Importer()
 }
 
 rendering::Surface::Handle
-Importer::get_frame(const RendDesc & /* renddesc */, const Time &time)
+Importer::get_frame(const RendDesc &renddesc, const Time &time)
 {
 	if (last_surface_ && last_surface_->is_exists() && !is_animated())
 		return last_surface_;
 
+	return last_surface_ = load_frame(renddesc, time);
+}
+
+rendering::Surface::Handle
+Importer::load_frame(const RendDesc &renddesc, const Time &time)
+{
+	// frames are decoded in native size, so size is not a part of the key
+	Time key_time(0);
+	if (is_animated())
+		key_time = renddesc.get_frame_rate() > 0 ? time.round(renddesc.get_frame_rate()) : time;
+	ImageCache::Key key(identifier, key_time);
+	if (rendering::Surface::Handle surface = ImageCache::instance().get(key))
+		return surface;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// frame may be loaded by another thread while we waited
+	if (ImageCache::instance().has(key))
+		if (rendering::Surface::Handle surface = ImageCache::instance().get(key))
+			return surface;
+
+	// frames are decoded in native size, only the frame rate is passed
+	RendDesc desc;
+	desc.set_frame_rate(renddesc.get_frame_rate());
 	Surface surface;
-	if(!get_frame(surface, RendDesc(), time))
+	if(!get_frame(surface, desc, time))
 		warning(strprintf("Unable to get frame from \"%s\"", identifier.filename.c_str()));
 
+	rendering::Surface::Handle result;
 	const char *s = getenv("SYNFIG_PACK_IMAGES");
 	if (s == nullptr || atoi(s) != 0)
-		last_surface_ = new rendering::SurfaceSWPacked();
+		result = new rendering::SurfaceSWPacked();
 	else
-		last_surface_ = new rendering::SurfaceSW();
+		result = new rendering::SurfaceSW();
 
 	if (surface.is_valid())
-		last_surface_->assign(surface[0], surface.get_w(), surface.get_h());
+	{
+		result->assign(surface[0], surface.get_w(), surface.get_h());
+		ImageCache::instance().put(key, result);
+	}
 
-	return last_surface_;
+	return result;
 }
@@ -30,6 +30,7 @@
 #include <cstdio>
 
 #include <map>
+#include <mutex>
 
 #include <ETL/handle>
 
@@ -147,6 +148,7 @@ public:
 
 private:
 	rendering::Surface::Handle last_surface_;
+	std::mutex mutex_;
 
 protected:
 
@@ -169,9 +171,18 @@ public:
 
 	virtual rendering::Surface::Handle get_frame(const RendDesc &renddesc, const Time &time);
 
+	//! Decodes the frame into the ImageCache, if it's not there yet.
+	//! Frames are indexed by \a time rounded to the frame rate of \a renddesc.
+	//! May be called from any thread, calls of get_frame() are serialized.
+	rendering::Surface::Handle load_frame(const RendDesc &renddesc, const Time &time);
+
 	//! Returns \c true if the importer pays attention to the \a time parameter of get_frame()
 	virtual bool is_animated() { return false; }
 
+	//! Returns \c true if the frames may be loaded by load_frame() in the background threads.
+	//! Importers which open other importers should return \c false, because open() is not thread-safe.
+	virtual bool is_prefetchable() { return is_animated(); }
+
 	//! Attempts to open \a filename, and returns a handle to the associated Importer
 	static Handle open(const FileSystem::Identifier &identifier, bool force=false);
 	static void forget(const FileSystem::Identifier &identifier);
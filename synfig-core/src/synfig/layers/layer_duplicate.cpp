@@ -30,7 +30,11 @@
 #	include <config.h>
 #endif
 
+#include <cmath>
+#include <vector>
+
 #include "layer_duplicate.h"
+#include "layer_pastecanvas.h"
 
 #include <synfig/general.h>
 #include <synfig/localization.h>
@@ -46,6 +50,8 @@
 #include <synfig/valuenode.h>
 
 #include <synfig/rendering/common/task/taskblend.h>
+#include <synfig/rendering/common/task/taskinstances.h>
+#include <synfig/rendering/common/task/tasktransformation.h>
 
 #endif
 
@@ -64,6 +70,128 @@ SYNFIG_LAYER_SET_CATEGORY(Layer_Duplicate,N_("Other"));
 SYNFIG_LAYER_SET_VERSION(Layer_Duplicate,"0.1");
 SYNFIG_LAYER_SET_CVS_ID(Layer_Duplicate,"$Id$");
 
+/* === P R O C E D U R E S ================================================= */
+
+namespace {
+
+typedef std::vector<Layer::ParamList> ParamListList;
+
+void
+collect_params(const Canvas &canvas, ParamListList &out)
+{
+	for(Canvas::const_iterator i = canvas.begin(); i != canvas.end(); ++i)
+	{
+		if (!*i) continue;
+		out.push_back((*i)->get_param_list());
+		if (etl::handle<Layer_PasteCanvas> paste = etl::handle<Layer_PasteCanvas>::cast_dynamic(*i))
+			if (Canvas::Handle sub_canvas = paste->get_sub_canvas())
+				collect_params(*sub_canvas, out);
+	}
+}
+
+//! Collects instances of the group which differs only by the origin, transformation and amount.
+//! Duplicated context should contain the single group, it's copies are rendered
+//! as one sub-task resampled with the different matrices
+class InstanceCollector
+{
+private:
+	const Layer_PasteCanvas *layer;
+	ParamListList params;
+	rendering::Task::Handle prototype;
+	rendering::TaskInstances::InstanceList instances;
+	Real min_scale, max_scale;
+	bool valid;
+
+public:
+	explicit InstanceCollector(Context context):
+		layer(), min_scale(), max_scale(), valid()
+	{
+		while(*context && !context.active())
+			++context;
+		if (!*context)
+			return;
+		Context next = context.get_next();
+		while(*next && !next.active())
+			++next;
+		if (*next)
+			return;
+		layer = dynamic_cast<const Layer_PasteCanvas*>((*context).get());
+		valid = (bool)layer;
+	}
+
+	bool is_valid() const
+		{ return valid; }
+
+	//! Adds the task built for the next index, current values of the params of the layers should be actual
+	void add(const rendering::Task::Handle &task)
+	{
+		if (!valid) return;
+		valid = false;
+
+		// expected result of Layer_PasteCanvas::build_rendering_task_vfunc()
+		rendering::TaskBlend::Handle task_blend = rendering::TaskBlend::Handle::cast_dynamic(task);
+		if ( !task_blend
+		  || task_blend->sub_task_a()
+		  || task_blend->blend_method != Color::BLEND_COMPOSITE )
+			return;
+		rendering::TaskTransformationAffine::Handle task_transformation =
+			rendering::TaskTransformationAffine::Handle::cast_dynamic(task_blend->sub_task_b());
+		if ( !task_transformation
+		  || !task_transformation->sub_task()
+		  || !task_transformation->is_simple() )
+			return;
+		const Matrix &matrix = task_transformation->transformation->matrix;
+		const Real scale = std::sqrt(std::fabs(matrix.det()));
+		if (!matrix.is_invertible() || std::isnan(scale))
+			return;
+
+		// the group should be drawn identically in all of the copies
+		ParamListList current;
+		current.push_back(layer->get_param_list());
+		current.back().erase("origin");
+		current.back().erase("transformation");
+		current.back().erase("amount");
+		if (Canvas::Handle sub_canvas = layer->get_sub_canvas())
+			collect_params(*sub_canvas, current);
+
+		if (instances.empty()) {
+			params.swap(current);
+			prototype = task_transformation->sub_task();
+			min_scale = max_scale = scale;
+		} else {
+			if (current != params)
+				return;
+			min_scale = std::min(min_scale, scale);
+			max_scale = std::max(max_scale, scale);
+		}
+
+		instances.push_back(rendering::TaskInstances::Instance(matrix, task_blend->amount));
+		valid = true;
+	}
+
+	rendering::Task::Handle build_task(ColorReal amount, Color::BlendMethod blend_method) const
+	{
+		// prototype is rendered at the largest scale, the smaller copies are downscaled,
+		// so large difference of the scales will produce aliasing
+		const Real max_scale_ratio = 2.0;
+
+		if ( !valid
+		  || instances.size() < 2
+		  || max_scale > min_scale*max_scale_ratio
+		  || Color::is_straight(blend_method) )
+			return rendering::Task::Handle();
+
+		rendering::TaskInstances::Handle task_instances(new rendering::TaskInstances());
+		task_instances->sub_task() = prototype;
+		task_instances->instances = instances;
+		task_instances->amount = amount;
+		task_instances->blend_method = blend_method;
+		return task_instances;
+	}
+};
+
+} // end of anonimous namespace
+
 /* === M E M B E R S ======================================================= */
 
 Layer_Duplicate::Layer_Duplicate():
@@ -171,6 +299,7 @@ Layer_Duplicate::build_rendering_task_vfunc(Context context) const
 	Color::BlendMethod blend_method = get_blend_method();
 
 	rendering::Task::Handle task;
+	InstanceCollector instances(context);
 
 	std::lock_guard<std::mutex> lock(mutex);
 	duplicate_param->reset_index(time_cur);
@@ -184,8 +313,14 @@ Layer_Duplicate::build_rendering_task_vfunc(Context context) const
 		task_blend->sub_task_a() = task;
 		task_blend->sub_task_b() = context.build_rendering_task();
 		task = task_blend;
+
+		instances.add(task_blend->sub_task_b());
 	}
 	while (duplicate_param->step(time_cur));
 
+	// draw the copies of the same group at once when possible
+	if (rendering::Task::Handle task_instances = instances.build_task(amount, blend_method))
+		return task_instances;
+
 	return task;
 }
@@ -143,7 +143,7 @@ Layer_MeshTransform::build_composite_fork_task_vfunc(ContextParams /* context_pa
 
 	rendering::TaskBlend::Handle task_blend(new rendering::TaskBlend());
 	task_blend->blend_method = Color::BLEND_ALPHA_OVER;
-	task_blend->sub_task_a() = sub_task->clone_recursive();
+	task_blend->sub_task_a() = sub_task;
 	task_blend->sub_task_b() = task_contour;
 
 	rendering::TaskMesh::Handle task_mesh(new rendering::TaskMesh());
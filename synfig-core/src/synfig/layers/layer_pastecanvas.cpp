@@ -90,6 +90,8 @@ Layer_PasteCanvas::Layer_PasteCanvas(Real amount, Color::BlendMethod blend_metho
 	Layer_Composite(amount, blend_method),
 	param_origin(Point()),
 	param_transformation(Transformation()),
+	canvas_static(false),
+	deferred_canvas_pending(false),
 	param_time_dilation(Real(1)),
 	param_time_offset(Time(0)),
 	param_outline_grow(Real(0)),
@@ -117,6 +119,8 @@ Layer_PasteCanvas::~Layer_PasteCanvas()
 String
 Layer_PasteCanvas::get_local_name()const
 {
+	String deferred_id = get_deferred_sub_canvas();
+	if(!deferred_id.empty()) return deferred_id;
 	if(!sub_canvas || sub_canvas->is_inline()) return String();
 	if(sub_canvas->get_root()==get_canvas()->get_root()) return sub_canvas->get_id();
 	return sub_canvas->get_file_name();
@@ -179,6 +183,12 @@ Layer_PasteCanvas::set_param(const String & param, const ValueBase &value)
 	// IMPORT(canvas);
 	if(param=="canvas" && value.can_get(Canvas::Handle()))
 	{
+		{
+			std::lock_guard<std::mutex> lock(deferred_canvas_mutex);
+			deferred_canvas_id.clear();
+			deferred_canvas_pending = false;
+		}
+		canvas_static = value.get_static();
 		set_sub_canvas(value.get(Canvas::Handle()));
 		return true;
 	}
@@ -258,6 +268,73 @@ Layer_PasteCanvas::set_sub_canvas(etl::handle<synfig::Canvas> x)
 		on_canvas_set();
 }
 
+void
+Layer_PasteCanvas::set_deferred_sub_canvas(const String &id, bool is_static)
+{
+	set_sub_canvas(0);
+	canvas_static = is_static;
+	std::lock_guard<std::mutex> lock(deferred_canvas_mutex);
+	deferred_canvas_id = id;
+	deferred_canvas_pending = !id.empty();
+}
+
+String
+Layer_PasteCanvas::get_deferred_sub_canvas()const
+{
+	if (!deferred_canvas_pending)
+		return String();
+	std::lock_guard<std::mutex> lock(deferred_canvas_mutex);
+	return deferred_canvas_id;
+}
+
+bool
+Layer_PasteCanvas::load_deferred_sub_canvas()const
+{
+	if (!deferred_canvas_pending)
+		return true;
+	if (!get_canvas())
+		return false;
+
+	// the flag is cleared when the canvas is assigned,
+	// so the other threads wait here until it is ready
+	std::lock_guard<std::mutex> lock(deferred_canvas_mutex);
+	if (!deferred_canvas_pending)
+		return true;
+
+	Layer_PasteCanvas *layer = const_cast<Layer_PasteCanvas*>(this);
+	String id = deferred_canvas_id;
+	layer->deferred_canvas_id.clear();
+	deferred_canvas_pending = false;
+
+	Canvas::Handle canvas;
+	try
+	{
+		String warnings;
+		canvas = get_canvas()->surefind_canvas(id, warnings);
+		if (!warnings.empty())
+			synfig::warning("%s", warnings.c_str());
+	}
+	catch(const std::exception &x)
+	{
+		synfig::error("Layer_PasteCanvas: unable to load external canvas '%s': %s", id.c_str(), x.what());
+		return false;
+	}
+	if (!canvas)
+		return false;
+
+	layer->set_sub_canvas(canvas);
+
+	// bring the new canvas to the same state as the layer
+	sub_canvas->set_outline_grow(get_outline_grow_mark() + param_outline_grow.get(Real()));
+	if (get_time_mark() != Time::end())
+	{
+		Time time = get_time_mark()*param_time_dilation.get(Real()) + param_time_offset.get(Time());
+		sub_canvas->set_time(time);
+		sub_canvas->load_resources(time);
+	}
+	return true;
+}
+
 // when a pastecanvas that contains another pastecanvas is copy/pasted
 // from one document to another, only the outermost pastecanvas was
 // getting its renddesc set to match that of its new parent.  this
@@ -292,7 +369,9 @@ Layer_PasteCanvas::get_param(const String& param)const
 	EXPORT_VALUE(param_transformation);
 	if (param=="canvas")
 	{
+		load_deferred_sub_canvas();
 		synfig::ValueBase ret(sub_canvas);
+		ret.set_static(canvas_static);
 		return ret;
 	}
 	EXPORT_VALUE(param_time_dilation);
@@ -308,6 +387,8 @@ Layer_PasteCanvas::set_time_vfunc(IndependentContext context, Time time)const
 {
 	context.set_time(time);
 
+	// deferred canvas is loaded by the render, when the layer is really visible,
+	// and it is brought to the time of the layer there
 	if (!sub_canvas)
 		return;
 	if (depth == MAX_DEPTH)
@@ -363,6 +444,7 @@ Layer_PasteCanvas::apply_z_range_to_params(ContextParams &cp)const
 synfig::Layer::Handle
 Layer_PasteCanvas::hit_check(synfig::Context context, const synfig::Point &pos)const
 {
+	load_deferred_sub_canvas();
 	if(!sub_canvas || !get_amount())
 		return context.hit_check(pos);
 	if (depth == MAX_DEPTH)
@@ -384,6 +466,7 @@ Layer_PasteCanvas::hit_check(synfig::Context context, const synfig::Point &pos)c
 Color
 Layer_PasteCanvas::get_color(Context context, const Point &pos)const
 {
+	load_deferred_sub_canvas();
 	if(!sub_canvas || !get_amount())
 		return context.get_color(pos);
 	if (depth == MAX_DEPTH)
@@ -404,6 +487,7 @@ Layer_PasteCanvas::get_color(Context context, const Point &pos)const
 Rect
 Layer_PasteCanvas::get_bounding_rect_context_dependent(const ContextParams &context_params)const
 {
+	load_deferred_sub_canvas();
 	if (!sub_canvas)
 		return Rect::zero();
 
@@ -420,6 +504,7 @@ Layer_PasteCanvas::get_bounding_rect_context_dependent(const ContextParams &cont
 Rect
 Layer_PasteCanvas::get_full_bounding_rect(Context context)const
 {
+	load_deferred_sub_canvas();
 	if (is_disabled() || Color::is_onto(get_blend_method()) || !sub_canvas)
 		return context.get_full_bounding_rect();
 
@@ -436,6 +521,8 @@ Layer_PasteCanvas::get_times_vfunc(Node::time_set &set) const
 	Real time_dilation=param_time_dilation.get(Real());
 	Time time_offset=param_time_offset.get(Time());
 
+	// waypoints should not depend on whether the deferred canvas was rendered
+	load_deferred_sub_canvas();
 	Node::time_set tset;
 	if(sub_canvas) tset = sub_canvas->get_times();
 
@@ -469,6 +556,12 @@ Layer_PasteCanvas::fill_sound_processor(SoundProcessor &soundProcessor) const
 rendering::Task::Handle
 Layer_PasteCanvas::build_rendering_task_vfunc(Context context)const
 {
+	// task is built only for active layers, so the deferred external canvas
+	// is loaded here, unless the layer is invisible at this time or out of z_range
+	Real amount = get_amount() * Context::z_depth_visibility(context.get_params(), *this);
+	if (amount != 0.0)
+		load_deferred_sub_canvas();
+
 	rendering::Task::Handle sub_task;
 	if (sub_canvas)
 	{
@@ -491,7 +584,7 @@ Layer_PasteCanvas::build_rendering_task_vfunc(Context context)const
 	}
 
 	rendering::TaskBlend::Handle task_blend(new rendering::TaskBlend());
-	task_blend->amount = get_amount() * Context::z_depth_visibility(context.get_params(), *this);
+	task_blend->amount = amount;
 	task_blend->blend_method = get_blend_method();
 	task_blend->sub_task_a() = context.build_rendering_task();
 	task_blend->sub_task_b() = sub_task;
@@ -501,6 +594,8 @@ Layer_PasteCanvas::build_rendering_task_vfunc(Context context)const
 Context
 Layer_PasteCanvas::build_context_queue(Context context, CanvasBase &out_queue)const
 {
+	load_deferred_sub_canvas();
+
 	ContextParams params(context.get_params());
 	apply_z_range_to_params(params);
 
@@ -30,6 +30,9 @@
 
 /* === H E A D E R S ======================================================= */
 
+#include <atomic>
+#include <mutex>
+
 #include "layer_composite.h"
 #include <synfig/color.h>
 #include <synfig/vector.h>
@@ -62,6 +65,17 @@ private:
 	ValueBase param_transformation;
 	//! Parameter: (etl::loose_handle<synfig::Canvas>) The canvas parameter
 	etl::loose_handle<synfig::Canvas> sub_canvas;
+	//! Static option of the canvas parameter, the canvas handle can't keep it
+	bool canvas_static;
+	//! Id of the external canvas (like "file.sif#") which is not loaded yet,
+	//! guarded by the deferred_canvas_mutex
+	//! \see set_deferred_sub_canvas()
+	String deferred_canvas_id;
+	//! Protects loading of the deferred external canvas
+	mutable std::mutex deferred_canvas_mutex;
+	//! Set while the deferred_canvas_id is waiting for loading,
+	//! so the loaded layers don't touch the mutex
+	mutable std::atomic<bool> deferred_canvas_pending;
 	//! Parameter: (Real) Time dilation of the paste canvas layer
 	ValueBase param_time_dilation;
 	//! Parameter: (Time) Time offset of the paste canvas layer
@@ -138,10 +152,20 @@ public:
 
 	//! Gets the canvas parameter. It is called sub_canvas to avoid confusion
 	//! with the get_canvas from the Layer class.
-	etl::handle<synfig::Canvas> get_sub_canvas()const { return sub_canvas; }
+	//! Deferred external canvas will be loaded here.
+	etl::handle<synfig::Canvas> get_sub_canvas()const { load_deferred_sub_canvas(); return sub_canvas; }
 	//! Sets the canvas parameter.
 	//! \see get_sub_canvas()
 	void set_sub_canvas(etl::handle<synfig::Canvas> x);
+	//! Remembers the reference to an external canvas without opening it.
+	//! The canvas will be opened the first time when it is required for rendering.
+	//! \see Canvas::set_lazy_loading()
+	void set_deferred_sub_canvas(const String &id, bool is_static = false);
+	//! Gets id of the external canvas which is not loaded yet
+	String get_deferred_sub_canvas()const;
+	//! Opens the external canvas remembered by set_deferred_sub_canvas()
+	//! and assigns it to the canvas parameter
+	bool load_deferred_sub_canvas()const;
 	//! Gets time dilation parameter
 	Real get_time_dilation()const { return param_time_dilation.get(Real()); }
 	//! Gets time offset parameter
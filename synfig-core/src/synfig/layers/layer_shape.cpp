@@ -32,7 +32,12 @@
 #endif
 
 #include <cfloat>
+#include <cstdlib>
 
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "layer_shape.h"
@@ -40,16 +45,20 @@
 #include <synfig/general.h>
 #include <synfig/localization.h>
 
+#include <synfig/blinepoint.h>
 #include <synfig/blur.h>
 #include <synfig/context.h>
+#include <synfig/dashitem.h>
 #include <synfig/curve_helper.h>
 #include <synfig/paramdesc.h>
 #include <synfig/renddesc.h>
+#include <synfig/segment.h>
 #include <synfig/string.h>
 #include <synfig/surface.h>
 #include <synfig/time.h>
 #include <synfig/value.h>
 #include <synfig/valuenode.h>
+#include <synfig/widthpoint.h>
 
 #include <synfig/rendering/primitive/intersector.h>
 #include <synfig/rendering/common/task/taskblend.h>
@@ -75,8 +84,88 @@ SYNFIG_LAYER_SET_CATEGORY(Layer_Shape,N_("Internal"));
 SYNFIG_LAYER_SET_VERSION(Layer_Shape,"0.1");
 SYNFIG_LAYER_SET_CVS_ID(Layer_Shape,"$Id$");
 
+#define DEFAULT_CONTOUR_CACHE_SIZE_MB 32
+
 /* === C L A S S E S ======================================================= */
 
+namespace {
+
+//! Tessellated contours shared between all shape layers and frames,
+//! the least recently used contours are dropped when the total size
+//! exceeds the budget (SYNFIG_CONTOUR_CACHE_SIZE environment variable, in megabytes)
+class ContourCache
+{
+private:
+	struct Entry
+	{
+		String key;
+		rendering::Contour::Handle contour;
+		size_t bytes;
+		Entry(): bytes() { }
+	};
+
+	typedef std::list<Entry> List;
+	typedef std::unordered_map<String, List::iterator> Map;
+
+	std::mutex mutex;
+	List entries; //!< most recently used entries are at the front
+	Map map;
+	size_t bytes;
+	size_t budget;
+
+	ContourCache():
+		bytes(),
+		budget((size_t)DEFAULT_CONTOUR_CACHE_SIZE_MB << 20)
+	{
+		if (const char *s = getenv("SYNFIG_CONTOUR_CACHE_SIZE"))
+			budget = (size_t)std::max(0, atoi(s)) << 20;
+	}
+
+public:
+	static ContourCache& instance()
+	{
+		static ContourCache cache;
+		return cache;
+	}
+
+	rendering::Contour::Handle get(const String &key)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Map::iterator i = map.find(key);
+		if (i == map.end())
+			return rendering::Contour::Handle();
+		entries.splice(entries.begin(), entries, i->second);
+		return i->second->contour;
+	}
+
+	void put(const String &key, const rendering::Contour &contour)
+	{
+		Entry entry;
+		entry.key = key;
+		entry.bytes = 2*key.size() + sizeof(contour)
+		            + contour.get_chunks().size()*sizeof(rendering::Contour::Chunk);
+		if (entry.bytes > budget)
+			return;
+		entry.contour = new rendering::Contour();
+		entry.contour->assign(contour);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (map.count(key))
+			return;
+		entries.push_front(entry);
+		map[key] = entries.begin();
+		bytes += entry.bytes;
+
+		while(bytes > budget) {
+			bytes -= entries.back().bytes;
+			map.erase(entries.back().key);
+			entries.pop_back();
+		}
+	}
+};
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 Layer_Shape::Layer_Shape(const Real &a, const Color::BlendMethod m):
@@ -301,6 +390,84 @@ Layer_Shape::set_time_vfunc(IndependentContext context, Time time)const
 	Layer_Composite::set_time_vfunc(context, time);
 }
 
+void
+Layer_Shape::ShapeKey::add(const String &x)
+{
+	add((int)x.size());
+	data += x;
+}
+
+bool
+Layer_Shape::ShapeKey::add(const ValueBase &x)
+{
+	Type &type = x.get_type();
+	add(String(type.description.name));
+
+	if (type == type_list) {
+		const ValueBase::List &list = x.get_list();
+		add((int)list.size());
+		add(x.get_loop());
+		for(ValueBase::List::const_iterator i = list.begin(); i != list.end(); ++i)
+			if (!add(*i)) return false;
+		return true;
+	}
+
+	if (type == type_real)    { add(x.get(Real())); return true; }
+	if (type == type_integer) { add(x.get(int())); return true; }
+	if (type == type_bool)    { add(x.get(bool())); return true; }
+	if (type == type_vector)  { add(x.get(Vector())); return true; }
+
+	if (type == type_bline_point) {
+		const BLinePoint &p = x.get(BLinePoint());
+		add(p.get_vertex());
+		add(p.get_tangent1());
+		add(p.get_tangent2());
+		add((Real)p.get_width());
+		add((Real)p.get_origin());
+		add(p.get_split_tangent_radius());
+		add(p.get_split_tangent_angle());
+		add(p.get_boned_vertex_flag());
+		add(p.get_vertex_setup());
+		return true;
+	}
+
+	if (type == type_width_point) {
+		const WidthPoint &p = x.get(WidthPoint());
+		add(p.get_position());
+		add(p.get_width());
+		add(p.get_side_type_before());
+		add(p.get_side_type_after());
+		add(p.get_dash());
+		add(p.get_lower_bound());
+		add(p.get_upper_bound());
+		return true;
+	}
+
+	if (type == type_dash_item) {
+		const DashItem &d = x.get(DashItem());
+		add(d.get_offset());
+		add(d.get_length());
+		add(d.get_side_type_before());
+		add(d.get_side_type_after());
+		return true;
+	}
+
+	if (type == type_segment) {
+		const Segment &s = x.get(Segment());
+		add(s.p1);
+		add(s.t1);
+		add(s.p2);
+		add(s.t2);
+		return true;
+	}
+
+	return false;
+}
+
+bool
+Layer_Shape::get_shape_key(ShapeKey& /* key */) const
+	{ return false; }
+
 void
 Layer_Shape::sync(bool force) const
 {
@@ -310,8 +477,24 @@ Layer_Shape::sync(bool force) const
 	{
 		last_sync_time = get_time_mark();
 		last_sync_outline_grow = get_outline_grow_mark();
+
+		// identical shapes (held frames, duplicated layers) are tessellated only once
+		ShapeKey key;
+		key.add(String(get_name()));
+		if (!get_shape_key(key)) {
+			const_cast<Layer_Shape*>(this)->sync_vfunc();
+			contour->close();
+			return;
+		}
+
+		if (rendering::Contour::Handle cached = ContourCache::instance().get(key.get_data())) {
+			contour->assign(*cached);
+			return;
+		}
+
 		const_cast<Layer_Shape*>(this)->sync_vfunc();
 		contour->close();
+		ContourCache::instance().put(key.get_data(), *contour);
 	}
 }
 
@@ -112,6 +112,33 @@ protected:
 	Vector get_feather() const { return feather; }
 	void set_feather(const Vector &x) { feather = x; }
 
+	//! Serialized values of the parameters which affect the contour,
+	//! the key of the cache of contours shared between all shape layers
+	class ShapeKey
+	{
+	private:
+		String data;
+
+		template<typename T>
+		void add_raw(const T &x)
+			{ data.append((const char*)&x, sizeof(x)); }
+
+	public:
+		void add(Real x) { add_raw(x); }
+		void add(int x) { add_raw(x); }
+		void add(bool x) { add_raw(x); }
+		void add(const Vector &x) { add_raw(x[0]); add_raw(x[1]); }
+		void add(const String &x);
+		//! Returns false for the types which cannot be serialized
+		bool add(const ValueBase &x);
+
+		const String& get_data() const { return data; }
+	};
+
+	//! Fills \a key by all values used by sync_vfunc(),
+	//! returns false when the contour should not be cached
+	virtual bool get_shape_key(ShapeKey &key) const;
+
 public:
 	void sync(bool force = false) const;
 	void force_sync() const { sync(true); }
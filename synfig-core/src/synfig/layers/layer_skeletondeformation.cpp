@@ -60,6 +60,11 @@ using namespace synfig;
 
 /* === C L A S S E S ======================================================= */
 
+namespace {
+	inline bool is_same_shape(const Bone::Shape &a, const Bone::Shape &b)
+		{ return a.p0 == b.p0 && a.p1 == b.p1 && a.r0 == b.r0 && a.r1 == b.r1; }
+}
+
 /* === G L O B A L S ======================================================= */
 
 SYNFIG_LAYER_INIT(Layer_SkeletonDeformation);
@@ -76,7 +81,9 @@ Layer_SkeletonDeformation::Layer_SkeletonDeformation():
 	param_point1(ValueBase(Point(-4,4))),
 	param_point2(ValueBase(Point(4,-4))),
 	param_x_subdivisions(32),
-	param_y_subdivisions(32)
+	param_y_subdivisions(32),
+	bind_grid_count_x(0),
+	bind_grid_count_y(0)
 {
 	param_bones.set_list_of(std::vector<BonePair>(1));
 
@@ -223,6 +230,81 @@ Real Layer_SkeletonDeformation::distance_to_line(const Vector &p0, const Vector
 	return std::min(distance_to_line, std::min(distance_to_p0, distance_to_p1) );
 }
 
+void
+Layer_SkeletonDeformation::prepare_bind_data(
+	const Point &grid_p0,
+	const Point &grid_p1,
+	int grid_count_x,
+	int grid_count_y,
+	const std::vector<Bone::Shape> &shapes )
+{
+	static const Real precision = 1e-10;
+
+	bool same = grid_p0 == bind_grid_p0
+	         && grid_p1 == bind_grid_p1
+	         && grid_count_x == bind_grid_count_x
+	         && grid_count_y == bind_grid_count_y
+	         && shapes.size() == bind_weights.size();
+	for(int i = 0; same && i < (int)shapes.size(); ++i)
+		same = is_same_shape(shapes[i], bind_weights[i].shape);
+	if (same) return;
+
+	bind_grid_p0 = grid_p0;
+	bind_grid_p1 = grid_p1;
+	bind_grid_count_x = grid_count_x;
+	bind_grid_count_y = grid_count_y;
+	bind_weights.clear();
+	bind_weights.resize(shapes.size());
+	bind_used.assign(grid_count_x*grid_count_y, false);
+
+	const Real grid_step_x = (grid_p1[0] - grid_p0[0]) / (Real)(grid_count_x - 1);
+	const Real grid_step_y = (grid_p1[1] - grid_p0[1]) / (Real)(grid_count_y - 1);
+	const Real grid_step_diagonal = sqrt(grid_step_x*grid_step_x + grid_step_y*grid_step_y);
+
+	for(int b = 0; b < (int)shapes.size(); ++b)
+	{
+		const Bone::Shape &shape = shapes[b];
+		BoneWeights &bone_weights = bind_weights[b];
+		bone_weights.shape = shape;
+
+		Bone::Shape expanded_shape = shape;
+		expanded_shape.r0 += 2.0*grid_step_diagonal;
+		expanded_shape.r1 += 2.0*grid_step_diagonal;
+
+		bone_weights.into_bone = Matrix(
+			shape.p1[0] - shape.p0[0], shape.p1[1] - shape.p0[1], 0.0,
+			shape.p0[1] - shape.p1[1], shape.p1[0] - shape.p0[0], 0.0,
+			shape.p0[0], shape.p0[1], 1.0
+		);
+		bone_weights.into_bone.invert();
+
+		for(int j = 0; j < grid_count_y; ++j)
+		{
+			for(int i = 0; i < grid_count_x; ++i)
+			{
+				Vector position(grid_p0[0] + i*grid_step_x, grid_p0[1] + j*grid_step_y);
+				Real percent = Bone::distance_to_shape_center_percent(expanded_shape, position);
+				if (percent > precision) {
+					Real distance = distance_to_line(shape.p0, shape.p1, position);
+					if (distance < precision) distance = precision;
+					Real weight =
+						percent/(distance*distance);
+						// 1.0/distance;
+						// 1.0/(distance*distance);
+						// 1.0/(distance*distance*distance);
+						// exp(-4.0*distance);
+					int index = j*grid_count_x + i;
+					bone_weights.indices.push_back(index);
+					bone_weights.x.push_back(position[0]);
+					bone_weights.y.push_back(position[1]);
+					bone_weights.weights.push_back(weight);
+					bind_used[index] = true;
+				}
+			}
+		}
+	}
+}
+
 void
 Layer_SkeletonDeformation::prepare_mesh()
 {
@@ -239,7 +321,25 @@ Layer_SkeletonDeformation::prepare_mesh()
 
 	const Real grid_step_x = (grid_p1[0] - grid_p0[0]) / (Real)(grid_side_count_x - 1);
 	const Real grid_step_y = (grid_p1[1] - grid_p0[1]) / (Real)(grid_side_count_y - 1);
-	const Real grid_step_diagonal = sqrt(grid_step_x*grid_step_x + grid_step_y*grid_step_y);
+
+	// collect bones
+	std::vector<Bone::Shape> setup_shapes;
+	std::vector<const BonePair*> bone_pairs;
+	if (param_bones.can_get(ValueBase::List()))
+	{
+		const ValueBase::List &bones = param_bones.get_list();
+		for(ValueBase::List::const_iterator i = bones.begin(); i != bones.end(); ++i)
+		{
+			if (i->can_get(BonePair()))
+			{
+				const BonePair &bone_pair = i->get(BonePair());
+				setup_shapes.push_back(bone_pair.first.get_shape());
+				bone_pairs.push_back(&bone_pair);
+			}
+		}
+	}
+
+	prepare_bind_data(grid_p0, grid_p1, grid_side_count_x, grid_side_count_y, setup_shapes);
 
 	// build grid
 	std::vector<GridPoint> grid;
@@ -249,55 +349,52 @@ Layer_SkeletonDeformation::prepare_mesh()
 			grid.push_back(GridPoint(Vector(
 				grid_p0[0] + i*grid_step_x,
 				grid_p0[1] + j*grid_step_y )));
-
-	// apply deformation
-	if (param_bones.can_get(ValueBase::List()))
+	for(int i = 0; i < (int)grid.size(); ++i)
+		grid[i].used = bind_used[i];
+
+	// apply deformation,
+	// the weighted positions are calculated in the separate arrays
+	// for the affected points only, then accumulated in the grid
+	std::vector<Real> weighted_x, weighted_y;
+	for(int b = 0; b < (int)bind_weights.size(); ++b)
 	{
-		const ValueBase::List &bones = param_bones.get_list();
-		for(ValueBase::List::const_iterator i = bones.begin(); i != bones.end(); ++i)
+		const BoneWeights &bone_weights = bind_weights[b];
+		const int count = (int)bone_weights.indices.size();
+		if (!count) continue;
+
+		Bone::Shape shape1 = bone_pairs[b]->second.get_shape();
+		Real depth = bone_pairs[b]->second.get_depth();
+		Matrix from_bone(
+			shape1.p1[0] - shape1.p0[0], shape1.p1[1] - shape1.p0[1], 0.0,
+			shape1.p0[1] - shape1.p1[1], shape1.p1[0] - shape1.p0[0], 0.0,
+			shape1.p0[0], shape1.p0[1], 1.0
+		);
+		Matrix matrix = from_bone * bone_weights.into_bone;
+
+		const Real m00 = matrix.m00, m01 = matrix.m01;
+		const Real m10 = matrix.m10, m11 = matrix.m11;
+		const Real m20 = matrix.m20, m21 = matrix.m21;
+		const Real *x = &bone_weights.x.front();
+		const Real *y = &bone_weights.y.front();
+		const Real *w = &bone_weights.weights.front();
+		weighted_x.resize(count);
+		weighted_y.resize(count);
+		Real *wx = &weighted_x.front();
+		Real *wy = &weighted_y.front();
+		for(int k = 0; k < count; ++k)
 		{
-			if (i->can_get(BonePair()))
-			{
-				const BonePair &bone_pair = i->get(BonePair());
-				Bone::Shape shape0 = bone_pair.first.get_shape();
-				Bone::Shape shape1 = bone_pair.second.get_shape();
-				Bone::Shape expandedShape0 = shape0;
-				expandedShape0.r0 += 2.0*grid_step_diagonal;
-				expandedShape0.r1 += 2.0*grid_step_diagonal;
-				Real depth = bone_pair.second.get_depth();
-
-				Matrix into_bone(
-					shape0.p1[0] - shape0.p0[0], shape0.p1[1] - shape0.p0[1], 0.0,
-					shape0.p0[1] - shape0.p1[1], shape0.p1[0] - shape0.p0[0], 0.0,
-					shape0.p0[0], shape0.p0[1], 1.0
-				);
-				into_bone.invert();
-				Matrix from_bone(
-					shape1.p1[0] - shape1.p0[0], shape1.p1[1] - shape1.p0[1], 0.0,
-					shape1.p0[1] - shape1.p1[1], shape1.p1[0] - shape1.p0[0], 0.0,
-					shape1.p0[0], shape1.p0[1], 1.0
-				);
-				Matrix matrix = from_bone * into_bone;
-
-				for(std::vector<GridPoint>::iterator j = grid.begin(); j != grid.end(); ++j)
-				{
-					Real percent = Bone::distance_to_shape_center_percent(expandedShape0, j->initial_position);
-					if (percent > precision) {
-						Real distance = distance_to_line(shape0.p0, shape0.p1, j->initial_position);
-						if (distance < precision) distance = precision;
-						Real weight =
-							percent/(distance*distance);
-							// 1.0/distance;
-							// 1.0/(distance*distance);
-							// 1.0/(distance*distance*distance);
-							// exp(-4.0*distance);
-						j->summary_position += matrix.get_transformed(j->initial_position) * weight;
-						j->summary_depth += depth * weight;
-						j->summary_weight += weight;
-						j->used = true;
-					}
-				}
-			}
+			wx[k] = (x[k]*m00 + y[k]*m10 + m20)*w[k];
+			wy[k] = (x[k]*m01 + y[k]*m11 + m21)*w[k];
+		}
+
+		const int *indices = &bone_weights.indices.front();
+		for(int k = 0; k < count; ++k)
+		{
+			GridPoint &point = grid[indices[k]];
+			point.summary_position[0] += wx[k];
+			point.summary_position[1] += wy[k];
+			point.summary_depth += depth * w[k];
+			point.summary_weight += w[k];
 		}
 	}
 
@@ -27,6 +27,8 @@
 
 /* === H E A D E R S ======================================================= */
 
+#include <vector>
+
 #include "layer_meshtransform.h"
 #include <synfig/pair.h>
 #include <synfig/bone.h>
@@ -60,6 +62,34 @@ private:
 	struct GridPoint;
 	static Real distance_to_line(const Vector &p0, const Vector &p1, const Vector &x);
 
+	//! Weights of the grid points affected by the bone in the setup position.
+	//! Arrays are parallel, one item for each affected grid point
+	struct BoneWeights
+	{
+		Bone::Shape shape;          //!< setup shape of the bone
+		Matrix into_bone;           //!< from the grid to the space of the setup bone
+		std::vector<int> indices;   //!< indices of the grid points
+		std::vector<Real> x;        //!< initial positions of the grid points
+		std::vector<Real> y;
+		std::vector<Real> weights;
+	};
+
+	//! Grid and the weights depend on the setup position of the bones only,
+	//! so they are recalculated only when the grid or the setup is changed
+	Point bind_grid_p0;
+	Point bind_grid_p1;
+	int bind_grid_count_x;
+	int bind_grid_count_y;
+	std::vector<BoneWeights> bind_weights;
+	std::vector<bool> bind_used;  //!< grid point is affected by any bone
+
+	void prepare_bind_data(
+		const Point &grid_p0,
+		const Point &grid_p1,
+		int grid_count_x,
+		int grid_count_y,
+		const std::vector<Bone::Shape> &shapes );
+
 public:
 	typedef std::pair<Bone, Bone> BonePair;
 
@@ -63,6 +63,7 @@ public:
 	virtual bool get_frame(Surface &surface, const RendDesc &renddesc, Time time, ProgressCallback *cb=NULL);
 	virtual rendering::Surface::Handle get_frame(const RendDesc &renddesc, const Time &time);
 	virtual bool is_animated();
+	virtual bool is_prefetchable() { return false; }
 
 };
 
@@ -49,6 +49,7 @@
 #include <ETL/stringf>
 
 #include "loadcanvas.h"
+#include "canvassnapshot.h"
 
 #include "general.h"
 #include "localization.h"
@@ -2868,6 +2869,18 @@ CanvasParser::parse_layer(xmlpp::Element *element,Canvas::Handle canvas)
 					error(child,_("Empty use=\"\" value in <param>"));
 				else if(layer->get_param(param_name).get_type()==type_canvas)
 				{
+					// With lazy loading the external canvas will be opened
+					// by the layer itself when it will be required for rendering
+					if ( layer_pastecanvas
+					  && param_name == "canvas"
+					  && Canvas::get_lazy_loading()
+					  && str.find_first_of('#') != String::npos
+					  && str.find_first_of('#') != 0 )
+					{
+						layer_pastecanvas->set_deferred_sub_canvas(str, parse_static(child));
+						continue;
+					}
+
 					String warnings;
 					Canvas::Handle c(canvas->surefind_canvas(str, warnings));
 					warnings_text += warnings;
@@ -3508,6 +3521,15 @@ CanvasParser::parse_from_file_as(const FileSystem::Identifier &identifier,const
 		total_warnings_=0;
 		
 		synfig::info(String("Loading file: ") + filename);
+
+		// use binary snapshot when it is enabled and up to date
+		if (Canvas::Handle canvas = CanvasSnapshot::get_enabled() ? CanvasSnapshot::read(identifier, as) : Canvas::Handle())
+		{
+			synfig::info(String("Using snapshot: ") + CanvasSnapshot::get_snapshot_filename(identifier));
+			register_canvas_in_map(canvas, as);
+			return canvas;
+		}
+
 		FileSystem::ReadStream::Handle stream = identifier.get_read_stream();
 		if (stream)
 		{
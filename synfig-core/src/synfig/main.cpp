@@ -495,6 +495,22 @@ synfig::info(const String &str)
 	general_io_mutex.unlock();
 }
 
+String
+synfig::escape_json(const String &str)
+{
+	String result;
+	for(String::const_iterator i = str.begin(); i != str.end(); ++i)
+	{
+		if (*i == '"' || *i == '\\')
+			result += String("\\") + *i;
+		else if ((unsigned char)*i < 0x20)
+			result += strprintf("\\u%04x", (int)(unsigned char)*i);
+		else
+			result += *i;
+	}
+	return result;
+}
+
 // synfig::get_binary_path()
 // See also: http://libsylph.sourceforge.net/wiki/Full_path_to_binary
 
@@ -35,6 +35,7 @@
 #include "surface.h"
 #include "general.h"
 #include <synfig/localization.h>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -247,6 +248,107 @@ Palette::find_closest(const Color& color, const Gamma &gamma, float* dist)
 }
 
 
+void
+PaletteIndex::get_coords(const Color &color, float *coords)
+{
+	// the same space as in Palette::find_closest(),
+	// where distance is a weighted sum of squares of the differences
+	coords[0] = color.get_y()*color.get_a();
+	coords[1] = color.get_a();
+	coords[2] = color.get_u();
+	coords[3] = color.get_v();
+}
+
+PaletteIndex::PaletteIndex(const Palette &palette, const Gamma &gamma):
+	gamma(gamma)
+{
+	std::vector<Node> items(palette.size());
+	for(int i = 0; i < (int)palette.size(); ++i) {
+		get_coords(gamma.apply(palette[i].color), items[i].coords);
+		items[i].item = i;
+	}
+	nodes.reserve(items.size());
+	build(items, 0, (int)items.size());
+}
+
+int
+PaletteIndex::build(std::vector<Node> &items, int begin, int end)
+{
+	if (begin >= end)
+		return -1;
+
+	// split by the axis with the widest spread
+	int axis = 0;
+	float best_spread = -1.f;
+	for(int a = 0; a < 4; ++a) {
+		float min = items[begin].coords[a], max = min;
+		for(int i = begin + 1; i < end; ++i) {
+			min = std::min(min, items[i].coords[a]);
+			max = std::max(max, items[i].coords[a]);
+		}
+		const float spread = (max - min)*(a == 0 ? 1.5f : 1.f);
+		if (spread > best_spread)
+			{ best_spread = spread; axis = a; }
+	}
+
+	const int middle = (begin + end)/2;
+	std::nth_element(
+		items.begin() + begin, items.begin() + middle, items.begin() + end,
+		[axis](const Node &a, const Node &b) { return a.coords[axis] < b.coords[axis]; } );
+
+	const int index = (int)nodes.size();
+	nodes.push_back(items[middle]);
+	nodes[index].axis = axis;
+	const int left = build(items, begin, middle);
+	const int right = build(items, middle + 1, end);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+void
+PaletteIndex::search(int node, const float *coords, int &best_item, float &best_dist) const
+{
+	const Node &n = nodes[node];
+
+	const float diff_y(coords[0] - n.coords[0]);
+	const float diff_a(coords[1] - n.coords[1]);
+	const float diff_u(coords[2] - n.coords[2]);
+	const float diff_v(coords[3] - n.coords[3]);
+	const float dist(
+		diff_y*diff_y*1.5f+
+		diff_a*diff_a+
+		diff_u*diff_u+
+		diff_v*diff_v );
+	// on equal distances prefer the first item, as the linear search does
+	if (dist < best_dist || (dist == best_dist && n.item < best_item))
+		{ best_dist = dist; best_item = n.item; }
+
+	const float diff = coords[n.axis] - n.coords[n.axis];
+	const int near = diff < 0.f ? n.left : n.right;
+	const int far  = diff < 0.f ? n.right : n.left;
+	if (near >= 0)
+		search(near, coords, best_item, best_dist);
+	if (far >= 0 && diff*diff*(n.axis == 0 ? 1.5f : 1.f) <= best_dist)
+		search(far, coords, best_item, best_dist);
+}
+
+int
+PaletteIndex::find_closest(const Color& color, float* dist) const
+{
+	int best_item = -1;
+	float best_dist(1000000);
+	if (!nodes.empty()) {
+		float coords[4];
+		get_coords(gamma.apply(color), coords);
+		search(0, coords, best_item, best_dist);
+	}
+	if (dist)
+		*dist = best_dist;
+	return best_item;
+}
+
+
 Palette::iterator
 Palette::find_heavy()
 {
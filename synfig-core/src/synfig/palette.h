@@ -87,6 +87,42 @@ public:
 	static Palette load_from_file(const synfig::String& filename);
 }; // END of class Palette
 
+/*!	\class PaletteIndex
+**	\brief K-d tree for the fast search of the closest colors of the palette.
+**
+**	Uses the same color distance as Palette::find_closest() and returns
+**	the same items. The palette should not be changed while the index is used,
+**	the index itself is read-only and may be used from several threads at once.
+*/
+class PaletteIndex
+{
+	struct Node
+	{
+		float coords[4];
+		int item;
+		int axis;
+		int left, right;
+
+		Node(): coords(), item(), axis(), left(-1), right(-1) { }
+	};
+
+	std::vector<Node> nodes;
+	Gamma gamma;
+
+	static void get_coords(const Color &color, float *coords);
+	int build(std::vector<Node> &items, int begin, int end);
+	void search(int node, const float *coords, int &best_item, float &best_dist) const;
+
+public:
+	PaletteIndex() { }
+	PaletteIndex(const Palette &palette, const Gamma &gamma);
+
+	bool empty() const { return nodes.empty(); }
+
+	//! Returns the index of the closest item of the palette or -1 if palette is empty
+	int find_closest(const Color& color, float* dist = 0) const;
+}; // END of class PaletteIndex
+
 }; // END of namespace synfig
 
 /* === E N D =============================================================== */
@@ -56,6 +56,7 @@ OptimizerBlendAssociative::OptimizerBlendAssociative()
 	mode = MODE_REPEAT_PARENT;
 	deep_first = true;
 	for_task = true;
+	reads_parent = true;
 }
 
 void
@@ -47,6 +47,8 @@ using namespace rendering;
 
 /* === M E T H O D S ======================================================= */
 
+const int OptimizerSplit::min_area;
+
 OptimizerSplit::OptimizerSplit()
 {
 	category_id = CATEGORY_ID_LIST;
@@ -58,7 +60,6 @@ void
 OptimizerSplit::run(const RunParams &params) const
 {
 	if (!params.list) return;
-	const int min_area = 256*256;
 	for(Task::List::iterator i = params.list->begin(); i != params.list->end(); ++i)
 	{
 		if (TaskInterfaceSplit *split = i->type_pointer<TaskInterfaceSplit>())
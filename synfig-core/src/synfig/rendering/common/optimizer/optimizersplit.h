@@ -43,6 +43,9 @@ namespace rendering
 class OptimizerSplit: public Optimizer
 {
 public:
+	//! tasks and surfaces smaller than this count of pixels are not split
+	static const int min_area = 256*256;
+
 	OptimizerSplit();
 	virtual void run(const RunParams &params) const;
 };
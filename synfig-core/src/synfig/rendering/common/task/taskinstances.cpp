@@ -0,0 +1,121 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/common/task/taskinstances.cpp
+**	\brief TaskInstances
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+#include "taskinstances.h"
+
+#include "../../primitive/transformationaffine.h"
+
+#endif
+
+using namespace synfig;
+using namespace rendering;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+
+Task::Token TaskInstances::token(
+	DescAbstract<TaskInstances>("Instances") );
+
+
+Rect
+TaskInstances::calc_bounds() const
+{
+	if (!sub_task())
+		return Rect::zero();
+	Rect bounds = sub_task()->get_bounds();
+	if (!bounds.is_valid())
+		return Rect::zero();
+	if (bounds.is_full_infinite())
+		return bounds;
+
+	Rect result = Rect::zero();
+	for(InstanceList::const_iterator i = instances.begin(); i != instances.end(); ++i)
+		result |= TransformationAffine::transform_bounds_affine(
+			i->matrix, Transformation::Bounds(bounds) ).rect;
+	return result;
+}
+
+void
+TaskInstances::set_coords_sub_tasks()
+{
+	if (!sub_task())
+		{ trunc_to_zero(); return; }
+	if (!is_valid_coords() || instances.empty())
+		{ sub_task()->set_coords_zero(); return; }
+
+	// all instances are drawn from the same surface,
+	// so it should cover the areas and the resolutions required by each of them
+	const Vector ppu = get_pixels_per_unit();
+	Rect rect;
+	Vector resolution;
+	bool found = false;
+	for(InstanceList::const_iterator i = instances.begin(); i != instances.end(); ++i)
+	{
+		if (!i->matrix.is_invertible())
+			continue;
+		Transformation::Bounds bounds = TransformationAffine::transform_bounds_affine(
+			i->matrix.get_inverted(), Transformation::Bounds(source_rect, ppu) );
+		if (!bounds.is_valid())
+			continue;
+		if (found) {
+			rect |= bounds.rect;
+			resolution[0] = std::max(resolution[0], bounds.resolution[0]);
+			resolution[1] = std::max(resolution[1], bounds.resolution[1]);
+		} else {
+			rect = bounds.rect;
+			resolution = bounds.resolution;
+			found = true;
+		}
+	}
+	if (!found)
+		{ sub_task()->set_coords_zero(); return; }
+
+	// add the extra pixels for the interpolation
+	rect.expand_x(2.0/resolution[0]);
+	rect.expand_y(2.0/resolution[1]);
+	rect &= sub_task()->get_bounds();
+
+	Transformation::DiscreteBounds discrete_bounds =
+		Transformation::make_discrete_bounds( Transformation::Bounds(rect, resolution) );
+	if (discrete_bounds.is_valid())
+		sub_task()->set_coords(discrete_bounds.rect, discrete_bounds.size);
+	else
+		sub_task()->set_coords_zero();
+}
+
+/* === E N T R Y P O I N T ================================================= */
@@ -0,0 +1,94 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/common/task/taskinstances.h
+**	\brief TaskInstances Header
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_RENDERING_TASKINSTANCES_H
+#define __SYNFIG_RENDERING_TASKINSTANCES_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <vector>
+
+#include <synfig/color.h>
+#include <synfig/matrix.h>
+
+#include "../../task.h"
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig
+{
+namespace rendering
+{
+
+//! Draws several copies of the same sub-task with the different affine transformations.
+//! Sub-task renders once with the resolution enough for all of the instances,
+//! then the instances are resampled and blended one by one to the target
+//! in the order of the list. Result is transparent before the first instance.
+class TaskInstances: public Task, public TaskInterfaceSplit
+{
+public:
+	typedef etl::handle<TaskInstances> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	struct Instance
+	{
+		Matrix matrix;
+		Color::value_type amount;
+
+		Instance(): amount(1.0) { }
+		Instance(const Matrix &matrix, Color::value_type amount):
+			matrix(matrix), amount(amount) { }
+	};
+
+	typedef std::vector<Instance> InstanceList;
+
+	InstanceList instances;
+	Color::BlendMethod blend_method;
+	Color::value_type amount;
+	Color::Interpolation interpolation;
+
+	TaskInstances():
+		blend_method(Color::BLEND_COMPOSITE),
+		amount(1.0),
+		interpolation(Color::INTERPOLATION_CUBIC) { }
+
+	const Task::Handle& sub_task() const { return Task::sub_task(0); }
+	Task::Handle& sub_task() { return Task::sub_task(0); }
+
+	virtual int get_pass_subtask_index() const
+		{ return sub_task() && !instances.empty() ? PASSTO_THIS_TASK : PASSTO_NO_TASK; }
+
+	virtual Rect calc_bounds() const;
+	virtual void set_coords_sub_tasks();
+};
+
+} /* end namespace rendering */
+} /* end namespace synfig */
+
+/* -- E N D ----------------------------------------------------------------- */
+
+#endif
@@ -0,0 +1,135 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/common/task/taskwarp.cpp
+**	\brief TaskWarp
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "taskwarp.h"
+
+#include "../../primitive/transformation.h"
+
+#endif
+
+using namespace synfig;
+using namespace rendering;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+
+Task::Token TaskWarp::token(
+	DescAbstract<TaskWarp>("Warp") );
+
+
+void
+TaskWarp::Mapping::map_row(Point *points, bool *valid, const Point &begin, const Vector &step, int count, int quality) const
+{
+	for(int i = 0; i < count; ++i, ++points, ++valid)
+		*valid = map(*points = begin + step*i, quality);
+}
+
+Rect
+TaskWarp::Mapping::map_bounds(const Rect &rect, const Vector &resolution, int quality) const
+{
+	const int max_count = 64;
+	const Real pixels_per_step = 16;
+
+	if (!rect.is_valid() || rect.is_nan_or_inf())
+		return Rect();
+
+	const Vector size = rect.get_size();
+	const int count_x = std::max(1, std::min(max_count,
+		(int)approximate_ceil(std::fabs(size[0]*resolution[0])/pixels_per_step) ));
+	const int count_y = std::max(1, std::min(max_count,
+		(int)approximate_ceil(std::fabs(size[1]*resolution[1])/pixels_per_step) ));
+	const Vector step(size[0]/count_x, size[1]/count_y);
+
+	std::vector<Point> points(count_x + 1);
+	std::unique_ptr<bool[]> valid(new bool[count_x + 1]);
+
+	Rect bounds;
+	bool found = false;
+	for(int j = 0; j <= count_y; ++j)
+	{
+		map_row(&points.front(), valid.get(), Point(rect.minx, rect.miny + step[1]*j), Vector(step[0], 0), count_x + 1, quality);
+		for(int i = 0; i <= count_x; ++i)
+		{
+			if (!valid[i] || points[i].is_nan_or_inf())
+				continue;
+			if (found)
+				bounds.expand(points[i]);
+			else
+				{ bounds = Rect(points[i]); found = true; }
+		}
+	}
+	return bounds;
+}
+
+
+Rect
+TaskWarp::calc_bounds() const
+{
+	if (!mapping || !sub_task())
+		return Rect::zero();
+	Rect bounds = sub_task()->get_bounds();
+	if (!bounds.is_valid())
+		return Rect::zero();
+	return mapping->unmap_bounds(bounds);
+}
+
+void
+TaskWarp::set_coords_sub_tasks()
+{
+	if (!mapping || !sub_task())
+		{ trunc_to_zero(); return; }
+	if (!is_valid_coords())
+		{ sub_task()->set_coords_zero(); return; }
+
+	// add the extra pixels for the interpolation
+	const Vector ppu = get_pixels_per_unit();
+	Rect rect = mapping->map_bounds(source_rect, ppu, quality);
+	rect.expand_x(2.0/std::fabs(ppu[0]));
+	rect.expand_y(2.0/std::fabs(ppu[1]));
+	rect &= sub_task()->get_bounds();
+
+	Transformation::DiscreteBounds discrete_bounds =
+		Transformation::make_discrete_bounds( Transformation::Bounds(rect, ppu) );
+	if (discrete_bounds.is_valid())
+		sub_task()->set_coords(discrete_bounds.rect, discrete_bounds.size);
+	else
+		sub_task()->set_coords_zero();
+}
+
+/* === E N T R Y P O I N T ================================================= */
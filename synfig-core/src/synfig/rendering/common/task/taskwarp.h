@@ -0,0 +1,104 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/common/task/taskwarp.h
+**	\brief TaskWarp Header
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_RENDERING_TASKWARP_H
+#define __SYNFIG_RENDERING_TASKWARP_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <synfig/color.h>
+
+#include "../../task.h"
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig
+{
+namespace rendering
+{
+
+//! Generic coordinate distortion of the sub-task.
+//! Sub-task renders once into the area estimated by the mapping,
+//! then each pixel of the result is sampled from it at the point returned
+//! by the mapping. Software implementation processes the strips
+//! of the result in several threads itself, so the task is not split.
+class TaskWarp: public Task
+{
+public:
+	typedef etl::handle<TaskWarp> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+	//! Back mapping from the coordinates of the result to the coordinates of the sub-task,
+	//! all methods should be thread-safe
+	class Mapping: public etl::shared_object
+	{
+	public:
+		typedef etl::handle<Mapping> Handle;
+
+		virtual ~Mapping() { }
+
+		//! Maps point of the result into the point of the source,
+		//! returns false when the result at this point should be transparent,
+		//! \a quality is in terms of Layer::accelerated_render, 0 is the best
+		virtual bool map(Point &point, int quality) const = 0;
+
+		//! Maps \a count points started from \a begin with the \a step,
+		//! mappings may override it to process the whole row at once
+		virtual void map_row(Point *points, bool *valid, const Point &begin, const Vector &step, int count, int quality) const;
+
+		//! Returns bounds of the source required to draw \a rect of the result,
+		//! default implementation maps points of the grid with the
+		//! step about 16 pixels of \a resolution
+		virtual Rect map_bounds(const Rect &rect, const Vector &resolution, int quality) const;
+
+		//! Returns bounds of the result drawn from the source with \a bounds
+		virtual Rect unmap_bounds(const Rect& /* bounds */) const
+			{ return Rect::infinite(); }
+	};
+
+	Mapping::Handle mapping;
+	Color::Interpolation interpolation;
+	int quality; //!< quality passed to the mapping, default one matches the cubic interpolation
+
+	TaskWarp(): interpolation(Color::INTERPOLATION_CUBIC), quality(4) { }
+
+	const Task::Handle& sub_task() const { return Task::sub_task(0); }
+	Task::Handle& sub_task() { return Task::sub_task(0); }
+
+	virtual int get_pass_subtask_index() const
+		{ return mapping && sub_task() ? PASSTO_THIS_TASK : PASSTO_NO_TASK; }
+
+	virtual Rect calc_bounds() const;
+	virtual void set_coords_sub_tasks();
+};
+
+} /* end namespace rendering */
+} /* end namespace synfig */
+
+/* -- E N D ----------------------------------------------------------------- */
+
+#endif
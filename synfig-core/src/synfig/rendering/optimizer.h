@@ -211,9 +211,12 @@ public:
 	bool for_root_task;
 	//! Optimizer runs for task after all of sub-tasks are processed
 	bool deep_first;
+	//! Optimizer reads the parent tasks (RunParams::parent), so the task shared
+	//! between several parents is optimized separately for each of them
+	bool reads_parent;
 
 
-	Optimizer(): category_id(), order(), index(), depends_from(), affects_to(), mode(), for_list(), for_task(), for_root_task(), deep_first() { }
+	Optimizer(): category_id(), order(), index(), depends_from(), affects_to(), mode(), for_list(), for_task(), for_root_task(), deep_first(), reads_parent() { }
 	virtual ~Optimizer();
 
 	static bool less(const Handle &a, const Handle &b)
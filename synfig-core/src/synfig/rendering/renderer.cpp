@@ -29,9 +29,13 @@
 #	include <config.h>
 #endif
 
+#include <cmath>
 #include <cstdlib>
 #include <climits>
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
 #include <typeinfo>
 
 #include <synfig/general.h>
@@ -40,6 +44,7 @@
 #include <synfig/debug/debugsurface.h>
 #include <synfig/debug/log.h>
 #include <synfig/debug/measure.h>
+#include <synfig/debug/stageprofile.h>
 
 #include "renderer.h"
 #include "renderqueue.h"
@@ -77,6 +82,221 @@ using namespace rendering;
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+//! Sets coordinates of the tasks shared between several parents.
+//! Coordinates requested by all parents are collected first, then the shared
+//! task is rendered once into the area which covers all the requests
+//! aligned to the same pixel grid. The parent which requests the different
+//! grid receives own copy of the task.
+class SharedCoordsResolver: public Task::CoordsCollector
+{
+private:
+	struct Request
+	{
+		Task::Handle parent;
+		Rect source_rect;
+		VectorInt target_size;
+
+		Request(const Task::Handle &parent, const Rect &source_rect, const VectorInt &target_size):
+			parent(parent), source_rect(source_rect), target_size(target_size) { }
+
+		bool is_valid() const
+		{
+			return source_rect.is_valid()
+				&& !source_rect.is_nan_or_inf()
+				&& target_size[0] > 0
+				&& target_size[1] > 0;
+		}
+
+		Vector get_pixels_per_unit() const
+		{
+			return Vector(
+				(Real)target_size[0]/source_rect.get_width(),
+				(Real)target_size[1]/source_rect.get_height() );
+		}
+	};
+
+	typedef std::vector<Request> RequestList;
+	typedef std::map<const Task*, int> CountMap;
+	typedef std::map<const Task*, Task::Handle> CopyMap;
+
+	struct Entry
+	{
+		int order;
+		RequestList requests;
+		Entry(): order() { }
+	};
+	typedef std::map<const Task*, Entry> EntryMap;
+
+	EntryMap entries;
+	std::vector<Task::List> queue; //!< shared tasks and its copies in the topological order
+
+	static bool is_same_grid(const Request &a, const Request &b)
+	{
+		const Real precision = 1e-6;
+		const Real pixel_precision = 1e-3;
+		const Vector ppu_a = a.get_pixels_per_unit();
+		const Vector ppu_b = b.get_pixels_per_unit();
+		for(int i = 0; i < 2; ++i) {
+			if (std::fabs(ppu_a[i] - ppu_b[i]) > precision*std::max(std::fabs(ppu_a[i]), std::fabs(ppu_b[i])))
+				return false;
+			const Real offset = (b.source_rect.get_min()[i] - a.source_rect.get_min()[i])*ppu_a[i];
+			if (std::fabs(offset - round(offset)) > pixel_precision)
+				return false;
+		}
+		return true;
+	}
+
+	static void count(const Task::Handle &task, CountMap &counts, Task::List &order)
+	{
+		if (counts[task.get()]++) return;
+		for(Task::List::const_iterator i = task->sub_tasks.begin(); i != task->sub_tasks.end(); ++i)
+			if (*i) count(*i, counts, order);
+		order.push_back(task);
+	}
+
+	Task::Handle copy(const Task::Handle &task, CopyMap &copies)
+	{
+		if (!task) return task;
+
+		CopyMap::const_iterator i = copies.find(task.get());
+		if (i != copies.end())
+			return i->second;
+
+		Task::Handle t = task->clone();
+		for(Task::List::iterator j = t->sub_tasks.begin(); j != t->sub_tasks.end(); ++j)
+			*j = copy(*j, copies);
+
+		// copy of the shared task is still shared inside of the copied tree
+		EntryMap::const_iterator k = entries.find(task.get());
+		if (k != entries.end()) {
+			int order = k->second.order;
+			entries[t.get()].order = order;
+			queue[order].push_back(t);
+		}
+
+		copies[task.get()] = t;
+		return t;
+	}
+
+	void resolve(const Task::Handle &task, const RequestList &requests)
+	{
+		if (requests.empty())
+			return;
+
+		// the root request keeps its grid, otherwise the grid of the largest resolution is used
+		const Request *master = NULL;
+		Real master_area = 0;
+		for(RequestList::const_iterator i = requests.begin(); i != requests.end(); ++i) {
+			if (!i->is_valid()) continue;
+			const Vector ppu = i->get_pixels_per_unit();
+			const Real area = std::fabs(ppu[0]*ppu[1]);
+			if ( !master
+			  || (!i->parent && master->parent)
+			  || (!i->parent == !master->parent && area > master_area) )
+				{ master = &*i; master_area = area; }
+		}
+		if (!master)
+			{ task->set_coords_zero(); return; }
+
+		// join requests with the same grid
+		const Vector ppu = master->get_pixels_per_unit();
+		RectInt rect(VectorInt::zero(), master->target_size);
+		std::vector<const Request*> others;
+		for(RequestList::const_iterator i = requests.begin(); i != requests.end(); ++i) {
+			if (!i->is_valid() || &*i == master) continue;
+			if (is_same_grid(*master, *i)) {
+				const Vector offset = (i->source_rect.get_min() - master->source_rect.get_min()).multiply_coords(ppu);
+				const VectorInt min((int)round(offset[0]), (int)round(offset[1]));
+				rect |= RectInt(min, min + i->target_size);
+			} else {
+				others.push_back(&*i);
+			}
+		}
+
+		// find places of the task in the parents which require another grid,
+		// several references from the same parent are matched in order of requests
+		std::vector<Task::Handle*> places(others.size());
+		for(int i = 0; i < (int)others.size(); ++i) {
+			if (!others[i]->parent) continue;
+			int index = 0;
+			for(RequestList::const_iterator j = requests.begin(); &*j != others[i]; ++j)
+				if (j->parent == others[i]->parent) ++index;
+			Task::List &sub_tasks = others[i]->parent->sub_tasks;
+			for(Task::List::iterator j = sub_tasks.begin(); j != sub_tasks.end(); ++j)
+				if (*j == task && !index--)
+					{ places[i] = &*j; break; }
+		}
+
+		// copies should be made before coordinates of the task are set
+		std::vector<Task::Handle> task_copies(others.size());
+		for(int i = 0; i < (int)others.size(); ++i)
+			if (places[i])
+				{ CopyMap copies; task_copies[i] = copy(task, copies); }
+
+		const Vector upp(1.0/ppu[0], 1.0/ppu[1]);
+		task->set_coords(
+			Rect( master->source_rect.get_min() + Vector(rect.minx*upp[0], rect.miny*upp[1]),
+				  master->source_rect.get_min() + Vector(rect.maxx*upp[0], rect.maxy*upp[1]) ),
+			rect.get_size() );
+
+		for(int i = 0; i < (int)others.size(); ++i) {
+			if (places[i]) {
+				*places[i] = task_copies[i];
+				task_copies[i]->set_coords(others[i]->source_rect, others[i]->target_size);
+			} else {
+				// parent is unknown, so task cannot be copied
+				task->set_coords(others[i]->source_rect, others[i]->target_size);
+			}
+		}
+	}
+
+public:
+	//! Returns false if there are no shared tasks in the list
+	bool prepare(const Task::List &list)
+	{
+		CountMap counts;
+		Task::List order;
+		for(Task::List::const_iterator i = list.begin(); i != list.end(); ++i)
+			if (*i) count(*i, counts, order);
+
+		// parents before children
+		for(Task::List::const_reverse_iterator i = order.rbegin(); i != order.rend(); ++i)
+			if (counts[i->get()] > 1) {
+				entries[i->get()].order = (int)queue.size();
+				queue.push_back(Task::List(1, *i));
+			}
+
+		return !queue.empty();
+	}
+
+	void resolve()
+	{
+		// queue may grow while resolving, only for the items after the current one
+		for(int i = 0; i < (int)queue.size(); ++i)
+			for(int j = 0; j < (int)queue[i].size(); ++j) {
+				Task::Handle task = queue[i][j];
+				RequestList requests;
+				EntryMap::iterator k = entries.find(task.get());
+				requests.swap(k->second.requests);
+				entries.erase(k);
+				resolve(task, requests);
+			}
+	}
+
+	virtual bool collect(Task &task, Task *parent, const Rect &source_rect, const VectorInt &target_size)
+	{
+		EntryMap::iterator i = entries.find(&task);
+		if (i == entries.end())
+			return false;
+		i->second.requests.push_back(Request(Task::Handle(parent), source_rect, target_size));
+		return true;
+	}
+};
+
+} // end of anonimous namespace
+
 /* === M E T H O D S ======================================================= */
 
 Renderer::Handle Renderer::blank;
@@ -204,15 +424,36 @@ Renderer::calc_coords(const Task::List &list) const
 	#ifdef DEBUG_OPTIMIZATION_MEASURE
 	debug::Measure t("calc coords");
 	#endif
+
+	SharedCoordsResolver resolver;
+	if (!resolver.prepare(list)) {
+		for(Task::List::const_iterator i = list.begin(); i != list.end(); ++i)
+			if (*i) (*i)->touch_coords();
+		return;
+	}
+
+	Task::CoordsCollector *previous = Task::set_coords_collector(&resolver);
 	for(Task::List::const_iterator i = list.begin(); i != list.end(); ++i)
 		if (*i) (*i)->touch_coords();
+	resolver.resolve();
+	Task::set_coords_collector(previous);
 }
 
 void
-Renderer::specialize_recursive(Task::List &list) const
+Renderer::specialize_recursive(Task::List &list, SpecializedMap &specialized) const
 {
 	for(Task::List::iterator i = list.begin(); i != list.end(); ++i)
 		if (*i) {
+			// shared sub-tasks are converted only once,
+			// bounds are calculated here because shared task may be
+			// accessed from several threads while optimization
+			SpecializedMap::const_iterator found = specialized.find(*i);
+			if (found != specialized.end()) {
+				*i = found->second;
+				(*i)->get_bounds();
+				continue;
+			}
+
 			Task::Handle task;
 			for(ModeList::const_iterator j = modes.begin(); j != modes.end() && !task; ++j)
 				task = (*i)->convert_to(*j);
@@ -220,8 +461,9 @@ Renderer::specialize_recursive(Task::List &list) const
 				task = (*i)->convert_to_any();
 			if (!task)
 				task = (*i)->clone();
+			specialized[*i] = task;
 			*i = task;
-			specialize_recursive((*i)->sub_tasks);
+			specialize_recursive((*i)->sub_tasks, specialized);
 		}
 }
 
@@ -231,7 +473,8 @@ Renderer::specialize(Task::List &list) const
 	#ifdef DEBUG_OPTIMIZATION_MEASURE
 	debug::Measure t("specialize");
 	#endif
-	specialize_recursive(list);
+	SpecializedMap specialized;
+	specialize_recursive(list, specialized);
 }
 
 void
@@ -252,7 +495,9 @@ Renderer::linearize(Task::List &list) const
 	debug::Measure t("linearize");
 	#endif
 
-	// convert task-tree to linear list
+	// convert task-tree to linear list,
+	// sub-tasks shared between several parents are inserted only once
+	Task::Set inserted;
 	for(Task::List::iterator i = list.begin(); i != list.end();)
 	{
 		if (*i && !i->type_is<TaskSurface>())
@@ -266,8 +511,10 @@ Renderer::linearize(Task::List &list) const
 				if ( *j
 				  && !TaskSurface::Handle::cast_dynamic(*j) )
 				{
-					i = list.insert(i, *j);
-					++i;
+					if (inserted.insert(*j).second) {
+						i = list.insert(i, *j);
+						++i;
+					}
 
 					if (!found)
 					{
@@ -362,16 +609,108 @@ Renderer::call_optimizers(
 	return true;
 }
 
+class Renderer::OptimizedTasks {
+private:
+	typedef std::pair<const Task*, const Task*> Key;
+
+	struct Entry {
+		Task::Handle orig_task;   // keeps the key alive
+		Task::Handle orig_parent; // keeps the key alive
+		Task::Handle task;
+		Optimizer::Category affects_to;
+		Optimizer::Mode mode;
+		bool ready;
+		Entry(): affects_to(), mode(), ready() { }
+	};
+
+	const bool by_parent;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::map<Key, Entry> entries;
+
+	Key get_key(const Task::Handle &task, const Optimizer::RunParams &params) const
+	{
+		return Key( task.get(),
+			by_parent && params.parent ? params.parent->ref_task.get() : NULL );
+	}
+
+public:
+	//! When \a by_parent is set, result is reused only for the same parent,
+	//! see Optimizer::reads_parent
+	explicit OptimizedTasks(bool by_parent): by_parent(by_parent) { }
+
+	//! Returns true and fills the params when the task is already optimized by another parent,
+	//! waits when it is optimizing right now. Returns false when the caller should optimize the task.
+	bool take(const Optimizer::RunParams &params)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		Entry &entry = entries[get_key(params.ref_task, params)];
+		if (!entry.orig_task) {
+			entry.orig_task = params.ref_task;
+			if (by_parent && params.parent)
+				entry.orig_parent = params.parent->ref_task;
+			return false;
+		}
+		while(!entry.ready)
+			ThreadPool::instance().wait(cond, lock);
+		params.ref_task = entry.task;
+		params.ref_affects_to |= entry.affects_to;
+		params.ref_mode |= entry.mode;
+		return true;
+	}
+
+	void put(const Task::Handle &orig_task, const Optimizer::RunParams &params)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry &entry = entries[get_key(orig_task, params)];
+		entry.task = params.ref_task;
+		entry.affects_to = params.ref_affects_to;
+		entry.mode = params.ref_mode;
+		entry.ready = true;
+		cond.notify_all();
+	}
+};
+
 void
 Renderer::optimize_recursive(
 	const Optimizer::List *optimizers,  // pass by pointer for use with sigc::bind
 	const Optimizer::RunParams *params, // pass by pointer for use with sigc::bind
+	OptimizedTasks *optimized,
 	std::atomic<int> *calls_count,
 	std::atomic<int> *optimizations_count,
-	int max_level ) const
+	int max_level,
+	bool reuse ) const
 {
 	if (!params || !params->ref_task) return;
 
+	// sub-task may be referenced by several parents,
+	// optimize it once and reuse the result for the other parents
+	if (!optimized || !reuse) {
+		optimize_task(optimizers, params, optimized, calls_count, optimizations_count, max_level);
+		return;
+	}
+
+	Task::Handle orig_task = params->ref_task;
+	if (optimized->take(*params))
+		return;
+	try {
+		optimize_task(optimizers, params, optimized, calls_count, optimizations_count, max_level);
+	} catch(...) {
+		optimized->put(orig_task, *params);
+		throw;
+	}
+	optimized->put(orig_task, *params);
+}
+
+void
+Renderer::optimize_task(
+	const Optimizer::List *optimizers,
+	const Optimizer::RunParams *params,
+	OptimizedTasks *optimized,
+	std::atomic<int> *calls_count,
+	std::atomic<int> *optimizations_count,
+	int max_level ) const
+{
 	// run all non-deep-first optimizers for current task
 	// before processing of sub-tasks (see Optimizer::deep_first)
 	if (!call_optimizers(*optimizers, *params, calls_count, optimizations_count, false))
@@ -417,9 +756,11 @@ Renderer::optimize_recursive(
 				group.enqueue( sigc::bind( sigc::mem_fun(this, &Renderer::optimize_recursive),
 					optimizers,
 					&sp,
+					optimized,
 					calls_count,
 					optimizations_count,
-					sub_level ), weight );
+					sub_level,
+					first_pass ), weight );
 			}
 			group.run();
 
@@ -604,18 +945,25 @@ Renderer::optimize(Task::List &list) const
 
 		if (for_task || for_root_task)
 		{
+			bool reads_parent = false;
+			for(Optimizer::List::const_iterator i = current_optimizers.begin(); i != current_optimizers.end(); ++i)
+				if ((*i)->reads_parent) reads_parent = true;
+
 			bool nonrecursive = false;
 			for(Task::List::iterator j = list.begin(); !(categories_to_process & depends_from) && j != list.end();)
 			{
 				if (*j)
 				{
 					Optimizer::RunParams params(depends_from, *j, &list);
+					OptimizedTasks optimized(reads_parent);
 					Renderer::optimize_recursive(
 						&current_optimizers,
 						&params,
+						&optimized,
 						calls_count_ptr,
 						optimizations_count_ptr,
-						!for_task ? 0 : nonrecursive ? 1 : INT_MAX );
+						!for_task ? 0 : nonrecursive ? 1 : INT_MAX,
+						false );
 					nonrecursive = false;
 
 					if (*j != params.ref_task)
@@ -799,6 +1147,7 @@ Renderer::run(const Task::List &list, bool quiet) const
 		if (!quiet) debug::Measure t("run tasks");
 		#endif
 
+		debug::StageProfile::Scope profile(debug::StageProfile::RUN, !quiet);
 		task_event->wait();
 	}
 
@@ -835,7 +1184,11 @@ Renderer::enqueue(const Task::List &list, const TaskEvent::Handle &finish_event_
 		log(get_debug_options().task_list_log, list, "input list");
 
 	Task::List optimized_list(list);
-	optimize(optimized_list);
+	{
+		// sub-queues of the tasks are enqueued quietly, they are the part of the task run
+		debug::StageProfile::Scope profile(debug::StageProfile::OPTIMIZE, !quiet);
+		optimize(optimized_list);
+	}
 	find_deps(optimized_list, ++last_batch_index);
 
 	#ifdef DEBUG_TASK_LIST
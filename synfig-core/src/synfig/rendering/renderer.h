@@ -93,13 +93,17 @@ private:
 	int count_tasks_recursive(Task::List &list) const;
 	int count_tasks(Task::List &list) const;
 	void calc_coords(const Task::List &list) const;
-	void specialize_recursive(Task::List &list) const;
+	typedef std::map<Task::Handle, Task::Handle> SpecializedMap;
+	void specialize_recursive(Task::List &list, SpecializedMap &specialized) const;
 	void specialize(Task::List &list) const;
 	void remove_dummy(Task::List &list) const;
 	void linearize(Task::List &list) const;
 
 	int subtasks_count(const Task::Handle &task, int max_count) const;
 
+	//! Results of the optimization of the tasks shared between several parents
+	class OptimizedTasks;
+
 	bool
 	call_optimizers(
 		const Optimizer::List &optimizers,
@@ -108,12 +112,22 @@ private:
 		std::atomic<int> *optimizations_count,
 		bool deep_first ) const;
 
+	void optimize_task(
+		const Optimizer::List *optimizers,
+		const Optimizer::RunParams *params,
+		OptimizedTasks *optimized,
+		std::atomic<int> *calls_count,
+		std::atomic<int> *optimizations_count,
+		int max_level ) const;
+
 	void optimize_recursive(
 		const Optimizer::List *optimizers,  // pass by pointer for use with sigc::bind
 		const Optimizer::RunParams *params, // pass by pointer for use with sigc::bind
+		OptimizedTasks *optimized,          // may be null
 		std::atomic<int> *calls_count,
 		std::atomic<int> *optimizations_count,
-		int max_level ) const;
+		int max_level,
+		bool reuse ) const;
 
 	void optimize(Optimizer::Category category, Task::List &list) const;
 
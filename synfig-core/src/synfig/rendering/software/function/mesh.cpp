@@ -29,7 +29,11 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+#include <vector>
+
 #include "mesh.h"
+#include "strips.h"
 
 #endif
 
@@ -83,6 +87,101 @@ namespace {
 			if (coords[1] < 0.0 || coords[1] > size[1])
 				coords[1] -= floor(coords[1]/size[1])*size[1];
 		}
+
+		//! Vertices and texture coordinates transformed once for all of the triangles
+		struct MeshParams
+		{
+			synfig::Surface *target_surface;
+			const synfig::Surface *texture;
+			Rect texture_rect;
+			std::vector<Vector> vertices;
+			std::vector<Vector> tex_coords;
+			std::vector<int> triangles;
+			Color color;
+			Color::value_type opacity;
+			Color::BlendMethod blend_method;
+
+			MeshParams(): target_surface(), texture(), opacity(), blend_method() { }
+
+			void prepare(
+				const Vector *vertices,
+				int vertices_strip,
+				const Vector *tex_coords,
+				int tex_coords_strip,
+				const int *triangles,
+				int triangles_strip,
+				int triangles_count,
+				const Matrix &transform_matrix,
+				const Matrix &texture_matrix )
+			{
+				int count = 0;
+				this->triangles.resize(3*triangles_count);
+				for(int i = 0; i < triangles_count; ++i)
+				{
+					const int *triangle = (const int*)((const char*)triangles + i*triangles_strip);
+					for(int j = 0; j < 3; ++j)
+					{
+						this->triangles[3*i + j] = triangle[j];
+						count = std::max(count, triangle[j] + 1);
+					}
+				}
+
+				this->vertices.resize(count);
+				for(int i = 0; i < count; ++i)
+					this->vertices[i] = transform_matrix.get_transformed(*(const Vector*)((const char*)vertices + i*vertices_strip));
+
+				if (!tex_coords) return;
+				this->tex_coords.resize(count);
+				for(int i = 0; i < count; ++i)
+					this->tex_coords[i] = texture_matrix.get_transformed(*(const Vector*)((const char*)tex_coords + i*tex_coords_strip));
+			}
+		};
+
+		//! Each thread draws all of the triangles clipped by its own band of rows,
+		//! so the triangles are blended in the same order
+		static void render_polygon_band(const MeshParams *p, RectInt band)
+		{
+			for(int i = 0; i < (int)p->triangles.size(); i += 3)
+				software::Mesh::render_triangle(
+					*p->target_surface,
+					band,
+					p->vertices[p->triangles[i]],
+					p->vertices[p->triangles[i + 1]],
+					p->vertices[p->triangles[i + 2]],
+					p->color,
+					p->opacity,
+					p->blend_method );
+		}
+
+		static void render_mesh_band(const MeshParams *p, RectInt band)
+		{
+			for(int i = 0; i < (int)p->triangles.size(); i += 3)
+				software::Mesh::render_triangle(
+					*p->target_surface,
+					band,
+					p->vertices[p->triangles[i]],
+					p->tex_coords[p->triangles[i]],
+					p->vertices[p->triangles[i + 1]],
+					p->tex_coords[p->triangles[i + 1]],
+					p->vertices[p->triangles[i + 2]],
+					p->tex_coords[p->triangles[i + 2]],
+					*p->texture,
+					p->texture_rect,
+					p->opacity,
+					p->blend_method );
+		}
+
+		static void render_bands(
+			void (*func)(const MeshParams*, RectInt),
+			const MeshParams &p,
+			const RectInt &bounds )
+		{
+			const int min_triangles = 64;
+			if ((int)p.triangles.size() < 3*min_triangles)
+				func(&p, bounds);
+			else
+				software::run_strips(func, &p, bounds);
+		}
 	};
 }
 
@@ -392,20 +491,20 @@ software::Mesh::render_polygon(
 
 	if (vertices_strip <= 0) vertices_strip = sizeof(Vector);
 	if (triangles_strip <= 0) triangles_strip = sizeof(int[3]);
-
-	for(int i = 0; i < triangles_count; ++i)
-	{
-		int *triangle = (int*)((char*)triangles + i*triangles_strip);
-		render_triangle(
-			target_surface,
-			target_rect,
-			transform_matrix.get_transformed(*(Vector*)((char*)vertices + triangle[0]*vertices_strip)),
-			transform_matrix.get_transformed(*(Vector*)((char*)vertices + triangle[1]*vertices_strip)),
-			transform_matrix.get_transformed(*(Vector*)((char*)vertices + triangle[2]*vertices_strip)),
-			color,
-			opacity,
-			blend_method );
-	}
+	if (triangles_count <= 0) return;
+
+	Internal::MeshParams p;
+	p.target_surface = &target_surface;
+	p.color = color;
+	p.opacity = opacity;
+	p.blend_method = blend_method;
+	p.prepare(
+		vertices, vertices_strip,
+		NULL, 0,
+		triangles, triangles_strip, triangles_count,
+		transform_matrix, Matrix() );
+
+	Internal::render_bands(&Internal::render_polygon_band, p, bounds);
 }
 
 void
@@ -470,24 +569,21 @@ software::Mesh::render_mesh(
 	if (vertices_strip <= 0) vertices_strip = sizeof(Vector);
 	if (tex_coords_strip <= 0) tex_coords_strip = sizeof(Vector);
 	if (triangles_strip <= 0) triangles_strip = sizeof(int[3]);
-
-	for(int i = 0; i < triangles_count; ++i)
-	{
-		int *triangle = (int*)((char*)triangles + i*triangles_strip);
-		render_triangle(
-			target_surface,
-			target_rect,
-			transform_matrix.get_transformed(*(Vector*)((char*)vertices + triangle[0]*vertices_strip)),
-			texture_matrix.get_transformed(*(Vector*)((char*)tex_coords + triangle[0]*tex_coords_strip)),
-			transform_matrix.get_transformed(*(Vector*)((char*)vertices + triangle[1]*vertices_strip)),
-			texture_matrix.get_transformed(*(Vector*)((char*)tex_coords + triangle[1]*tex_coords_strip)),
-			transform_matrix.get_transformed(*(Vector*)((char*)vertices + triangle[2]*vertices_strip)),
-			texture_matrix.get_transformed(*(Vector*)((char*)tex_coords + triangle[2]*tex_coords_strip)),
-			texture,
-			texture_rect,
-			opacity,
-			blend_method );
-	}
+	if (triangles_count <= 0) return;
+
+	Internal::MeshParams p;
+	p.target_surface = &target_surface;
+	p.texture = &texture;
+	p.texture_rect = texture_rect;
+	p.opacity = opacity;
+	p.blend_method = blend_method;
+	p.prepare(
+		vertices, vertices_strip,
+		tex_coords, tex_coords_strip,
+		triangles, triangles_strip, triangles_count,
+		transform_matrix, texture_matrix );
+
+	Internal::render_bands(&Internal::render_mesh_band, p, bounds);
 }
 
 void
@@ -165,6 +165,7 @@ public:
 	void set_pixels(const Color *pixels, int width, int height, int pitch = 0);
 	int get_width() const { return width; }
 	int get_height() const { return height; }
+	size_t get_data_size() const { return data.size(); }
 	void get_pixels(Color *target) const;
 };
 
@@ -0,0 +1,78 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/software/function/strips.cpp
+**	\brief Strips
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+
+#include <synfig/threadpool.h>
+
+#include "strips.h"
+
+#include "../../common/optimizer/optimizersplit.h"
+
+#endif
+
+using namespace synfig;
+using namespace rendering;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+int
+software::get_strips_count(int rows, int cols, StripsCost cost)
+{
+	const bool expensive = cost == STRIPS_EXPENSIVE;
+	const int min_area = expensive ? 64*64 : OptimizerSplit::min_area;
+	const int min_rows = expensive ? 8 : 16;
+	const int strips_per_thread = expensive ? 4 : 1;
+	if (rows*cols < min_area)
+		return 1;
+	return std::max(1, std::min(strips_per_thread*ThreadPool::instance().get_max_threads(), rows/min_rows));
+}
+
+void
+software::run_strips(int rows, int cols, const sigc::slot<void, int, int> &func, StripsCost cost)
+{
+	const int strips = get_strips_count(rows, cols, cost);
+	if (strips < 2) {
+		func(0, rows);
+		return;
+	}
+
+	ThreadPool::Group group;
+	for(int i = 0; i < strips; ++i)
+		group.enqueue( sigc::bind(func, rows*i/strips, rows*(i + 1)/strips) );
+	group.run();
+}
+
+/* === M E T H O D S ======================================================= */
+
+/* === E N T R Y P O I N T ================================================= */
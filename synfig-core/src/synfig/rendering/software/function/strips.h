@@ -0,0 +1,83 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/software/function/strips.h
+**	\brief Strips Header
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_RENDERING_SOFTWARE_STRIPS_H
+#define __SYNFIG_RENDERING_SOFTWARE_STRIPS_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <sigc++/bind.h>
+#include <sigc++/signal.h>
+
+#include <synfig/rect.h>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig
+{
+namespace rendering
+{
+namespace software
+{
+
+//! Cost of the processing of one pixel
+enum StripsCost
+{
+	STRIPS_CHEAP,     //!< areas smaller than OptimizerSplit::min_area are not split
+	STRIPS_EXPENSIVE  //!< small areas are split too, and there are more strips than threads
+	                  //!< to balance the uneven cost of the rows
+};
+
+//! Returns count of the horizontal strips to process rows x cols pixels in several threads
+int get_strips_count(int rows, int cols, StripsCost cost = STRIPS_CHEAP);
+
+//! Splits rows into the horizontal strips and calls func(first_row, end_row) for each strip,
+//! strips are processed in the thread pool, call returns when all of them are done
+void run_strips(int rows, int cols, const sigc::slot<void, int, int> &func, StripsCost cost = STRIPS_CHEAP);
+
+template<typename T>
+void run_strips_rect(int first_row, int end_row, void (*func)(T*, RectInt), T *params, RectInt rect)
+	{ func(params, RectInt(rect.minx, rect.miny + first_row, rect.maxx, rect.miny + end_row)); }
+
+//! Calls func(params, strip) for the horizontal strips of rect
+template<typename T, typename P>
+void run_strips(void (*func)(T*, RectInt), P *params, const RectInt &rect, StripsCost cost = STRIPS_CHEAP)
+{
+	T *p = params;
+	run_strips(
+		rect.get_height(),
+		rect.get_width(),
+		sigc::bind(sigc::ptr_fun(&run_strips_rect<T>), func, p, rect),
+		cost );
+}
+
+} /* end namespace software */
+} /* end namespace rendering */
+} /* end namespace synfig */
+
+/* -- E N D ----------------------------------------------------------------- */
+
+#endif
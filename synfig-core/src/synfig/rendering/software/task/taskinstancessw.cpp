@@ -0,0 +1,156 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/software/task/taskinstancessw.cpp
+**	\brief TaskInstancesSW
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+#include <synfig/general.h>
+#include <synfig/localization.h>
+
+#include "../../common/task/taskinstances.h"
+#include "../function/resample.h"
+#include "../function/strips.h"
+#include "tasksw.h"
+
+#endif
+
+using namespace synfig;
+using namespace rendering;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+namespace {
+
+class TaskInstancesSW: public TaskInstances, public TaskSW
+{
+public:
+	typedef etl::handle<TaskInstancesSW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+private:
+	struct Params
+	{
+		synfig::Surface *dst_surface;
+		const synfig::Surface *src_surface;
+		RectInt src_rect;
+		std::vector<Matrix> matrices;  //!< from the pixels of the source to the pixels of the result
+		std::vector<ColorReal> amounts;
+		Color::Interpolation interpolation;
+		Color::BlendMethod blend_method;
+
+		Params(): dst_surface(), src_surface(), interpolation(), blend_method() { }
+	};
+
+	static void process_rect(const Params *p, RectInt rect)
+	{
+		// instances should be blended in order, so each thread draws all of them in its own strip
+		for(size_t i = 0; i < p->matrices.size(); ++i)
+			software::Resample::resample(
+				*p->dst_surface,
+				rect,
+				*p->src_surface,
+				p->src_rect,
+				p->matrices[i],
+				p->interpolation,
+				true,
+				p->amounts[i],
+				p->blend_method );
+	}
+
+public:
+	virtual bool run(RunParams&) const
+	{
+		if (!is_valid() || !sub_task() || !sub_task()->is_valid())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+
+		Params p;
+		p.dst_surface = &ldst->get_surface();
+
+		const RectInt rect = RectInt(0, 0, p.dst_surface->get_w(), p.dst_surface->get_h()) & target_rect;
+		if (!rect.is_valid())
+			return true;
+
+		LockRead lsrc(sub_task());
+		if (!lsrc)
+			return false;
+		p.src_surface = &lsrc->get_surface();
+		p.src_rect = sub_task()->target_rect;
+		p.interpolation = interpolation;
+		p.blend_method = blend_method;
+
+		Vector src_upp = sub_task()->get_units_per_pixel();
+		Matrix src_pixels_to_units;
+		src_pixels_to_units.m00 = src_upp[0];
+		src_pixels_to_units.m11 = src_upp[1];
+		src_pixels_to_units.m20 = sub_task()->source_rect.minx - src_upp[0]*sub_task()->target_rect.minx;
+		src_pixels_to_units.m21 = sub_task()->source_rect.miny - src_upp[1]*sub_task()->target_rect.miny;
+
+		Vector dst_ppu = get_pixels_per_unit();
+		Matrix dst_units_to_pixels;
+		dst_units_to_pixels.m00 = dst_ppu[0];
+		dst_units_to_pixels.m11 = dst_ppu[1];
+		dst_units_to_pixels.m20 = target_rect.minx - dst_ppu[0]*source_rect.minx;
+		dst_units_to_pixels.m21 = target_rect.miny - dst_ppu[1]*source_rect.miny;
+
+		p.matrices.reserve(instances.size());
+		p.amounts.reserve(instances.size());
+		for(InstanceList::const_iterator i = instances.begin(); i != instances.end(); ++i)
+		{
+			if (!i->matrix.is_invertible())
+				continue;
+			p.matrices.push_back(dst_units_to_pixels * i->matrix * src_pixels_to_units);
+			p.amounts.push_back(amount*i->amount);
+		}
+
+		software::run_strips(&TaskInstancesSW::process_rect, &p, rect);
+
+		return true;
+	}
+};
+
+
+Task::Token TaskInstancesSW::token(
+	DescReal< TaskInstancesSW,
+		      TaskInstances >
+			    ("InstancesSW") );
+
+} // end of anonimous namespace
+
+/* === E N T R Y P O I N T ================================================= */
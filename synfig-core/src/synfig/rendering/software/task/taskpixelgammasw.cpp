@@ -29,10 +29,15 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include <synfig/debug/debugsurface.h>
 #include <synfig/general.h>
 
 #include "../../common/task/taskpixelprocessor.h"
+#include "../function/strips.h"
 #include "tasksw.h"
 
 #endif
@@ -58,7 +63,45 @@ public:
 	virtual Token::Handle get_token() const { return token.handle(); }
 
 private:
-	typedef void Func(ColorReal &dst, const ColorReal &src, const ColorReal &gamma);
+	static inline ColorReal clamp(const ColorReal &x)
+	{
+		const ColorReal max = ColorReal(1.0)/real_low_precision<ColorReal>();
+		return std::max(-max, std::min(max, x));
+	}
+
+	//! Gamma curve of the channel, values in range [1/SIZE, 1] are interpolated
+	//! by the lookup table, other values are calculated directly
+	class Curve
+	{
+	public:
+		enum { SIZE = 4096 };
+
+		ColorReal gamma;
+		std::vector<ColorReal> table;
+
+		explicit Curve(ColorReal gamma = ColorReal(1.0)): gamma(gamma) { }
+
+		void build_table()
+		{
+			table.resize(SIZE + 2);
+			for(int i = 0; i <= SIZE; ++i)
+				table[i] = clamp(std::pow(ColorReal(i)/SIZE, gamma));
+			table[SIZE + 1] = table[SIZE];
+		}
+
+		ColorReal operator() (const ColorReal &x) const
+		{
+			if (!table.empty() && x >= ColorReal(1.0)/SIZE && x <= ColorReal(1.0))
+			{
+				const ColorReal f = x*SIZE;
+				const int i = (int)f;
+				return table[i] + (table[i + 1] - table[i])*(f - i);
+			}
+			return clamp(x < 0 ? -std::pow(-x, gamma) : std::pow(x, gamma));
+		}
+	};
+
+	typedef void Func(ColorReal &dst, const ColorReal &src, const Curve &curve);
 
 	struct Params
 	{
@@ -70,9 +113,9 @@ private:
 		int height;
 
 		union {
-			ColorReal gamma[3];
+			const Curve *curve[3];
 			struct {
-				ColorReal gamma_r, gamma_g, gamma_b;
+				const Curve *curve_r, *curve_g, *curve_b;
 			};
 		};
 
@@ -80,7 +123,7 @@ private:
 			dst(), dst_stride(),
 			src(), src_stride(),
 			width(), height(),
-			gamma_r(1.0), gamma_g(1.0), gamma_b(1.0)
+			curve_r(), curve_g(), curve_b()
 		{ }
 
 		Params(
@@ -90,22 +133,26 @@ private:
 			int src_stride,
 			int width,
 			int height,
-			ColorReal gamma_r,
-			ColorReal gamma_g,
-			ColorReal gamma_b
+			const Curve *curve_r,
+			const Curve *curve_g,
+			const Curve *curve_b
 		):
 			dst((ColorReal*)dst), dst_stride(dst_stride),
 			src((const ColorReal*)src), src_stride(src_stride),
 			width(width), height(height),
-			gamma_r(gamma_r), gamma_g(gamma_g), gamma_b(gamma_b)
+			curve_r(curve_r), curve_g(curve_g), curve_b(curve_b)
 		{ }
-	};
 
-	static inline ColorReal clamp(const ColorReal &x)
-	{
-		const ColorReal max = ColorReal(1.0)/real_low_precision<ColorReal>();
-		return std::max(-max, std::min(max, x));
-	}
+		//! Returns params for \a count rows started from \a row
+		Params rows(int row, int count) const
+		{
+			Params p(*this);
+			p.dst += 4*dst_stride*row;
+			p.src += 4*src_stride*row;
+			p.height = count;
+			return p;
+		}
+	};
 
 	static inline ColorReal clamp_positive(const ColorReal &x)
 	{
@@ -113,13 +160,13 @@ private:
 		return std::max(real_low_precision<ColorReal>(), std::min(max, x));
 	}
 
-	static inline void func_none(ColorReal&, const ColorReal&, const ColorReal&) { }
-	static inline void func_copy(ColorReal &dst, const ColorReal &src, const ColorReal&)
+	static inline void func_none(ColorReal&, const ColorReal&, const Curve&) { }
+	static inline void func_copy(ColorReal &dst, const ColorReal &src, const Curve&)
 		{ dst = src; }
-	static inline void func_one(ColorReal &dst, const ColorReal &, const ColorReal &)
+	static inline void func_one(ColorReal &dst, const ColorReal &, const Curve&)
 		{ dst = ColorReal(1.0); }
-	static inline void func_pow(ColorReal &dst, const ColorReal &src, const ColorReal &gamma)
-		{ dst = clamp(src < 0 ? -pow(-src, gamma) : pow(src, gamma)); }
+	static inline void func_pow(ColorReal &dst, const ColorReal &src, const Curve &curve)
+		{ dst = curve(src); }
 
 	template<Func fr, Func fg, Func fb>
 	static void process_rgb(const Params &p) {
@@ -134,9 +181,9 @@ private:
 			{
 				for(ColorReal *dst_row_end = dst + row_size; dst != dst_row_end; dst += 4)
 				{
-					fr(dst[0], dst[0], p.gamma_r);
-					fg(dst[1], dst[1], p.gamma_g);
-					fb(dst[2], dst[2], p.gamma_b);
+					fr(dst[0], dst[0], *p.curve_r);
+					fg(dst[1], dst[1], *p.curve_g);
+					fb(dst[2], dst[2], *p.curve_b);
 				}
 			}
 		}
@@ -153,9 +200,9 @@ private:
 			{
 				for(ColorReal *dst_row_end = dst + row_size; dst != dst_row_end; dst += 4, src += 4)
 				{
-					fr(dst[0], src[0], p.gamma_r);
-					fg(dst[1], src[1], p.gamma_g);
-					fb(dst[2], src[2], p.gamma_b);
+					fr(dst[0], src[0], *p.curve_r);
+					fg(dst[1], src[1], *p.curve_g);
+					fb(dst[2], src[2], *p.curve_b);
 					dst[3] = src[3];
 				}
 			}
@@ -164,27 +211,30 @@ private:
 
 	template<Func fr, Func fg>
 	static void process_rg(const Params &p) {
-		if ( approximate_equal_lp(p.gamma_b, ColorReal(0.0))) process_rgb<fr, fg, func_one >(p); else
-		if (!approximate_equal_lp(p.gamma_b, ColorReal(1.0))) process_rgb<fr, fg, func_pow >(p); else
-		if (p.src == p.dst)                                   process_rgb<fr, fg, func_none>(p); else
-				                                              process_rgb<fr, fg, func_copy>(p);
+		if ( approximate_equal_lp(p.curve_b->gamma, ColorReal(0.0))) process_rgb<fr, fg, func_one >(p); else
+		if (!approximate_equal_lp(p.curve_b->gamma, ColorReal(1.0))) process_rgb<fr, fg, func_pow >(p); else
+		if (p.src == p.dst)                                          process_rgb<fr, fg, func_none>(p); else
+				                                                     process_rgb<fr, fg, func_copy>(p);
 	}
 
 	template<Func fr>
 	static void process_r(const Params &p) {
-		if ( approximate_equal_lp(p.gamma_g, ColorReal(0.0))) process_rg<fr, func_one >(p); else
-		if (!approximate_equal_lp(p.gamma_g, ColorReal(1.0))) process_rg<fr, func_pow >(p); else
-		if (p.src == p.dst)                                   process_rg<fr, func_none>(p); else
-				                                              process_rg<fr, func_copy>(p);
+		if ( approximate_equal_lp(p.curve_g->gamma, ColorReal(0.0))) process_rg<fr, func_one >(p); else
+		if (!approximate_equal_lp(p.curve_g->gamma, ColorReal(1.0))) process_rg<fr, func_pow >(p); else
+		if (p.src == p.dst)                                          process_rg<fr, func_none>(p); else
+				                                                     process_rg<fr, func_copy>(p);
 	}
 
 	static void process(const Params &p) {
-		if ( approximate_equal_lp(p.gamma_r, ColorReal(0.0))) process_r<func_one >(p); else
-		if (!approximate_equal_lp(p.gamma_r, ColorReal(1.0))) process_r<func_pow >(p); else
-		if (p.src == p.dst)                                   process_r<func_none>(p); else
-				                                              process_r<func_copy>(p);
+		if ( approximate_equal_lp(p.curve_r->gamma, ColorReal(0.0))) process_r<func_one >(p); else
+		if (!approximate_equal_lp(p.curve_r->gamma, ColorReal(1.0))) process_r<func_pow >(p); else
+		if (p.src == p.dst)                                          process_r<func_none>(p); else
+				                                                     process_r<func_copy>(p);
 	}
 
+	static void process_rows(int first_row, int end_row, const Params *p)
+		{ process(p->rows(first_row, end_row - first_row)); }
+
 public:
 	virtual bool run(RunParams&) const {
 		if (!is_valid() || !sub_task() || !sub_task()->is_valid())
@@ -204,16 +254,33 @@ public:
 			synfig::Surface &dst = ldst->get_surface();
 			const synfig::Surface &src = lsrc->get_surface();
 
-			process(Params(
+			// tables are cheaper than pow() only for the large surfaces
+			const int min_area_for_tables = 16*Curve::SIZE;
+			Curve curves[3];
+			for(int i = 0; i < 3; ++i)
+			{
+				curves[i].gamma = clamp_positive(gamma.get(i));
+				if ( rs.get_width()*rs.get_height() >= min_area_for_tables
+				  && !approximate_equal_lp(curves[i].gamma, ColorReal(0.0))
+				  && !approximate_equal_lp(curves[i].gamma, ColorReal(1.0)) )
+					curves[i].build_table();
+			}
+
+			Params p(
 				&dst[rs.miny][rs.minx],
 				dst.get_pitch()/sizeof(Color),
 				&src[rs.miny - rd.miny - offset[1]][rs.minx - rd.minx - offset[0]],
 				src.get_pitch()/sizeof(Color),
 				rs.get_width(),
 				rs.get_height(),
-				clamp_positive(gamma.get_r()),
-				clamp_positive(gamma.get_g()),
-				clamp_positive(gamma.get_b()) ));
+				&curves[0],
+				&curves[1],
+				&curves[2] );
+
+			software::run_strips(
+				rs.get_height(),
+				rs.get_width(),
+				sigc::bind(sigc::ptr_fun(&TaskPixelGammaSW::process_rows), &p) );
 		}
 
 		return true;
@@ -0,0 +1,180 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file synfig/rendering/software/task/taskwarpsw.cpp
+**	\brief TaskWarpSW
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <synfig/general.h>
+#include <synfig/localization.h>
+
+#include "../../common/task/taskwarp.h"
+#include "../function/strips.h"
+#include "tasksw.h"
+
+#endif
+
+using namespace synfig;
+using namespace rendering;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === M E T H O D S ======================================================= */
+
+namespace {
+
+class TaskWarpSW: public TaskWarp, public TaskSW
+{
+public:
+	typedef etl::handle<TaskWarpSW> Handle;
+	static Token token;
+	virtual Token::Handle get_token() const { return token.handle(); }
+
+private:
+	struct Params
+	{
+		synfig::Surface *dst_surface;
+		const synfig::Surface *src_surface;
+		const Mapping *mapping;
+		Color::Interpolation interpolation;
+		int quality;
+		Point origin;       //!< units of the pixel (0, 0) of the result
+		Vector upp;         //!< units per pixel of the result
+		Vector src_ppu;     //!< pixels per unit of the source
+		Vector src_offset;  //!< pixel of the source at zero point (integer coordinates are centers of pixels)
+
+		Params(): dst_surface(), src_surface(), mapping(), interpolation(), quality() { }
+	};
+
+	template<synfig::Surface::sampler_cook::func func>
+	static void process(const Params &p, const RectInt &rect)
+	{
+		const int width = rect.get_width();
+
+		// keep coordinates in the range of int,
+		// sampler clamps them by the edges of the surface anyway
+		const Real min_x = -2, max_x = p.src_surface->get_w() + 2;
+		const Real min_y = -2, max_y = p.src_surface->get_h() + 2;
+
+		std::vector<Point> points(width);
+		std::unique_ptr<bool[]> valid(new bool[width]);
+
+		for(int r = rect.miny; r < rect.maxy; ++r) {
+			p.mapping->map_row(
+				&points.front(),
+				valid.get(),
+				Point(p.origin[0] + p.upp[0]*rect.minx, p.origin[1] + p.upp[1]*r),
+				Vector(p.upp[0], 0),
+				width,
+				p.quality );
+
+			Color *c = &(*p.dst_surface)[r][rect.minx];
+			for(int i = 0; i < width; ++i, ++c) {
+				if (!valid[i] || points[i].is_nan_or_inf())
+					{ *c = Color::alpha(); continue; }
+				const Point sp = points[i].multiply_coords(p.src_ppu) + p.src_offset;
+				*c = func( p.src_surface,
+						   clamp(sp[0], min_x, max_x),
+						   clamp(sp[1], min_y, max_y) ).demult_alpha();
+			}
+		}
+	}
+
+	static void process_rect(const Params *p, RectInt rect)
+	{
+		switch(p->interpolation) {
+			case Color::INTERPOLATION_LINEAR:
+				process<synfig::Surface::sampler_cook::linear_sample>(*p, rect);
+				break;
+			case Color::INTERPOLATION_COSINE:
+				process<synfig::Surface::sampler_cook::cosine_sample>(*p, rect);
+				break;
+			case Color::INTERPOLATION_CUBIC:
+				process<synfig::Surface::sampler_cook::cubic_sample>(*p, rect);
+				break;
+			default: // nearest
+				process<synfig::Surface::sampler_cook::nearest_sample>(*p, rect);
+				break;
+		}
+	}
+
+public:
+	virtual bool run(RunParams&) const
+	{
+		if (!is_valid() || !mapping || !sub_task() || !sub_task()->is_valid())
+			return true;
+
+		LockWrite ldst(this);
+		if (!ldst)
+			return false;
+
+		Params p;
+		p.dst_surface = &ldst->get_surface();
+
+		const RectInt rect = RectInt(0, 0, p.dst_surface->get_w(), p.dst_surface->get_h()) & target_rect;
+		if (!rect.is_valid())
+			return true;
+
+		LockRead lsrc(sub_task());
+		if (!lsrc)
+			return false;
+		p.src_surface = &lsrc->get_surface();
+
+		p.mapping = mapping.get();
+		p.interpolation = interpolation;
+		p.quality = quality;
+		p.upp = get_units_per_pixel();
+		p.origin = Point(
+			source_rect.minx + p.upp[0]*(0.5 - target_rect.minx),
+			source_rect.miny + p.upp[1]*(0.5 - target_rect.miny) );
+		p.src_ppu = sub_task()->get_pixels_per_unit();
+		p.src_offset = Vector(
+			sub_task()->target_rect.minx - sub_task()->source_rect.minx*p.src_ppu[0] - 0.5,
+			sub_task()->target_rect.miny - sub_task()->source_rect.miny*p.src_ppu[1] - 0.5 );
+
+		// mappings are expensive, so process large areas by strips in several threads
+		software::run_strips(&TaskWarpSW::process_rect, &p, rect);
+
+		return true;
+	}
+};
+
+
+Task::Token TaskWarpSW::token(
+	DescReal< TaskWarpSW,
+		      TaskWarp >
+		        ("WarpSW") );
+
+} // end of anonimous namespace
+
+/* === E N T R Y P O I N T ================================================= */
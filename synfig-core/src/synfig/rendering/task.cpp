@@ -43,6 +43,11 @@ using namespace rendering;
 
 /* === G L O B A L S ======================================================= */
 
+namespace {
+	thread_local Task::CoordsCollector *coords_collector = NULL;
+	thread_local Task *coords_parent = NULL;
+}
+
 /* === P R O C E D U R E S ================================================= */
 
 /* === M E T H O D S ======================================================= */
@@ -255,9 +260,20 @@ Rect
 Task::calc_bounds() const
 	{ return Rect::infinite(); }
 
+Task::CoordsCollector*
+Task::set_coords_collector(CoordsCollector *collector)
+{
+	CoordsCollector *previous = coords_collector;
+	coords_collector = collector;
+	return previous;
+}
+
 void
 Task::set_coords(const Rect &source_rect, const VectorInt &target_size)
 {
+	if (coords_collector && coords_collector->collect(*this, coords_parent, source_rect, target_size))
+		return;
+
 	if (this->source_rect.is_full_infinite()) {
 		this->source_rect = source_rect;
 		this->target_rect = RectInt(VectorInt(), target_size);
@@ -276,7 +292,11 @@ Task::set_coords(const Rect &source_rect, const VectorInt &target_size)
 		target_surface->create(target_rect.maxx, target_rect.maxy);
 
 	trunc_by_bounds();
+
+	Task *parent = coords_parent;
+	coords_parent = this;
 	set_coords_sub_tasks();
+	coords_parent = parent;
 }
 
 bool
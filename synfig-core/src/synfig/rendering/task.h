@@ -346,6 +346,17 @@ public:
 	};
 
 
+	//! Intercepts set_coords() calls made in the current thread.
+	//! Renderer uses it to collect coordinates requested by all parents
+	//! of the sub-task which is shared between several parents.
+	class CoordsCollector
+	{
+	public:
+		virtual ~CoordsCollector() { }
+		//! Returns true when call is collected and should not be processed
+		virtual bool collect(Task &task, Task *parent, const Rect &source_rect, const VectorInt &target_size) = 0;
+	};
+
 	static synfig::Token token;
 	virtual Token::Handle get_token() const = 0;
 
@@ -447,6 +458,9 @@ public:
 	virtual int get_pass_subtask_index() const
 		{ return PASSTO_THIS_TASK; }
 
+	//! Sets collector for the current thread, returns previous one
+	static CoordsCollector* set_coords_collector(CoordsCollector *collector);
+
 	void touch_coords();
 	void set_coords(const Rect &source_rect, const VectorInt &target_size);
 	void set_coords_zero();
@@ -31,6 +31,11 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
+#include <cstring>
+
+#include <sigc++/bind.h>
+
 #include "target_scanline.h"
 
 #include "general.h"
@@ -38,12 +43,15 @@
 
 #include "canvas.h"
 #include "context.h"
+#include "imageprefetcher.h"
 #include "render.h"
 #include "string.h"
 #include "surface.h"
+#include "debug/stageprofile.h"
 #include "rendering/renderer.h"
 #include "rendering/surface.h"
 #include "rendering/software/surfacesw.h"
+#include "rendering/software/function/strips.h"
 #include "rendering/common/task/tasktransformation.h"
 
 #endif
@@ -65,10 +73,78 @@ using namespace rendering;
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+struct ConvertRowsParams
+{
+	unsigned char *dst;
+	int dst_stride;
+	const synfig::Surface *surface;
+	PixelFormat pf;
+	const Gamma *gamma;
+	TargetAlphaMode alpha_mode;
+	Color bg_color;
+	PixelDither dither;
+	int offset_y;
+
+	ConvertRowsParams():
+		dst(), dst_stride(), surface(), pf(), gamma(), alpha_mode(TARGET_ALPHA_MODE_KEEP),
+		dither(PIXEL_DITHER_NONE), offset_y() { }
+};
+
+//! Applies the alpha mode by small chunks which stay in the cache
+//! until they are converted to the pixel format
+void
+convert_rows_strip(int y0, int y1, const ConvertRowsParams *p)
+{
+	const int chunk = 256;
+	Color buffer[chunk];
+
+	const int w = p->surface->get_w();
+	for(int y = y0; y < y1; ++y)
+	{
+		unsigned char *dst = p->dst + (ptrdiff_t)y*p->dst_stride;
+		const Color *src = (*p->surface)[y];
+
+		if (p->alpha_mode == TARGET_ALPHA_MODE_KEEP)
+		{
+			color_to_pixelformat(dst, src, p->pf, p->gamma, w, 1, 0, 0, p->dither, 0, p->offset_y + y);
+			continue;
+		}
+
+		for(int x = 0; x < w; x += chunk, src += chunk)
+		{
+			const int n = std::min(chunk, w - x);
+			switch(p->alpha_mode)
+			{
+				case TARGET_ALPHA_MODE_FILL:
+					for(int i = 0; i < n; ++i)
+						buffer[i] = Color::blend(src[i], p->bg_color, 1.0f);
+					break;
+				case TARGET_ALPHA_MODE_EXTRACT:
+					for(int i = 0; i < n; ++i)
+					{
+						float a = src[i].get_a();
+						buffer[i] = Color(a,a,a,a);
+					}
+					break;
+				default:
+					for(int i = 0; i < n; ++i)
+						buffer[i] = Color(src[i].get_r(), src[i].get_g(), src[i].get_b(), 1.0f);
+					break;
+			}
+			dst = color_to_pixelformat(dst, buffer, p->pf, p->gamma, n, 1, 0, 0, p->dither, x, p->offset_y + y);
+		}
+	}
+}
+
+} // end of anonymous namespace
+
 /* === M E T H O D S ======================================================= */
 
 Target_Scanline::Target_Scanline():
-	threads_(2)
+	threads_(2),
+	dither_(PIXEL_DITHER_NONE)
 {
 	curr_frame_=0;
 	if (const char *s = getenv("SYNFIG_TARGET_DEFAULT_ENGINE"))
@@ -89,7 +165,11 @@ synfig::Target_Scanline::call_renderer(
 	const RendDesc &renddesc )
 {
 	surface->create(renddesc.get_w(), renddesc.get_h());
-	rendering::Task::Handle task = canvas.build_rendering_task(context_params);
+	rendering::Task::Handle task;
+	{
+		debug::StageProfile::Scope profile(debug::StageProfile::BUILD_TASK);
+		task = canvas.build_rendering_task(context_params);
+	}
 
 	if (task)
 	{
@@ -149,6 +229,9 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 	total_frames=frame_end-frame_start+1;
 	if(total_frames<=0)total_frames=1;
 
+	// Load frames of imported animations in background while rendering
+	ImagePrefetcher::Render prefetch_render(canvas.get(), desc.get_time_start(), desc.get_time_end(), desc.get_frame_rate());
+
 	try {
 
 	//synfig::info("1time_set_to %s",t.get_string().c_str());
@@ -166,7 +249,12 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 
 			// Set the time that we wish to render
 			if(!get_avoid_time_sync() || canvas->get_time()!=t) {
-				canvas->set_time(t);
+				{
+					debug::StageProfile::Scope profile(debug::StageProfile::SET_TIME);
+					ImagePrefetcher::instance().set_time(t);
+					canvas->set_time(t);
+				}
+				debug::StageProfile::Scope profile(debug::StageProfile::LOAD_RESOURCES);
 				canvas->load_resources(t);
 			}
 			canvas->set_outline_grow(desc.get_outline_grow());
@@ -227,60 +315,17 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 								return false;
 							}
 
-							const synfig::Surface &s = lock->get_surface();
-
-							int y;
-							int rowspan=sizeof(Color)*s.get_w();
-							Surface::const_pen pen = s.begin();
-
-							int yoff = i*rowheight;
-
-							for(y = 0; y < blockrd.get_h(); y++, pen.inc_y())
-							{
-								Color *colordata= start_scanline(y + yoff);
-								if(!colordata)
-								{
-//									throw(string("add_frame(): call to start_scanline(y) returned NULL"));
-									if(cb)
-										cb->error(_("add_frame(): call to start_scanline(y) returned NULL"));
-									return false;
-								}
-
-								switch(get_alpha_mode())
-								{
-									case TARGET_ALPHA_MODE_FILL:
-										for(int i = 0; i < s.get_w(); i++)
-											colordata[i] = Color::blend(s[y][i], desc.get_bg_color(), 1.0f);
-										break;
-									case TARGET_ALPHA_MODE_EXTRACT:
-										for(int i = 0; i < s.get_w(); i++)
-										{
-											float a=s[y][i].get_a();
-											colordata[i] = Color(a,a,a,a);
-										}
-										break;
-									case TARGET_ALPHA_MODE_REDUCE:
-										for(int i = 0; i < s.get_w(); i++)
-											colordata[i] = Color(s[y][i].get_r(), s[y][i].get_g(), s[y][i].get_b(), 1.f);
-										break;
-									case TARGET_ALPHA_MODE_KEEP:
-										memcpy(colordata, s[y], rowspan);
-										break;
-								}
-
-								if(!end_scanline())
-								{
-//									throw(string("add_frame(): target panic on end_scanline()"));
-									if(cb)
-										cb->error(_("add_frame(): target panic on end_scanline()"));
-									return false;
-								}
-							}
+							debug::StageProfile::Scope profile(debug::StageProfile::WRITE);
+							if (!put_surface(lock->get_surface(), i*rowheight, cb))
+								return false;
 						}
 					}
 					surface->reset();
 
-					end_frame();
+					{
+						debug::StageProfile::Scope profile(debug::StageProfile::WRITE);
+						end_frame();
+					}
 
 				}else //use normal rendering...
 				{
@@ -312,13 +357,19 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 				}
 				#endif
 			}
+
+			debug::StageProfile::frame_finished();
 		}while(frames);
 	}
     else
     {
 		// Set the time that we wish to render
 		if(!get_avoid_time_sync() || canvas->get_time()!=t) {
-			canvas->set_time(t);
+			{
+				debug::StageProfile::Scope profile(debug::StageProfile::SET_TIME);
+				canvas->set_time(t);
+			}
+			debug::StageProfile::Scope profile(debug::StageProfile::LOAD_RESOURCES);
 			canvas->load_resources(t);
 		}
 		canvas->set_outline_grow(desc.get_outline_grow());
@@ -383,54 +434,10 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 						return false;
 					}
 
-					const synfig::Surface &s = lock->get_surface();
-
-					int y;
-					int rowspan=sizeof(Color)*s.get_w();
-					Surface::const_pen pen = s.begin();
-
-					int yoff = i*rowheight;
-
-					for(y = 0; y < blockrd.get_h(); y++, pen.inc_y())
 					{
-						Color *colordata= start_scanline(y + yoff);
-						if(!colordata)
-						{
-//							throw(string("add_frame(): call to start_scanline(y) returned NULL"));
-							if(cb)
-								cb->error(_("add_frame(): call to start_scanline(y) returned NULL"));
-							return false;
-						}
-
-						switch(get_alpha_mode())
-						{
-							case TARGET_ALPHA_MODE_FILL:
-								for(int i = 0; i < s.get_w(); i++)
-									colordata[i] = Color::blend(s[y][i], desc.get_bg_color(), 1.0f);
-								break;
-							case TARGET_ALPHA_MODE_EXTRACT:
-								for(int i = 0; i < s.get_w(); i++)
-								{
-									float a=s[y][i].get_a();
-									colordata[i] = Color(a,a,a,a);
-								}
-								break;
-							case TARGET_ALPHA_MODE_REDUCE:
-								for(int i = 0; i < s.get_w(); i++)
-									colordata[i] = Color(s[y][i].get_r(), s[y][i].get_g(), s[y][i].get_b(), 1.0f);
-								break;
-							case TARGET_ALPHA_MODE_KEEP:
-								memcpy(colordata,s[y], rowspan);
-								break;
-						}
-
-						if(!end_scanline())
-						{
-//							throw(string("add_frame(): target panic on end_scanline()"));
-							if(cb)
-								cb->error(_("add_frame(): target panic on end_scanline()"));
+						debug::StageProfile::Scope profile(debug::StageProfile::WRITE);
+						if (!put_surface(lock->get_surface(), i*rowheight, cb))
 							return false;
-						}
 					}
 
 					//I'm done with this part
@@ -438,7 +445,10 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 				}
 				surface->reset();
 
-				end_frame();
+				{
+					debug::StageProfile::Scope profile(debug::StageProfile::WRITE);
+					end_frame();
+				}
 
 			}else
 			{
@@ -470,6 +480,8 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 			}
 			#endif
 		}
+
+		debug::StageProfile::frame_finished();
 	}
 
 	}
@@ -496,10 +508,7 @@ Target_Scanline::add_frame(const synfig::Surface *surface, ProgressCallback *cb)
 {
 	assert(surface);
 
-
-	int y;
-	int rowspan=sizeof(Color)*surface->get_w();
-	Surface::const_pen pen=surface->begin();
+	debug::StageProfile::Scope profile(debug::StageProfile::WRITE);
 
 	if(!start_frame(cb))
 	{
@@ -509,9 +518,31 @@ Target_Scanline::add_frame(const synfig::Surface *surface, ProgressCallback *cb)
 		return false;
 	}
 
-	for(y=0;y<surface->get_h();y++,pen.inc_y())
+	if (!put_surface(*surface, 0, cb))
+		return false;
+
+	end_frame();
+	return true;
+}
+
+bool
+Target_Scanline::put_surface(const synfig::Surface &surface, int y, ProgressCallback *cb)
+{
+	if (can_put_rows())
+	{
+		if (!put_rows(surface, y))
+		{
+			if (cb)
+				cb->error(_("add_frame(): target panic on put_rows()"));
+			return false;
+		}
+		return true;
+	}
+
+	int rowspan=sizeof(Color)*surface.get_w();
+	for(int j = 0; j < surface.get_h(); j++)
 	{
-		Color *colordata= start_scanline(y);
+		Color *colordata= start_scanline(y + j);
 		if(!colordata)
 		{
 //			throw(string("add_frame(): call to start_scanline(y) returned NULL"));
@@ -520,25 +551,26 @@ Target_Scanline::add_frame(const synfig::Surface *surface, ProgressCallback *cb)
 			return false;
 		}
 
+		const Color *row = surface[j];
 		switch(get_alpha_mode())
 		{
 			case TARGET_ALPHA_MODE_FILL:
-				for(int i=0;i<surface->get_w();i++)
-					colordata[i]=Color::blend((*surface)[y][i],desc.get_bg_color(),1.0f);
+				for(int i = 0; i < surface.get_w(); i++)
+					colordata[i] = Color::blend(row[i], desc.get_bg_color(), 1.0f);
 				break;
 			case TARGET_ALPHA_MODE_EXTRACT:
-				for(int i=0;i<surface->get_w();i++)
+				for(int i = 0; i < surface.get_w(); i++)
 				{
-					float a=(*surface)[y][i].get_a();
+					float a = row[i].get_a();
 					colordata[i] = Color(a,a,a,a);
 				}
 				break;
 			case TARGET_ALPHA_MODE_REDUCE:
-				for(int i = 0; i < surface->get_w(); i++)
-					colordata[i] = Color((*surface)[y][i].get_r(),(*surface)[y][i].get_g(),(*surface)[y][i].get_b(),1.0f);
+				for(int i = 0; i < surface.get_w(); i++)
+					colordata[i] = Color(row[i].get_r(), row[i].get_g(), row[i].get_b(), 1.0f);
 				break;
 			case TARGET_ALPHA_MODE_KEEP:
-				memcpy(colordata,(*surface)[y],rowspan);
+				memcpy(colordata, row, rowspan);
 				break;
 		}
 
@@ -550,8 +582,35 @@ Target_Scanline::add_frame(const synfig::Surface *surface, ProgressCallback *cb)
 			return false;
 		}
 	}
-
-	end_frame();
-
 	return true;
 }
+
+bool
+Target_Scanline::put_rows(const synfig::Surface & /* surface */, int /* y */)
+	{ return false; }
+
+void
+Target_Scanline::convert_rows(
+	unsigned char *dst,
+	int dst_stride,
+	const synfig::Surface &surface,
+	PixelFormat pf,
+	const Gamma *gamma,
+	int y ) const
+{
+	ConvertRowsParams p;
+	p.dst = dst;
+	p.dst_stride = dst_stride;
+	p.surface = &surface;
+	p.pf = pf;
+	p.gamma = gamma;
+	p.alpha_mode = get_alpha_mode();
+	p.bg_color = desc.get_bg_color();
+	p.dither = get_dither();
+	p.offset_y = y;
+
+	rendering::software::run_strips(
+		surface.get_h(),
+		surface.get_w(),
+		sigc::bind(sigc::ptr_fun(&convert_rows_strip), &p) );
+}
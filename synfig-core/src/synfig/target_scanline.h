@@ -29,6 +29,7 @@
 /* === H E A D E R S ======================================================= */
 
 #include "target.h"
+#include "color/pixelformat.h"
 
 /* === M A C R O S ========================================================= */
 
@@ -51,12 +52,18 @@ class Target_Scanline : public Target
 
 	String engine_;
 
+	//! Rounding of the channels in convert_rows()
+	PixelDither dither_;
+
 	bool call_renderer(
 		const etl::handle<rendering::SurfaceResource> &surface,
 		Canvas &canvas,
 		const ContextParams &context_params,
 		const RendDesc &renddesc );
 
+	//! Puts the rendered rows starting from the scanline \a y onto the target
+	bool put_surface(const synfig::Surface &surface, int y, ProgressCallback *cb);
+
 public:
 	typedef etl::handle<Target_Scanline> Handle;
 	typedef etl::loose_handle<Target_Scanline> LooseHandle;
@@ -97,6 +104,37 @@ public:
 	**	\see start_scanline()
 	*/
 	virtual bool end_scanline()=0;
+
+	//! Returns \c true if the target takes the rendered rows by put_rows()
+	//! instead of start_scanline() and end_scanline()
+	virtual bool can_put_rows() const { return false; }
+
+	//! Takes the rendered rows right from the surface of the renderer
+	/*!	\param surface The rows, it's valid only during the call.
+	**		Alpha mode isn't applied to them, use convert_rows() for it.
+	**	\param y Which scanline is the first row of the \a surface.
+	**	\return \c true on success, \c false on failure.
+	**	\warning Must be called after start_frame()
+	**	\see can_put_rows()
+	*/
+	virtual bool put_rows(const synfig::Surface &surface, int y);
+
+	//! Converts the rows of the \a surface to the PixelFormat \a pf
+	//! applying the alpha mode and the dithering of the target, in one pass without the intermediate frame.
+	//! \a dst_stride is the offset to the next row of \a dst in bytes,
+	//! \a y is the scanline of the first row to keep the dithering pattern continuous.
+	void convert_rows(
+		unsigned char *dst,
+		int dst_stride,
+		const synfig::Surface &surface,
+		PixelFormat pf,
+		const Gamma *gamma = NULL,
+		int y = 0 ) const;
+
+	//! Sets the dithering of convert_rows()
+	void set_dither(PixelDither x) { dither_=x; }
+	//! Gets the dithering of convert_rows()
+	PixelDither get_dither()const { return dither_; }
 	//! Sets the number of threads
 
 	void set_threads(int x) { threads_=x; }
@@ -31,10 +31,14 @@
 #	include <config.h>
 #endif
 
-#include <vector>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
 
-#include <ETL/clock>
+#include <sigc++/bind.h>
 
 #include "target_tile.h"
 
@@ -48,6 +52,7 @@
 #include "surface.h"
 
 #include "debug/measure.h"
+#include "debug/stageprofile.h"
 
 #include "rendering/renderer.h"
 #include "rendering/surface.h"
@@ -96,6 +101,36 @@ Target_Tile::next_frame(Time& time)
 	return Target::next_frame(time);
 }
 
+void
+Target_Tile::build_tile_order(int tiles_w, int tiles_h)
+{
+	// walk the square of the power of two size along the Hilbert curve,
+	// and keep only the tiles inside of the frame
+	int n = 1;
+	while(n < tiles_w || n < tiles_h) n *= 2;
+
+	tile_order_.clear();
+	tile_order_.reserve(tiles_w*tiles_h);
+	for(int d = 0; d < n*n; ++d)
+	{
+		int x = 0, y = 0;
+		for(int s = 1, t = d; s < n; s *= 2, t /= 4)
+		{
+			int rx = 1 & (t/2);
+			int ry = 1 & (t ^ rx);
+			if (!ry)
+			{
+				if (rx) { x = s - 1 - x; y = s - 1 - y; }
+				std::swap(x, y);
+			}
+			x += s*rx;
+			y += s*ry;
+		}
+		if (x < tiles_w && y < tiles_h)
+			tile_order_.push_back(y*tiles_w + x);
+	}
+}
+
 int
 Target_Tile::next_tile(RectInt& rect)
 {
@@ -107,68 +142,160 @@ Target_Tile::next_tile(RectInt& rect)
 	if(rend_desc().get_w()%tile_w_!=0)tw++;
 	if(rend_desc().get_h()%tile_h_!=0)th++;
 
-	rect.minx = (curr_tile_%tw)*tile_w_;
-	rect.miny = (curr_tile_/tw)*tile_h_;
-	rect.maxx = rect.minx + tile_w_;
-	rect.maxy = rect.miny + tile_h_;
+	if (curr_tile_ == 0 || (int)tile_order_.size() != tw*th)
+		build_tile_order(tw, th);
+
+	if (curr_tile_ < tw*th)
+	{
+		int index = tile_order_[curr_tile_];
+		rect.minx = (index%tw)*tile_w_;
+		rect.miny = (index/tw)*tile_h_;
+		rect.maxx = rect.minx + tile_w_;
+		rect.maxy = rect.miny + tile_h_;
+	}
 
 	curr_tile_++;
 	return (tw*th)-curr_tile_+1;
 }
 
-bool
-synfig::Target_Tile::call_renderer(
+struct synfig::Target_Tile::TileGroup
+{
+	struct Tile
+	{
+		SurfaceResource::Handle surface;
+		RectInt rect;
+		bool success;
+		Tile *next;
+
+		Tile(): success(), next() { }
+	};
+
+	const TargetAlphaMode alpha_mode;
+	const Color bg_color;
+
+	// used by the thread which enqueues and delivers the tiles only,
+	// renderer enqueues the clones of the tasks, so the tiles are cancelled by their events
+	rendering::TaskEvent::List events;
+	int count;
+	int delivered;
+
+	// lock-free stack of the tiles finished by the renderer,
+	// mutex is locked only to sleep while nothing is finished
+	std::atomic<Tile*> finished;
+	std::mutex mutex;
+	std::condition_variable cond;
+
+	TileGroup(TargetAlphaMode alpha_mode, const Color &bg_color):
+		alpha_mode(alpha_mode), bg_color(bg_color), count(), delivered(), finished(NULL) { }
+	~TileGroup()
+		{ delete_list(finished.exchange(NULL)); }
+
+	static void delete_list(Tile *tile)
+	{
+		while(tile)
+			{ Tile *next = tile->next; delete tile; tile = next; }
+	}
+
+	void push(Tile *tile)
+	{
+		tile->next = finished.load();
+		while(!finished.compare_exchange_weak(tile->next, tile)) { }
+		std::lock_guard<std::mutex> lock(mutex);
+		cond.notify_one();
+	}
+
+	//! Takes all of the finished tiles in the order of completion, waits if there are no one
+	Tile* pop_all()
+	{
+		Tile *list = finished.exchange(NULL);
+		if (!list)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while(!(list = finished.exchange(NULL)))
+				cond.wait(lock);
+		}
+
+		Tile *reversed = NULL;
+		while(list)
+			{ Tile *next = list->next; list->next = reversed; reversed = list; list = next; }
+		return reversed;
+	}
+
+	//! Called by the renderer thread, so the alpha of the tiles is processed in parallel
+	static void tile_finished(bool success, std::shared_ptr<TileGroup> group, Tile *tile)
+	{
+		if (success && group->alpha_mode != TARGET_ALPHA_MODE_KEEP)
+		{
+			SurfaceResource::LockWrite<SurfaceSW> lock(tile->surface);
+			if (lock)
+			{
+				synfig::Surface &s = lock->get_surface();
+				int cnt = s.get_w() * s.get_h();
+
+				switch(group->alpha_mode)
+				{
+					case TARGET_ALPHA_MODE_FILL:
+						for(int i = 0; i < cnt; ++i)
+							s[0][i] = Color::blend(s[0][i], group->bg_color, 1.0f);
+						break;
+					case TARGET_ALPHA_MODE_EXTRACT:
+						for(int i = 0; i< cnt; ++i)
+						{
+							float a = s[0][i].get_a();
+							s[0][i] = Color(a,a,a,a);
+						}
+						break;
+					case TARGET_ALPHA_MODE_REDUCE:
+						for(int i = 0; i < cnt; ++i)
+							s[0][i].set_a(1.0f);
+						break;
+					default:
+						break;
+				}
+			}
+		}
+
+		tile->success = success;
+		group->push(tile);
+	}
+};
+
+rendering::Task::Handle
+synfig::Target_Tile::build_tile_task(
 	const etl::handle<rendering::SurfaceResource> &surface,
 	Canvas &canvas,
 	const ContextParams &context_params,
 	const RendDesc &renddesc )
 {
 	#ifdef DEBUG_MEASURE
-	debug::Measure t("Target_Tile::call_renderer");
+	debug::Measure t("Target_Tile::build_tile_task");
 	#endif
 
 	surface->create(renddesc.get_w(), renddesc.get_h());
 	rendering::Task::Handle task;
 	{
-		#ifdef DEBUG_MEASURE
-		debug::Measure t("build rendering task");
-		#endif
+		debug::StageProfile::Scope profile(debug::StageProfile::BUILD_TASK);
 		task = canvas.build_rendering_task(context_params);
 	}
-
-	if (task)
-	{
-		rendering::Renderer::Handle renderer = rendering::Renderer::get_renderer(get_engine());
-		if (!renderer)
-			throw "Renderer '" + get_engine() + "' not found";
-
-		Vector p0 = renddesc.get_tl();
-		Vector p1 = renddesc.get_br();
-		if (p0[0] > p1[0] || p0[1] > p1[1]) {
-			Matrix m;
-			if (p0[0] > p1[0]) { m.m00 = -1.0; m.m20 = p0[0] + p1[0]; std::swap(p0[0], p1[0]); }
-			if (p0[1] > p1[1]) { m.m11 = -1.0; m.m21 = p0[1] + p1[1]; std::swap(p0[1], p1[1]); }
-			TaskTransformationAffine::Handle t = new TaskTransformationAffine();
-			t->transformation->matrix = m;
-			t->sub_task() = task;
-			task = t;
-		}
-
-		task->target_surface = surface;
-		task->target_rect = RectInt( VectorInt(), surface->get_size() );
-		task->source_rect = Rect(p0, p1);
-
-		rendering::Task::List list;
-		list.push_back(task);
-
-		{
-			#ifdef DEBUG_MEASURE
-			debug::Measure t("run renderer");
-			#endif
-			renderer->run(list);
-		}
+	if (!task)
+		return task;
+
+	Vector p0 = renddesc.get_tl();
+	Vector p1 = renddesc.get_br();
+	if (p0[0] > p1[0] || p0[1] > p1[1]) {
+		Matrix m;
+		if (p0[0] > p1[0]) { m.m00 = -1.0; m.m20 = p0[0] + p1[0]; std::swap(p0[0], p1[0]); }
+		if (p0[1] > p1[1]) { m.m11 = -1.0; m.m21 = p0[1] + p1[1]; std::swap(p0[1], p1[1]); }
+		TaskTransformationAffine::Handle t = new TaskTransformationAffine();
+		t->transformation->matrix = m;
+		t->sub_task() = task;
+		task = t;
 	}
-	return true;
+
+	task->target_surface = surface;
+	task->target_rect = RectInt( VectorInt(), surface->get_size() );
+	task->source_rect = Rect(p0, p1);
+	return task;
 }
 
 bool
@@ -176,9 +303,6 @@ synfig::Target_Tile::render_frame_(Canvas::Handle canvas, ContextParams context_
 {
 	const RendDesc &rend_desc(desc);
 
-	etl::clock tile_timer;
-	tile_timer.reset();
-
 	// Gather tiles
 	std::vector<RectInt> tiles;
 	RectInt rect;
@@ -189,19 +313,10 @@ synfig::Target_Tile::render_frame_(Canvas::Handle canvas, ContextParams context_
 		tiles.push_back(rect);
 	}
 
-	// Render tiles
+	// Enqueue tiles, they are delivered by wait_render_tiles()
+	begin_render_tiles();
 	for(std::vector<RectInt>::iterator i = tiles.begin(); i != tiles.end(); ++i)
 	{
-		// Progress callback
-		int index = i - tiles.begin();
-		int count = (int)tiles.size();
-		SuperCallback super(cb, (count-index)*1000, (count-index+1)*1000, count*1000);
-		if(!super.amount_complete(0,1000))
-			return false;
-
-		// Render tile
-		tile_timer.reset();
-
 		rect = *i;
 		if (clipping_)
 			etl::set_intersect(rect, rect, RectInt(0, 0, rend_desc.get_w(), rend_desc.get_h()));
@@ -212,89 +327,144 @@ synfig::Target_Tile::render_frame_(Canvas::Handle canvas, ContextParams context_
 		RendDesc tile_desc=rend_desc;
 		tile_desc.set_subwindow(rect.minx, rect.miny, rect.maxx - rect.minx, rect.maxy - rect.miny);
 
-		async_render_tile(canvas, context_params, rect, tile_desc, &super);
+		if (!async_render_tile(canvas, context_params, rect, tile_desc, cb))
+			return false;
 	}
 
+	return true;
+}
+
+bool
+synfig::Target_Tile::finish_frame_(ProgressCallback *cb)
+{
 	if (!wait_render_tiles(cb))
 		return false;
 
 	if(cb && !cb->amount_complete(10000,10000))
 		return false;
 
+	{
+		debug::StageProfile::Scope profile(debug::StageProfile::WRITE);
+		end_frame();
+	}
+	debug::StageProfile::frame_finished();
 	return true;
 }
 
+void
+synfig::Target_Tile::begin_render_tiles()
+{
+	tile_groups_.push_back(std::make_shared<TileGroup>(get_alpha_mode(), desc.get_bg_color()));
+}
+
 bool
 synfig::Target_Tile::async_render_tile(
 	etl::handle<Canvas> canvas,
 	ContextParams context_params,
 	RectInt rect,
 	RendDesc tile_desc,
-	ProgressCallback *cb)
+	ProgressCallback* /* cb */)
 {
-	SurfaceResource::Handle surface = new rendering::SurfaceResource();
+	rendering::Renderer::Handle renderer = rendering::Renderer::get_renderer(get_engine());
+	if (!renderer)
+		throw "Renderer '" + get_engine() + "' not found";
+
+	if (tile_groups_.empty())
+		begin_render_tiles();
+	std::shared_ptr<TileGroup> group = tile_groups_.back();
 
-	if (!call_renderer(surface, *canvas, context_params, tile_desc))
+	std::unique_ptr<TileGroup::Tile> tile(new TileGroup::Tile());
+	tile->surface = new rendering::SurfaceResource();
+	tile->rect = rect;
+
+	rendering::Task::Handle task;
 	{
-		// For some reason, the accelerated renderer failed.
-		if(cb)cb->error(_("Accelerated Renderer Failure"));
-		return false;
+		#ifdef DEBUG_MEASURE
+		debug::Measure t("build rendering task");
+		#endif
+		task = build_tile_task(tile->surface, *canvas, context_params, tile_desc);
 	}
 
-	SurfaceResource::LockWrite<SurfaceSW> lock(surface);
-
-	if(!lock)
+	++group->count;
+	if (!task)
 	{
-		if(cb)cb->error(_("Bad surface"));
-		return false;
+		// nothing to render, tile is transparent
+		TileGroup::tile_finished(true, group, tile.release());
+		return true;
 	}
 
-	synfig::Surface &s = lock->get_surface();
-	int cnt = s.get_w() * s.get_h();
+	rendering::TaskEvent::Handle event = new rendering::TaskEvent();
+	event->signal_finished.connect(
+		sigc::bind(sigc::ptr_fun(&TileGroup::tile_finished), group, tile.release()) );
+	group->events.push_back(event);
+	renderer->enqueue(task, event);
+	return true;
+}
+
+bool
+synfig::Target_Tile::wait_render_tiles(ProgressCallback *cb)
+{
+	if (tile_groups_.empty())
+		return true;
+	std::shared_ptr<TileGroup> group = tile_groups_.front();
+	tile_groups_.pop_front();
 
-	switch(get_alpha_mode())
+	// deliver tiles as soon as they are finished
+	while(group->delivered < group->count)
 	{
-		case TARGET_ALPHA_MODE_FILL:
-			for(int i = 0; i < cnt; ++i)
-				s[0][i] = Color::blend(s[0][i], desc.get_bg_color(), 1.0f);
-			break;
-		case TARGET_ALPHA_MODE_EXTRACT:
-			for(int i = 0; i< cnt; ++i)
+		TileGroup::Tile *list;
+		{
+			debug::StageProfile::Scope profile(debug::StageProfile::RUN);
+			list = group->pop_all();
+		}
+		while(list)
+		{
+			std::unique_ptr<TileGroup::Tile> tile(list);
+			list = list->next;
+			++group->delivered;
+
+			String error;
+			if (!tile->success)
+				error = _("Accelerated Renderer Failure");
+			else
 			{
-				float a = s[0][i].get_a();
-				s[0][i] = Color(a,a,a,a);
+				debug::StageProfile::Scope profile(debug::StageProfile::WRITE);
+				SurfaceResource::LockRead<SurfaceSW> lock(tile->surface);
+				if (!lock)
+					error = _("Bad surface");
+				else
+				if (!add_tile(lock->get_surface(), tile->rect.minx, tile->rect.miny))
+					error = _("add_tile(): Unable to put surface on target");
 			}
-			break;
-		case TARGET_ALPHA_MODE_REDUCE:
-			for(int i = 0; i < cnt; ++i)
-				s[0][i].set_a(1.0f);
-			break;
-		default:
-			break;
-	}
 
-	// Add the tile to the target
-	if (!add_tile(s, rect.minx, rect.miny))
-	{
-		if(cb)cb->error(_("add_tile(): Unable to put surface on target"));
-		return false;
+			if (!error.empty() || (cb && !cb->amount_complete(group->delivered, group->count)))
+			{
+				if (cb && !error.empty()) cb->error(error);
+				// tiles still rendering will be released with the group
+				TileGroup::delete_list(list);
+				rendering::Renderer::cancel(rendering::Task::List(group->events.begin(), group->events.end()));
+				return false;
+			}
+
+			signal_progress()();
+		}
 	}
 
-	signal_progress()();
 	return true;
 }
 
-bool
-synfig::Target_Tile::wait_render_tiles(ProgressCallback* /* cb */)
+void
+synfig::Target_Tile::cancel_render_tiles()
 {
-	return true;
+	for(std::deque< std::shared_ptr<TileGroup> >::const_iterator i = tile_groups_.begin(); i != tile_groups_.end(); ++i)
+		rendering::Renderer::cancel(rendering::Task::List((*i)->events.begin(), (*i)->events.end()));
+	tile_groups_.clear();
 }
 
 
 bool
 synfig::Target_Tile::render(ProgressCallback *cb)
 {
-	SuperCallback super_cb;
 	int
 		frames=0,
 		total_frames,
@@ -305,6 +475,13 @@ synfig::Target_Tile::render(ProgressCallback *cb)
 
 	assert(canvas);
 	curr_frame_=0;
+	cancel_render_tiles();
+
+	// tiles of the next frame may be still rendering when the render is interrupted
+	struct CancelGuard {
+		Target_Tile &target;
+		~CancelGuard() { target.cancel_render_tiles(); }
+	} cancel_guard = { *this };
 	//init();
 	if (!init()) {
 		if (cb) cb->error(_("Target initialization failure"));
@@ -324,6 +501,10 @@ synfig::Target_Tile::render(ProgressCallback *cb)
 
 		if(total_frames>=1)
 		{
+			// Tiles of the next frame are enqueued before the tiles of the previous one
+			// are delivered, so the renderer is not idle while the tail tiles are finishing.
+			// start_frame() and end_frame() are still called in order.
+			bool first_frame = true;
 			do
 			{		
 				// Grab the time
@@ -333,21 +514,45 @@ synfig::Target_Tile::render(ProgressCallback *cb)
 
 				// If we have a callback, and it returns
 				// false, go ahead and bail. (maybe a use cancel)
+				// Tiles of the previous frame are already enqueued,
+				// so it is finished before, to not lose the rendered frame.
 				if(cb && !cb->amount_complete(total_frames-frames,total_frames))
+				{
+					if (!first_frame)
+						finish_frame_(0);
 					return false;
+				}
 
-				if(!start_frame(cb))
+				// the first frame is started before its tiles, so target may setup the tiles size
+				if(first_frame && !start_frame(cb))
 					return false;
 
 				// Set the time that we wish to render
-				canvas->set_time(t);
-				canvas->load_resources(t);
+				{
+					debug::StageProfile::Scope profile(debug::StageProfile::SET_TIME);
+					canvas->set_time(t);
+				}
+				{
+					debug::StageProfile::Scope profile(debug::StageProfile::LOAD_RESOURCES);
+					canvas->load_resources(t);
+				}
 				canvas->set_outline_grow(desc.get_outline_grow());
 				if(!render_frame_(canvas, context_params, 0))
 					return false;
-				end_frame();
+
+				if (!first_frame)
+				{
+					if(!finish_frame_(0))
+						return false;
+					if(!start_frame(cb))
+						return false;
+				}
+				first_frame = false;
 			}while(frames);
 			//synfig::info("tilerenderer: i=%d, t=%s",i,t.get_string().c_str());
+
+			if(!finish_frame_(0))
+				return false;
 		}
 		else
 		{
@@ -357,14 +562,21 @@ synfig::Target_Tile::render(ProgressCallback *cb)
 				return false;
 
 			// Set the time that we wish to render
-			canvas->set_time(t);
-			canvas->load_resources(t);
+			{
+				debug::StageProfile::Scope profile(debug::StageProfile::SET_TIME);
+				canvas->set_time(t);
+			}
+			{
+				debug::StageProfile::Scope profile(debug::StageProfile::LOAD_RESOURCES);
+				canvas->load_resources(t);
+			}
 			canvas->set_outline_grow(desc.get_outline_grow());
 
 			//synfig::info("2time_set_to %s",t.get_string().c_str());
 			if(!render_frame_(canvas, context_params, cb))
 				return false;
-			end_frame();
+			if(!finish_frame_(cb))
+				return false;
 		}
 
 	}
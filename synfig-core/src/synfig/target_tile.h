@@ -29,6 +29,10 @@
 
 /* === H E A D E R S ======================================================= */
 
+#include <deque>
+#include <memory>
+#include <vector>
+
 #include "target.h"
 
 /* === M A C R O S ========================================================= */
@@ -63,14 +67,22 @@ class Target_Tile : public Target
 
 	String engine_;
 
+	//! Order of the tiles in the frame (Hilbert curve), indices of tiles by rows
+	std::vector<int> tile_order_;
+
+	//! Tiles of one frame, rendered and waiting for the delivery to add_tile()
 	struct TileGroup;
+	//! Groups of the frames being rendered, the first one is delivered by wait_render_tiles()
+	std::deque< std::shared_ptr<TileGroup> > tile_groups_;
 
-	bool call_renderer(
+	etl::handle<rendering::Task> build_tile_task(
 		const etl::handle<rendering::SurfaceResource> &surface,
 		Canvas &canvas,
 		const ContextParams &context_params,
 		const RendDesc &renddesc );
 
+	void build_tile_order(int tiles_w, int tiles_h);
+
 public:
 	typedef etl::handle<Target_Tile> Handle;
 	typedef etl::loose_handle<Target_Tile> LooseHandle;
@@ -81,17 +93,31 @@ public:
 	//! Renders the canvas to the target
 	virtual bool render(ProgressCallback *cb=NULL);
 
+	//! Starts the group of the tiles of the next frame
+	virtual void begin_render_tiles();
+
+	//! Enqueues the tile to the renderer and returns immediately.
+	//! The tile is passed to add_tile() by wait_render_tiles().
 	virtual bool async_render_tile(
 		etl::handle<Canvas> canvas,
 		ContextParams context_params,
 		RectInt rect,
 		RendDesc tile_desc,
 		ProgressCallback *cb);
+
+	//! Passes the tiles of the oldest group to add_tile() in the order of their completion,
+	//! returns when all of them are delivered. Tiles of the next frame
+	//! may be rendering at the same time.
 	virtual bool wait_render_tiles(ProgressCallback *cb=NULL);
 
+	//! Cancels the tiles of all of the groups which are not delivered yet
+	virtual void cancel_render_tiles();
+
 	//! Determines which tile needs to be rendered next.
 	/*!	Most cases will not have to redefine this function.
-	**	The default should be adequate in nearly all situations.
+	**	The default should be adequate in nearly all situations,
+	**	it walks the tiles along the Hilbert curve, so the neighbour tiles
+	**	are rendered at the same time and share the cached data.
 	**	\returns The number of tiles left to go <i>plus one</i>.
 	**		This means that whenever this function returns zero,
 	**		there are no more tiles to render and that any value
@@ -106,7 +132,10 @@ public:
 	virtual bool add_tile(const synfig::Surface &surface, int x, int y)=0;
 
 	//! Marks the start of a frame
-	/*! \return \c true on success, \c false upon an error.
+	/*! Tiles of the frames after the first one are enqueued before
+	**	this call (while the previous frame is finishing), so it should not
+	**	change the size of the tiles after the first frame.
+	**	\return \c true on success, \c false upon an error.
 	**	\see end_frame(), start_scanline()
 	*/
 	virtual bool start_frame(ProgressCallback *cb=NULL)=0;
@@ -136,8 +165,10 @@ public:
 	void set_engine(const String &x) { engine_=x; }
 
 private:
-	//! Renders the context to the surface
+	//! Enqueues the tiles of the frame
 	bool render_frame_(etl::handle<Canvas> canvas, ContextParams context_params, ProgressCallback *cb);
+	//! Delivers the tiles of the oldest frame and ends it
+	bool finish_frame_(ProgressCallback *cb);
 
 }; // END of class Target_Tile
 
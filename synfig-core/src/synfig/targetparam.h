@@ -45,7 +45,8 @@ struct TargetParam
 	 *  its own valid default settings.
 	 */
 	TargetParam (const std::string& Video_codec = "none", int Bitrate = -1):
-		video_codec(Video_codec), bitrate(Bitrate), sequence_separator("."), offset_x(0), offset_y(0),rows(0),columns(0),append(true),dir(HR)
+		video_codec(Video_codec), bitrate(Bitrate), sequence_separator("."), offset_x(0), offset_y(0),rows(0),columns(0),append(true),dir(HR),
+		encoder_jobs(0), compression_level(-1), png_filter("none"), dither("none")
 	{ }
 
 	std::string video_codec;
@@ -58,6 +59,16 @@ struct TargetParam
 	int columns;
 	bool append;
 	Direction dir;
+
+	//! Max count of the frames of the image sequence which are encoded in background at once,
+	//! zero means count of the threads
+	int encoder_jobs;
+	//! zlib compression level (0-9) of the png images, -1 means the zlib default
+	int compression_level;
+	//! Comma-separated list of the png row filters: none, sub, up, avg, paeth or all
+	std::string png_filter;
+	//! Dithering of the 8-bit images: none, ordered or blue-noise
+	std::string dither;
 };
 
 }; // END of namespace synfig
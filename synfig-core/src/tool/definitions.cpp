@@ -27,6 +27,7 @@
 #include <synfig/general.h>
 
 #include <synfig/main.h>
+#include <synfig/debug/stageprofile.h>
 
 
 std::shared_ptr<SynfigToolGeneralOptions> SynfigToolGeneralOptions::_instance;
@@ -103,3 +104,14 @@ void SynfigToolGeneralOptions::set_should_print_benchmarks(bool print_benchmarks
 {
 	_should_print_benchmarks = print_benchmarks;
 }
+
+std::string SynfigToolGeneralOptions::get_profile_stages() const
+{
+	return _profile_stages;
+}
+
+void SynfigToolGeneralOptions::set_profile_stages(const std::string& format)
+{
+	_profile_stages = format;
+	synfig::debug::StageProfile::set_enabled(!format.empty());
+}
@@ -101,6 +101,11 @@ public:
 
 	void set_should_print_benchmarks(bool print_benchmarks);
 
+	//! Format of the per-frame profile of the render stages: "text", "json" or empty if disabled
+	std::string get_profile_stages() const;
+
+	void set_profile_stages(const std::string& format);
+
 private:
 	SynfigToolGeneralOptions(const char* argv0);
 
@@ -109,6 +114,7 @@ private:
 	size_t _threads;
 	bool _should_be_quiet,
 		 _should_print_benchmarks;
+	std::string _profile_stages;
 
 	static std::shared_ptr<SynfigToolGeneralOptions> _instance;
 };
@@ -39,6 +39,11 @@
 //#include <boost/program_options/variables_map.hpp>
 //#include <boost/format.hpp>
 #include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ETL/stringf>
 
 #include <autorevision.h>
 #include <synfig/general.h>
@@ -50,10 +55,12 @@
 #include <synfig/target_scanline.h>
 #include <synfig/paramdesc.h>
 #include <synfig/module.h>
+#include <synfig/imagecache.h>
 #include <synfig/importer.h>
 #include <synfig/loadcanvas.h>
 #include <synfig/savecanvas.h>
 #include <synfig/filesystemnative.h>
+#include <synfig/debug/stageprofile.h>
 
 #include "definitions.h"
 #include "job.h"
@@ -66,16 +73,249 @@
 
 using namespace synfig;
 
-void process_job_list(std::list<Job>& job_list, const TargetParam& target_params)
+namespace {
+
+/// Runs several jobs at once. Each job is processed by its own thread,
+/// but the rendering tasks and the encoders of all of them go to the same
+/// ThreadPool, so they share its threads in the order of the enqueueing.
+/// Compositions are loaded one by one.
+class JobScheduler
+{
+public:
+	struct Report
+	{
+		std::string filename;
+		std::string outfilename;
+		double load_time;
+		double render_time;
+		double finish_time; ///< encoding of the last frames and closing of the output
+		bool failed;
+
+		Report(): load_time(), render_time(), finish_time(), failed(true) { }
+	};
+
+private:
+	typedef std::chrono::system_clock Clock;
+
+	std::list<Job>& job_list;
+	const TargetParam& target_params;
+	const JobLoader& loader;
+
+	std::mutex mutex;
+	std::mutex load_mutex;
+	std::vector<Report> reports;
+	int next_index;
+
+	static double seconds_since(const Clock::time_point& timepoint)
+		{ return std::chrono::duration<double>(Clock::now() - timepoint).count(); }
+
+	bool take_job(Job& job, int& index)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (job_list.empty())
+			return false;
+		job = job_list.front();
+		job_list.pop_front();
+		index = next_index++;
+		return true;
+	}
+
+	//! Drops the target and the canvases of the job.
+	//! Canvases are released under load_mutex, because they share
+	//! the global maps of the open canvases and importers with the loading
+	void release_job(Job& job)
+	{
+		// target waits for its encoders when destroyed,
+		// it holds the canvas, so keep the canvas here until the lock is taken
+		synfig::Canvas::Handle root = job.root;
+		synfig::Canvas::Handle canvas = job.canvas;
+		job.target = 0;
+
+		std::lock_guard<std::mutex> lock(load_mutex);
+		job = Job();
+		canvas = 0;
+		root = 0;
+	}
+
+	void run_job(Job& job, Report& report)
+	{
+		report.filename = job.filename;
+		try
+		{
+			Clock::time_point timepoint = Clock::now();
+			if (!job.canvas && loader)
+			{
+				std::lock_guard<std::mutex> lock(load_mutex);
+				loader(job);
+			}
+			report.load_time = seconds_since(timepoint);
+
+			if (!setup_job(job, target_params))
+				return;
+			report.outfilename = job.outfilename;
+
+			timepoint = Clock::now();
+			process_job(job, false);
+			report.render_time = seconds_since(timepoint);
+
+			timepoint = Clock::now();
+			release_job(job);
+			report.finish_time = seconds_since(timepoint);
+
+			report.failed = false;
+		}
+		catch (SynfigToolException& e)
+		{
+			synfig::error("%s: %s", job.filename.c_str(), e.get_message().c_str());
+		}
+		catch (std::exception& e)
+		{
+			synfig::error("%s: %s", job.filename.c_str(), e.what());
+		}
+	}
+
+	void worker()
+	{
+		Job job;
+		int index;
+		while(take_job(job, index))
+		{
+			Report report;
+			run_job(job, report);
+			release_job(job);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			reports[index] = report;
+		}
+	}
+
+public:
+	JobScheduler(std::list<Job>& job_list, const TargetParam& target_params, const JobLoader& loader):
+		job_list(job_list),
+		target_params(target_params),
+		loader(loader),
+		reports(job_list.size()),
+		next_index()
+	{ }
+
+	void run(int max_jobs)
+	{
+		const int count = std::min(max_jobs, (int)job_list.size());
+		std::vector<std::thread> threads;
+		for(int i = 1; i < count; ++i)
+			threads.push_back(std::thread(&JobScheduler::worker, this));
+		worker();
+		for(std::vector<std::thread>::iterator i = threads.begin(); i != threads.end(); ++i)
+			i->join();
+	}
+
+	const std::vector<Report>& get_reports() const
+		{ return reports; }
+};
+
+/// Prints min, median and 99th percentile of the time spent by the frames
+/// in the stages of the render pipeline, in milliseconds
+void print_stage_profile(const Job& job, const std::string& format)
+{
+	typedef debug::StageProfile StageProfile;
+	const int frames = StageProfile::get_frames_count();
+
+	if (format == "json")
+	{
+		std::string json = etl::strprintf(
+			"{\n\t\"file\": \"%s\",\n\t\"output\": \"%s\",\n\t\"target\": \"%s\",\n"
+			"\t\"frames\": %d,\n\t\"unit\": \"ms\",\n\t\"stages\": {\n",
+			escape_json(job.filename).c_str(), escape_json(job.outfilename).c_str(),
+			escape_json(job.target_name).c_str(), frames );
+		for(int i = 0; i < StageProfile::STAGES_COUNT; ++i)
+		{
+			const StageProfile::Stage stage = (StageProfile::Stage)i;
+			const StageProfile::Statistics s = StageProfile::get_statistics(stage);
+			const std::vector<double> values = StageProfile::get_frames(stage);
+
+			std::string per_frame;
+			for(std::vector<double>::const_iterator j = values.begin(); j != values.end(); ++j)
+				per_frame += etl::strprintf(j == values.begin() ? "%.3f" : ", %.3f", *j*1000.0);
+
+			json += etl::strprintf(
+				"\t\t\"%s\": {\"min\": %.3f, \"median\": %.3f, \"p99\": %.3f, \"total\": %.3f, \"per_frame\": [%s]}%s\n",
+				StageProfile::get_stage_name(stage),
+				s.min*1000.0, s.median*1000.0, s.p99*1000.0, s.total*1000.0,
+				per_frame.c_str(),
+				i + 1 < StageProfile::STAGES_COUNT ? "," : "" );
+		}
+		json += "\t}\n}\n";
+		std::cout << json << std::flush;
+		return;
+	}
+
+	std::cout << job.filename << _(": Stage profile of ") << frames << _(" frames, ms per frame") << std::endl;
+	std::cout << etl::strprintf("  %-22s %10s %10s %10s %12s", _("stage"), _("min"), _("median"), _("p99"), _("total")) << std::endl;
+	for(int i = 0; i < StageProfile::STAGES_COUNT; ++i)
+	{
+		const StageProfile::Stage stage = (StageProfile::Stage)i;
+		const StageProfile::Statistics s = StageProfile::get_statistics(stage);
+		std::cout << etl::strprintf("  %-22s %10.3f %10.3f %10.3f %12.3f",
+									StageProfile::get_stage_name(stage),
+									s.min*1000.0, s.median*1000.0, s.p99*1000.0, s.total*1000.0)
+				  << std::endl;
+	}
+}
+
+} // end of anonymous namespace
+
+void process_job_list(std::list<Job>& job_list, const TargetParam& target_params, int max_jobs, const JobLoader& loader)
 {
 	if (job_list.empty())
 		throw (SynfigToolException(SYNFIGTOOL_BORED, _("Nothing to do!")));
 
-	for(; !job_list.empty(); job_list.pop_front())
+	if (max_jobs <= 1 && !loader)
+	{
+		for(; !job_list.empty(); job_list.pop_front())
+		{
+			if (setup_job(job_list.front(), target_params))
+				process_job(job_list.front());
+		}
+		return;
+	}
+
+	std::chrono::system_clock::time_point start_timepoint =
+		std::chrono::system_clock::now();
+
+	JobScheduler scheduler(job_list, target_params, loader);
+	scheduler.run(max_jobs);
+
+	const std::vector<JobScheduler::Report>& reports = scheduler.get_reports();
+	int failed = 0;
+	for(std::vector<JobScheduler::Report>::const_iterator i = reports.begin(); i != reports.end(); ++i)
+		if (i->failed)
+			++failed;
+
+	if (SynfigToolGeneralOptions::instance()->should_print_benchmarks())
 	{
-		if (setup_job(job_list.front(), target_params))
-			process_job(job_list.front());
+		std::chrono::duration<double> duration =
+			std::chrono::system_clock::now() - start_timepoint;
+
+		std::cout << reports.size() << _(" jobs processed in ")
+				  << duration.count() << _(" seconds.") << std::endl;
+		for(std::vector<JobScheduler::Report>::const_iterator i = reports.begin(); i != reports.end(); ++i)
+		{
+			if (i->failed)
+			{
+				std::cout << "  " << i->filename << _(": Failed") << std::endl;
+				continue;
+			}
+			std::cout << "  " << i->filename << " ==> " << i->outfilename
+					  << _(": Loaded in ") << i->load_time
+					  << _(", rendered in ") << i->render_time
+					  << _(", finished in ") << i->finish_time
+					  << _(" seconds.") << std::endl;
+		}
 	}
+
+	if (failed)
+		throw (SynfigToolException(SYNFIGTOOL_RENDERFAILURE,
+			etl::strprintf(_("Render Failure: %d of %d jobs failed."), failed, (int)reports.size())));
 }
 
 std::string get_extension(const std::string &filename)
@@ -99,7 +339,7 @@ std::string get_absolute_path(std::string relative_path) {
   return file->get_path();
 }
 
-bool setup_job(Job& job, const TargetParam& target_parameters)
+void setup_job_output(Job& job)
 {
 	VERBOSE_OUT(4) << _("Attempting to determine target/outfile...") << std::endl;
 
@@ -159,6 +399,11 @@ bool setup_job(Job& job, const TargetParam& target_parameters)
 
 	VERBOSE_OUT(4) << "Target name = " << job.target_name.c_str() << std::endl;
 	VERBOSE_OUT(4) << "Outfilename = " << job.outfilename.c_str() << std::endl;
+}
+
+bool setup_job(Job& job, const TargetParam& target_parameters)
+{
+	setup_job_output(job);
 
 	// Check permissions
 	//if (access(bfs::canonical(bfs::path(job.outfilename).parent_path()).string().c_str(), W_OK) == -1)
@@ -222,7 +467,7 @@ bool setup_job(Job& job, const TargetParam& target_parameters)
 	return true;
 }
 
-void process_job (Job& job)
+void process_job (Job& job, bool print_progress)
 {
 	VERBOSE_OUT(3) << job.filename.c_str() << " -- " << std::endl;
 	synfig::info("\tw: %d, h: %d, a: %d, pxaspect: %f, imaspect: %f, span: %f", 
@@ -254,7 +499,10 @@ void process_job (Job& job)
                                     % job.desc.get_focus()[1]
                     << std::endl;*/
 
-	RenderProgress p;
+	// progress lines of the parallel jobs would overwrite each other
+	RenderProgress render_progress;
+	ProgressCallback silent_progress;
+	ProgressCallback& p = print_progress ? render_progress : silent_progress;
 	p.task(job.filename + " ==> " + job.outfilename);
 
 	if(job.sifout)
@@ -269,10 +517,17 @@ void process_job (Job& job)
 		std::chrono::system_clock::time_point start_timepoint =
             std::chrono::system_clock::now();
 
+		const std::string profile_stages = SynfigToolGeneralOptions::instance()->get_profile_stages();
+		if (!profile_stages.empty())
+			debug::StageProfile::reset();
+
 		// Call the render member of the target
 		if(!job.target->render(&p))
 			throw (SynfigToolException(SYNFIGTOOL_RENDERFAILURE, _("Render Failure.")));
 
+		if (!profile_stages.empty())
+			print_stage_profile(job, profile_stages);
+
 		if(SynfigToolGeneralOptions::instance()->should_print_benchmarks())
         {
             std::chrono::duration<double> duration =
@@ -282,6 +537,14 @@ void process_job (Job& job)
                       << _(": Rendered in ")
                       << duration.count()
                       << _(" seconds.") << std::endl;
+
+            ImageCache::Statistics stats = ImageCache::instance().get_statistics();
+            std::cout << _("Image cache: ")
+                      << stats.hits << _(" hits, ")
+                      << stats.misses << _(" misses, ")
+                      << stats.entries << _(" images, ")
+                      << (stats.bytes >> 20) << _(" of ")
+                      << (stats.budget >> 20) << _(" MB used") << std::endl;
         }
 	}
 
@@ -25,20 +25,33 @@
 #ifndef __SYNFIG_JOBLISTPROCESSOR_H
 #define __SYNFIG_JOBLISTPROCESSOR_H
 
+#include <functional>
 #include <list>
 #include <synfig/targetparam.h>
 #include "job.h"
 
+/// Loads the composition of a job which has no canvas yet.
+/// Loaders are never called at the same time.
+typedef std::function<void(Job&)> JobLoader;
+
 /// Process a Job list setting up and processing each job
+/// Up to \a max_jobs jobs are processed at once, they share the threads
+/// of the renderer. Jobs without canvas are loaded by the \a loader
+/// while the other ones are rendering.
 void process_job_list(std::list<Job>& job_list,
-						const synfig::TargetParam& target_parameters);
+						const synfig::TargetParam& target_parameters,
+						int max_jobs = 1,
+						const JobLoader& loader = JobLoader());
+
+/// Determine the target name and the output filename of a job, if they aren't given
+void setup_job_output(Job& job);
 
 /// Prepare a job to be processed
 /// \return whether the preparation was OK or not
 bool setup_job(Job& job, const synfig::TargetParam& target_parameters);
 
 /// Process an individual job
-void process_job(Job& job);
+void process_job(Job& job, bool print_progress = true);
 
 std::string get_absolute_path(std::string relative_path);
 
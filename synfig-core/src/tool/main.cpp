@@ -34,6 +34,7 @@
 #include <iostream>
 #include <string>
 #include <list>
+#include <vector>
 
 //#include <boost/program_options/options_description.hpp>
 //#include <boost/program_options/parsers.hpp>
@@ -64,6 +65,7 @@
 #include "synfigtoolexception.h"
 #include "optionsprocessor.h"
 #include "joblistprocessor.h"
+#include "renderworker.h"
 #include "printing_functions.h"
 
 //#include "named_type.h"
@@ -265,6 +267,9 @@ int main(int argc, char* argv[])
         }*/
 
         //OptionsProcessor op(vm, po_visible);
+		// render workers are started with the same options, parser modifies argv
+		const std::vector<std::string> arguments(argv + 1, argv + argc);
+
 		SynfigCommandLineParser parser;
 		parser.parse(argc, argv);
 
@@ -291,10 +296,41 @@ int main(int argc, char* argv[])
 		std::list<Job> job_list;
 
 		// Processing --------------------------------------------------
+		const std::vector<std::string> input_files = parser.extract_input_files();
+		if (input_files.size() > 1)
+		{
+			// compositions are loaded by the job scheduler,
+			// so loading of the next one overlaps with rendering of the previous ones
+			for (std::vector<std::string>::const_iterator i = input_files.begin(); i != input_files.end(); ++i)
+			{
+				Job job;
+				job.filename = *i;
+				job_list.push_back(job);
+			}
+
+			process_job_list(job_list, parser.extract_targetparam(), parser.extract_max_jobs(),
+				[&parser](Job& job) {
+					job = parser.extract_job(job.filename);
+					job.desc = job.canvas->rend_desc() = parser.extract_renddesc(job.canvas->rend_desc());
+				});
+
+			return SYNFIGTOOL_OK;
+		}
+
 		Job job;
 		job = parser.extract_job();
 		job.desc = job.canvas->rend_desc() = parser.extract_renddesc(job.canvas->rend_desc());
 
+		if (parser.extract_worker_mode()) {
+			process_render_worker(job, parser.extract_targetparam());
+			return SYNFIGTOOL_OK;
+		}
+
+		if (int workers = parser.extract_coordinator_workers()) {
+			process_render_coordinator(job, workers, arguments);
+			return SYNFIGTOOL_OK;
+		}
+
 		if (job.extract_alpha) {
 			job.alpha_mode = synfig::TARGET_ALPHA_MODE_REDUCE;
 			job_list.push_front(job);
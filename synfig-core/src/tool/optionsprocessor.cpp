@@ -29,6 +29,7 @@
 #	include <config.h>
 #endif
 
+#include <algorithm>
 #include <iostream>
 //#include <boost/format.hpp>
 
@@ -37,6 +38,8 @@
 #include <synfig/localization.h>
 #include <synfig/canvas.h>
 #include <synfig/canvasfilenaming.h>
+#include <synfig/canvassnapshot.h>
+#include <synfig/color/pixelformat.h>
 #include <synfig/context.h>
 #include <synfig/target.h>
 #include <synfig/layer.h>
@@ -100,6 +103,8 @@ SynfigCommandLineParser::SynfigCommandLineParser() :
 	set_antialias(),
 	set_quality(),
 	set_num_threads(),
+	set_jobs(),
+	set_coordinate(),
 	set_input_file(),
 	set_output_file(),
 	set_sequence_separator(),
@@ -112,12 +117,20 @@ SynfigCommandLineParser::SynfigCommandLineParser() :
 	set_dpi(),
 	set_dpi_x(),
 	set_dpi_y(),
+	set_encoder_jobs(),
+	set_png_compression(-1),
+	set_png_filter(),
+	set_dither(),
+	set_profile_stages(),
 
 	// Switch group
 	sw_verbosity(),
 	sw_quiet(),
 	sw_print_benchmarks(),
 	sw_extract_alpha(),
+	sw_lazy_loading(),
+	sw_cache_binary(),
+	sw_worker(),
 
 	// Misc group
 	misc_append_filename(),
@@ -158,6 +171,8 @@ SynfigCommandLineParser::SynfigCommandLineParser() :
 	add_option(og_set, "antialias",   'a', set_antialias,	_("Set antialias amount for parametric renderer."), "1..30");
 	//og_set.add_option("quality",     'Q', quality_arg_desc, etl::strprintf(_("Specify image quality for accelerated renderer (Default: %d)"), DEFAULT_QUALITY).c_str(), "NUM");
 	add_option(og_set, "threads",     'T', set_num_threads, _("Enable multithreaded renderer using the specified number of threads"), "NUM");
+	add_option(og_set, "jobs",        ' ', set_jobs,        _("Render up to NUM input files at once, they share the render threads (Default: 1)"), "NUM");
+	add_option(og_set, "coordinate",  ' ', set_coordinate,  _("Split the frames of the image sequence among NUM worker processes"), "NUM");
 	add_option(og_set, "input-file",  'i', set_input_file, 	_("Specify input filename"), "filename");
 	add_option(og_set, "output-file", 'o', set_output_file, _("Specify output filename"), "filename");
 	add_option(og_set, "sequence-separator", ' ', set_sequence_separator, _("Output file sequence separator string (Use double quotes if you want to use spaces)"), "string");
@@ -170,6 +185,11 @@ SynfigCommandLineParser::SynfigCommandLineParser() :
 	add_option(og_set, "dpi",         ' ', set_dpi, 		_("Set the physical resolution (Dots-per-inch)"), "NUM");
 	add_option(og_set, "dpi-x",       ' ', set_dpi_x, 		_("Set the physical X resolution (Dots-per-inch)"), "NUM");
 	add_option(og_set, "dpi-y",       ' ', set_dpi_y, 		_("Set the physical Y resolution (Dots-per-inch)"), "NUM");
+	add_option(og_set, "encoder-jobs",    ' ', set_encoder_jobs,    _("Max count of the image sequence frames compressed in background at once (Default: number of threads)"), "NUM");
+	add_option(og_set, "png-compression", ' ', set_png_compression, _("Set the zlib compression level of PNG images, lower is faster (0..9)"), "NUM");
+	add_option(og_set, "png-filter",      ' ', set_png_filter,      _("Set the PNG row filters: none, sub, up, avg, paeth or all (comma-separated, Default: none)"), "filters");
+	add_option(og_set, "dither",          ' ', set_dither,          _("Set the dithering of PNG and JPEG images: none, ordered or blue-noise (Default: none)"), "method");
+	add_option(og_set, "profile-stages",  ' ', set_profile_stages,  _("Print min/median/p99 per-frame time of the render stages: text or json"), "format");
 
 	// Switch options
 	//og_switch("switch", _("Switch options"), "Show switch help");
@@ -177,6 +197,9 @@ SynfigCommandLineParser::SynfigCommandLineParser() :
 	add_option(og_switch, "quiet",         'q', sw_quiet, 				_("Quiet mode (No progress/time-remaining display)"), "");
 	add_option(og_switch, "benchmarks",    'b', sw_print_benchmarks,	_("Print benchmarks"), "");
 	add_option(og_switch, "extract-alpha", 'x', sw_extract_alpha, 		_("Extract alpha"), "");
+	add_option(og_switch, "lazy-loading",  ' ', sw_lazy_loading, 		_("Load external canvases and imported files only when they are needed for rendering"), "");
+	add_option(og_switch, "cache-binary",  ' ', sw_cache_binary, 		_("Write binary snapshot of the input file to speed up the next loading"), "");
+	add_option(og_switch, "worker",        ' ', sw_worker, 				_("Keep the composition loaded and render the ranges of frames requested from stdin"), "");
 
 	//SynfigOptionGroup og_misc("misc", _("Misc options"), "Show Misc options help");
 	add_option_filename(og_misc, "append", ' ', misc_append_filename, 	_("Append layers in <filename> to composition"), _("filename"));
@@ -350,11 +373,30 @@ void SynfigCommandLineParser::process_settings_options()
 		SynfigToolGeneralOptions::instance()->set_should_print_benchmarks(true);
 	}
 
+	if (!set_profile_stages.empty())
+	{
+		if (set_profile_stages != "text" && set_profile_stages != "json")
+			throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+									  etl::strprintf(_("Unknown format of the stage profile: %s."), set_profile_stages.c_str()));
+		SynfigToolGeneralOptions::instance()->set_profile_stages(set_profile_stages);
+	}
+
 	if (sw_quiet)
 	{
 		SynfigToolGeneralOptions::instance()->set_should_be_quiet(true);
 	}
 
+	if (sw_lazy_loading)
+	{
+		synfig::Canvas::set_lazy_loading(true);
+		VERBOSE_OUT(1) << _("Lazy loading of external resources enabled") << std::endl;
+	}
+
+	if (sw_cache_binary)
+	{
+		synfig::CanvasSnapshot::set_enabled(true);
+	}
+
 	if (set_num_threads > 0)
 	{
 		SynfigToolGeneralOptions::instance()->set_threads(set_num_threads);
@@ -675,19 +717,119 @@ TargetParam SynfigCommandLineParser::extract_targetparam()
                        << "'."
 					   << std::endl;
 	}
+	if (set_encoder_jobs > 0)
+	{
+		params.encoder_jobs = set_encoder_jobs;
+		VERBOSE_OUT(1) << _("Encoder jobs set to: ") << params.encoder_jobs << std::endl;
+	}
+	if (set_png_compression >= 0)
+	{
+		if (set_png_compression > 9)
+			throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+									  etl::strprintf(_("PNG compression level %d is out of range 0..9."), set_png_compression));
+		params.compression_level = set_png_compression;
+		VERBOSE_OUT(1) << _("PNG compression level set to: ") << params.compression_level << std::endl;
+	}
+	if (!set_png_filter.empty())
+	{
+		params.png_filter = set_png_filter;
+		VERBOSE_OUT(1) << _("PNG filters set to: ") << params.png_filter << std::endl;
+	}
+	if (!set_dither.empty())
+	{
+		PixelDither dither;
+		if (!pixel_dither_from_name(set_dither, dither))
+			throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+									  etl::strprintf(_("Unknown dithering: %s."), set_dither.c_str()));
+		params.dither = set_dither;
+		VERBOSE_OUT(1) << _("Dithering set to: ") << params.dither << std::endl;
+	}
 
 	return params;
 }
 
+std::vector<std::string> SynfigCommandLineParser::extract_input_files()
+{
+	std::vector<std::string> files;
+	if (!set_input_file.empty())
+		files.push_back(set_input_file);
+	for (Glib::OptionGroup::vecustrings::const_iterator i = remaining_options_list.begin();
+		 i != remaining_options_list.end(); ++i)
+		if (std::find(files.begin(), files.end(), std::string(*i)) == files.end())
+			files.push_back(*i);
+
+	if (files.size() > 1)
+	{
+		// these options are bound to the single composition
+		if (!set_output_file.empty())
+			throw SynfigToolException(SYNFIGTOOL_INVALIDOUTPUT,
+									  _("Output file can't be specified for several input files."));
+		if (sw_extract_alpha || misc_canvases || !misc_canvas_info.empty())
+			throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+									  _("Alpha extraction and canvas info options can't be used with several input files."));
+		if (sw_worker || set_coordinate)
+			throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+									  _("Render workers can't be used with several input files."));
+	}
+
+	return files;
+}
+
+int SynfigCommandLineParser::extract_max_jobs()
+{
+	if (set_jobs < 0)
+		throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+								  etl::strprintf(_("Invalid count of jobs: %d."), set_jobs));
+	if (set_jobs > 1 && !set_profile_stages.empty())
+		throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+								  _("Stage profiling can't be used with several jobs at once."));
+	if (set_jobs > 1)
+		VERBOSE_OUT(1) << _("Max jobs set to ") << set_jobs << std::endl;
+	return std::max(1, set_jobs);
+}
+
+bool SynfigCommandLineParser::extract_worker_mode()
+{
+	if (sw_worker && sw_extract_alpha)
+		throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+								  _("Alpha extraction can't be used with render workers."));
+	// the report would be mixed with the answers to the coordinator
+	if (sw_worker && !set_profile_stages.empty())
+		throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+								  _("Stage profiling can't be used with render workers."));
+	return sw_worker;
+}
+
+int SynfigCommandLineParser::extract_coordinator_workers()
+{
+	if (set_coordinate < 0)
+		throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+								  etl::strprintf(_("Invalid count of workers: %d."), set_coordinate));
+	if (set_coordinate && sw_extract_alpha)
+		throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+								  _("Alpha extraction can't be used with render workers."));
+	if (set_coordinate && !set_profile_stages.empty())
+		throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+								  _("Stage profiling can't be used with render workers."));
+	if (set_coordinate)
+		VERBOSE_OUT(1) << _("Render workers set to ") << set_coordinate << std::endl;
+	return set_coordinate;
+}
+
 //Job OptionsProcessor::extract_job()
 Job SynfigCommandLineParser::extract_job()
+{
+	return extract_job(set_input_file);
+}
+
+Job SynfigCommandLineParser::extract_job(const std::string& filename)
 {
 	Job job;
 
 	// Common input file loading
-	if (!set_input_file.empty())
+	if (!filename.empty())
 	{
-		job.filename = set_input_file;
+		job.filename = filename;
 
 		// Open the composition
 		string errors, warnings;
@@ -697,6 +839,15 @@ Job SynfigCommandLineParser::extract_job()
 			{
 				FileSystem::Identifier identifier = file_system->get_identifier(CanvasFileNaming::project_file(job.filename));
 				job.root = open_canvas_as(identifier, job.filename, errors, warnings);
+
+				if (job.root && sw_cache_binary && !CanvasSnapshot::is_actual(identifier))
+				{
+					if (CanvasSnapshot::write(identifier, job.root))
+						VERBOSE_OUT(1) << _("Binary snapshot saved to ")
+									   << CanvasSnapshot::get_snapshot_filename(identifier) << std::endl;
+					else
+						std::cerr << _("Unable to save binary snapshot") << std::endl;
+				}
 			}
 			else
 			{
@@ -110,6 +110,25 @@ public:
 	/// and set the target parameters, if provided. Then can be processed
 	Job extract_job();
 
+	/// Same as extract_job(), but loads the given input file
+	Job extract_job(const std::string& filename);
+
+	/// Extract the list of the input files
+	/// input-file and the remaining arguments
+	std::vector<std::string> extract_input_files();
+
+	/// Extract the count of the jobs which may be processed at once
+	/// jobs
+	int extract_max_jobs();
+
+	/// Whether the tool should run as the render worker
+	/// worker
+	bool extract_worker_mode();
+
+	/// Extract the count of the worker processes, zero if the frames are rendered here
+	/// coordinate
+	int extract_coordinator_workers();
+
 	/// Overwrite the input RendDesc object with the options given in the command line
 	synfig::RendDesc extract_renddesc(const synfig::RendDesc& renddesc);
 
@@ -155,6 +174,8 @@ private:
 	int				set_quality;
 //			(",Q", quality_arg_desc->default_value(DEFAULT_QUALITY), )
 	int				set_num_threads;
+	int				set_jobs;
+	int				set_coordinate;
 	Glib::ustring	set_input_file;
 	Glib::ustring	set_output_file;
 	Glib::ustring	set_sequence_separator;
@@ -167,12 +188,20 @@ private:
 	double			set_dpi;
 	double			set_dpi_x;
 	double			set_dpi_y;
+	int				set_encoder_jobs;
+	int				set_png_compression;
+	Glib::ustring	set_png_filter;
+	Glib::ustring	set_dither;
+	Glib::ustring	set_profile_stages;
 
 	// Switch group
 	int				sw_verbosity;
 	bool			sw_quiet;
 	bool			sw_print_benchmarks;
 	bool			sw_extract_alpha;
+	bool			sw_lazy_loading;
+	bool			sw_cache_binary;
+	bool			sw_worker;
 
 	// Misc group
 	std::string		misc_append_filename;
@@ -0,0 +1,392 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file tool/renderworker.cpp
+**	\brief Synfig Tool Render Worker and Local Coordinator
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+#include <glibmm.h>
+
+#include <ETL/stringf>
+
+#include <synfig/general.h>
+#include <synfig/localization.h>
+#include <synfig/canvas.h>
+#include <synfig/target.h>
+
+#include "definitions.h"
+#include "job.h"
+#include "joblistprocessor.h"
+#include "renderprogress.h"
+#include "synfigtoolexception.h"
+#include "renderworker.h"
+
+#endif
+
+using namespace synfig;
+
+namespace {
+
+/// Range of frames given to the worker at once
+struct FrameRange
+{
+	int first;
+	int last;
+	int attempts;
+
+	FrameRange(int first, int last): first(first), last(last), attempts() { }
+	int count() const { return last - first + 1; }
+};
+
+/// Reads the line without the line break, returns false at the end of the stream
+bool read_line(FILE* file, std::string& line)
+{
+	line.clear();
+	int c;
+	while ((c = fgetc(file)) != EOF && c != '\n')
+		if (c != '\r')
+			line += (char)c;
+	return c != EOF || !line.empty();
+}
+
+/// Parses "<command> <first> <last>"
+bool parse_range(const std::string& line, std::string& command, int& first, int& last)
+{
+	std::istringstream stream(line);
+	return (stream >> command >> first >> last) && first <= last;
+}
+
+/// Shared state of the coordinator, fields are guarded by the mutex
+class Coordinator
+{
+public:
+	std::mutex mutex;
+	std::deque<FrameRange> ranges;
+	std::vector<FrameRange> failed;
+	int frames_done;
+	int frames_total;
+	RenderProgress progress;
+
+	Coordinator(): frames_done(), frames_total() { }
+
+	bool next(FrameRange& range)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ranges.empty())
+			return false;
+		range = ranges.front();
+		ranges.pop_front();
+		return true;
+	}
+
+	void finish(const FrameRange& range, bool success)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!success) {
+			failed.push_back(range);
+			return;
+		}
+		frames_done += range.count();
+		progress.amount_complete(frames_done, frames_total);
+	}
+
+	/// Returns the range of the lost worker to the queue, so other workers will take it.
+	/// The range which has killed the workers twice is given up.
+	void lost(FrameRange range)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (++range.attempts < 2)
+			ranges.push_front(range);
+		else
+			failed.push_back(range);
+	}
+};
+
+/// Talks to a single worker process until the ranges are over or the worker is lost
+void serve_worker(Coordinator* coordinator, int index, FILE* to_worker, FILE* from_worker)
+{
+	std::string line, command;
+	int first, last;
+
+	// wait for the loading of the composition
+	while (true) {
+		if (!read_line(from_worker, line)) {
+			synfig::error(_("Render worker %d has exited before it was ready"), index);
+			return;
+		}
+		if (parse_range(line, command, first, last) && command == "ready")
+			break;
+	}
+	VERBOSE_OUT(2) << etl::strprintf(_("Render worker %d is ready"), index) << std::endl;
+
+	FrameRange range(0, 0);
+	while (coordinator->next(range)) {
+		bool answered = false;
+		if (fprintf(to_worker, "render %d %d\n", range.first, range.last) > 0 && fflush(to_worker) == 0) {
+			while (read_line(from_worker, line)) {
+				if (!parse_range(line, command, first, last) || first != range.first || last != range.last)
+					continue;
+				if (command == "done" || command == "failed") {
+					coordinator->finish(range, command == "done");
+					answered = true;
+					break;
+				}
+			}
+		}
+
+		if (!answered) {
+			synfig::error(_("Render worker %d is lost while rendering frames %d..%d"), index, range.first, range.last);
+			coordinator->lost(range);
+			return;
+		}
+	}
+
+	fprintf(to_worker, "quit\n");
+	fflush(to_worker);
+}
+
+/// Environment of the worker processes, generic threads of the renderer
+/// are split among the workers
+std::vector<std::string> worker_environment(int workers)
+{
+	const char *threads_variable = "SYNFIG_GENERIC_THREADS";
+	const int threads = std::max(1, (int)std::thread::hardware_concurrency()/workers);
+
+	std::vector<std::string> environment;
+	std::vector<std::string> names = Glib::listenv();
+	for (std::vector<std::string>::const_iterator i = names.begin(); i != names.end(); ++i)
+		if (*i != threads_variable)
+			environment.push_back(*i + "=" + Glib::getenv(*i));
+	environment.push_back(etl::strprintf("%s=%d", threads_variable, threads));
+	return environment;
+}
+
+/// Command line of the worker processes: the same options without --coordinate
+std::vector<std::string> worker_arguments(const std::vector<std::string>& arguments)
+{
+	std::vector<std::string> result;
+	result.push_back(SynfigToolGeneralOptions::instance()->get_binary_path());
+	for (std::vector<std::string>::const_iterator i = arguments.begin(); i != arguments.end(); ++i)
+	{
+		if (*i == "--coordinate") {
+			if (i + 1 != arguments.end())
+				++i;
+			continue;
+		}
+		if (i->compare(0, 13, "--coordinate=") == 0)
+			continue;
+		result.push_back(*i);
+	}
+	result.push_back("--worker");
+	result.push_back("--quiet");
+	return result;
+}
+
+/// Targets writing each frame of the sequence to its own file.
+/// Frames of other targets (gif, libav, png-atlas, etc.) go to one file,
+/// so they can't be split between the workers
+bool is_file_per_frame_target(const std::string& target_name)
+{
+	static const char* const names[] = {
+		"png", "cairo_png", "jpeg", "bmp", "ppm", "openexr", "imagemagick", "null", "null-tile" };
+	for (size_t i = 0; i < sizeof(names)/sizeof(names[0]); ++i)
+		if (target_name == names[i])
+			return true;
+	return false;
+}
+
+} // end of anonymous namespace
+
+void process_render_worker(Job& job, const TargetParam& target_parameters)
+{
+	const int shot_first = job.desc.get_frame_start();
+	const int shot_last = job.desc.get_frame_end();
+
+	// names of the single frames are derived from the output filename
+	setup_job_output(job);
+
+	std::cout << "ready " << shot_first << " " << shot_last << std::endl;
+
+	std::string line, command;
+	int first, last;
+	while (std::getline(std::cin, line))
+	{
+		if (line == "quit" || line == "quit\r")
+			break;
+		if (!parse_range(line, command, first, last) || command != "render")
+		{
+			synfig::warning(_("Render worker: unknown command: %s"), line.c_str());
+			continue;
+		}
+
+		bool success = false;
+		if (first < shot_first || last > shot_last)
+		{
+			synfig::error(_("Render worker: frames %d..%d are out of the range %d..%d"),
+						  first, last, shot_first, shot_last);
+		}
+		else
+		{
+			// canvas stays loaded between the ranges, so the caches of the layers are warm
+			Job item = job;
+			item.desc.set_frame_start(first);
+			item.desc.set_frame_end(last);
+			item.canvas->rend_desc() = item.desc;
+
+			// single frame is written without the frame number,
+			// so name it as the frame of the whole sequence
+			if (first == last && shot_first != shot_last)
+				item.outfilename = etl::filename_sans_extension(item.outfilename)
+								 + target_parameters.sequence_separator
+								 + etl::strprintf("%04d", first)
+								 + etl::filename_extension(item.outfilename);
+
+			try
+			{
+				if (setup_job(item, target_parameters))
+				{
+					process_job(item, false);
+					success = true;
+				}
+			}
+			catch (SynfigToolException& e)
+			{
+				synfig::error("%s", e.get_message().c_str());
+			}
+			catch (std::exception& e)
+			{
+				synfig::error("%s", e.what());
+			}
+			// target writes the rest of the files when it is destroyed
+			item.target = 0;
+		}
+
+		std::cout << (success ? "done " : "failed ") << first << " " << last << std::endl;
+	}
+
+	job.canvas->rend_desc() = job.desc;
+}
+
+void process_render_coordinator(Job& job, int workers, const std::vector<std::string>& arguments)
+{
+	// workers resolve the same target, but each of them writes its own frames
+	Job output = job;
+	setup_job_output(output);
+	if (!is_file_per_frame_target(output.target_name))
+		throw SynfigToolException(SYNFIGTOOL_INVALIDTARGET,
+			etl::strprintf(_("Target \"%s\" writes all frames to one file, it can't be used with render workers."),
+						   output.target_name.c_str()));
+
+	const int shot_first = job.desc.get_frame_start();
+	const int shot_last = job.desc.get_frame_end();
+	const int frames = shot_last - shot_first + 1;
+	workers = std::max(1, std::min(workers, frames));
+
+	// several ranges per worker, so the workers finishing earlier take the rest
+	const int chunk = std::max(1, frames/(workers*4));
+
+	Coordinator coordinator;
+	coordinator.frames_total = frames;
+	for (int i = shot_first; i <= shot_last; i += chunk)
+		coordinator.ranges.push_back(FrameRange(i, std::min(i + chunk - 1, shot_last)));
+
+	VERBOSE_OUT(1) << etl::strprintf(_("Rendering frames %d..%d by %d workers in %d ranges"),
+									 shot_first, shot_last, workers, (int)coordinator.ranges.size())
+				   << std::endl;
+
+#ifndef _WIN32
+	// lost worker should not kill the coordinator by writing to the closed pipe
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	const std::vector<std::string> argv = worker_arguments(arguments);
+	const std::vector<std::string> envp = worker_environment(workers);
+
+	std::chrono::system_clock::time_point start_timepoint = std::chrono::system_clock::now();
+	coordinator.progress.task(job.filename + " ==> " + job.outfilename);
+
+	std::vector<FILE*> files;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < workers; ++i)
+	{
+		int to_worker = -1, from_worker = -1;
+		try
+		{
+			Glib::spawn_async_with_pipes(
+				Glib::get_current_dir(), argv, envp, Glib::SPAWN_DEFAULT, Glib::SlotSpawnChildSetup(),
+				NULL, &to_worker, &from_worker, NULL );
+		}
+		catch (Glib::Error& e)
+		{
+			synfig::error(_("Unable to start render worker: %s"), e.what().c_str());
+			break;
+		}
+
+		files.push_back(fdopen(to_worker, "w"));
+		files.push_back(fdopen(from_worker, "r"));
+		threads.push_back(std::thread(serve_worker, &coordinator, i, files[files.size() - 2], files.back()));
+	}
+
+	for (std::vector<std::thread>::iterator i = threads.begin(); i != threads.end(); ++i)
+		i->join();
+	for (std::vector<FILE*>::iterator i = files.begin(); i != files.end(); ++i)
+		if (*i) fclose(*i);
+
+	int frames_lost = 0;
+	for (std::deque<FrameRange>::const_iterator i = coordinator.ranges.begin(); i != coordinator.ranges.end(); ++i)
+		frames_lost += i->count();
+	for (std::vector<FrameRange>::const_iterator i = coordinator.failed.begin(); i != coordinator.failed.end(); ++i)
+	{
+		synfig::error(_("Frames %d..%d are not rendered"), i->first, i->last);
+		frames_lost += i->count();
+	}
+
+	if (SynfigToolGeneralOptions::instance()->should_print_benchmarks())
+	{
+		std::chrono::duration<double> duration = std::chrono::system_clock::now() - start_timepoint;
+		std::cout << job.filename.c_str()
+				  << _(": Rendered in ") << duration.count()
+				  << _(" seconds by ") << threads.size() << _(" workers.") << std::endl;
+	}
+
+	if (frames_lost)
+		throw SynfigToolException(SYNFIGTOOL_RENDERFAILURE,
+								  etl::strprintf(_("Render Failure: %d of %d frames are not rendered."), frames_lost, frames));
+
+	VERBOSE_OUT(1) << _("Done.") << std::endl;
+}
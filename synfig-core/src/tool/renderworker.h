@@ -0,0 +1,44 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file tool/renderworker.h
+**	\brief Synfig Tool Render Worker and Local Coordinator
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+#ifndef __SYNFIG_RENDERWORKER_H
+#define __SYNFIG_RENDERWORKER_H
+
+#include <string>
+#include <vector>
+#include <synfig/targetparam.h>
+#include "job.h"
+
+/// Keeps the composition of the job loaded and renders ranges of its frames
+/// on request. Commands are read from stdin and answered to stdout, line by line:
+///   worker:      ready <first frame> <last frame>    (frames of the whole job)
+///   coordinator: render <first frame> <last frame>
+///   worker:      done <first frame> <last frame>  or  failed <first frame> <last frame>
+///   coordinator: quit
+/// Other lines of the worker output should be ignored.
+void process_render_worker(Job& job, const synfig::TargetParam& target_parameters);
+
+/// Runs \a workers worker processes of the synfig tool with the same
+/// command line \a arguments (without the program name) and splits
+/// the frames of the job among them. Intended for image sequence targets,
+/// each range of frames is written to its own files.
+void process_render_coordinator(Job& job, int workers, const std::vector<std::string>& arguments);
+
+#endif // __SYNFIG_RENDERWORKER_H
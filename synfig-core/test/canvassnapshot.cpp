@@ -0,0 +1,263 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file canvassnapshot.cpp
+**	\brief Test of the writing and loading of the binary canvas snapshot
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <cstdio>
+
+#include <utime.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <synfig/general.h>
+#include <synfig/main.h>
+#include <synfig/canvas.h>
+#include <synfig/canvassnapshot.h>
+#include <synfig/filesystemnative.h>
+#include <synfig/layers/layer_pastecanvas.h>
+#include <synfig/loadcanvas.h>
+#include <synfig/savecanvas.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+//! Canvas with exported values, animation, linkable and dynamic list
+//! value nodes, value node linked by GUID, keyframes, metadata and inline canvas
+#define CANVAS_TEXT \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+	"<canvas version=\"1.2\" width=\"8\" height=\"8\" xres=\"2834.645669\" yres=\"2834.645669\"" \
+	" view-box=\"-4.0 4.0 4.0 -4.0\" antialias=\"1\" fps=\"24\" begin-time=\"0f\" end-time=\"2s\" bgcolor=\"0 0 0 0\">\n" \
+	"<name>snapshot</name>\n" \
+	"<meta name=\"grid_size\" content=\"0.25 0.25\"/>\n" \
+	"<keyframe time=\"1s\" active=\"true\">middle</keyframe>\n" \
+	"<defs>\n" \
+	"<real id=\"amount\" value=\"0.7500000000\"/>\n" \
+	"</defs>\n" \
+	"<layer type=\"SolidColor\" active=\"true\" version=\"0.1\" desc=\"background\">\n" \
+	"<param name=\"amount\" use=\"amount\"/>\n" \
+	"<param name=\"color\"><animated type=\"color\">\n" \
+	"<waypoint time=\"0s\" before=\"clamped\" after=\"linear\"><color><r>1.000000</r><g>0.000000</g><b>0.000000</b><a>1.000000</a></color></waypoint>\n" \
+	"<waypoint time=\"2s\" before=\"linear\" after=\"clamped\"><color><r>0.000000</r><g>0.000000</g><b>1.000000</b><a>1.000000</a></color></waypoint>\n" \
+	"</animated></param>\n" \
+	"</layer>\n" \
+	"<layer type=\"polygon\" active=\"false\" exclude_from_rendering=\"true\" version=\"0.1\">\n" \
+	"<param name=\"amount\"><real guid=\"0123456789ABCDEF0123456789ABCDEF\" value=\"0.5000000000\"/></param>\n" \
+	"<param name=\"origin\"><scale type=\"vector\">\n" \
+	"<link><vector><x>1.0000000000</x><y>0.5000000000</y></vector></link>\n" \
+	"<scalar><real value=\"2.0000000000\"/></scalar>\n" \
+	"</scale></param>\n" \
+	"<param name=\"vector_list\"><dynamic_list type=\"vector\">\n" \
+	"<entry><vector><x>0.0000000000</x><y>0.0000000000</y></vector></entry>\n" \
+	"<entry on=\"0s\" off=\"1s\"><vector><x>1.0000000000</x><y>0.0000000000</y></vector></entry>\n" \
+	"<entry><vector><x>0.0000000000</x><y>1.0000000000</y></vector></entry>\n" \
+	"</dynamic_list></param>\n" \
+	"</layer>\n" \
+	"<layer type=\"group\" active=\"true\" version=\"0.3\" desc=\"group\">\n" \
+	"<param name=\"canvas\"><canvas>\n" \
+	"<layer type=\"SolidColor\" active=\"true\" version=\"0.1\" desc=\"inner\">\n" \
+	"<param name=\"amount\"><real guid=\"0123456789ABCDEF0123456789ABCDEF\" value=\"0.5000000000\"/></param>\n" \
+	"<param name=\"color\"><color><r>0.000000</r><g>1.000000</g><b>0.000000</b><a>1.000000</a></color></param>\n" \
+	"</layer>\n" \
+	"</canvas></param>\n" \
+	"</layer>\n" \
+	"</canvas>\n"
+
+/* === P R O C E D U R E S ================================================= */
+
+static bool write_file(const String &filename, const String &text)
+{
+	FILE *file = g_fopen(filename.c_str(), "wb");
+	if (!file) return false;
+	bool success = fwrite(text.c_str(), 1, text.size(), file) == text.size();
+	return fclose(file) == 0 && success;
+}
+
+//! Returns the "amount" value nodes of the polygon and of the layer of the inline canvas
+static bool get_linked_nodes(const Canvas::Handle &canvas, ValueNode::Handle &first, ValueNode::Handle &second)
+{
+	if (canvas->size() != 3)
+		return false;
+	Canvas::const_iterator i = canvas->begin();
+	Layer::Handle polygon = *++i;
+	Layer_PasteCanvas::Handle group = Layer_PasteCanvas::Handle::cast_dynamic(*++i);
+	if (!group || !group->get_sub_canvas() || group->get_sub_canvas()->empty())
+		return false;
+
+	const Layer::DynamicParamList &list0 = polygon->dynamic_param_list();
+	const Layer::DynamicParamList &list1 = group->get_sub_canvas()->front()->dynamic_param_list();
+	if (!list0.count("amount") || !list1.count("amount"))
+		return false;
+	first = list0.find("amount")->second;
+	second = list1.find("amount")->second;
+	return true;
+}
+
+//! The node linked by GUID should be shared in the canvas loaded from the snapshot,
+//! and its GUID relative to the canvas should be the same as after the XML parsing
+static int test_linked_nodes(const Canvas::Handle &canvas, const Canvas::Handle &snapshot_canvas)
+{
+	ValueNode::Handle expected0, expected1, loaded0, loaded1;
+	if ( !get_linked_nodes(canvas, expected0, expected1)
+	  || !get_linked_nodes(snapshot_canvas, loaded0, loaded1) )
+	{
+		printf("linked value nodes not found\n");
+		return 1;
+	}
+
+	int failures = 0;
+	if (expected0 != expected1)
+	{
+		printf("value nodes with the same GUID are not linked by the parser\n");
+		++failures;
+	}
+	if (loaded0 != loaded1)
+	{
+		printf("linked value node is not shared in the canvas loaded from snapshot\n");
+		++failures;
+	}
+	if ((loaded0->get_guid() ^ snapshot_canvas->get_guid()) != (expected0->get_guid() ^ canvas->get_guid()))
+	{
+		printf("GUID of the linked value node is not restored from snapshot: %s instead of %s\n",
+			(loaded0->get_guid() ^ snapshot_canvas->get_guid()).get_string().c_str(),
+			(expected0->get_guid() ^ canvas->get_guid()).get_string().c_str() );
+		++failures;
+	}
+	return failures;
+}
+
+//! Loads the canvas from XML, writes the snapshot and loads it back,
+//! the canvas should be saved to the same document.
+//! Then changes the source without changing of its size and modification time,
+//! the snapshot should be rejected.
+static int test_round_trip(const String &dir)
+{
+	const String filename = dir + "/main.sif";
+	const String snapshot_filename = filename + CanvasSnapshot::snapshot_extension;
+	const String text = CANVAS_TEXT;
+
+	if (!write_file(filename, text))
+	{
+		printf("unable to write the test file to %s\n", dir.c_str());
+		return 1;
+	}
+
+	FileSystem::Identifier identifier = FileSystemNative::instance()->get_identifier(filename);
+	String errors, warnings;
+	Canvas::Handle canvas = open_canvas_as(identifier, filename, errors, warnings);
+	if (!canvas)
+	{
+		printf("unable to open %s: %s\n", filename.c_str(), errors.c_str());
+		g_remove(filename.c_str());
+		return 1;
+	}
+
+	int failures = 0;
+	if (CanvasSnapshot::is_actual(identifier))
+	{
+		printf("snapshot is actual before writing\n");
+		++failures;
+	}
+	if (!CanvasSnapshot::write(identifier, canvas))
+	{
+		printf("unable to write snapshot\n");
+		++failures;
+	}
+	if (!CanvasSnapshot::is_actual(identifier))
+	{
+		printf("snapshot is not actual after writing\n");
+		++failures;
+	}
+
+	Canvas::Handle snapshot_canvas = CanvasSnapshot::read(identifier, filename);
+	if (!snapshot_canvas)
+	{
+		printf("unable to read snapshot\n");
+		++failures;
+	}
+	else
+	{
+		const String expected = canvas_to_string(canvas);
+		const String loaded = canvas_to_string(snapshot_canvas);
+		if (expected != loaded)
+		{
+			printf("canvas loaded from snapshot differs from the source:\n%s\nexpected:\n%s\n",
+				loaded.c_str(), expected.c_str());
+			++failures;
+		}
+		failures += test_linked_nodes(canvas, snapshot_canvas);
+	}
+
+	// change the source and keep its size and modification time
+	GStatBuf buf;
+	String changed = text;
+	changed.replace(changed.find("background"), 10, "foreground");
+	if ( g_stat(filename.c_str(), &buf) != 0
+	  || !write_file(filename, changed) )
+	{
+		printf("unable to change the test file\n");
+		++failures;
+	}
+	else
+	{
+		struct utimbuf times;
+		times.actime = buf.st_atime;
+		times.modtime = buf.st_mtime;
+		g_utime(filename.c_str(), &times);
+
+		if (CanvasSnapshot::is_actual(identifier))
+		{
+			printf("snapshot is actual after the change of source\n");
+			++failures;
+		}
+		if (CanvasSnapshot::read(identifier, filename))
+		{
+			printf("outdated snapshot is loaded\n");
+			++failures;
+		}
+	}
+
+	g_remove(snapshot_filename.c_str());
+	g_remove(filename.c_str());
+	return failures;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	synfig::Main main(".");
+
+	gchar *dir = g_dir_make_tmp("synfig-canvassnapshot-XXXXXX", NULL);
+	if (!dir)
+	{
+		printf("unable to create the temporary directory\n");
+		return 1;
+	}
+
+	int failures = test_round_trip(dir);
+
+	g_rmdir(dir);
+	g_free(dir);
+	return failures;
+}
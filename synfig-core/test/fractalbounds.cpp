@@ -0,0 +1,142 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file fractalbounds.cpp
+**	\brief Test of the distorted context bounds of the rendering task of the Julia Set layer
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <synfig/general.h>
+#include <synfig/main.h>
+#include <synfig/canvas.h>
+#include <synfig/context.h>
+#include <synfig/rendering/renderer.h>
+#include <synfig/rendering/surface.h>
+#include <synfig/rendering/software/surfacesw.h>
+
+#include <modules/lyr_std/julia.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+using namespace modules::lyr_std;
+
+/* === M A C R O S ========================================================= */
+
+#define SIZE 64
+
+/* === P R O C E D U R E S ================================================= */
+
+//! Renders the Julia Set which distorts the red background with the green triangle
+//! in the view box of the given size, by the rendering task and by the legacy
+//! Layer::get_color(). Pixels far from the origin escape at the first iteration
+//! and distort the context points far away, so the results should differ only
+//! at the edges of the triangle.
+static int test_julia_bounds(Real view_size, bool broken)
+{
+	Canvas::Handle canvas = Canvas::create();
+	RendDesc &desc = canvas->rend_desc();
+	desc.set_wh(SIZE, SIZE);
+	desc.set_tl(Point(-view_size, view_size));
+	desc.set_br(Point(view_size, -view_size));
+
+	Layer::Handle julia = Julia::create();
+	julia->set_canvas(canvas);
+	julia->set_param("seed", Point(-0.4, 0.6));
+	julia->set_param("shade_inside", false);
+	julia->set_param("shade_outside", false);
+	julia->set_param("color_inside", false);
+	julia->set_param("broken", broken);
+
+	std::vector<Point> points;
+	points.push_back(Point(-1.0, -1.0));
+	points.push_back(Point( 1.5, -0.5));
+	points.push_back(Point( 0.0,  1.5));
+	Layer::Handle triangle = Layer::create("polygon");
+	triangle->set_canvas(canvas);
+	triangle->set_param("vector_list", ValueBase(points));
+	triangle->set_param("color", Color::green());
+
+	Layer::Handle background = Layer::create("SolidColor");
+	background->set_canvas(canvas);
+	background->set_param("color", Color::red());
+
+	canvas->push_back(julia);
+	canvas->push_back(triangle);
+	canvas->push_back(background);
+
+	rendering::SurfaceResource::Handle surface = new rendering::SurfaceResource();
+	surface->create(SIZE, SIZE);
+	rendering::Task::Handle task = canvas->build_rendering_task(ContextParams());
+	if (task)
+	{
+		task->target_surface = surface;
+		task->target_rect = RectInt(0, 0, SIZE, SIZE);
+		task->source_rect = Rect(-view_size, -view_size, view_size, view_size);
+		rendering::Renderer::get_renderer("software")->run(rendering::Task::List(1, task));
+	}
+
+	rendering::SurfaceResource::LockRead<rendering::SurfaceSW> lock(surface);
+	if (!lock)
+	{
+		printf("julia %f%s: nothing is rendered\n", view_size, broken ? " broken" : "");
+		return 1;
+	}
+
+	Context context = canvas->get_context(ContextParams());
+	const Real pixel = 2.0*view_size/SIZE;
+	int differs = 0;
+	for(int y = 0; y < SIZE; ++y)
+	{
+		for(int x = 0; x < SIZE; ++x)
+		{
+			const Point pos(-view_size + (x + 0.5)*pixel, view_size - (y + 0.5)*pixel);
+			const Color expected = context.get_color(pos);
+			const Color rendered = lock->get_surface()[y][x];
+			if ( std::fabs(expected.get_r()*expected.get_a() - rendered.get_r()*rendered.get_a()) > 0.05
+			  || std::fabs(expected.get_g()*expected.get_a() - rendered.get_g()*rendered.get_a()) > 0.05
+			  || std::fabs(expected.get_a() - rendered.get_a()) > 0.05 )
+				++differs;
+		}
+	}
+
+	// distorted edges of the triangle are sampled differently
+	if (differs > SIZE*SIZE/20)
+	{
+		printf("julia %f%s: %d of %d pixels differ from the legacy rendering\n",
+			view_size, broken ? " broken" : "", differs, SIZE*SIZE);
+		return 1;
+	}
+	return 0;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	synfig::Main main(".");
+
+	int failures = 0;
+	failures += test_julia_bounds(2.0, false);
+	failures += test_julia_bounds(6.0, false);
+	failures += test_julia_bounds(6.0, true);
+	return failures;
+}
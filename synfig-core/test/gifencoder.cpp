@@ -0,0 +1,260 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file gifencoder.cpp
+**	\brief Test of the palette search and of the LZW compression of the GIF target
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <synfig/general.h>
+#include <synfig/main.h>
+#include <synfig/palette.h>
+#include <synfig/smartfile.h>
+
+#include <modules/mod_gif/trgt_gif.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === P R O C E D U R E S ================================================= */
+
+//! Returns random color, or color with channels multiple of 1/\a steps
+//! to get many equally distant items
+static Color random_color(std::mt19937 &random, int steps = 0)
+{
+	if (steps > 0) {
+		std::uniform_int_distribution<int> channel(0, steps);
+		const ColorReal k = ColorReal(1)/steps;
+		return Color(channel(random)*k, channel(random)*k, channel(random)*k, channel(random)*k);
+	}
+	std::uniform_real_distribution<float> channel(0.f, 1.f);
+	return Color(channel(random), channel(random), channel(random), channel(random));
+}
+
+//! K-d tree of the palette should return the same items as the linear search,
+//! including the first of the equally distant items
+static int test_palette_index(const Gamma &gamma)
+{
+	std::mt19937 random(1);
+	int failures = 0;
+
+	for(int p = 0; p < 200 && failures < 10; ++p) {
+		// every second palette is built on the coarse grid
+		const int steps = p % 2 ? 0 : 4;
+		const int size = 1 + (int)(random() % 256);
+		Palette palette;
+		for(int i = 0; i < size; ++i)
+			palette.push_back(random_color(random, steps));
+
+		// equal items, and two items at the equal distance from the transparent black
+		for(int i = 0; i < size/4; ++i)
+			palette[random() % size] = palette[random() % size].color;
+		if (size > 2) {
+			palette[size - 2] = Color(0, 0, 0, 0.75);
+			palette[size - 1] = Color(0, 0, 0, 0.25);
+		}
+
+		const PaletteIndex index(palette, gamma);
+
+		std::vector<Color> colors;
+		for(int i = 0; i < 200; ++i)
+			colors.push_back(random_color(random, steps ? 2*steps : 0));
+		for(int i = 0; i < size; ++i)
+			colors.push_back(palette[i].color);
+		colors.push_back(Color(0, 0, 0, 0.5));
+
+		for(std::vector<Color>::const_iterator i = colors.begin(); i != colors.end(); ++i) {
+			const int expected = (int)(palette.find_closest(*i, gamma) - palette.begin());
+			const int found = index.find_closest(*i);
+			if (found != expected) {
+				printf("palette %d of %d items: k-d tree returns item %d instead of %d for color (%f, %f, %f, %f)\n",
+					p, size, found, expected, i->get_r(), i->get_g(), i->get_b(), i->get_a());
+				++failures;
+			}
+		}
+	}
+	return failures;
+}
+
+//! Reference LZW decoder of the GIF image data:
+//! the code size byte followed by the data sub-blocks
+static bool lzw_decode(const std::vector<unsigned char> &data, std::vector<int> &values)
+{
+	if (data.empty())
+		return false;
+	const int rootsize = data[0];
+	const int clear = 1 << rootsize;
+	const int end = clear + 1;
+
+	std::vector<unsigned char> bytes;
+	size_t pos = 1;
+	while(pos < data.size() && data[pos]) {
+		size_t length = data[pos++];
+		if (pos + length > data.size())
+			return false;
+		bytes.insert(bytes.end(), data.begin() + pos, data.begin() + pos + length);
+		pos += length;
+	}
+
+	std::vector< std::vector<int> > dictionary;
+	std::vector<int> prev;
+	int codesize = rootsize + 1;
+	size_t bit = 0;
+	while(true) {
+		if (bit + codesize > bytes.size()*8)
+			return false;
+		int code = 0;
+		for(int i = 0; i < codesize; ++i, ++bit)
+			if (bytes[bit/8] & (1 << (bit%8)))
+				code |= 1 << i;
+
+		if (code == clear) {
+			dictionary.clear();
+			for(int i = 0; i < clear; ++i)
+				dictionary.push_back(std::vector<int>(1, i));
+			dictionary.resize(clear + 2);
+			codesize = rootsize + 1;
+			prev.clear();
+			continue;
+		}
+		if (code == end)
+			return true;
+		if (dictionary.empty())
+			return false;
+
+		std::vector<int> entry;
+		if (code < (int)dictionary.size() && !dictionary[code].empty()) {
+			entry = dictionary[code];
+		} else
+		if (code == (int)dictionary.size() && !prev.empty()) {
+			entry = prev;
+			entry.push_back(prev.front());
+		} else {
+			return false;
+		}
+		values.insert(values.end(), entry.begin(), entry.end());
+
+		if (!prev.empty()) {
+			prev.push_back(entry.front());
+			dictionary.push_back(prev);
+		}
+		prev = entry;
+		if ((int)dictionary.size() == (1 << codesize) && codesize < 12)
+			++codesize;
+	}
+}
+
+//! Values compressed by the encoder of the GIF target
+//! should be restored by the reference decoder
+static int test_lzw_round_trip(const String &dir, const String &name, int rootsize, const std::vector<int> &values)
+{
+	const String filename = dir + "/" + name + ".lzw";
+	{
+		SmartFILE file(g_fopen(filename.c_str(), "wb"));
+		if (!file) {
+			printf("unable to write the test file to %s\n", dir.c_str());
+			return 1;
+		}
+		gif::lzwencoder lzw;
+		lzw.start(file, rootsize);
+		for(std::vector<int>::const_iterator i = values.begin(); i != values.end(); ++i)
+			lzw.put(*i);
+		lzw.finish();
+		fputc(0, file.get()); // Block terminator
+	}
+
+	std::vector<unsigned char> data;
+	if (FILE *file = g_fopen(filename.c_str(), "rb")) {
+		for(int c = fgetc(file); c != EOF; c = fgetc(file))
+			data.push_back((unsigned char)c);
+		fclose(file);
+	}
+	g_remove(filename.c_str());
+
+	std::vector<int> decoded;
+	if (!lzw_decode(data, decoded)) {
+		printf("%s: compressed data of %d values is broken\n", name.c_str(), (int)values.size());
+		return 1;
+	}
+	if (decoded != values) {
+		size_t i = 0;
+		while(i < decoded.size() && i < values.size() && decoded[i] == values[i]) ++i;
+		printf("%s: %d values are decoded instead of %d, first difference at %d\n",
+			name.c_str(), (int)decoded.size(), (int)values.size(), (int)i);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_lzw(const String &dir)
+{
+	std::mt19937 random(2);
+	int failures = 0;
+
+	// the same value repeated, strings grow by one value at a time
+	failures += test_lzw_round_trip(dir, "solid", 8, std::vector<int>(100000, 7));
+
+	// noise fills the table quickly, so it is reset several times
+	for(int rootsize = 2; rootsize <= 8; rootsize += 3) {
+		std::vector<int> values;
+		for(int i = 0; i < 100000; ++i)
+			values.push_back((int)(random() % (1 << rootsize)));
+		failures += test_lzw_round_trip(dir, strprintf("noise%d", rootsize), rootsize, values);
+	}
+
+	// runs and repeated patterns, like the rows of the images
+	std::vector<int> values;
+	for(int i = 0; i < 3000; ++i) {
+		const int value = (int)(random() % 16);
+		const int run = 1 + (int)(random() % 40);
+		values.insert(values.end(), run, value);
+	}
+	failures += test_lzw_round_trip(dir, "runs", 4, values);
+
+	failures += test_lzw_round_trip(dir, "single", 8, std::vector<int>(1, 255));
+	return failures;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	synfig::Main main(".");
+
+	int failures = 0;
+	failures += test_palette_index(Gamma());
+	failures += test_palette_index(Gamma(2.2));
+
+	gchar *dir = g_dir_make_tmp("synfig-gifencoder-XXXXXX", NULL);
+	if (!dir) {
+		printf("unable to create the temporary directory\n");
+		return failures + 1;
+	}
+	failures += test_lzw(dir);
+	g_rmdir(dir);
+	g_free(dir);
+
+	return failures;
+}
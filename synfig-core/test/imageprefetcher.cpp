@@ -0,0 +1,173 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file imageprefetcher.cpp
+**	\brief Test of the background loading of frames of the animated imported files
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include <ETL/misc>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <synfig/general.h>
+#include <synfig/main.h>
+#include <synfig/canvas.h>
+#include <synfig/filesystemnative.h>
+#include <synfig/imagecache.h>
+#include <synfig/imageprefetcher.h>
+#include <synfig/importer.h>
+#include <synfig/surface.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define FPS 24
+
+/* === C L A S S E S ======================================================= */
+
+//! Animated importer which counts the decoded frames,
+//! red channel of the frame is its number
+class CountingImporter: public Importer
+{
+public:
+	static std::atomic<int> loads;
+
+	CountingImporter(const FileSystem::Identifier &identifier): Importer(identifier) { }
+
+	static Importer* create(const FileSystem::Identifier &identifier)
+		{ return new CountingImporter(identifier); }
+
+	virtual bool get_frame(Surface &surface, const RendDesc &renddesc, Time time, ProgressCallback* /* callback */)
+	{
+		++loads;
+		surface.set_wh(4, 4);
+		surface.fill(Color(ColorReal(etl::round_to_int(time*renddesc.get_frame_rate())), 0, 0, 1));
+		return true;
+	}
+
+	virtual bool is_animated() { return true; }
+};
+
+std::atomic<int> CountingImporter::loads(0);
+
+/* === P R O C E D U R E S ================================================= */
+
+static bool write_file(const String &filename, const String &text)
+{
+	FILE *file = g_fopen(filename.c_str(), "wb");
+	if (!file) return false;
+	bool success = fwrite(text.c_str(), 1, text.size(), file) == text.size();
+	return fclose(file) == 0 && success;
+}
+
+//! Frames prefetched while the render is active should be taken
+//! from the cache by the render, without the decoding
+static int test_render_hits_prefetched_frame(const String &dir)
+{
+	const String filename = dir + "/frames.counting";
+	if (!write_file(filename, "frames"))
+	{
+		printf("unable to write the test file to %s\n", dir.c_str());
+		return 1;
+	}
+
+	Importer::book()["counting"] = Importer::BookEntry(&CountingImporter::create, false);
+	Importer::Handle importer = Importer::open(FileSystemNative::instance()->get_identifier(filename));
+	if (!importer)
+	{
+		printf("unable to open %s\n", filename.c_str());
+		g_remove(filename.c_str());
+		return 1;
+	}
+
+	Canvas::Handle canvas = Canvas::create();
+	canvas->rend_desc().set_frame_rate(FPS);
+
+	int failures = 0;
+	{
+		ImagePrefetcher::instance().set_look_ahead(4);
+		ImagePrefetcher::Render render(canvas.get(), Time(0), Time(1), FPS);
+
+		// the render requests the first frame, the next ones should be prefetched
+		importer->get_frame(canvas->rend_desc(), Time(0));
+		ImagePrefetcher::instance().request(importer, Time(0), canvas.get());
+
+		const Time time = Time(2.0/FPS);
+		const ImageCache::Key key(importer->identifier, time.round(FPS));
+		for(int i = 0; i < 500 && !ImageCache::instance().has(key); ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (!ImageCache::instance().has(key))
+		{
+			printf("frame %f is not prefetched\n", (double)time);
+			++failures;
+		}
+
+		const int loads = CountingImporter::loads;
+		const long long hits = ImageCache::instance().get_statistics().hits;
+		rendering::Surface::Handle surface = importer->get_frame(canvas->rend_desc(), time);
+		if (CountingImporter::loads != loads)
+		{
+			printf("prefetched frame %f is decoded again by the render\n", (double)time);
+			++failures;
+		}
+		if (ImageCache::instance().get_statistics().hits <= hits)
+		{
+			printf("render of the frame %f does not hit the cache\n", (double)time);
+			++failures;
+		}
+		if (!surface || !surface->is_exists())
+		{
+			printf("render of the frame %f returns empty surface\n", (double)time);
+			++failures;
+		}
+	}
+
+	importer.reset();
+	Importer::book().erase("counting");
+	g_remove(filename.c_str());
+	return failures;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	synfig::Main main(".");
+
+	gchar *dir = g_dir_make_tmp("synfig-imageprefetcher-XXXXXX", NULL);
+	if (!dir)
+	{
+		printf("unable to create the temporary directory\n");
+		return 1;
+	}
+
+	int failures = test_render_hits_prefetched_frame(dir);
+
+	g_rmdir(dir);
+	g_free(dir);
+	return failures;
+}
@@ -0,0 +1,206 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file lazyloading.cpp
+**	\brief Test of the rendering of the external canvas with the lazy loading
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <synfig/general.h>
+#include <synfig/main.h>
+#include <synfig/canvas.h>
+#include <synfig/context.h>
+#include <synfig/filesystemnative.h>
+#include <synfig/loadcanvas.h>
+#include <synfig/rendering/renderer.h>
+#include <synfig/rendering/surface.h>
+#include <synfig/rendering/software/surfacesw.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define CANVAS_HEADER \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+	"<canvas version=\"1.2\" width=\"8\" height=\"8\" xres=\"2834.645669\" yres=\"2834.645669\"" \
+	" view-box=\"-4.0 4.0 4.0 -4.0\" antialias=\"1\" fps=\"24\" begin-time=\"0f\" end-time=\"0f\" bgcolor=\"0 0 0 0\">\n"
+
+/* === P R O C E D U R E S ================================================= */
+
+static bool write_file(const String &filename, const String &text)
+{
+	FILE *file = g_fopen(filename.c_str(), "wb");
+	if (!file) return false;
+	bool success = fwrite(text.c_str(), 1, text.size(), file) == text.size();
+	return fclose(file) == 0 && success;
+}
+
+static bool is_open(const String &filename)
+{
+	const std::map<String, etl::loose_handle<Canvas> > &map = get_open_canvas_map();
+	return map.count(etl::absolute_path(filename)) && map.find(etl::absolute_path(filename))->second;
+}
+
+//! Writes the external canvas filled by red and the main canvas with \a layers,
+//! which should refer to "external_<name>.sif#", then renders the main canvas at zero time.
+//! The external canvas should be opened by the rendering only when \a expect_loaded is set,
+//! its solid color should be in the result then.
+static int test_lazy_external_canvas(const String &dir, const String &name, const String &layers, bool expect_loaded)
+{
+	const String main_filename = dir + "/main_" + name + ".sif";
+	const String external_filename = dir + "/external_" + name + ".sif";
+
+	if ( !write_file(external_filename,
+			CANVAS_HEADER
+			"<layer type=\"SolidColor\" active=\"true\" version=\"0.1\">\n"
+			"<param name=\"color\"><color><r>1.000000</r><g>0.000000</g><b>0.000000</b><a>1.000000</a></color></param>\n"
+			"</layer>\n"
+			"</canvas>\n" )
+	  || !write_file(main_filename, CANVAS_HEADER + layers + "</canvas>\n") )
+	{
+		printf("unable to write the test files to %s\n", dir.c_str());
+		return 1;
+	}
+
+	Canvas::set_lazy_loading(true);
+	String errors, warnings;
+	Canvas::Handle canvas = open_canvas_as(
+		FileSystemNative::instance()->get_identifier(main_filename), main_filename, errors, warnings);
+	if (!canvas)
+	{
+		printf("%s: unable to open %s: %s\n", name.c_str(), main_filename.c_str(), errors.c_str());
+		return 1;
+	}
+
+	int failures = 0;
+	if (is_open(external_filename))
+	{
+		printf("%s: external canvas is opened before the rendering\n", name.c_str());
+		++failures;
+	}
+
+	canvas->set_time(0);
+	canvas->load_resources(0);
+	if (is_open(external_filename))
+	{
+		printf("%s: external canvas is opened by set_time() or load_resources()\n", name.c_str());
+		++failures;
+	}
+
+	const RendDesc &desc = canvas->rend_desc();
+	rendering::SurfaceResource::Handle surface = new rendering::SurfaceResource();
+	surface->create(desc.get_w(), desc.get_h());
+	rendering::Task::Handle task = canvas->build_rendering_task(ContextParams());
+	if (task)
+	{
+		task->target_surface = surface;
+		task->target_rect = RectInt(VectorInt(), surface->get_size());
+		Vector p0 = desc.get_tl(), p1 = desc.get_br();
+		task->source_rect = Rect(std::min(p0[0], p1[0]), std::min(p0[1], p1[1]), std::max(p0[0], p1[0]), std::max(p0[1], p1[1]));
+		rendering::Renderer::get_renderer("software")->run(rendering::Task::List(1, task));
+	}
+
+	if (expect_loaded)
+	{
+		rendering::SurfaceResource::LockRead<rendering::SurfaceSW> lock(surface);
+		const Color color = lock ? lock->get_surface()[desc.get_h()/2][desc.get_w()/2] : Color::alpha();
+		if (color.get_r() < 0.99 || color.get_a() < 0.99)
+		{
+			printf("%s: external canvas is not rendered, color is (%f, %f, %f, %f)\n",
+				name.c_str(), color.get_r(), color.get_g(), color.get_b(), color.get_a());
+			++failures;
+		}
+	}
+
+	if (is_open(external_filename) != expect_loaded)
+	{
+		printf(expect_loaded ? "%s: external canvas is not opened by the rendering\n"
+		                     : "%s: invisible external canvas is opened by the rendering\n", name.c_str());
+		++failures;
+	}
+
+	canvas.reset();
+	g_remove(main_filename.c_str());
+	g_remove(external_filename.c_str());
+	return failures;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	synfig::Main main(".");
+
+	gchar *dir = g_dir_make_tmp("synfig-lazyloading-XXXXXX", NULL);
+	if (!dir)
+	{
+		printf("unable to create the temporary directory\n");
+		return 1;
+	}
+
+	int failures = 0;
+
+	failures += test_lazy_external_canvas(dir, "visible",
+		"<layer type=\"group\" active=\"true\" version=\"0.3\">\n"
+		"<param name=\"canvas\" use=\"external_visible.sif#\"/>\n"
+		"</layer>\n",
+		true );
+
+	failures += test_lazy_external_canvas(dir, "inactive",
+		"<layer type=\"group\" active=\"false\" version=\"0.3\">\n"
+		"<param name=\"canvas\" use=\"external_inactive.sif#\"/>\n"
+		"</layer>\n",
+		false );
+
+	failures += test_lazy_external_canvas(dir, "zrange",
+		"<layer type=\"group\" active=\"true\" version=\"0.3\">\n"
+		"<param name=\"z_range\"><bool value=\"true\"/></param>\n"
+		"<param name=\"z_range_position\"><real value=\"0.0000000000\"/></param>\n"
+		"<param name=\"z_range_depth\"><real value=\"1.0000000000\"/></param>\n"
+		"<param name=\"canvas\"><canvas>\n"
+		"<layer type=\"group\" active=\"true\" version=\"0.3\">\n"
+		"<param name=\"z_depth\"><real value=\"5.0000000000\"/></param>\n"
+		"<param name=\"canvas\" use=\"external_zrange.sif#\"/>\n"
+		"</layer>\n"
+		"</canvas></param>\n"
+		"</layer>\n",
+		false );
+
+	// layer appears at 1s only, the frame at 0s is rendered
+	failures += test_lazy_external_canvas(dir, "time",
+		"<layer type=\"group\" active=\"true\" version=\"0.3\">\n"
+		"<param name=\"amount\"><animated type=\"real\">\n"
+		"<waypoint time=\"0s\" before=\"constant\" after=\"constant\"><real value=\"0.0000000000\"/></waypoint>\n"
+		"<waypoint time=\"1s\" before=\"constant\" after=\"constant\"><real value=\"1.0000000000\"/></waypoint>\n"
+		"</animated></param>\n"
+		"<param name=\"canvas\" use=\"external_time.sif#\"/>\n"
+		"</layer>\n",
+		false );
+
+	g_rmdir(dir);
+	g_free(dir);
+	return failures;
+}
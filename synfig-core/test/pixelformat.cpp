@@ -0,0 +1,195 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file pixelformat.cpp
+**	\brief Test and benchmark of the conversion of colors to the pixel formats
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include <synfig/color/pixelformat.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define BENCHMARK_PIXELS (1024*1024)
+
+/* === P R O C E D U R E S ================================================= */
+
+static std::vector<Color> random_colors(int count)
+{
+	std::vector<Color> colors(count);
+	srand(1);
+	for(int i = 0; i < count; ++i) {
+		ColorReal c[4];
+		for(int j = 0; j < 4; ++j)
+			c[j] = ColorReal(rand()%1100)/ColorReal(1000) - ColorReal(0.05);
+		colors[i] = Color(c[0], c[1], c[2], c[3]);
+	}
+	return colors;
+}
+
+//! NaN is clamped to zero
+static ColorReal clamp(ColorReal x)
+	{ return x > ColorReal(0.0) ? (x < ColorReal(1.0) ? x : ColorReal(1.0)) : ColorReal(0.0); }
+
+//! Tabulated gamma should differ from the direct calculation not more than by one step
+static int test_gamma_accuracy()
+{
+	const int count = 64*1024;
+	const ColorReal gammas[] = { 2.2, 1/2.2, 1.8, 0.5 };
+
+	std::vector<Color> colors(count);
+	for(int i = 0; i < count; ++i) {
+		const ColorReal x = ColorReal(i)/ColorReal(count - 1);
+		colors[i] = Color(x, x*x, std::sqrt(x), 1);
+	}
+
+	int failures = 0;
+	std::vector<unsigned char> pixels(count*3);
+	for(int g = 0; g < (int)(sizeof(gammas)/sizeof(gammas[0])); ++g) {
+		const Gamma gamma(gammas[g]);
+		color_to_pixelformat(&pixels.front(), &colors.front(), PF_RGB, &gamma, count);
+		for(int i = 0; i < count*3; ++i) {
+			const ColorReal c = i%3 == 0 ? colors[i/3].get_r()
+			                  : i%3 == 1 ? colors[i/3].get_g()
+			                  :            colors[i/3].get_b();
+			const int expected = (int)(gamma.apply(i%3, c)*ColorReal(255.99));
+			if (std::abs(expected - (int)pixels[i]) > 1) {
+				printf("gamma %f: value %f converted to %d instead of %d\n", gammas[g], c, pixels[i], expected);
+				++failures;
+				break;
+			}
+		}
+	}
+	return failures;
+}
+
+//! Dithered flat color should keep the mean value
+static int test_dither_mean()
+{
+	const int size = 64;
+	const Color color(0.3, 0.5, 0.7, 1);
+	const PixelDither dithers[] = { PIXEL_DITHER_ORDERED, PIXEL_DITHER_BLUE_NOISE };
+
+	int failures = 0;
+	std::vector<Color> colors(size*size, color);
+	std::vector<unsigned char> pixels(size*size*3);
+	for(int d = 0; d < 2; ++d) {
+		color_to_pixelformat(&pixels.front(), &colors.front(), PF_RGB, NULL, size, size, 0, 0, dithers[d]);
+		for(int c = 0; c < 3; ++c) {
+			double sum = 0;
+			for(int i = 0; i < size*size; ++i)
+				sum += pixels[i*3 + c];
+			const double expected = (c == 0 ? color.get_r() : c == 1 ? color.get_g() : color.get_b())*255.0;
+			if (std::fabs(sum/(size*size) - expected) > 0.05) {
+				printf("dither %d: mean of the channel %d is %f instead of %f\n", dithers[d], c, sum/(size*size), expected);
+				++failures;
+			}
+		}
+	}
+	return failures;
+}
+
+//! Premultiplied BGRA and ARGB should keep the channels of the generic conversion,
+//! NaN channels become zero
+static int test_premult()
+{
+	const int count = 4096;
+	const PixelFormat formats[] = { PF_BGR|PF_A_PREMULT, PF_RGB|PF_A_START|PF_A_PREMULT };
+	const int offsets[][4] = { { 2, 1, 0, 3 }, { 1, 2, 3, 0 } };
+	std::vector<Color> colors = random_colors(count);
+	const ColorReal nan = std::numeric_limits<ColorReal>::quiet_NaN();
+	colors[0].set_r(nan);
+	colors[1].set_a(nan);
+	colors[2] = Color(nan, nan, nan, nan);
+
+	int failures = 0;
+	std::vector<unsigned char> pixels(count*4);
+	for(int f = 0; f < 2; ++f) {
+		color_to_pixelformat(&pixels.front(), &colors.front(), formats[f], NULL, count);
+		for(int i = 0; i < count; ++i) {
+			const Color &c = colors[i];
+			const int a = (int)(clamp(c.get_a())*ColorReal(255.99));
+			const int expected[] = {
+				((int)(clamp(c.get_r())*ColorReal(65535.99))*(a + 1)) >> 16,
+				((int)(clamp(c.get_g())*ColorReal(65535.99))*(a + 1)) >> 16,
+				((int)(clamp(c.get_b())*ColorReal(65535.99))*(a + 1)) >> 16,
+				a };
+			for(int j = 0; j < 4; ++j) {
+				const int value = pixels[i*4 + offsets[f][j]];
+				if (std::abs(expected[j] - value) > 1) {
+					printf("format %d: channel %d of the pixel %d is %d instead of %d\n", formats[f], j, i, value, expected[j]);
+					++failures;
+				}
+			}
+		}
+	}
+	return failures;
+}
+
+static void benchmark(const char *name, PixelFormat pf, const Gamma *gamma, PixelDither dither)
+{
+	static const std::vector<Color> colors = random_colors(BENCHMARK_PIXELS);
+	std::vector<unsigned char> pixels(BENCHMARK_PIXELS*pixel_size(pf));
+
+	const int width = 1024;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	color_to_pixelformat(&pixels.front(), &colors.front(), pf, gamma, width, BENCHMARK_PIXELS/width, 0, 0, dither);
+	std::chrono::duration<double> duration = std::chrono::steady_clock::now() - begin;
+
+	printf("%-32s %8.1f Mpixels/s\n", name, BENCHMARK_PIXELS/duration.count()*1e-6);
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	int failures = 0;
+
+	failures += test_gamma_accuracy();
+	failures += test_dither_mean();
+	failures += test_premult();
+
+	const Gamma gamma(2.2);
+	benchmark("RGB",                         PF_RGB,                   NULL,   PIXEL_DITHER_NONE);
+	benchmark("RGBA",                        PF_RGB|PF_A,              NULL,   PIXEL_DITHER_NONE);
+	benchmark("BGRA",                        PF_BGR|PF_A,              NULL,   PIXEL_DITHER_NONE);
+	benchmark("ARGB",                        PF_RGB|PF_A_START,        NULL,   PIXEL_DITHER_NONE);
+	benchmark("RGBA premultiplied",          PF_RGB|PF_A_PREMULT,      NULL,   PIXEL_DITHER_NONE);
+	benchmark("BGRA premultiplied",          PF_BGR|PF_A_PREMULT,      NULL,   PIXEL_DITHER_NONE);
+	benchmark("ARGB premultiplied",          PF_RGB|PF_A_START|PF_A_PREMULT, NULL, PIXEL_DITHER_NONE);
+	benchmark("Gray",                        PF_GRAY,                  NULL,   PIXEL_DITHER_NONE);
+	benchmark("RGB gamma",                   PF_RGB,                   &gamma, PIXEL_DITHER_NONE);
+	benchmark("RGBA gamma",                  PF_RGB|PF_A,              &gamma, PIXEL_DITHER_NONE);
+	benchmark("BGRA premultiplied gamma",    PF_BGR|PF_A_PREMULT,      &gamma, PIXEL_DITHER_NONE);
+	benchmark("RGBA ordered dither",         PF_RGB|PF_A,              NULL,   PIXEL_DITHER_ORDERED);
+	benchmark("RGBA blue noise dither",      PF_RGB|PF_A,              NULL,   PIXEL_DITHER_BLUE_NOISE);
+	benchmark("RGBA gamma blue noise dither",PF_RGB|PF_A,              &gamma, PIXEL_DITHER_BLUE_NOISE);
+	benchmark("Raw color",                   PF_RAW_COLOR,             NULL,   PIXEL_DITHER_NONE);
+
+	return failures;
+}
@@ -0,0 +1,319 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file pngatlas.cpp
+**	\brief Test of the packing and of the compression of the PNG texture atlas target
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+
+#include <synfig/general.h>
+#include <synfig/main.h>
+#include <synfig/renddesc.h>
+#include <synfig/surface.h>
+#include <synfig/targetparam.h>
+
+#include <modules/mod_png/trgt_png_atlas.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define WIDTH 40
+#define HEIGHT 30
+#define FRAMES 8
+
+/* === C L A S S E S ======================================================= */
+
+struct SpriteInfo
+{
+	int x, y, w, h;                     //!< rect in the atlas
+	int trim_x, trim_y, trim_w, trim_h; //!< rect in the frame
+};
+
+/* === P R O C E D U R E S ================================================= */
+
+//! Frames are the opaque rects of the growing size, then the frame
+//! with two distant pixels and the fully transparent frame.
+//! Channels are 0 or 1, so RGBA8 values do not depend on the gamma.
+static void get_frame_bounds(int frame, int &x, int &y, int &w, int &h)
+{
+	if (frame < 6) {
+		x = 2 + 3*frame;
+		y = 1 + 2*frame;
+		w = 6 + 3*frame;
+		h = 4 + 3*frame;
+	} else
+	if (frame == 6) {
+		x = 3; y = 2; w = 34; h = 24;
+	} else {
+		x = 0; y = 0; w = 1; h = 1;
+	}
+}
+
+static void get_pixel(int frame, int x, int y, unsigned char *rgba)
+{
+	memset(rgba, 0, 4);
+	bool opaque;
+	if (frame < 6) {
+		int fx, fy, fw, fh;
+		get_frame_bounds(frame, fx, fy, fw, fh);
+		opaque = x >= fx && y >= fy && x < fx + fw && y < fy + fh;
+	} else {
+		opaque = frame == 6 && ((x == 3 && y == 25) || (x == 36 && y == 2));
+	}
+	if (!opaque)
+		return;
+	const int bits = (x*3 + y*5 + frame) % 7 + 1;
+	rgba[0] = bits & 1 ? 255 : 0;
+	rgba[1] = bits & 2 ? 255 : 0;
+	rgba[2] = bits & 4 ? 255 : 0;
+	rgba[3] = 255;
+}
+
+static bool read_file(const String &filename, std::vector<unsigned char> &data)
+{
+	FILE *file = g_fopen(filename.c_str(), "rb");
+	if (!file) return false;
+	for(int c = fgetc(file); c != EOF; c = fgetc(file))
+		data.push_back((unsigned char)c);
+	fclose(file);
+	return true;
+}
+
+static unsigned int get_uint32(const unsigned char *src)
+	{ return ((unsigned int)src[0] << 24) | ((unsigned int)src[1] << 16) | ((unsigned int)src[2] << 8) | src[3]; }
+
+//! Reads the rects of the frames from the JSON metadata in the order of the frames
+static bool read_metadata(const String &json, std::vector<SpriteInfo> &sprites, int &width, int &height)
+{
+	for(const char *pos = strstr(json.c_str(), "\"frame\":"); pos; pos = strstr(pos + 1, "\"frame\":")) {
+		SpriteInfo s;
+		const char *source = strstr(pos, "\"spriteSourceSize\":");
+		if ( !source
+		  || sscanf(pos, "\"frame\": {\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d}", &s.x, &s.y, &s.w, &s.h) != 4
+		  || sscanf(source, "\"spriteSourceSize\": {\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d}", &s.trim_x, &s.trim_y, &s.trim_w, &s.trim_h) != 4 )
+			return false;
+		sprites.push_back(s);
+	}
+	const char *size = strstr(json.c_str(), "\"size\":");
+	return size && sscanf(size, "\"size\": {\"w\":%d,\"h\":%d}", &width, &height) == 2;
+}
+
+//! Joins the IDAT chunks of the PNG file, inflates them and removes the filters of the rows
+static bool read_png(const std::vector<unsigned char> &data, int &width, int &height, std::vector<unsigned char> &pixels)
+{
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	if (data.size() < 8 || memcmp(&data.front(), signature, 8))
+		return false;
+
+	std::vector<unsigned char> stream;
+	width = height = 0;
+	for(size_t pos = 8; pos + 12 <= data.size(); ) {
+		const size_t size = get_uint32(&data[pos]);
+		const String type((const char*)&data[pos + 4], 4);
+		if (pos + 12 + size > data.size())
+			return false;
+		const unsigned char *chunk = &data[pos + 8];
+		if (crc32(crc32(0, &data[pos + 4], 4), chunk, (uInt)size) != get_uint32(chunk + size))
+			return false;
+		if (type == "IHDR") {
+			width = (int)get_uint32(chunk);
+			height = (int)get_uint32(chunk + 4);
+			if (chunk[8] != 8 || chunk[9] != 6)
+				return false;
+		} else
+		if (type == "IDAT") {
+			stream.insert(stream.end(), chunk, chunk + size);
+		}
+		pos += 12 + size;
+	}
+	if (width <= 0 || height <= 0 || stream.empty())
+		return false;
+
+	// uncompress() checks the adler32 of the stream too
+	const size_t stride = (size_t)width*4;
+	std::vector<unsigned char> raw((stride + 1)*height);
+	uLongf raw_size = (uLongf)raw.size();
+	if (uncompress(&raw.front(), &raw_size, &stream.front(), (uLong)stream.size()) != Z_OK || raw_size != raw.size())
+		return false;
+
+	pixels.assign(stride*height, 0);
+	for(int y = 0; y < height; ++y) {
+		const unsigned char filter = raw[y*(stride + 1)];
+		const unsigned char *src = &raw[y*(stride + 1) + 1];
+		unsigned char *row = &pixels[y*stride];
+		const unsigned char *prev = y ? &pixels[(y - 1)*stride] : NULL;
+		for(size_t x = 0; x < stride; ++x) {
+			const int a = x >= 4 ? row[x - 4] : 0;
+			const int b = prev ? prev[x] : 0;
+			const int c = prev && x >= 4 ? prev[x - 4] : 0;
+			int predictor;
+			switch(filter) {
+			case 0: predictor = 0; break;
+			case 1: predictor = a; break;
+			case 2: predictor = b; break;
+			case 3: predictor = (a + b)/2; break;
+			case 4: {
+				const int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+				predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+				break;
+			}
+			default: return false;
+			}
+			row[x] = (unsigned char)(src[x] + predictor);
+		}
+	}
+	return true;
+}
+
+//! Renders the frames to the atlas, then checks the placement of the sprites
+//! and the pixels of the inflated image
+static int test_atlas(const String &dir)
+{
+	const String filename = dir + "/atlas.png";
+	const String metadata_filename = dir + "/atlas.json";
+
+	{
+		RendDesc desc;
+		desc.set_wh(WIDTH, HEIGHT);
+		desc.set_frame_rate(24);
+		desc.set_frame_start(0);
+		desc.set_frame_end(FRAMES - 1);
+
+		etl::handle<png_trgt_atlas> target(new png_trgt_atlas(filename.c_str(), TargetParam()));
+		target->set_rend_desc(&desc);
+		for(int frame = 0; frame < FRAMES; ++frame) {
+			Surface surface(WIDTH, HEIGHT);
+			for(int y = 0; y < HEIGHT; ++y)
+				for(int x = 0; x < WIDTH; ++x) {
+					unsigned char rgba[4];
+					get_pixel(frame, x, y, rgba);
+					surface[y][x] = Color(rgba[0]/255.f, rgba[1]/255.f, rgba[2]/255.f, rgba[3]/255.f);
+				}
+			if (!target->start_frame(NULL) || !target->put_rows(surface, 0)) {
+				printf("unable to render the frame %d to the atlas\n", frame);
+				return 1;
+			}
+			target->end_frame();
+		}
+	}
+
+	std::vector<unsigned char> png, json;
+	const bool read = read_file(filename, png) && read_file(metadata_filename, json);
+	g_remove(filename.c_str());
+	g_remove(metadata_filename.c_str());
+	if (!read) {
+		printf("atlas is not written to %s\n", dir.c_str());
+		return 1;
+	}
+
+	std::vector<SpriteInfo> sprites;
+	int width = 0, height = 0;
+	if (!read_metadata(String(json.begin(), json.end()), sprites, width, height) || (int)sprites.size() != FRAMES) {
+		printf("unable to read the metadata of %d frames\n", FRAMES);
+		return 1;
+	}
+
+	int failures = 0;
+
+	// trim bounds
+	for(int i = 0; i < FRAMES; ++i) {
+		const SpriteInfo &s = sprites[i];
+		int x, y, w, h;
+		get_frame_bounds(i, x, y, w, h);
+		if (s.trim_x != x || s.trim_y != y || s.trim_w != w || s.trim_h != h || s.w != w || s.h != h) {
+			printf("frame %d is trimmed to (%d, %d, %d, %d) instead of (%d, %d, %d, %d)\n",
+				i, s.trim_x, s.trim_y, s.trim_w, s.trim_h, x, y, w, h);
+			++failures;
+		}
+	}
+
+	// placement of the sprites, with the padding
+	for(int i = 0; i < FRAMES; ++i) {
+		const SpriteInfo &a = sprites[i];
+		if (a.x < 0 || a.y < 0 || a.x + a.w > width || a.y + a.h > height) {
+			printf("frame %d is placed out of the atlas\n", i);
+			++failures;
+		}
+		for(int j = i + 1; j < FRAMES; ++j) {
+			const SpriteInfo &b = sprites[j];
+			if ( a.x < b.x + b.w + 1 && b.x < a.x + a.w + 1
+			  && a.y < b.y + b.h + 1 && b.y < a.y + a.h + 1 ) {
+				printf("frames %d and %d overlap in the atlas\n", i, j);
+				++failures;
+			}
+		}
+	}
+
+	// pixels
+	int png_width = 0, png_height = 0;
+	std::vector<unsigned char> pixels;
+	if (!read_png(png, png_width, png_height, pixels)) {
+		printf("unable to inflate the image of the atlas\n");
+		return failures + 1;
+	}
+	if (png_width != width || png_height != height) {
+		printf("atlas image is %dx%d instead of %dx%d\n", png_width, png_height, width, height);
+		return failures + 1;
+	}
+
+	std::vector<unsigned char> expected((size_t)width*height*4, 0);
+	for(int i = 0; i < FRAMES; ++i) {
+		const SpriteInfo &s = sprites[i];
+		for(int y = 0; y < s.h; ++y)
+			for(int x = 0; x < s.w; ++x)
+				get_pixel(i, s.trim_x + x, s.trim_y + y, &expected[((size_t)(s.y + y)*width + s.x + x)*4]);
+	}
+	int differs = 0;
+	for(size_t i = 0; i < expected.size(); i += 4)
+		if (memcmp(&expected[i], &pixels[i], 4)) ++differs;
+	if (differs) {
+		printf("%d of %d pixels of the atlas differ from the frames\n", differs, width*height);
+		++failures;
+	}
+	return failures;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	synfig::Main main(".");
+
+	gchar *dir = g_dir_make_tmp("synfig-pngatlas-XXXXXX", NULL);
+	if (!dir) {
+		printf("unable to create the temporary directory\n");
+		return 1;
+	}
+
+	int failures = test_atlas(dir);
+
+	g_rmdir(dir);
+	g_free(dir);
+	return failures;
+}
@@ -0,0 +1,255 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file taskgraph.cpp
+**	\brief Test of the optimization of the tasks shared between several parents
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <synfig/general.h>
+#include <synfig/main.h>
+#include <synfig/canvas.h>
+#include <synfig/context.h>
+#include <synfig/rendering/optimizer.h>
+#include <synfig/rendering/renderer.h>
+#include <synfig/rendering/surface.h>
+#include <synfig/rendering/task.h>
+#include <synfig/rendering/common/task/taskblend.h>
+#include <synfig/rendering/common/task/taskblur.h>
+#include <synfig/rendering/common/task/taskcontour.h>
+#include <synfig/rendering/software/surfacesw.h>
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+using namespace rendering;
+
+/* === M A C R O S ========================================================= */
+
+#define SIZE 64
+
+/* === C L A S S E S ======================================================= */
+
+class RendererTest: public Renderer
+{
+public:
+	virtual String get_name() const { return "test"; }
+};
+
+//! Counts the visits of each task
+class OptimizerCounter: public Optimizer
+{
+public:
+	mutable std::mutex mutex;
+	mutable std::map<const Task*, int> visits;
+
+	explicit OptimizerCounter(bool reads_parent = false)
+	{
+		category_id = CATEGORY_ID_BEGIN;
+		for_task = true;
+		this->reads_parent = reads_parent;
+	}
+
+	virtual void run(const RunParams &params) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++visits[params.ref_task.get()];
+	}
+};
+
+/* === P R O C E D U R E S ================================================= */
+
+//! Optimizes the chain of diamonds:
+//! each level is a list of two lists which refer to the same task of the previous level.
+//! As a tree it has 2^levels leafs, but each of its 3*levels + 1 tasks should be visited once.
+//! When the optimizer reads the parent, the shared tasks are visited once for each of the parents.
+static int test_diamonds(bool reads_parent)
+{
+	const int levels = 20;
+
+	Task::Handle task = new TaskList();
+	std::vector<Task::Handle> tasks(1, task);
+	for(int i = 0; i < levels; ++i) {
+		Task::Handle a = new TaskList();
+		Task::Handle b = new TaskList();
+		a->sub_tasks.push_back(task);
+		b->sub_tasks.push_back(task);
+		task = new TaskList();
+		task->sub_tasks.push_back(a);
+		task->sub_tasks.push_back(b);
+		tasks.push_back(a);
+		tasks.push_back(b);
+		tasks.push_back(task);
+	}
+
+	etl::handle<OptimizerCounter> counter = new OptimizerCounter(reads_parent);
+	Renderer::Handle renderer = new RendererTest();
+	renderer->register_optimizer(counter);
+
+	Task::List list(1, task);
+	renderer->optimize(list);
+
+	int failures = 0;
+	for(std::vector<Task::Handle>::const_iterator i = tasks.begin(); i != tasks.end(); ++i) {
+		// tasks with the index multiple of 3 are shared, except the root
+		int index = (int)(i - tasks.begin());
+		int expected = reads_parent && index % 3 == 0 && index + 1 < (int)tasks.size() ? 2 : 1;
+		int visits = counter->visits.count(i->get()) ? counter->visits[i->get()] : 0;
+		if (visits != expected) {
+			printf("task %d of the diamonds chain is optimized %d times instead of %d%s\n",
+				index, visits, expected, reads_parent ? " by parent" : "");
+			++failures;
+		}
+	}
+	if ((int)counter->visits.size() != (int)tasks.size()) {
+		printf("optimizer visited %d tasks instead of %d\n", (int)counter->visits.size(), (int)tasks.size());
+		++failures;
+	}
+	return failures;
+}
+
+//! Builds the blend of the context and its blurred copy like the Blur layer does,
+//! the context task is shared by both branches or cloned for the blur
+static Task::Handle build_blur_fork(bool shared, const SurfaceResource::Handle &surface)
+{
+	Canvas::Handle canvas = Canvas::create();
+	canvas->rend_desc().set_wh(SIZE, SIZE);
+
+	std::vector<Point> points;
+	points.push_back(Point(-1.0, -1.0));
+	points.push_back(Point( 1.5, -0.5));
+	points.push_back(Point( 0.0,  1.5));
+	Layer::Handle triangle = Layer::create("polygon");
+	triangle->set_canvas(canvas);
+	triangle->set_param("vector_list", ValueBase(points));
+	triangle->set_param("color", Color::green());
+	canvas->push_back(triangle);
+
+	Task::Handle context = canvas->build_rendering_task(ContextParams());
+
+	TaskBlur::Handle blur(new TaskBlur());
+	blur->blur.size = Vector(0.25, 0.25);
+	blur->blur.type = rendering::Blur::GAUSSIAN;
+	blur->sub_task() = shared ? context : context->clone_recursive();
+
+	TaskBlend::Handle blend(new TaskBlend());
+	blend->blend_method = Color::BLEND_COMPOSITE;
+	blend->sub_task_a() = context;
+	blend->sub_task_b() = blur;
+	blend->target_surface = surface;
+	blend->target_rect = RectInt(0, 0, SIZE, SIZE);
+	blend->source_rect = Rect(-2.0, -2.0, 2.0, 2.0);
+	return blend;
+}
+
+//! Returns count of the contour tasks in the optimized list
+//! and count of the tasks which read the surface of the first contour
+static void count_contours(const Task::List &list, int &contours, int &readers)
+{
+	contours = 0;
+	readers = 0;
+	SurfaceResource::Handle surface;
+	for(Task::List::const_iterator i = list.begin(); i != list.end(); ++i)
+		if (TaskContour::Handle::cast_dynamic(*i)) {
+			if (!contours++) surface = (*i)->target_surface;
+		}
+	if (!surface) return;
+	for(Task::List::const_iterator i = list.begin(); i != list.end(); ++i)
+		if (*i)
+			for(Task::List::const_iterator j = (*i)->sub_tasks.begin(); j != (*i)->sub_tasks.end(); ++j)
+				if (*j && (*j)->target_surface == surface) { ++readers; break; }
+}
+
+//! Context shared by both branches of the fork should get the same coordinates
+//! from both parents and should be inserted into the linear list once,
+//! so it is rendered once and the result matches the graph without sharing
+static int test_shared_fork()
+{
+	int failures = 0;
+	const Renderer::Handle &renderer = Renderer::get_renderer("software");
+
+	// the optimization
+	for(int shared = 0; shared < 2; ++shared) {
+		SurfaceResource::Handle surface = new SurfaceResource();
+		surface->create(SIZE, SIZE);
+		Task::List list(1, build_blur_fork(shared, surface));
+		renderer->optimize(list);
+
+		int contours, readers;
+		count_contours(list, contours, readers);
+		int expected = shared ? 1 : 2;
+		if (contours != expected) {
+			printf("%s context is rendered %d times instead of %d\n", shared ? "shared" : "cloned", contours, expected);
+			++failures;
+		}
+		if (shared && readers < 2) {
+			printf("surface of the shared context is read by %d tasks instead of 2\n", readers);
+			++failures;
+		}
+	}
+
+	// the result
+	SurfaceResource::Handle surfaces[2];
+	for(int shared = 0; shared < 2; ++shared) {
+		surfaces[shared] = new SurfaceResource();
+		surfaces[shared]->create(SIZE, SIZE);
+		renderer->run(Task::List(1, build_blur_fork(shared, surfaces[shared])));
+	}
+
+	SurfaceResource::LockRead<SurfaceSW> cloned(surfaces[0]);
+	SurfaceResource::LockRead<SurfaceSW> shared(surfaces[1]);
+	if (!cloned || !shared) {
+		printf("blur fork is not rendered\n");
+		return failures + 1;
+	}
+
+	int differs = 0;
+	for(int y = 0; y < SIZE; ++y)
+		for(int x = 0; x < SIZE; ++x) {
+			const Color a = cloned->get_surface()[y][x];
+			const Color b = shared->get_surface()[y][x];
+			if ( std::fabs(a.get_r() - b.get_r()) > 1e-4
+			  || std::fabs(a.get_g() - b.get_g()) > 1e-4
+			  || std::fabs(a.get_b() - b.get_b()) > 1e-4
+			  || std::fabs(a.get_a() - b.get_a()) > 1e-4 )
+				++differs;
+		}
+	if (differs) {
+		printf("%d of %d pixels of the shared blur fork differ from the cloned one\n", differs, SIZE*SIZE);
+		++failures;
+	}
+	return failures;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main()
+{
+	synfig::Main main(".");
+
+	int failures = 0;
+	failures += test_diamonds(false);
+	failures += test_diamonds(true);
+	failures += test_shared_fork();
+	return failures;
+}
@@ -79,8 +79,6 @@ public:
 		}
 	};
 	std::list<tile_t> tile_queue;
-	std::list<Glib::Thread*> threads;
-	bool err;
 	Glib::Mutex mutex;
 
 #ifndef GLIB_DISPATCHER_BROKEN
@@ -93,7 +91,7 @@ public:
 
 public:
 	AsyncTarget_Tile(etl::handle<synfig::Target_Tile> warm_target):
-		warm_target(warm_target), err(false)
+		warm_target(warm_target)
 	{
 		set_avoid_time_sync(warm_target->get_avoid_time_sync());
 		set_tile_w(warm_target->get_tile_w());
@@ -121,69 +119,37 @@ public:
 		alive_flag=false;
 	}
 
-	virtual bool async_render_tile(
-		etl::handle<Canvas> canvas,
-		ContextParams context_params,
-		RectInt rect,
-		RendDesc tile_desc,
-		ProgressCallback */*cb*/ )
+	virtual void begin_render_tiles()
 	{
-		if(!alive_flag)
-			return false;
-
-		Glib::Thread *thread = Glib::Thread::create(
-			sigc::hide_return(
-				sigc::bind(
-					sigc::mem_fun(*this, &AsyncTarget_Tile::sync_render_tile),
-					canvas, context_params, rect, tile_desc, (synfig::ProgressCallback*)NULL )),
-				true
-			);
-		assert(thread);
-
-		{
-			Glib::Mutex::Lock lock(mutex);
-			threads.push_back(thread);
-		}
-
-		return true;
+		if(alive_flag)
+			warm_target->begin_render_tiles();
 	}
 
-	bool sync_render_tile(
+	// warm target enqueues the tiles to the renderer and doesn't block
+	virtual bool async_render_tile(
 		etl::handle<Canvas> canvas,
 		ContextParams context_params,
 		RectInt rect,
 		RendDesc tile_desc,
-		ProgressCallback *cb )
+		ProgressCallback */*cb*/ )
 	{
 		if(!alive_flag)
 			return false;
-		bool r = warm_target->async_render_tile(canvas, context_params, rect, tile_desc, cb);
-		if (!r) { Glib::Mutex::Lock lock(mutex); err = true; }
-		return r;
+		return warm_target->async_render_tile(canvas, context_params, rect, tile_desc, NULL);
 	}
 
 	virtual bool wait_render_tiles(ProgressCallback *cb=NULL)
 	{
 		if(!alive_flag)
 			return false;
-
-		while(true)
-		{
-			Glib::Thread *thread;
-			{
-				Glib::Mutex::Lock lock(mutex);
-				if (threads.empty()) break;
-				thread = threads.front();
-				threads.pop_front();
-
-			}
-			thread->join();
-		}
-
-		{ Glib::Mutex::Lock lock(mutex); if (err) return false; }
 		return warm_target->wait_render_tiles(cb);
 	}
 
+	virtual void cancel_render_tiles()
+	{
+		warm_target->cancel_render_tiles();
+	}
+
 	virtual int next_tile(RectInt& rect)
 	{
 		if(!alive_flag)
@@ -203,7 +169,6 @@ public:
 	{
 		if(!alive_flag)
 			return false;
-		{ Glib::Mutex::Lock lock(mutex); err = false; }
 		return warm_target->start_frame(cb);
 	}
 